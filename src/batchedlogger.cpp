@@ -21,6 +21,11 @@ void CBatchedLogger::Flush()
     if (!accept || msg.empty()) {
         return;
     }
-    LogPrintStr(strprintf("%s:\n%s", header, msg));
+    std::string str;
+    str.reserve(header.size() + msg.size() + 2);
+    str += header;
+    str += ":\n";
+    str += msg;
+    LogPrintStr(str);
     msg.clear();
 }
@@ -7,6 +7,7 @@
 #define COSANTA_BATCHEDLOGGER_H
 
 #include "tinyformat.h"
+#include "util.h"
 
 class CBatchedLogger
 {
@@ -16,15 +17,28 @@ private:
     std::string msg;
 public:
     CBatchedLogger(uint64_t _category, const std::string& _header);
+    // Only formats the header when the category is enabled
+    template<typename... Args>
+    CBatchedLogger(uint64_t _category, const char* fmt, const Args&... args) :
+        accept(LogAcceptCategory(_category))
+    {
+        if (accept) {
+            header = strprintf(fmt, args...);
+        }
+    }
     virtual ~CBatchedLogger();
 
+    bool IsAccepting() const { return accept; }
+
     template<typename... Args>
-    void Batch(const std::string& fmt, const Args&... args)
+    void Batch(const char* fmt, const Args&... args)
     {
         if (!accept) {
             return;
         }
-        msg += "    " + strprintf(fmt, args...) + "\n";
+        msg += "    ";
+        msg += strprintf(fmt, args...);
+        msg += '\n';
     }
 
     void Flush();
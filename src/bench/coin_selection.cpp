@@ -58,3 +58,55 @@ static void CoinSelection(benchmark::State& state)
 }
 
 BENCHMARK(CoinSelection);
+
+// Coin selection in a large wallet, the target can be met exactly by the
+// branch and bound search without creating change.
+static void CoinSelection100k(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < 100000; i++)
+        addCoin((i % 1000 + 1) * CENT, wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(2500 * CENT + 7 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet >= 2507 * CENT);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
+BENCHMARK(CoinSelection100k);
+
+// Coin selection in a large wallet where no input set matches the target
+// exactly, the branch and bound search has to accept an excess within the
+// tolerance and keep it over the larger coin.
+static void CoinSelection100kTolerance(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    for (int i = 0; i < 100000; i++)
+        addCoin((i % 1000 + 1) * CENT, wallet, vCoins);
+    addCoin(100000 * COIN, wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<CInputCoin> setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(2507 * CENT - 1000, 1, 6, 0, vCoins, setCoinsRet, nValueRet, CoinType::ALL_COINS, 1000);
+        assert(success);
+        assert(nValueRet == 2507 * CENT);
+    }
+
+    for (COutput output : vCoins)
+        delete output.tx;
+}
+
+BENCHMARK(CoinSelection100kTolerance);
@@ -0,0 +1,172 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "hash.h"
+#include "pos_kernel.h"
+#include "primitives/transaction.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include "llmq/quorums_signing.h"
+#include "llmq/quorums_signing_shares.h"
+
+/*
+ * Every hot loop below is benchmarked three times:
+ *  - <Name>NoLog: the loop without the LogPrint call, the baseline
+ *  - <Name>LogDisabled: the loop with the LogPrint call and its category disabled
+ *  - <Name>LogDisabledInline: the same, but with the LogPrint expansion used
+ *    before the formatting code was moved out of line (LogPrintInline below)
+ *
+ * LogDisabled should match NoLog, the difference to LogDisabledInline is what
+ * a disabled call site used to cost.
+ */
+
+// The LogPrint expansion from before LogPrintFormatted(), formatting inlined at the call site
+#define LogPrintInline(category, ...) do { \
+    if (LogAcceptCategory((category))) { \
+        std::string _log_msg_; \
+        try { \
+            _log_msg_ = tfm::format(__VA_ARGS__); \
+        } catch (tinyformat::format_error &e) { \
+            _log_msg_ = "Error \"" + std::string(e.what()) + "\" while formatting log message: " + FormatStringFromLogArgs(__VA_ARGS__); \
+        } \
+        LogPrintStr(_log_msg_); \
+    } \
+} while(0)
+
+enum class LogMode {
+    NONE,
+    OUT_OF_LINE,
+    INLINE,
+};
+
+// Mimics the CheckStakeKernelHash() search loop
+static void StakeKernelLoopImpl(benchmark::State& state, LogMode mode)
+{
+    uint64_t prevCategories = logCategories.exchange(BCLog::NONE);
+
+    CDataStream ss(SER_GETHASH, 0);
+    ss << (uint32_t)0x12345678;
+    COutPoint prevout(uint256S("0x1"), 1);
+    unsigned int nTime = 1600000000;
+
+    while (state.KeepRunning()) {
+        uint256 hashProofOfStake = stakeHash(nTime, ss, prevout.n, prevout.hash, nTime - 3600);
+        if (mode == LogMode::OUT_OF_LINE) {
+            LogPrint(BCLog::STAKING, "%s: try_time=%d time=%s hash=%s\n", __func__,
+                     nTime, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTime), hashProofOfStake.ToString());
+        } else if (mode == LogMode::INLINE) {
+            LogPrintInline(BCLog::STAKING, "%s: try_time=%d time=%s hash=%s\n", __func__,
+                           nTime, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTime), hashProofOfStake.ToString());
+        }
+        nTime++;
+    }
+
+    logCategories = prevCategories;
+}
+
+// Mimics the per session loops in CSigSharesManager::SendMessages()
+static void SigSharesInvLoopImpl(benchmark::State& state, LogMode mode)
+{
+    uint64_t prevCategories = logCategories.exchange(BCLog::NONE);
+
+    std::vector<std::pair<uint256, llmq::CSigSharesInv>> sessions(64);
+    for (size_t i = 0; i < sessions.size(); i++) {
+        sessions[i].first = Hash(BEGIN(i), END(i));
+        sessions[i].second.sessionId = (uint32_t)i;
+        sessions[i].second.Init(50);
+        sessions[i].second.Set((uint16_t)(i % 50), true);
+    }
+    NodeId nodeId = 1;
+
+    while (state.KeepRunning()) {
+        size_t nCount = 0;
+        for (auto& p : sessions) {
+            nCount += p.second.CountSet();
+            if (mode == LogMode::OUT_OF_LINE) {
+                LogPrint(BCLog::LLMQ_SIGS, "CSigSharesManager::SendMessages -- QSIGSHARESINV signHash=%s, inv={%s}, node=%d\n",
+                         p.first.ToString(), p.second.ToString(), nodeId);
+            } else if (mode == LogMode::INLINE) {
+                LogPrintInline(BCLog::LLMQ_SIGS, "CSigSharesManager::SendMessages -- QSIGSHARESINV signHash=%s, inv={%s}, node=%d\n",
+                               p.first.ToString(), p.second.ToString(), nodeId);
+            }
+        }
+        assert(nCount == sessions.size());
+    }
+
+    logCategories = prevCategories;
+}
+
+// Mimics the per input loop in CInstantSendManager::ProcessTx()
+static void InstantSendVoteLoopImpl(benchmark::State& state, LogMode mode)
+{
+    uint64_t prevCategories = logCategories.exchange(BCLog::NONE);
+
+    CMutableTransaction mtx;
+    mtx.vin.resize(16);
+    for (size_t i = 0; i < mtx.vin.size(); i++) {
+        mtx.vin[i].prevout = COutPoint(Hash(BEGIN(i), END(i)), (uint32_t)i);
+    }
+    mtx.vout.resize(1);
+    CTransaction tx(mtx);
+    bool allowReSigning = false;
+
+    while (state.KeepRunning()) {
+        for (auto& in : tx.vin) {
+            uint256 id = ::SerializeHash(std::make_pair(std::string("inlock"), in.prevout));
+            if (mode == LogMode::OUT_OF_LINE) {
+                LogPrint(BCLog::INSTANTSEND, "CInstantSendManager::%s -- txid=%s: trying to vote on input %s with id %s. allowReSigning=%d\n", __func__,
+                         tx.GetHash().ToString(), in.prevout.ToStringShort(), id.ToString(), allowReSigning);
+            } else if (mode == LogMode::INLINE) {
+                LogPrintInline(BCLog::INSTANTSEND, "CInstantSendManager::%s -- txid=%s: trying to vote on input %s with id %s. allowReSigning=%d\n", __func__,
+                               tx.GetHash().ToString(), in.prevout.ToStringShort(), id.ToString(), allowReSigning);
+            }
+        }
+    }
+
+    logCategories = prevCategories;
+}
+
+static void StakeKernelLoopNoLog(benchmark::State& state) { StakeKernelLoopImpl(state, LogMode::NONE); }
+static void StakeKernelLoopLogDisabled(benchmark::State& state) { StakeKernelLoopImpl(state, LogMode::OUT_OF_LINE); }
+static void StakeKernelLoopLogDisabledInline(benchmark::State& state) { StakeKernelLoopImpl(state, LogMode::INLINE); }
+
+static void SigSharesInvLoopNoLog(benchmark::State& state) { SigSharesInvLoopImpl(state, LogMode::NONE); }
+static void SigSharesInvLoopLogDisabled(benchmark::State& state) { SigSharesInvLoopImpl(state, LogMode::OUT_OF_LINE); }
+static void SigSharesInvLoopLogDisabledInline(benchmark::State& state) { SigSharesInvLoopImpl(state, LogMode::INLINE); }
+
+static void InstantSendVoteLoopNoLog(benchmark::State& state) { InstantSendVoteLoopImpl(state, LogMode::NONE); }
+static void InstantSendVoteLoopLogDisabled(benchmark::State& state) { InstantSendVoteLoopImpl(state, LogMode::OUT_OF_LINE); }
+static void InstantSendVoteLoopLogDisabledInline(benchmark::State& state) { InstantSendVoteLoopImpl(state, LogMode::INLINE); }
+
+// Only formats the message, fPrintToDebugLog is off in bench_cosanta
+static void LogPrintEnabled(benchmark::State& state)
+{
+    uint64_t prevCategories = logCategories.exchange(BCLog::STAKING);
+    bool prevPrintToConsole = fPrintToConsole;
+    fPrintToConsole = false;
+
+    uint256 hash = uint256S("0x1");
+    unsigned int nTime = 1600000000;
+    while (state.KeepRunning()) {
+        LogPrint(BCLog::STAKING, "%s: try_time=%d time=%s hash=%s\n", __func__,
+                 nTime, DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTime), hash.ToString());
+        nTime++;
+    }
+
+    fPrintToConsole = prevPrintToConsole;
+    logCategories = prevCategories;
+}
+
+BENCHMARK(StakeKernelLoopNoLog);
+BENCHMARK(StakeKernelLoopLogDisabled);
+BENCHMARK(StakeKernelLoopLogDisabledInline);
+BENCHMARK(SigSharesInvLoopNoLog);
+BENCHMARK(SigSharesInvLoopLogDisabled);
+BENCHMARK(SigSharesInvLoopLogDisabledInline);
+BENCHMARK(InstantSendVoteLoopNoLog);
+BENCHMARK(InstantSendVoteLoopLogDisabled);
+BENCHMARK(InstantSendVoteLoopLogDisabledInline);
+BENCHMARK(LogPrintEnabled);
@@ -0,0 +1,95 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "memusage.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "primitives/block.h"
+#include "streams.h"
+
+#include "bench/data/block813851.raw.h"
+
+#include <memory>
+#include <set>
+#include <vector>
+
+// Number of peers a fresh block is relayed to
+static const int FANOUT_PEERS = 64;
+
+// Memory held by the payloads in the send queues, every shared payload is only counted once
+static size_t QueuedPayloadUsage(const std::vector<std::unique_ptr<CNode>>& nodes)
+{
+    std::set<const CNetMsgPayload*> setPayloads;
+    size_t nUsage = 0;
+    for (const auto& node : nodes) {
+        LOCK(node->cs_vSend);
+        for (const auto& msg : node->vSendMsg) {
+            if (setPayloads.insert(msg.payload.get()).second) {
+                nUsage += memusage::DynamicUsage(msg.payload->data);
+            }
+        }
+    }
+    return nUsage;
+}
+
+// Queues the same block for FANOUT_PEERS peers, either serializing it for every peer
+// or once into a payload shared by all send queues
+static void BlockFanout(benchmark::State& state, bool fShared)
+{
+    SelectParams(CBaseChainParams::MAIN);
+
+    CDataStream stream((const char*)raw_bench::block813851,
+            (const char*)&raw_bench::block813851[sizeof(raw_bench::block813851)],
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    const size_t nBlockSize = sizeof(raw_bench::block813851);
+
+    CConnman connman(0x1337, 0x1337);
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (int i = 0; i < FANOUT_PEERS; i++) {
+        nodes.emplace_back(new CNode(i, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(), 0, 0, CAddress(), "", true));
+    }
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    while (state.KeepRunning()) {
+        CSharedNetPayload payload;
+        if (fShared) {
+            payload = msgMaker.MakePayload(block);
+        }
+        for (const auto& node : nodes) {
+            if (fShared) {
+                connman.PushMessage(node.get(), msgMaker.MakeShared(NetMsgType::BLOCK, payload), false);
+            } else {
+                connman.PushMessage(node.get(), msgMaker.Make(NetMsgType::BLOCK, block), false);
+            }
+        }
+
+        // One copy of the block for all peers instead of one per peer
+        size_t nUsage = QueuedPayloadUsage(nodes);
+        assert(fShared ? nUsage < 2 * nBlockSize : nUsage >= FANOUT_PEERS * nBlockSize);
+
+        for (const auto& node : nodes) {
+            LOCK(node->cs_vSend);
+            node->vSendMsg.clear();
+            node->nSendSize = 0;
+        }
+    }
+}
+
+static void BlockFanoutCopies(benchmark::State& state)
+{
+    BlockFanout(state, false);
+}
+
+static void BlockFanoutShared(benchmark::State& state)
+{
+    BlockFanout(state, true);
+}
+
+BENCHMARK(BlockFanoutCopies);
+BENCHMARK(BlockFanoutShared);
@@ -0,0 +1,376 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "script/script.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+#include <ios>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+namespace {
+
+/** Writes the lowest nBits of each value, most significant bit first */
+class CBitWriter
+{
+private:
+    std::vector<unsigned char>& vch;
+    uint8_t nBuffer{0};
+    int nOffset{0};
+
+public:
+    explicit CBitWriter(std::vector<unsigned char>& _vch) : vch(_vch) {}
+
+    void Write(uint64_t nData, int nBits)
+    {
+        while (nBits > 0) {
+            int nCount = std::min(8 - nOffset, nBits);
+            nBuffer |= (nData << (64 - nBits)) >> (64 - 8 + nOffset);
+            nOffset += nCount;
+            nBits -= nCount;
+            if (nOffset == 8) {
+                Flush();
+            }
+        }
+    }
+
+    /** Pads the last byte with zero bits */
+    void Flush()
+    {
+        if (nOffset == 0) {
+            return;
+        }
+        vch.push_back(nBuffer);
+        nBuffer = 0;
+        nOffset = 0;
+    }
+};
+
+class CBitReader
+{
+private:
+    const std::vector<unsigned char>& vch;
+    size_t nPos;
+    uint8_t nBuffer{0};
+    int nOffset{8};
+
+public:
+    CBitReader(const std::vector<unsigned char>& _vch, size_t _nPos) : vch(_vch), nPos(_nPos) {}
+
+    uint64_t Read(int nBits)
+    {
+        uint64_t nData = 0;
+        while (nBits > 0) {
+            if (nOffset == 8) {
+                if (nPos >= vch.size()) {
+                    throw std::ios_base::failure("CBitReader::Read(): end of data");
+                }
+                nBuffer = vch[nPos++];
+                nOffset = 0;
+            }
+            int nCount = std::min(8 - nOffset, nBits);
+            nData <<= nCount;
+            nData |= static_cast<uint8_t>(nBuffer << nOffset) >> (8 - nCount);
+            nOffset += nCount;
+            nBits -= nCount;
+        }
+        return nData;
+    }
+
+    /** Whether all bytes have been consumed */
+    bool AtEnd() const { return nPos == vch.size(); }
+};
+
+void GolombRiceEncode(CBitWriter& writer, uint8_t nP, uint64_t x)
+{
+    // Write quotient as unary-encoded: q 1's followed by one 0
+    uint64_t q = x >> nP;
+    while (q > 0) {
+        int nBits = q <= 64 ? static_cast<int>(q) : 64;
+        writer.Write(~0ULL, nBits);
+        q -= nBits;
+    }
+    writer.Write(0, 1);
+
+    // Write the remainder in nP bits
+    writer.Write(x, nP);
+}
+
+uint64_t GolombRiceDecode(CBitReader& reader, uint8_t nP)
+{
+    uint64_t q = 0;
+    while (reader.Read(1) == 1) {
+        ++q;
+    }
+    uint64_t r = reader.Read(nP);
+    return (q << nP) + r;
+}
+
+/** Maps x uniformly into [0, n), see https://lemire.me/blog/2016/06/27/a-fast-alternative-to-the-modulo-reduction/ */
+uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+    return (static_cast<unsigned __int128>(x) * static_cast<unsigned __int128>(n)) >> 64;
+#else
+    // To perform the calculation on 64-bit numbers without losing the
+    // result to overflow, split the numbers into the most significant and
+    // least significant 32 bits and perform multiplication piece-wise.
+    uint64_t a = x >> 32, b = x & 0xffffffff;
+    uint64_t c = n >> 32, d = n & 0xffffffff;
+
+    uint64_t ac = a * c;
+    uint64_t ad = a * d;
+    uint64_t bc = b * c;
+    uint64_t bd = b * d;
+
+    uint64_t mid34 = (bd >> 32) + (bc & 0xffffffff) + (ad & 0xffffffff);
+    uint64_t upper64 = ac + (bc >> 32) + (ad >> 32) + (mid34 >> 32);
+    return upper64;
+#endif
+}
+
+/** Reads the number of elements from the start of an encoded filter, returns the offset of the bit stream */
+size_t ReadFilterSize(const std::vector<unsigned char>& vchEncoded, uint32_t& nN)
+{
+    // a CompactSize, parsed in place as this runs for every filter matched during a rescan
+    if (vchEncoded.empty()) {
+        throw std::ios_base::failure("ReadFilterSize(): end of data");
+    }
+    uint64_t nSize = vchEncoded[0];
+    size_t nPos = 1;
+    if (nSize >= 253) {
+        size_t nBytes = nSize == 253 ? 2 : nSize == 254 ? 4 : 8;
+        if (vchEncoded.size() < 1 + nBytes) {
+            throw std::ios_base::failure("ReadFilterSize(): end of data");
+        }
+        const unsigned char* p = vchEncoded.data() + 1;
+        nSize = nBytes == 2 ? ReadLE16(p) : nBytes == 4 ? ReadLE32(p) : ReadLE64(p);
+        if (nSize < (nBytes == 2 ? 253 : nBytes == 4 ? 0x10000 : 0x100000000ULL)) {
+            throw std::ios_base::failure("non-canonical ReadCompactSize()");
+        }
+        nPos += nBytes;
+    }
+    if (nSize > std::numeric_limits<uint32_t>::max()) {
+        throw std::ios_base::failure("N must be <2^32");
+    }
+    nN = static_cast<uint32_t>(nSize);
+    return nPos;
+}
+
+} // namespace
+
+CGCSFilter::CGCSFilter(uint64_t _nSipHashK0, uint64_t _nSipHashK1, uint8_t _nP, uint32_t _nM) :
+    CGCSFilter(_nSipHashK0, _nSipHashK1, _nP, _nM, ElementSet())
+{
+}
+
+CGCSFilter::CGCSFilter(uint64_t _nSipHashK0, uint64_t _nSipHashK1, uint8_t _nP, uint32_t _nM, std::vector<unsigned char> vchEncodedFilter) :
+    nSipHashK0(_nSipHashK0), nSipHashK1(_nSipHashK1), nP(_nP), nM(_nM), vchEncoded(std::move(vchEncodedFilter))
+{
+    size_t nPos = ReadFilterSize(vchEncoded, nN);
+    nF = static_cast<uint64_t>(nN) * nM;
+
+    // Verify that the encoded filter contains exactly N elements. If it has too much or too little
+    // data, a std::ios_base::failure exception will be raised.
+    CBitReader reader(vchEncoded, nPos);
+    for (uint64_t i = 0; i < nN; ++i) {
+        GolombRiceDecode(reader, nP);
+    }
+    if (!reader.AtEnd()) {
+        throw std::ios_base::failure("encoded_filter contains excess data");
+    }
+}
+
+CGCSFilter::CGCSFilter(uint64_t _nSipHashK0, uint64_t _nSipHashK1, uint8_t _nP, uint32_t _nM, const ElementSet& elements) :
+    nSipHashK0(_nSipHashK0), nSipHashK1(_nSipHashK1), nP(_nP), nM(_nM)
+{
+    if (elements.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::invalid_argument("N must be <2^32");
+    }
+    nN = static_cast<uint32_t>(elements.size());
+    nF = static_cast<uint64_t>(nN) * nM;
+
+    CVectorWriter stream(SER_NETWORK, PROTOCOL_VERSION, vchEncoded, 0);
+    WriteCompactSize(stream, nN);
+
+    if (elements.empty()) {
+        return;
+    }
+
+    CBitWriter writer(vchEncoded);
+    uint64_t nLastValue = 0;
+    for (uint64_t nValue : BuildHashedSet(elements)) {
+        GolombRiceEncode(writer, nP, nValue - nLastValue);
+        nLastValue = nValue;
+    }
+    writer.Flush();
+}
+
+uint64_t CGCSFilter::HashToRange(const Element& element) const
+{
+    uint64_t nHash = CSipHasher(nSipHashK0, nSipHashK1)
+        .Write(element.data(), element.size())
+        .Finalize();
+    return MapIntoRange(nHash, nF);
+}
+
+std::vector<uint64_t> CGCSFilter::BuildHashedSet(const ElementSet& elements) const
+{
+    std::vector<uint64_t> vHashed;
+    vHashed.reserve(elements.size());
+    for (const Element& element : elements) {
+        vHashed.push_back(HashToRange(element));
+    }
+    std::sort(vHashed.begin(), vHashed.end());
+    return vHashed;
+}
+
+bool CGCSFilter::MatchInternal(const uint64_t* elementHashes, size_t nSize) const
+{
+    uint32_t nFilterSize;
+    size_t nPos = ReadFilterSize(vchEncoded, nFilterSize);
+    CBitReader reader(vchEncoded, nPos);
+
+    uint64_t nValue = 0;
+    size_t nHashesIndex = 0;
+    for (uint32_t i = 0; i < nN; ++i) {
+        nValue += GolombRiceDecode(reader, nP);
+
+        while (true) {
+            if (nHashesIndex == nSize) {
+                return false;
+            } else if (elementHashes[nHashesIndex] == nValue) {
+                return true;
+            } else if (elementHashes[nHashesIndex] > nValue) {
+                break;
+            }
+            nHashesIndex++;
+        }
+    }
+    return false;
+}
+
+bool CGCSFilter::Match(const Element& element) const
+{
+    if (nN == 0) {
+        return false;
+    }
+    uint64_t nQuery = HashToRange(element);
+    return MatchInternal(&nQuery, 1);
+}
+
+bool CGCSFilter::MatchAny(const ElementSet& elements) const
+{
+    if (nN == 0 || elements.empty()) {
+        return false;
+    }
+    const std::vector<uint64_t> vQueries = BuildHashedSet(elements);
+    return MatchInternal(vQueries.data(), vQueries.size());
+}
+
+static const std::map<BlockFilterType, std::string> mapFilterTypeNames = {
+    {BlockFilterType::BASIC, "basic"},
+};
+
+const std::string& BlockFilterTypeName(BlockFilterType filterType)
+{
+    static const std::string strUnknown;
+    auto it = mapFilterTypeNames.find(filterType);
+    return it != mapFilterTypeNames.end() ? it->second : strUnknown;
+}
+
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterType)
+{
+    for (const auto& entry : mapFilterTypeNames) {
+        if (entry.second == name) {
+            filterType = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+static CGCSFilter::ElementSet BasicFilterElements(const CBlock& block, const CBlockUndo& blockUndo)
+{
+    CGCSFilter::ElementSet elements;
+
+    for (const CTransactionRef& tx : block.vtx) {
+        for (const CTxOut& txout : tx->vout) {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN) continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    for (const CTxUndo& txUndo : blockUndo.vtxundo) {
+        for (const Coin& prevout : txUndo.vprevout) {
+            const CScript& script = prevout.out.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN) continue;
+            elements.emplace(script.begin(), script.end());
+        }
+    }
+
+    return elements;
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType _filterType, const uint256& _blockHash, std::vector<unsigned char> vchFilter) :
+    filterType(_filterType), blockHash(_blockHash)
+{
+    uint64_t nSipHashK0, nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    if (!BuildParams(nSipHashK0, nSipHashK1, nP, nM)) {
+        throw std::invalid_argument("unknown filter_type");
+    }
+    filter = CGCSFilter(nSipHashK0, nSipHashK1, nP, nM, std::move(vchFilter));
+}
+
+CBlockFilter::CBlockFilter(BlockFilterType _filterType, const CBlock& block, const CBlockUndo& blockUndo) :
+    filterType(_filterType), blockHash(block.GetHash())
+{
+    uint64_t nSipHashK0, nSipHashK1;
+    uint8_t nP;
+    uint32_t nM;
+    if (!BuildParams(nSipHashK0, nSipHashK1, nP, nM)) {
+        throw std::invalid_argument("unknown filter_type");
+    }
+    filter = CGCSFilter(nSipHashK0, nSipHashK1, nP, nM, BasicFilterElements(block, blockUndo));
+}
+
+bool CBlockFilter::BuildParams(uint64_t& nSipHashK0, uint64_t& nSipHashK1, uint8_t& nP, uint32_t& nM) const
+{
+    // the SipHash key is the first 16 bytes of the block hash, little-endian
+    nSipHashK0 = ReadLE64(blockHash.begin());
+    nSipHashK1 = ReadLE64(blockHash.begin() + 8);
+
+    switch (filterType) {
+    case BlockFilterType::BASIC:
+        nP = BASIC_FILTER_P;
+        nM = BASIC_FILTER_M;
+        return true;
+    case BlockFilterType::INVALID:
+        return false;
+    }
+
+    return false;
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    const std::vector<unsigned char>& vchData = GetEncodedFilter();
+    return Hash(vchData.begin(), vchData.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& prevHeader) const
+{
+    const uint256 filterHash = GetHash();
+    return Hash(filterHash.begin(), filterHash.end(), prevHeader.begin(), prevHeader.end());
+}
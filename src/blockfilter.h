@@ -0,0 +1,118 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_BLOCKFILTER_H
+#define COSANTA_BLOCKFILTER_H
+
+#include "coins.h"
+#include "primitives/block.h"
+#include "uint256.h"
+#include "undo.h"
+
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+ * A Golomb-coded set as defined in BIP 158. It is a compact, probabilistic
+ * data structure for testing set membership, false positives happen with a
+ * rate of about 1/M per queried element, false negatives never.
+ */
+class CGCSFilter
+{
+public:
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint64_t nSipHashK0;
+    uint64_t nSipHashK1;
+    uint8_t nP;  //!< Golomb-Rice coding parameter
+    uint32_t nM; //!< Inverse false positive rate
+    uint32_t nN; //!< Number of elements in the filter
+    uint64_t nF; //!< Range of element hashes, F = N * M
+    std::vector<unsigned char> vchEncoded;
+
+    /** Hash a data element to an integer in the range [0, N * M) */
+    uint64_t HashToRange(const Element& element) const;
+    std::vector<uint64_t> BuildHashedSet(const ElementSet& elements) const;
+    /** Checks if the elements may be in the set, elementHashes must be sorted */
+    bool MatchInternal(const uint64_t* elementHashes, size_t nSize) const;
+
+public:
+    /** Constructs an empty filter */
+    CGCSFilter(uint64_t nSipHashK0 = 0, uint64_t nSipHashK1 = 0, uint8_t nP = 0, uint32_t nM = 0);
+
+    /** Reconstructs an already-created filter from an encoding, throws std::ios_base::failure if it is invalid */
+    CGCSFilter(uint64_t nSipHashK0, uint64_t nSipHashK1, uint8_t nP, uint32_t nM, std::vector<unsigned char> vchEncodedFilter);
+
+    /** Builds a new filter from the params and set of elements */
+    CGCSFilter(uint64_t nSipHashK0, uint64_t nSipHashK1, uint8_t nP, uint32_t nM, const ElementSet& elements);
+
+    uint32_t GetN() const { return nN; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    /** Checks if the element may be in the set. False positives are possible with probability 1/M */
+    bool Match(const Element& element) const;
+
+    /**
+     * Checks if any of the given elements may be in the set. False positives
+     * are possible with probability 1/M per element checked. This is more
+     * efficient than checking Match on multiple elements separately.
+     */
+    bool MatchAny(const ElementSet& elements) const;
+};
+
+static const uint8_t BASIC_FILTER_P = 19;
+static const uint32_t BASIC_FILTER_M = 784931;
+
+enum class BlockFilterType : uint8_t
+{
+    BASIC = 0,
+    INVALID = 255,
+};
+
+/** Get the human-readable name for a filter type, returns an empty string for unknown types */
+const std::string& BlockFilterTypeName(BlockFilterType filterType);
+
+/** Find a filter type by its human-readable name */
+bool BlockFilterTypeByName(const std::string& name, BlockFilterType& filterType);
+
+/**
+ * Complete block filter struct as defined in BIP 157. The basic filter
+ * contains every output script of the block and every script spent by its
+ * inputs, except empty and OP_RETURN scripts.
+ */
+class CBlockFilter
+{
+private:
+    BlockFilterType filterType{BlockFilterType::INVALID};
+    uint256 blockHash;
+    CGCSFilter filter;
+
+    bool BuildParams(uint64_t& nSipHashK0, uint64_t& nSipHashK1, uint8_t& nP, uint32_t& nM) const;
+
+public:
+    CBlockFilter() {}
+
+    /** Reconstruct a filter from the encoded filter, throws std::ios_base::failure if it is invalid */
+    CBlockFilter(BlockFilterType filterType, const uint256& blockHash, std::vector<unsigned char> vchFilter);
+
+    /** Construct a new filter for the given block, blockUndo must be the undo data of the block */
+    CBlockFilter(BlockFilterType filterType, const CBlock& block, const CBlockUndo& blockUndo);
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    const uint256& GetBlockHash() const { return blockHash; }
+    const CGCSFilter& GetFilter() const { return filter; }
+    const std::vector<unsigned char>& GetEncodedFilter() const { return filter.GetEncoded(); }
+
+    /** Compute the filter hash */
+    uint256 GetHash() const;
+
+    /** Compute the filter header given the previous one */
+    uint256 ComputeHeader(const uint256& prevHeader) const;
+};
+
+#endif // COSANTA_BLOCKFILTER_H
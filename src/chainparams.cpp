@@ -159,6 +159,11 @@ void CChainParams::UpdateBudgetParameters(int nMasternodePaymentsStartBlock, int
     consensus.nSuperblockStartBlock = nSuperblockStartBlock;
 }
 
+void CChainParams::UpdateSnapshotParameters(int nBaseHeight, const uint256& hashBaseBlock, const uint256& muhash, const uint256& evohash)
+{
+    mapSnapshots[nBaseHeight] = CSnapshotData{hashBaseBlock, muhash, evohash};
+}
+
 void CChainParams::UpdateSubsidyAndDiffParams(int nMinimumDifficultyBlocks, int nHighSubsidyBlocks, int nHighSubsidyFactor)
 {
     consensus.nMinimumDifficultyBlocks = nMinimumDifficultyBlocks;
@@ -972,6 +977,11 @@ void UpdateBudgetParameters(int nMasternodePaymentsStartBlock, int nBudgetPaymen
     globalChainParams->UpdateBudgetParameters(nMasternodePaymentsStartBlock, nBudgetPaymentsStartBlock, nSuperblockStartBlock);
 }
 
+void UpdateSnapshotParameters(int nBaseHeight, const uint256& hashBaseBlock, const uint256& muhash, const uint256& evohash)
+{
+    globalChainParams->UpdateSnapshotParameters(nBaseHeight, hashBaseBlock, muhash, evohash);
+}
+
 void UpdateDevnetSubsidyAndDiffParams(int nMinimumDifficultyBlocks, int nHighSubsidyBlocks, int nHighSubsidyFactor)
 {
     globalChainParams->UpdateSubsidyAndDiffParams(nMinimumDifficultyBlocks, nHighSubsidyBlocks, nHighSubsidyFactor);
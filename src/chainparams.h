@@ -26,6 +26,17 @@ struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
 };
 
+/** Base block, UTXO set hash and evo records hash of a UTXO snapshot which may be loaded with -loadsnapshot */
+struct CSnapshotData {
+    uint256 hashBaseBlock;
+    //! Finalized MuHash3072 of the unspent outputs at the base block
+    uint256 muhash;
+    //! Hash of the evo database records at the base block, see CUTXOSnapshotMetadata::evohash
+    uint256 evohash;
+};
+
+typedef std::map<int, CSnapshotData> MapSnapshots;
+
 struct ChainTxData {
     int64_t nTime;
     int64_t nTxCount;
@@ -79,10 +90,13 @@ public:
     int ExtCoinType() const { return nExtCoinType; }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
+    /** UTXO snapshots by base height, -loadsnapshot is disabled if there are none */
+    const MapSnapshots& Snapshots() const { return mapSnapshots; }
     const ChainTxData& TxData() const { return chainTxData; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout, int64_t nWindowSize, int64_t nThreshold);
     void UpdateDIP3Parameters(int nActivationHeight, int nEnforcementHeight);
     void UpdateBudgetParameters(int nMasternodePaymentsStartBlock, int nBudgetPaymentsStartBlock, int nSuperblockStartBlock);
+    void UpdateSnapshotParameters(int nBaseHeight, const uint256& hashBaseBlock, const uint256& muhash, const uint256& evohash);
     void UpdateSubsidyAndDiffParams(int nMinimumDifficultyBlocks, int nHighSubsidyBlocks, int nHighSubsidyFactor);
     void UpdateLLMQChainLocks(Consensus::LLMQType llmqType);
     int PoolMinParticipants() const { return nPoolMinParticipants; }
@@ -114,6 +128,7 @@ protected:
     bool fAllowMultipleAddressesFromGroup;
     bool fAllowMultiplePorts;
     CCheckpointData checkpointData;
+    MapSnapshots mapSnapshots;
     ChainTxData chainTxData;
     int nPoolMinParticipants;
     int nPoolMaxParticipants;
@@ -160,6 +175,11 @@ void UpdateDIP3Parameters(int nActivationHeight, int nEnforcementHeight);
  */
 void UpdateBudgetParameters(int nMasternodePaymentsStartBlock, int nBudgetPaymentsStartBlock, int nSuperblockStartBlock);
 
+/**
+ * Allows adding a UTXO snapshot on regtest.
+ */
+void UpdateSnapshotParameters(int nBaseHeight, const uint256& hashBaseBlock, const uint256& muhash, const uint256& evohash);
+
 /**
  * Allows modifying the subsidy and difficulty devnet parameters.
  */
@@ -9,6 +9,7 @@
 #include "memusage.h"
 #include "random.h"
 
+#include <algorithm>
 #include <assert.h>
 
 bool CCoinsView::GetCoin(const COutPoint &outpoint, Coin &coin) const { return false; }
@@ -17,6 +18,18 @@ std::vector<uint256> CCoinsView::GetHeadBlocks() const { return std::vector<uint
 bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return false; }
 CCoinsViewCursor *CCoinsView::Cursor() const { return nullptr; }
 
+bool CCoinsView::BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock)
+{
+    CCoinsMap mapDirty;
+    for (auto& entry : mapCoins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY) {
+            mapDirty.emplace(entry.first, entry.second);
+            entry.second.flags = 0;
+        }
+    }
+    return BatchWrite(mapDirty, hashBlock);
+}
+
 bool CCoinsView::HaveCoin(const COutPoint &outpoint) const
 {
     Coin coin;
@@ -30,12 +43,13 @@ uint256 CCoinsViewBacked::GetBestBlock() const { return base->GetBestBlock(); }
 std::vector<uint256> CCoinsViewBacked::GetHeadBlocks() const { return base->GetHeadBlocks(); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
 bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWrite(mapCoins, hashBlock); }
+bool CCoinsViewBacked::BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock) { return base->BatchWriteInPlace(mapCoins, hashBlock); }
 CCoinsViewCursor *CCoinsViewBacked::Cursor() const { return base->Cursor(); }
 size_t CCoinsViewBacked::EstimateSize() const { return base->EstimateSize(); }
 
 SaltedOutpointHasher::SaltedOutpointHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn) : CCoinsViewBacked(baseIn), cachedCoinsUsage(0), nCacheHits(0), nCacheMisses(0) {}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -43,8 +57,11 @@ size_t CCoinsViewCache::DynamicMemoryUsage() const {
 
 CCoinsMap::iterator CCoinsViewCache::FetchCoin(const COutPoint &outpoint) const {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
-    if (it != cacheCoins.end())
+    if (it != cacheCoins.end()) {
+        nCacheHits++;
         return it;
+    }
+    nCacheMisses++;
     Coin tmp;
     if (!base->GetCoin(outpoint, tmp))
         return cacheCoins.end();
@@ -137,6 +154,25 @@ bool CCoinsViewCache::HaveCoinInCache(const COutPoint &outpoint) const {
     return (it != cacheCoins.end() && !it->second.coin.IsSpent());
 }
 
+bool CCoinsViewCache::IsCached(const COutPoint &outpoint) const {
+    return cacheCoins.count(outpoint) != 0;
+}
+
+size_t CCoinsViewCache::AddPrefetchedCoins(std::vector<std::pair<COutPoint, Coin> >& vCoins) {
+    size_t nAdded = 0;
+    for (auto& entry : vCoins) {
+        assert(!entry.second.IsSpent());
+        CCoinsMap::iterator it;
+        bool inserted;
+        std::tie(it, inserted) = cacheCoins.emplace(std::piecewise_construct, std::forward_as_tuple(entry.first), std::forward_as_tuple(std::move(entry.second)));
+        if (inserted) {
+            cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+            nAdded++;
+        }
+    }
+    return nAdded;
+}
+
 uint256 CCoinsViewCache::GetBestBlock() const {
     if (hashBlock.IsNull())
         hashBlock = base->GetBestBlock();
@@ -212,6 +248,72 @@ bool CCoinsViewCache::Flush() {
     return fOk;
 }
 
+bool CCoinsViewCache::Sync() {
+    // a copy of the dirty entries could be as large as the cache itself
+    bool fOk = base->BatchWriteInPlace(cacheCoins, hashBlock);
+    for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); ) {
+        if (it->second.coin.IsSpent()) {
+            // spent entries are only kept until the spend has been written
+            cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+            it = cacheCoins.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return fOk;
+}
+
+size_t CCoinsViewCache::Trim(size_t nTargetUsage) {
+    if (DynamicMemoryUsage() <= nTargetUsage) {
+        return 0;
+    }
+
+    size_t nEvicted = 0;
+    // Every round evicts at least the sampled entry at the cutoff height, so
+    // the loop ends once the target is reached or no clean entries are left.
+    // Usually the first round is enough.
+    while (DynamicMemoryUsage() > nTargetUsage) {
+        // the hasher is salted, so every nStep-th entry is a random sample
+        size_t nStep = std::max(cacheCoins.size() / COINS_TRIM_SAMPLE_SIZE, (size_t)1);
+        std::vector<uint32_t> vSample;
+        vSample.reserve(cacheCoins.size() / nStep + 1);
+        size_t nClean = 0;
+        size_t nCleanUsage = 0;
+        for (CCoinsMap::const_iterator it = cacheCoins.begin(); it != cacheCoins.end(); ++it) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                continue;
+            }
+            if (nClean++ % nStep == 0) {
+                vSample.push_back(it->second.coin.nHeight);
+            }
+            nCleanUsage += it->second.coin.DynamicMemoryUsage();
+        }
+        if (vSample.empty()) {
+            break;
+        }
+        // evicting an entry also frees its map node
+        nCleanUsage += nClean * ((DynamicMemoryUsage() - cachedCoinsUsage) / cacheCoins.size());
+
+        // the share of the clean entries which has to go, at least one of them
+        size_t nExcess = DynamicMemoryUsage() - nTargetUsage;
+        size_t nth = std::min((size_t)((double)vSample.size() * nExcess / nCleanUsage), vSample.size() - 1);
+        std::nth_element(vSample.begin(), vSample.begin() + nth, vSample.end());
+        uint32_t nCutoffHeight = vSample[nth];
+
+        CCoinsMap::iterator it = cacheCoins.begin();
+        while (it != cacheCoins.end() && DynamicMemoryUsage() > nTargetUsage) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY) && it->second.coin.nHeight <= nCutoffHeight) {
+                cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+                it = cacheCoins.erase(it);
+                nEvicted++;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return nEvicted;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint& hash)
 {
     CCoinsMap::iterator it = cacheCoins.find(hash);
@@ -175,6 +175,11 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Do a bulk modification like BatchWrite, but keep all entries in
+    //! mapCoins and clear the flags of the written ones. The default
+    //! implementation passes a copy of the DIRTY entries to BatchWrite.
+    virtual bool BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
 
@@ -200,11 +205,15 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
 
 
+/** Maximum number of clean entry heights CCoinsViewCache::Trim() samples to choose the entries to evict */
+static const size_t COINS_TRIM_SAMPLE_SIZE = 4096;
+
 /** CCoinsView that adds a memory cache for transactions to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
@@ -219,6 +228,10 @@ protected:
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Number of lookups which were answered from the cache, or had to go to the backing view. */
+    mutable uint64_t nCacheHits;
+    mutable uint64_t nCacheMisses;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -233,6 +246,7 @@ public:
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock) override { return CCoinsView::BatchWriteInPlace(mapCoins, hashBlock); }
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -244,6 +258,20 @@ public:
      */
     bool HaveCoinInCache(const COutPoint &outpoint) const;
 
+    /**
+     * Check if the given outpoint has an entry in this cache, including
+     * entries of spent coins which have not been flushed yet. Reading such
+     * an outpoint from the backing view would return stale data.
+     */
+    bool IsCached(const COutPoint &outpoint) const;
+
+    /**
+     * Add coins which were read from the backing view outside of this cache,
+     * like a cache miss in AccessCoin() would. Outpoints which are already
+     * cached are skipped. Returns the number of coins added.
+     */
+    size_t AddPrefetchedCoins(std::vector<std::pair<COutPoint, Coin> >& vCoins);
+
     /**
      * Return a reference to Coin in the cache, or a pruned one if not found. This is
      * more efficient than GetCoin.
@@ -276,6 +304,25 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base like Flush(),
+     * but keep the unspent coins cached as clean entries, so that the blocks
+     * connected afterwards don't start with a cold cache. A database base
+     * writes the entries straight from the cache, without copying them.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Evict clean entries until the memory usage of the cache is at most
+     * nTargetUsage. Recently created coins are the most likely to be spent
+     * soon, so the coins of the lowest heights are evicted first. The height
+     * below which the clean entries hold the excess usage is estimated from a
+     * sample of at most COINS_TRIM_SAMPLE_SIZE entries, so the order is only
+     * approximate. Returns the number of evicted entries.
+     */
+    size_t Trim(size_t nTargetUsage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -288,6 +335,11 @@ public:
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Number of lookups answered from the cache
+    uint64_t GetCacheHits() const { return nCacheHits; }
+    //! Number of lookups which had to go to the backing view
+    uint64_t GetCacheMisses() const { return nCacheMisses; }
+
     /** 
      * Amount of cosanta coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -0,0 +1,102 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_CRYPTO_MUHASH_H
+#define COSANTA_CRYPTO_MUHASH_H
+
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A 3072-bit number, reduced modulo the safe prime 2^3072 - 1103717 */
+class Num3072
+{
+private:
+    void FullReduce();
+    bool IsOverflow() const;
+    Num3072 GetInverse() const;
+
+public:
+    static const size_t BYTE_SIZE = 384;
+
+#ifdef __SIZEOF_INT128__
+    typedef unsigned __int128 double_limb_t;
+    typedef uint64_t limb_t;
+    static const int LIMBS = 48;
+    static const int LIMB_SIZE = 64;
+#else
+    typedef uint64_t double_limb_t;
+    typedef uint32_t limb_t;
+    static const int LIMBS = 96;
+    static const int LIMB_SIZE = 32;
+#endif
+    limb_t limbs[LIMBS];
+
+    static_assert(LIMB_SIZE * LIMBS == 3072, "Num3072 isn't 3072 bits");
+    static_assert(sizeof(double_limb_t) == sizeof(limb_t) * 2, "bad size for double_limb_t");
+    static_assert(sizeof(limb_t) * 8 == LIMB_SIZE, "LIMB_SIZE is incorrect");
+
+    void Multiply(const Num3072& a);
+    void Divide(const Num3072& a);
+    void SetToOne();
+    void ToBytes(unsigned char (&out)[BYTE_SIZE]);
+
+    Num3072() { SetToOne(); }
+    explicit Num3072(const unsigned char (&data)[BYTE_SIZE]);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        for (int i = 0; i < LIMBS; i++) {
+            READWRITE(limbs[i]);
+        }
+    }
+};
+
+/**
+ * A rolling hash of a set, based on multiplication modulo a 3072-bit prime.
+ *
+ * Every element is hashed to a number in the group; the hash of a set is the
+ * product of its elements. Elements can be added and removed in any order and
+ * the hashes of disjoint sets can be combined, so a set hash can be updated
+ * with the changes of a block, or built from parts computed in parallel.
+ * Removals are collected in a separate denominator, so that only Finalize()
+ * has to compute a modular inverse.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+    static Num3072 ToNum3072(const unsigned char* data, size_t len);
+
+public:
+    /** The hash of the empty set */
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+
+    /** Union with the set hashed by mul */
+    MuHash3072& operator*=(const MuHash3072& mul);
+    /** Difference with the set hashed by div, which has to be a subset of this set */
+    MuHash3072& operator/=(const MuHash3072& div);
+
+    /** Finalize into a 32-byte hash. The value of the set is left unchanged. */
+    void Finalize(uint256& out);
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(numerator);
+        READWRITE(denominator);
+    }
+};
+
+#endif // COSANTA_CRYPTO_MUHASH_H
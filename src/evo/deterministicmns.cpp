@@ -211,6 +211,10 @@ static bool CompareByLastPaid(const CDeterministicMNCPtr& _a, const CDeterminist
 
 CDeterministicMNCPtr CDeterministicMNList::GetMNPayee() const
 {
+    if (payeeQueue) {
+        return payeeQueue->empty() ? nullptr : payeeQueue->front();
+    }
+
     if (mnMap.size() == 0) {
         return nullptr;
     }
@@ -227,6 +231,11 @@ CDeterministicMNCPtr CDeterministicMNList::GetMNPayee() const
 
 std::vector<CDeterministicMNCPtr> CDeterministicMNList::GetProjectedMNPayees(int nCount) const
 {
+    if (payeeQueue) {
+        nCount = std::max(0, std::min(nCount, (int)payeeQueue->size()));
+        return std::vector<CDeterministicMNCPtr>(payeeQueue->begin(), payeeQueue->begin() + nCount);
+    }
+
     if (nCount > GetValidMNsCount()) {
         nCount = GetValidMNsCount();
     }
@@ -246,6 +255,68 @@ std::vector<CDeterministicMNCPtr> CDeterministicMNList::GetProjectedMNPayees(int
     return result;
 }
 
+void CDeterministicMNList::BuildPayeeQueue()
+{
+    auto queue = std::make_shared<MnPayeeQueue>();
+    ForEachMN(true, [&](const CDeterministicMNCPtr& dmn) {
+        queue->emplace_back(dmn);
+    });
+    std::sort(queue->begin(), queue->end(), [](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
+        return CompareByLastPaid(a, b);
+    });
+    payeeQueue = std::move(queue);
+}
+
+void CDeterministicMNList::UpdatePayeeQueue(const CDeterministicMNList& base, const CDeterministicMNListDiff& diff)
+{
+    if (!base.payeeQueue) {
+        return;
+    }
+
+    // MNs which are not part of the diff keep their last paid height and their order
+    std::set<uint256> setChanged;
+    for (const auto& id : diff.removedMns) {
+        auto dmn = base.GetMNByInternalId(id);
+        assert(dmn);
+        setChanged.emplace(dmn->proTxHash);
+    }
+    for (const auto& dmn : diff.addedMNs) {
+        setChanged.emplace(dmn->proTxHash);
+    }
+    for (const auto& p : diff.updatedMNs) {
+        auto dmn = GetMNByInternalId(p.first);
+        assert(dmn);
+        setChanged.emplace(dmn->proTxHash);
+    }
+
+    MnPayeeQueue vecChanged;
+    for (const auto& proTxHash : setChanged) {
+        auto dmn = GetValidMN(proTxHash);
+        if (dmn) {
+            vecChanged.emplace_back(dmn);
+        }
+    }
+    std::sort(vecChanged.begin(), vecChanged.end(), [](const CDeterministicMNCPtr& a, const CDeterministicMNCPtr& b) {
+        return CompareByLastPaid(a, b);
+    });
+
+    // merge the changed MNs into the remaining ones
+    auto queue = std::make_shared<MnPayeeQueue>();
+    queue->reserve(base.payeeQueue->size() + vecChanged.size());
+    auto it = vecChanged.begin();
+    for (const auto& dmn : *base.payeeQueue) {
+        if (setChanged.count(dmn->proTxHash)) {
+            continue;
+        }
+        while (it != vecChanged.end() && CompareByLastPaid(*it, dmn)) {
+            queue->emplace_back(*it++);
+        }
+        queue->emplace_back(dmn);
+    }
+    queue->insert(queue->end(), it, vecChanged.end());
+    payeeQueue = std::move(queue);
+}
+
 std::vector<CDeterministicMNCPtr> CDeterministicMNList::CalculateQuorum(size_t maxSize, const uint256& modifier) const
 {
     auto scores = CalculateScores(modifier);
@@ -426,6 +497,7 @@ CDeterministicMNList CDeterministicMNList::ApplyDiff(const CBlockIndex* pindex,
         auto dmn = result.GetMNByInternalId(p.first);
         result.UpdateMN(dmn, p.second);
     }
+    result.UpdatePayeeQueue(*this, diff);
 
     return result;
 }
@@ -435,6 +507,7 @@ void CDeterministicMNList::AddMN(const CDeterministicMNCPtr& dmn)
     assert(!mnMap.find(dmn->proTxHash));
     mnMap = mnMap.set(dmn->proTxHash, dmn);
     mnInternalIdMap = mnInternalIdMap.set(dmn->internalId, dmn->proTxHash);
+    payeeQueue.reset();
     AddUniqueProperty(dmn, dmn->collateralOutpoint);
     if (dmn->pdmnState->addr != CService()) {
         AddUniqueProperty(dmn, dmn->pdmnState->addr);
@@ -452,6 +525,7 @@ void CDeterministicMNList::UpdateMN(const CDeterministicMNCPtr& oldDmn, const CD
     auto oldState = dmn->pdmnState;
     dmn->pdmnState = pdmnState;
     mnMap = mnMap.set(oldDmn->proTxHash, dmn);
+    payeeQueue.reset();
 
     UpdateUniqueProperty(dmn, oldState->addr, pdmnState->addr);
     UpdateUniqueProperty(dmn, oldState->keyIDOwner, pdmnState->keyIDOwner);
@@ -488,6 +562,7 @@ void CDeterministicMNList::RemoveMN(const uint256& proTxHash)
     }
     mnMap = mnMap.erase(proTxHash);
     mnInternalIdMap = mnInternalIdMap.erase(dmn->internalId);
+    payeeQueue.reset();
 }
 
 CDeterministicMNManager::CDeterministicMNManager(CEvoDB& _evoDb) :
@@ -903,6 +978,7 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
         }
 
         if (evoDb.Read(std::make_pair(DB_LIST_SNAPSHOT, pindex->GetBlockHash()), snapshot)) {
+            snapshot.BuildPayeeQueue();
             mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
             break;
         }
@@ -910,6 +986,7 @@ CDeterministicMNList CDeterministicMNManager::GetListForBlock(const CBlockIndex*
         CDeterministicMNListDiff diff;
         if (!evoDb.Read(std::make_pair(DB_LIST_DIFF, pindex->GetBlockHash()), diff)) {
             snapshot = CDeterministicMNList(pindex->GetBlockHash(), -1, 0);
+            snapshot.BuildPayeeQueue();
             mnListsCache.emplace(pindex->GetBlockHash(), snapshot);
             break;
         }
@@ -276,6 +276,7 @@ public:
     typedef immer::map<uint256, CDeterministicMNCPtr> MnMap;
     typedef immer::map<uint64_t, uint256> MnInternalIdMap;
     typedef immer::map<uint256, std::pair<uint256, uint32_t> > MnUniquePropertyMap;
+    typedef std::vector<CDeterministicMNCPtr> MnPayeeQueue;
 
 private:
     uint256 blockHash;
@@ -288,6 +289,10 @@ private:
     // we keep track of this as checking for duplicates would otherwise be painfully slow
     MnUniquePropertyMap mnUniquePropertyMap;
 
+    // valid MNs in the order they get paid, shared between copies of the list and maintained
+    // incrementally by ApplyDiff. Not set (and not used) after the list was modified directly
+    std::shared_ptr<const MnPayeeQueue> payeeQueue;
+
 public:
     CDeterministicMNList() {}
     explicit CDeterministicMNList(const uint256& _blockHash, int _height, uint32_t _totalRegisteredCount) :
@@ -321,6 +326,7 @@ public:
         mnMap = MnMap();
         mnUniquePropertyMap = MnUniquePropertyMap();
         mnInternalIdMap = MnInternalIdMap();
+        payeeQueue.reset();
 
         SerializationOpBase(s, CSerActionUnserialize());
 
@@ -417,6 +423,12 @@ public:
      */
     std::vector<CDeterministicMNCPtr> GetProjectedMNPayees(int nCount) const;
 
+    /**
+     * Sorts the valid MNs into the payee queue. Lists derived from this one through ApplyDiff keep the queue
+     * up to date without sorting again, so GetMNPayee and GetProjectedMNPayees don't need to look at all MNs
+     */
+    void BuildPayeeQueue();
+
     /**
      * Calculate a quorum based on the modifier. The resulting list is deterministically sorted by score
      * @param maxSize
@@ -485,6 +497,8 @@ public:
     }
 
 private:
+    void UpdatePayeeQueue(const CDeterministicMNList& base, const CDeterministicMNListDiff& diff);
+
     template <typename T>
     void AddUniqueProperty(const CDeterministicMNCPtr& dmn, const T& v)
     {
@@ -15,6 +15,9 @@
 
 #include <unordered_set>
 
+// Makes checking for a duplicate MNAUTH and accepting it atomic, MNAUTHs of different peers might be processed concurrently
+static CCriticalSection cs_verifyMNAuth;
+
 void CMNAuth::PushMNAUTH(CNode* pnode, CConnman& connman)
 {
     if (!fMasternodeMode || activeMasternodeInfo.proTxHash.IsNull()) {
@@ -100,7 +103,9 @@ void CMNAuth::ProcessMessage(CNode* pnode, const std::string& strCommand, CDataS
             return;
         }
 
+        LOCK(cs_verifyMNAuth);
         connman.ForEachNode([&](CNode* pnode2) {
+            LOCK(pnode2->cs_mnauth);
             if (pnode2->verifiedProRegTxHash == mnauth.proRegTxHash) {
                 LogPrint(BCLog::NET, "CMNAuth::ProcessMessage -- Masternode %s has already verified as peer %d, dropping new connection. peer=%d\n",
                         mnauth.proRegTxHash.ToString(), pnode2->GetId(), pnode->GetId());
@@ -384,6 +384,38 @@ bool CheckProUpRevTx(const CTransaction& tx, const CBlockIndex* pindexPrev, CVal
     return true;
 }
 
+template <typename ProTx>
+static bool GetProTxHashFromPayload(const CTransaction& tx, uint256& proTxHashRet)
+{
+    ProTx ptx;
+    if (!GetTxPayload(tx, ptx)) {
+        return false;
+    }
+    proTxHashRet = ptx.proTxHash;
+    return true;
+}
+
+bool GetProTxHash(const CTransaction& tx, uint256& proTxHashRet)
+{
+    if (tx.nVersion != 3) {
+        return false;
+    }
+
+    switch (tx.nType) {
+    case TRANSACTION_PROVIDER_REGISTER:
+        proTxHashRet = tx.GetHash();
+        return true;
+    case TRANSACTION_PROVIDER_UPDATE_SERVICE:
+        return GetProTxHashFromPayload<CProUpServTx>(tx, proTxHashRet);
+    case TRANSACTION_PROVIDER_UPDATE_REGISTRAR:
+        return GetProTxHashFromPayload<CProUpRegTx>(tx, proTxHashRet);
+    case TRANSACTION_PROVIDER_UPDATE_REVOKE:
+        return GetProTxHashFromPayload<CProUpRevTx>(tx, proTxHashRet);
+    }
+
+    return false;
+}
+
 std::string CProRegTx::MakeSignString() const
 {
     std::string s;
@@ -244,4 +244,7 @@ bool CheckProUpServTx(const CTransaction& tx, const CBlockIndex* pindexPrev, CVa
 bool CheckProUpRegTx(const CTransaction& tx, const CBlockIndex* pindexPrev, CValidationState& state);
 bool CheckProUpRevTx(const CTransaction& tx, const CBlockIndex* pindexPrev, CValidationState& state);
 
+/** Returns the hash of the ProRegTx a ProTx belongs to, false for all other transactions */
+bool GetProTxHash(const CTransaction& tx, uint256& proTxHashRet);
+
 #endif //COSANTA_PROVIDERTX_H
@@ -210,6 +210,47 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
     return true;
 }
 
+/** Only the start of a request body is inspected to find its method */
+static const size_t MAX_CLASSIFY_BODY_SIZE = 512;
+
+std::string PeekJSONRPCMethod(const std::string& body)
+{
+    size_t pos = body.find_first_not_of(" \t\r\n");
+    if (pos != std::string::npos && body[pos] == '[') {
+        return "batch";
+    }
+    pos = body.find("\"method\"");
+    if (pos != std::string::npos) {
+        pos = body.find_first_not_of(" \t\r\n", pos + 8);
+    }
+    if (pos != std::string::npos && body[pos] == ':') {
+        pos = body.find_first_not_of(" \t\r\n", pos + 1);
+    } else {
+        pos = std::string::npos;
+    }
+    if (pos != std::string::npos && body[pos] == '"') {
+        size_t end = body.find('"', pos + 1);
+        if (end != std::string::npos) {
+            return body.substr(pos + 1, end - pos - 1);
+        }
+    }
+    return "";
+}
+
+/** Find the method of a JSON-RPC request without parsing its body, so that the
+ * work queue can schedule it from the HTTP event loop. Batches and requests
+ * for unknown methods are not told apart any further.
+ */
+static std::string ClassifyJSONRPCRequest(HTTPRequest* req)
+{
+    std::string method = PeekJSONRPCMethod(req->PeekBody(MAX_CLASSIFY_BODY_SIZE));
+    // don't let unauthenticated callers create arbitrary work queue entries
+    if (method == "batch" || tableRPC[method]) {
+        return method;
+    }
+    return "unknown";
+}
+
 static bool InitRPCAuthentication()
 {
     if (gArgs.GetArg("-rpcpassword", "") == "")
@@ -238,10 +279,10 @@ bool StartHTTPRPC()
     if (!InitRPCAuthentication())
         return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, ClassifyJSONRPCRequest);
 #ifdef ENABLE_WALLET
     // ifdef can be removed once we switch to better endpoint support and API versioning
-    RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/wallet/", false, HTTPReq_JSONRPC, ClassifyJSONRPCRequest);
 #endif
     assert(EventBase());
     httpRPCTimerInterface = MakeUnique<HTTPRPCTimerInterface>(EventBase());
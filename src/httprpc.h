@@ -21,6 +21,11 @@ void InterruptHTTPRPC();
  */
 void StopHTTPRPC();
 
+/** Find the method of a JSON-RPC request by looking at the start of its body only.
+ * Returns "batch" for batch requests and an empty string if no method was found.
+ */
+std::string PeekJSONRPCMethod(const std::string& body);
+
 /** Start HTTP REST subsystem.
  * Precondition; HTTP and RPC has been started.
  */
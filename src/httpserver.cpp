@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "httpserver.h"
+#include "httpworkqueue.h"
 
 #include "init.h"
 #include "chainparamsbase.h"
@@ -22,6 +23,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <signal.h>
+#ifdef WIN32
+#include <io.h>
+#endif
 
 #include <event2/thread.h>
 #include <event2/buffer.h>
@@ -38,6 +42,7 @@
 #endif
 #endif
 
+#include <deque>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -49,8 +54,8 @@ static const size_t MAX_HEADERS_SIZE = 8192;
 class HTTPWorkItem final : public HTTPClosure
 {
 public:
-    HTTPWorkItem(std::unique_ptr<HTTPRequest> _req, const std::string &_path, const HTTPRequestHandler& _func):
-        req(std::move(_req)), path(_path), func(_func)
+    HTTPWorkItem(std::unique_ptr<HTTPRequest> _req, const std::string &_path, const HTTPRequestHandler& _func, const std::string& _name):
+        req(std::move(_req)), name(_name), path(_path), func(_func)
     {
     }
     void operator()() override
@@ -59,83 +64,27 @@ public:
     }
 
     std::unique_ptr<HTTPRequest> req;
+    //! Name this item is scheduled and accounted under
+    const std::string name;
+    HTTPWorkLane lane{HTTP_LANE_DEFAULT};
+    int64_t nEnqueueTime{0};
 
 private:
     std::string path;
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
- * Work items are simply callable objects.
- */
-template <typename WorkItem>
-class WorkQueue
-{
-private:
-    /** Mutex protects entire object */
-    std::mutex cs;
-    std::condition_variable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
-    bool running;
-    size_t maxDepth;
-
-public:
-    explicit WorkQueue(size_t _maxDepth) : running(true),
-                                 maxDepth(_maxDepth)
-    {
-    }
-    /** Precondition: worker threads have all stopped (they have been joined).
-     */
-    ~WorkQueue()
-    {
-    }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
-    {
-        std::unique_lock<std::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
-            return false;
-        }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
-        cond.notify_one();
-        return true;
-    }
-    /** Thread function */
-    void Run()
-    {
-        while (true) {
-            std::unique_ptr<WorkItem> i;
-            {
-                std::unique_lock<std::mutex> lock(cs);
-                while (running && queue.empty())
-                    cond.wait(lock);
-                if (!running)
-                    break;
-                i = std::move(queue.front());
-                queue.pop_front();
-            }
-            (*i)();
-        }
-    }
-    /** Interrupt and exit loops */
-    void Interrupt()
-    {
-        std::unique_lock<std::mutex> lock(cs);
-        running = false;
-        cond.notify_all();
-    }
-};
-
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler):
-        prefix(_prefix), exactMatch(_exactMatch), handler(_handler)
+    HTTPPathHandler(std::string _prefix, bool _exactMatch, HTTPRequestHandler _handler, HTTPRequestClassifier _classifier):
+        prefix(_prefix), exactMatch(_exactMatch), handler(_handler), classifier(_classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
@@ -147,7 +96,7 @@ struct evhttp* eventHTTP = nullptr;
 //! List of subnets to allow RPC connections from
 static std::vector<CSubNet> rpc_allow_subnets;
 //! Work queue for handling longer requests off the event loop thread
-static WorkQueue<HTTPClosure>* workQueue = nullptr;
+static WorkQueue<HTTPWorkItem>* workQueue = nullptr;
 //! Handlers for (sub)paths
 std::vector<HTTPPathHandler> pathHandlers;
 //! Bound listening sockets
@@ -262,12 +211,16 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
-        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
+        std::string name = i->classifier ? i->classifier(hreq.get()) : "";
+        if (name.empty()) {
+            name = i->prefix;
+        }
+        std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler, name));
         assert(workQueue);
         if (workQueue->Enqueue(item.get()))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request for %s rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n", item->name);
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -332,7 +285,7 @@ static bool HTTPBindAddresses(struct evhttp* http)
 }
 
 /** Simple wrapper to set thread name and run work queue */
-static void HTTPWorkQueueRun(WorkQueue<HTTPClosure>* queue)
+static void HTTPWorkQueueRun(WorkQueue<HTTPWorkItem>* queue)
 {
     RenameThread("cosanta-httpworker");
     queue->Run();
@@ -352,6 +305,45 @@ static void libevent_log_cb(int severity, const char *msg)
     //    LogPrint(BCLog::LIBEVENT, "libevent: %s\n", msg);
 }
 
+/** Requests which should be answered even while the work queue is busy with slow calls */
+static const char* const DEFAULT_HTTP_PRIORITY_METHODS[] = {
+    "getbestblockhash", "getbestchainlock", "getblockcount", "getconnectioncount",
+    "getrpcinfo", "mnsync", "ping", "uptime",
+};
+/** Requests known to take long, they are never allowed to occupy more than half of the worker threads */
+static const char* const DEFAULT_HTTP_HEAVY_METHODS[] = {
+    "getaddressbalance", "getaddressdeltas", "getaddressmempool", "getaddresstxids", "getaddressutxos",
+    "getspecialtxes", "gettxoutsetinfo", "gobject", "protx", "rescanblockchain", "verifychain",
+};
+
+bool InitHTTPWorkLanes(std::map<std::string, HTTPWorkLane>& laneByName, std::map<std::string, size_t>& maxActiveByName)
+{
+    for (const char* name : DEFAULT_HTTP_PRIORITY_METHODS) {
+        laneByName[name] = HTTP_LANE_PRIORITY;
+    }
+    for (const char* name : DEFAULT_HTTP_HEAVY_METHODS) {
+        laneByName[name] = HTTP_LANE_HEAVY;
+    }
+    for (const std::string& name : gArgs.GetArgs("-rpcprioritymethod")) {
+        laneByName[name] = HTTP_LANE_PRIORITY;
+    }
+    for (const std::string& name : gArgs.GetArgs("-rpcheavymethod")) {
+        laneByName[name] = HTTP_LANE_HEAVY;
+    }
+    for (const std::string& strLimit : gArgs.GetArgs("-rpcmethodlimit")) {
+        size_t pos = strLimit.rfind(':');
+        int64_t nLimit = 0;
+        if (pos == std::string::npos || pos == 0 || !ParseInt64(strLimit.substr(pos + 1), &nLimit) || nLimit < 1) {
+            uiInterface.ThreadSafeMessageBox(
+                strprintf("Invalid -rpcmethodlimit specification: %s. Expected <method>:<n> with n >= 1.", strLimit),
+                "", CClientUIInterface::MSG_ERROR);
+            return false;
+        }
+        maxActiveByName[strLimit.substr(0, pos)] = (size_t)nLimit;
+    }
+    return true;
+}
+
 bool InitHTTPServer()
 {
     if (!InitHTTPAllowList())
@@ -401,9 +393,15 @@ bool InitHTTPServer()
 
     LogPrint(BCLog::HTTP, "Initialized HTTP server\n");
     int workQueueDepth = std::max((long)gArgs.GetArg("-rpcworkqueue", DEFAULT_HTTP_WORKQUEUE), 1L);
+    int rpcThreads = std::max((long)gArgs.GetArg("-rpcthreads", DEFAULT_HTTP_THREADS), 1L);
     LogPrintf("HTTP: creating work queue of depth %d\n", workQueueDepth);
 
-    workQueue = new WorkQueue<HTTPClosure>(workQueueDepth);
+    std::map<std::string, HTTPWorkLane> laneByName;
+    std::map<std::string, size_t> maxActiveByName;
+    if (!InitHTTPWorkLanes(laneByName, maxActiveByName)) {
+        return false;
+    }
+    workQueue = new WorkQueue<HTTPWorkItem>(workQueueDepth, rpcThreads, laneByName, maxActiveByName);
     // transfer ownership to eventBase/HTTP via .release()
     eventBase = base_ctr.release();
     eventHTTP = http_ctr.release();
@@ -489,6 +487,41 @@ struct event_base* EventBase()
     return eventBase;
 }
 
+const std::array<int64_t, 8> HTTPTimingHistogram::BUCKET_LIMITS_MS = {{1, 5, 10, 50, 100, 500, 1000, 5000}};
+
+void HTTPTimingHistogram::Add(int64_t nMicros)
+{
+    size_t i = 0;
+    while (i < BUCKET_LIMITS_MS.size() && nMicros >= BUCKET_LIMITS_MS[i] * 1000) {
+        i++;
+    }
+    buckets[i]++;
+    nTotalMicros += nMicros;
+    nMaxMicros = std::max(nMaxMicros, nMicros);
+}
+
+std::string HTTPWorkLaneName(HTTPWorkLane lane)
+{
+    switch (lane) {
+    case HTTP_LANE_PRIORITY:
+        return "priority";
+    case HTTP_LANE_DEFAULT:
+        return "default";
+    case HTTP_LANE_HEAVY:
+        return "heavy";
+    default:
+        return "unknown";
+    }
+}
+
+std::map<std::string, HTTPWorkStats> GetHTTPWorkStats()
+{
+    if (!workQueue) {
+        return {};
+    }
+    return workQueue->GetStats();
+}
+
 static void httpevent_callback_fn(evutil_socket_t, short, void* data)
 {
     // Static handler: simply call inner handler
@@ -560,6 +593,19 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+std::string HTTPRequest::PeekBody(size_t nMaxSize)
+{
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return "";
+    std::string rv(std::min(evbuffer_get_length(buf), nMaxSize), '\0');
+    if (rv.empty())
+        return rv;
+    ev_ssize_t nCopied = evbuffer_copyout(buf, &rv[0], rv.size());
+    rv.resize(nCopied > 0 ? nCopied : 0);
+    return rv;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -575,13 +621,60 @@ void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
 {
     assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    evbuffer_add(evb, strReply.data(), strReply.size());
+    SendReply(nStatus);
+}
+
+void HTTPRequest::WriteReply(int nStatus, std::vector<unsigned char>&& vchReply)
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    if (!vchReply.empty()) {
+        // libevent references the data until it has been written to the socket
+        // and frees it afterwards through the cleanup callback
+        auto* pvch = new std::vector<unsigned char>(std::move(vchReply));
+        auto cleanup = [](const void*, size_t, void* arg) {
+            delete static_cast<std::vector<unsigned char>*>(arg);
+        };
+        if (evbuffer_add_reference(evb, pvch->data(), pvch->size(), cleanup, pvch) != 0) {
+            evbuffer_add(evb, pvch->data(), pvch->size());
+            delete pvch;
+        }
+    }
+    SendReply(nStatus);
+}
+
+bool HTTPRequest::WriteReplyFile(int nStatus, FILE* file, int64_t nOffset, int64_t nLength)
+{
+    assert(!replySent && req);
+    if (!file || nOffset < 0 || nLength < 0) {
+        return false;
+    }
+    // evbuffer_add_file() takes ownership of the descriptor, keep the caller's FILE* intact
+    int fd = dup(fileno(file));
+    if (fd < 0) {
+        return false;
+    }
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    if (evbuffer_add_file(evb, fd, nOffset, nLength) != 0) {
+        // on failure the descriptor is left open
+        close(fd);
+        return false;
+    }
+    SendReply(nStatus);
+    return true;
+}
+
+void HTTPRequest::SendReply(int nStatus)
+{
     if (ShutdownRequested()) {
         WriteHeader("Connection", "close");
     }
     // Send event to main http thread to send reply message
-    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
-    assert(evb);
-    evbuffer_add(evb, strReply.data(), strReply.size());
     auto req_copy = req;
     HTTPEvent* ev = new HTTPEvent(eventBase, true, [req_copy, nStatus]{
         evhttp_send_reply(req_copy, nStatus, nullptr, nullptr);
@@ -642,10 +735,10 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier)
 {
     LogPrint(BCLog::HTTP, "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
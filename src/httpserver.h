@@ -6,14 +6,28 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <array>
+#include <map>
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <vector>
+#include <stdio.h>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
+/** Lanes of the HTTP work queue. Workers serve lower numbered lanes first and
+ * never hand all of their threads to lanes other than HTTP_LANE_PRIORITY.
+ */
+enum HTTPWorkLane {
+    HTTP_LANE_PRIORITY = 0,
+    HTTP_LANE_DEFAULT,
+    HTTP_LANE_HEAVY,
+    HTTP_LANE_COUNT
+};
+
 struct evhttp_request;
 struct event_base;
 class CService;
@@ -39,11 +53,16 @@ bool UpdateHTTPServerLogging(bool enable);
 
 /** Handler for requests to a certain HTTP path */
 typedef std::function<bool(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Returns the name a request is scheduled and accounted under (e.g. its RPC method).
+ * Called on the HTTP event loop thread, so it must be cheap.
+ */
+typedef std::function<std::string(HTTPRequest* req)> HTTPRequestClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
- * be invoked.
+ * be invoked. Requests are scheduled under the name returned by classifier,
+ * or under the prefix if there is no classifier.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier = nullptr);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
@@ -52,6 +71,42 @@ void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
  */
 struct event_base* EventBase();
 
+/** Histogram of work queue timings */
+struct HTTPTimingHistogram
+{
+    /** Upper bounds (exclusive) of all but the last bucket, in milliseconds */
+    static const std::array<int64_t, 8> BUCKET_LIMITS_MS;
+
+    std::array<uint64_t, 9> buckets{};
+    int64_t nTotalMicros{0};
+    int64_t nMaxMicros{0};
+
+    void Add(int64_t nMicros);
+};
+
+/** Work queue statistics of all requests scheduled under the same name */
+struct HTTPWorkStats
+{
+    HTTPWorkLane lane{HTTP_LANE_DEFAULT};
+    //! Maximum number of concurrently executing requests, 0 means no limit
+    size_t nMaxActive{0};
+    size_t nActive{0};
+    size_t nQueued{0};
+    uint64_t nCalls{0};
+    uint64_t nRejected{0};
+    HTTPTimingHistogram queueWait;
+    HTTPTimingHistogram execution;
+};
+
+std::string HTTPWorkLaneName(HTTPWorkLane lane);
+/** Lanes and concurrency limits of request names: the built-in defaults, adjusted by
+ * -rpcprioritymethod, -rpcheavymethod and -rpcmethodlimit. Returns false on an invalid
+ * -rpcmethodlimit.
+ */
+bool InitHTTPWorkLanes(std::map<std::string, HTTPWorkLane>& laneByName, std::map<std::string, size_t>& maxActiveByName);
+/** Return work queue statistics by request name */
+std::map<std::string, HTTPWorkStats> GetHTTPWorkStats();
+
 /** In-flight HTTP request.
  * Thin C++ wrapper around evhttp_request.
  */
@@ -99,6 +154,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Copy (at most nMaxSize bytes of) the start of the request body without
+     * consuming it.
+     */
+    std::string PeekBody(size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -115,6 +176,28 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write HTTP reply, handing the body buffer over to libevent instead of
+     * copying it.
+     *
+     * @note Same restrictions as WriteReply(int, const std::string&).
+     */
+    void WriteReply(int nStatus, std::vector<unsigned char>&& vchReply);
+
+    /**
+     * Write HTTP reply with nLength bytes at nOffset of file as body. The data is
+     * sent straight from the file (using sendfile() or mmap() where libevent
+     * supports it) and never copied into the process. The caller keeps
+     * ownership of file, it may be closed right after this returns.
+     *
+     * Returns false without sending anything if the file could not be attached,
+     * the request can then still be answered with WriteReply.
+     */
+    bool WriteReplyFile(int nStatus, FILE* file, int64_t nOffset, int64_t nLength);
+
+private:
+    void SendReply(int nStatus);
 };
 
 /** Event handler closure.
@@ -0,0 +1,206 @@
+// Copyright (c) 2015 The Bitcoin Core developers
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_HTTPWORKQUEUE_H
+#define COSANTA_HTTPWORKQUEUE_H
+
+#include "httpserver.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/** Work queue for distributing work over multiple threads.
+ * Work items are kept in one FIFO per lane and need to provide name, lane and
+ * nEnqueueTime members. Workers take the first runnable item of the highest
+ * priority lane. Items whose name reached its concurrency limit stay queued
+ * until another item with the same name finishes. Lanes other than
+ * HTTP_LANE_PRIORITY may only occupy all but one worker thread, so cheap calls
+ * are still served while slow calls pile up.
+ *
+ * The lanes share a total depth of maxDepth queued items. A quarter of it is
+ * kept free for HTTP_LANE_PRIORITY, HTTP_LANE_HEAVY may fill at most half of
+ * the remainder.
+ */
+template <typename WorkItem>
+class WorkQueue
+{
+private:
+    /** Mutex protects entire object */
+    std::mutex cs;
+    std::condition_variable cond;
+    std::array<std::deque<std::unique_ptr<WorkItem>>, HTTP_LANE_COUNT> queues;
+    std::array<size_t, HTTP_LANE_COUNT> nActiveByLane{};
+    bool running;
+    //! Maximum number of queued items of all lanes together
+    size_t maxDepth;
+    size_t maxDepthNonPriority;
+    size_t maxDepthHeavy;
+    //! Maximum number of threads working on lanes other than HTTP_LANE_PRIORITY
+    size_t maxActiveNonPriority;
+    size_t maxActiveHeavy;
+    std::map<std::string, HTTPWorkLane> laneByName;
+    std::map<std::string, size_t> maxActiveByName;
+    std::map<std::string, HTTPWorkStats> stats;
+
+    HTTPWorkStats& GetStats(const std::string& name)
+    {
+        auto it = stats.find(name);
+        if (it == stats.end()) {
+            it = stats.emplace(name, HTTPWorkStats()).first;
+            auto itLane = laneByName.find(name);
+            it->second.lane = itLane != laneByName.end() ? itLane->second : HTTP_LANE_DEFAULT;
+            auto itMax = maxActiveByName.find(name);
+            it->second.nMaxActive = itMax != maxActiveByName.end() ? itMax->second : 0;
+        }
+        return it->second;
+    }
+
+    /** Precondition: cs is held */
+    bool HasRoom(HTTPWorkLane lane) const
+    {
+        size_t nNonPriority = queues[HTTP_LANE_DEFAULT].size() + queues[HTTP_LANE_HEAVY].size();
+        if (nNonPriority + queues[HTTP_LANE_PRIORITY].size() >= maxDepth) {
+            return false;
+        }
+        if (lane == HTTP_LANE_PRIORITY) {
+            return true;
+        }
+        if (nNonPriority >= maxDepthNonPriority) {
+            return false;
+        }
+        return lane != HTTP_LANE_HEAVY || queues[HTTP_LANE_HEAVY].size() < maxDepthHeavy;
+    }
+
+    /** Precondition: cs is held */
+    bool IsLaneRunnable(int lane) const
+    {
+        if (lane == HTTP_LANE_PRIORITY) {
+            return true;
+        }
+        if (nActiveByLane[HTTP_LANE_DEFAULT] + nActiveByLane[HTTP_LANE_HEAVY] >= maxActiveNonPriority) {
+            return false;
+        }
+        return lane != HTTP_LANE_HEAVY || nActiveByLane[HTTP_LANE_HEAVY] < maxActiveHeavy;
+    }
+
+    /** Precondition: cs is held */
+    std::unique_ptr<WorkItem> PopRunnable()
+    {
+        for (int lane = 0; lane < HTTP_LANE_COUNT; lane++) {
+            if (!IsLaneRunnable(lane)) {
+                continue;
+            }
+            auto& queue = queues[lane];
+            for (auto it = queue.begin(); it != queue.end(); ++it) {
+                HTTPWorkStats& s = GetStats((*it)->name);
+                if (s.nMaxActive != 0 && s.nActive >= s.nMaxActive) {
+                    continue;
+                }
+                std::unique_ptr<WorkItem> item = std::move(*it);
+                queue.erase(it);
+                s.nQueued--;
+                s.nActive++;
+                s.queueWait.Add(GetTimeMicros() - item->nEnqueueTime);
+                nActiveByLane[lane]++;
+                return item;
+            }
+        }
+        return nullptr;
+    }
+
+public:
+    WorkQueue(size_t _maxDepth, size_t nThreads, const std::map<std::string, HTTPWorkLane>& _laneByName, const std::map<std::string, size_t>& _maxActiveByName) :
+        running(true),
+        maxDepth(_maxDepth),
+        maxDepthNonPriority(_maxDepth > 1 ? _maxDepth - std::max(_maxDepth / 4, (size_t)1) : _maxDepth),
+        maxDepthHeavy(std::max(maxDepthNonPriority / 2, (size_t)1)),
+        maxActiveNonPriority(std::max(nThreads, (size_t)2) - 1),
+        maxActiveHeavy(std::max(nThreads / 2, (size_t)1)),
+        laneByName(_laneByName),
+        maxActiveByName(_maxActiveByName)
+    {
+    }
+    /** Precondition: worker threads have all stopped (they have been joined).
+     */
+    ~WorkQueue()
+    {
+    }
+    /** Enqueue a work item */
+    bool Enqueue(WorkItem* item)
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        HTTPWorkStats& s = GetStats(item->name);
+        if (!HasRoom(s.lane)) {
+            s.nRejected++;
+            return false;
+        }
+        item->lane = s.lane;
+        item->nEnqueueTime = GetTimeMicros();
+        s.nQueued++;
+        queues[s.lane].emplace_back(std::unique_ptr<WorkItem>(item));
+        cond.notify_one();
+        return true;
+    }
+    /** Take the next runnable item without waiting, nullptr if there is none.
+     * The caller must hand the item to Finish() once it has been executed.
+     */
+    std::unique_ptr<WorkItem> TryPop()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return PopRunnable();
+    }
+    /** Account an item returned by TryPop() as done */
+    void Finish(const WorkItem& item, int64_t nTime)
+    {
+        {
+            std::unique_lock<std::mutex> lock(cs);
+            HTTPWorkStats& s = GetStats(item.name);
+            s.nActive--;
+            s.nCalls++;
+            s.execution.Add(nTime);
+            nActiveByLane[item.lane]--;
+        }
+        // a lane or name limit might have been lifted
+        cond.notify_all();
+    }
+    /** Thread function */
+    void Run()
+    {
+        while (true) {
+            std::unique_ptr<WorkItem> i;
+            {
+                std::unique_lock<std::mutex> lock(cs);
+                while (running && !(i = PopRunnable()))
+                    cond.wait(lock);
+                if (!running)
+                    break;
+            }
+            int64_t nStart = GetTimeMicros();
+            (*i)();
+            Finish(*i, GetTimeMicros() - nStart);
+        }
+    }
+    /** Interrupt and exit loops */
+    void Interrupt()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        running = false;
+        cond.notify_all();
+    }
+    std::map<std::string, HTTPWorkStats> GetStats()
+    {
+        std::unique_lock<std::mutex> lock(cs);
+        return stats;
+    }
+};
+
+#endif // COSANTA_HTTPWORKQUEUE_H
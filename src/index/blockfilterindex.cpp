@@ -0,0 +1,275 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/blockfilterindex.h"
+
+#include "chain.h"
+#include "ctpl.h"
+#include "util.h"
+#include "validation.h"
+
+#include <future>
+
+static const char DB_FILTER = 'f';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<CBlockFilterIndex> blockFilterIndex;
+
+CBlockFilterIndex::CBlockFilterIndex(BlockFilterType _filterType, size_t nCacheSize, bool fMemory, bool fWipe) :
+    filterType(_filterType)
+{
+    const std::string& name = BlockFilterTypeName(filterType);
+    if (name.empty()) {
+        throw std::invalid_argument("unknown filter_type");
+    }
+    db.reset(new CDBWrapper(GetDataDir() / "indexes" / "blockfilter" / name, nCacheSize, fMemory, fWipe));
+}
+
+CBlockFilterIndex::~CBlockFilterIndex()
+{
+    Stop();
+}
+
+bool CBlockFilterIndex::Start()
+{
+    CBlockLocator locator;
+    if (db->Exists(DB_BEST_BLOCK) && !db->Read(DB_BEST_BLOCK, locator)) {
+        return error("%s: failed to read the best block of the %s block filter index", __func__, BlockFilterTypeName(filterType));
+    }
+
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = locator.IsNull() ? nullptr : FindForkInGlobalIndex(chainActive, locator);
+        uint256 header;
+        if (pindex && !LookupFilterHeader(pindex, header)) {
+            return error("%s: filter header of block %s not found", __func__, pindex->GetBlockHash().ToString());
+        }
+        LOCK(cs);
+        pindexBest = pindex;
+        bestHeader = header;
+    }
+
+    interrupt.reset();
+    RegisterValidationInterface(this);
+    syncThread = std::thread(&TraceThread<std::function<void()> >, "blkfilter", std::function<void()>(std::bind(&CBlockFilterIndex::ThreadSync, this)));
+    return true;
+}
+
+void CBlockFilterIndex::Interrupt()
+{
+    interrupt();
+}
+
+void CBlockFilterIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+    Interrupt();
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+}
+
+const CBlockIndex* CBlockFilterIndex::GetBestBlock() const
+{
+    LOCK(cs);
+    return pindexBest;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, CBlockFilter& filterOut) const
+{
+    std::pair<std::vector<unsigned char>, uint256> entry;
+    if (!db->Read(std::make_pair(DB_FILTER, pindex->GetBlockHash()), entry)) {
+        return false;
+    }
+    try {
+        filterOut = CBlockFilter(filterType, pindex->GetBlockHash(), std::move(entry.first));
+    } catch (const std::exception& e) {
+        return error("%s: invalid filter of block %s: %s", __func__, pindex->GetBlockHash().ToString(), e.what());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilterHeader(const CBlockIndex* pindex, uint256& headerOut) const
+{
+    std::pair<std::vector<unsigned char>, uint256> entry;
+    if (!db->Read(std::make_pair(DB_FILTER, pindex->GetBlockHash()), entry)) {
+        return false;
+    }
+    headerOut = entry.second;
+    return true;
+}
+
+bool CBlockFilterIndex::BuildFilter(const CBlockIndex* pindex, const CDiskBlockPos& pos, const CDiskBlockPos& undoPos, CBlockFilter& filterOut) const
+{
+    CBlock block;
+    if (!ReadValidatedBlockFromDisk(block, pos, pindex->GetBlockHash())) {
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    // the genesis block has no undo data
+    CBlockUndo blockUndo;
+    if (pindex->pprev && !UndoReadFromDisk(blockUndo, undoPos, pindex->pprev->GetBlockHash())) {
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    filterOut = CBlockFilter(filterType, block, blockUndo);
+    return true;
+}
+
+bool CBlockFilterIndex::WriteFilters(const std::vector<const CBlockIndex*>& vBlocks, const std::vector<CBlockFilter>& vFilters)
+{
+    assert(!vBlocks.empty() && vBlocks.size() == vFilters.size());
+
+    uint256 header;
+    {
+        LOCK(cs);
+        if (vBlocks.front()->pprev != pindexBest) {
+            return error("%s: block %s does not connect to the best indexed block", __func__, vBlocks.front()->GetBlockHash().ToString());
+        }
+        header = bestHeader;
+    }
+
+    CDBBatch batch(*db);
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        header = vFilters[i].ComputeHeader(header);
+        batch.Write(std::make_pair(DB_FILTER, vBlocks[i]->GetBlockHash()), std::make_pair(vFilters[i].GetEncodedFilter(), header));
+    }
+    {
+        LOCK(cs_main);
+        batch.Write(DB_BEST_BLOCK, chainActive.GetLocator(vBlocks.back()));
+    }
+    db->WriteBatch(batch);
+
+    LOCK(cs);
+    pindexBest = vBlocks.back();
+    bestHeader = header;
+    return true;
+}
+
+bool CBlockFilterIndex::WriteBestBlock(const CBlockIndex* pindex, const uint256& header)
+{
+    {
+        LOCK(cs_main);
+        db->Write(DB_BEST_BLOCK, chainActive.GetLocator(pindex));
+    }
+
+    LOCK(cs);
+    pindexBest = pindex;
+    bestHeader = header;
+    return true;
+}
+
+void CBlockFilterIndex::ThreadSync()
+{
+    ctpl::thread_pool workerPool(std::max(1, std::min(GetNumCores(), MAX_BLOCKFILTERINDEX_THREADS)));
+    RenameThreadPool(workerPool, "cosanta-blkfilter");
+
+    int64_t nLastLogTime = 0;
+    while (!interrupt) {
+        std::vector<const CBlockIndex*> vBlocks;
+        std::vector<std::pair<CDiskBlockPos, CDiskBlockPos> > vPos;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindex = GetBestBlock();
+            if (pindex && !chainActive.Contains(pindex)) {
+                // the best indexed block was disconnected, continue from the fork point
+                const CBlockIndex* pindexFork = chainActive.FindFork(pindex);
+                uint256 header;
+                if (pindexFork && !LookupFilterHeader(pindexFork, header)) {
+                    error("%s: filter header of block %s not found", __func__, pindexFork->GetBlockHash().ToString());
+                    return;
+                }
+                WriteBestBlock(pindexFork, header);
+                pindex = pindexFork;
+            }
+
+            const CBlockIndex* pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+            if (!pindexNext) {
+                // Blocks connected from now on are indexed by BlockConnected. Notifications
+                // of blocks which are already indexed are ignored there.
+                fSynced = true;
+                LogPrintf("%s block filter index is enabled at height %d\n", BlockFilterTypeName(filterType), pindex ? pindex->nHeight : -1);
+                return;
+            }
+
+            for (; pindexNext && vBlocks.size() < BLOCKFILTERINDEX_SYNC_BATCH; pindexNext = chainActive.Next(pindexNext)) {
+                vBlocks.push_back(pindexNext);
+                vPos.emplace_back(pindexNext->GetBlockPos(), pindexNext->GetUndoPos());
+            }
+        }
+
+        // Filters are independent of each other, only the headers chain them together
+        std::vector<CBlockFilter> vFilters(vBlocks.size());
+        std::vector<std::future<bool> > vFutures;
+        vFutures.reserve(vBlocks.size());
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            vFutures.emplace_back(workerPool.push([this, &vBlocks, &vPos, &vFilters, i](int) {
+                return BuildFilter(vBlocks[i], vPos[i].first, vPos[i].second, vFilters[i]);
+            }));
+        }
+        bool fOk = true;
+        for (auto& future : vFutures) {
+            fOk &= future.get();
+        }
+        if (!fOk) {
+            LogPrintf("%s: failed to build block filters, the %s block filter index is not synced\n", __func__, BlockFilterTypeName(filterType));
+            return;
+        }
+
+        if (!WriteFilters(vBlocks, vFilters)) {
+            return;
+        }
+
+        if (GetTime() >= nLastLogTime + 30) {
+            LogPrintf("Syncing %s block filter index with block chain from height %d\n", BlockFilterTypeName(filterType), vBlocks.back()->nHeight);
+            nLastLogTime = GetTime();
+        }
+    }
+}
+
+void CBlockFilterIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted)
+{
+    if (!fSynced) {
+        return;
+    }
+
+    const CBlockIndex* pindexPrev = GetBestBlock();
+    if (pindexPrev != pindex->pprev) {
+        if (pindexPrev && pindexPrev->GetAncestor(pindex->nHeight) == pindex) {
+            // already indexed by the initial sync
+            return;
+        }
+        LogPrintf("%s: WARNING: block %s does not connect to the best indexed block %s, not updating the index\n", __func__,
+                  pindex->GetBlockHash().ToString(), pindexPrev ? pindexPrev->GetBlockHash().ToString() : "null");
+        return;
+    }
+
+    CBlockUndo blockUndo;
+    if (pindex->pprev) {
+        CDiskBlockPos undoPos;
+        {
+            LOCK(cs_main);
+            undoPos = pindex->GetUndoPos();
+        }
+        if (!UndoReadFromDisk(blockUndo, undoPos, pindex->pprev->GetBlockHash())) {
+            error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    WriteFilters({pindex}, {CBlockFilter(filterType, *block, blockUndo)});
+}
+
+void CBlockFilterIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindexDisconnected)
+{
+    if (!fSynced || GetBestBlock() != pindexDisconnected) {
+        return;
+    }
+
+    // filters are stored by block hash, only the best block moves back
+    uint256 header;
+    if (!LookupFilterHeader(pindexDisconnected->pprev, header)) {
+        error("%s: filter header of block %s not found", __func__, pindexDisconnected->pprev->GetBlockHash().ToString());
+        return;
+    }
+    WriteBestBlock(pindexDisconnected->pprev, header);
+}
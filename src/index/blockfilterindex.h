@@ -0,0 +1,95 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_INDEX_BLOCKFILTERINDEX_H
+#define COSANTA_INDEX_BLOCKFILTERINDEX_H
+
+#include "blockfilter.h"
+#include "dbwrapper.h"
+#include "sync.h"
+#include "threadinterrupt.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class CBlockIndex;
+struct CDiskBlockPos;
+
+static const bool DEFAULT_BLOCKFILTERINDEX = false;
+//! Max memory allocated to the block filter index database cache in MiB
+static const int64_t nMaxBlockFilterIndexCache = 1024;
+//! Number of blocks the initial sync builds filters for at once
+static const unsigned int BLOCKFILTERINDEX_SYNC_BATCH = 1000;
+//! Maximum number of threads building filters during the initial sync
+static const int MAX_BLOCKFILTERINDEX_THREADS = 8;
+
+/**
+ * Maintains a compact block filter (BIP 157/158) and filter header for every
+ * block of the active chain in its own database.
+ *
+ * Filters of existing blocks are built by a background thread, which reads
+ * blocks and their undo data and builds the filters of a batch of blocks in
+ * parallel. Once it has caught up with the tip, new blocks are indexed from the
+ * BlockConnected notification. Filters are stored by block hash, so entries of
+ * blocks which were disconnected stay valid.
+ */
+class CBlockFilterIndex final : public CValidationInterface
+{
+private:
+    const BlockFilterType filterType;
+    std::unique_ptr<CDBWrapper> db;
+
+    mutable CCriticalSection cs;
+    //! The last block of the active chain which has been indexed
+    const CBlockIndex* pindexBest{nullptr};
+    //! The filter header of pindexBest
+    uint256 bestHeader;
+
+    //! Whether the initial sync has caught up with the tip, updates come from BlockConnected afterwards
+    std::atomic<bool> fSynced{false};
+
+    std::thread syncThread;
+    CThreadInterrupt interrupt;
+
+    void ThreadSync();
+
+    /** Build the filter of a block of the active chain */
+    bool BuildFilter(const CBlockIndex* pindex, const CDiskBlockPos& pos, const CDiskBlockPos& undoPos, CBlockFilter& filterOut) const;
+
+    /** Write filters of consecutive blocks following pindexBest and make the last one the best block */
+    bool WriteFilters(const std::vector<const CBlockIndex*>& vBlocks, const std::vector<CBlockFilter>& vFilters);
+
+    bool WriteBestBlock(const CBlockIndex* pindex, const uint256& header);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindexDisconnected) override;
+
+public:
+    CBlockFilterIndex(BlockFilterType filterType, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CBlockFilterIndex();
+
+    /** Load the best block, register for validation notifications and start the sync thread */
+    bool Start();
+    void Interrupt();
+    /** Stop the sync thread and unregister from validation notifications */
+    void Stop();
+
+    BlockFilterType GetFilterType() const { return filterType; }
+    bool IsSynced() const { return fSynced; }
+    const CBlockIndex* GetBestBlock() const;
+
+    /** Get the filter of a block, returns false if it has not been indexed (yet) */
+    bool LookupFilter(const CBlockIndex* pindex, CBlockFilter& filterOut) const;
+    bool LookupFilterHeader(const CBlockIndex* pindex, uint256& headerOut) const;
+};
+
+/** The basic block filter index, only set if -blockfilterindex is enabled */
+extern std::unique_ptr<CBlockFilterIndex> blockFilterIndex;
+
+#endif // COSANTA_INDEX_BLOCKFILTERINDEX_H
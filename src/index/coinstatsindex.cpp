@@ -0,0 +1,389 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "index/coinstatsindex.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "ctpl.h"
+#include "streams.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+
+#include <future>
+
+static const char DB_STATS = 's';
+static const char DB_BEST_BLOCK = 'B';
+
+std::unique_ptr<CCoinStatsIndex> coinStatsIndex;
+
+void MuHashCoin(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin, bool fRemove)
+{
+    // the serialization is the same when the output is created and when it is spent
+    std::vector<unsigned char> data;
+    uint32_t code = coin.nHeight * 4 + (coin.fCoinBase ? 2u : 0u) + (coin.fCoinStake ? 1u : 0u);
+    CVectorWriter{SER_DISK, 0, data, 0, outpoint, code, coin.out};
+    if (fRemove) {
+        muhash.Remove(data.data(), data.size());
+    } else {
+        muhash.Insert(data.data(), data.size());
+    }
+}
+
+static uint64_t GetBogoSize(const CScript& scriptPubKey)
+{
+    return 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+           2 /* scriptPubKey len */ + scriptPubKey.size() /* scriptPubKey */;
+}
+
+CCoinStatsIndex::CCoinStatsIndex(size_t nCacheSize, bool fMemory, bool fWipe)
+{
+    db.reset(new CDBWrapper(GetDataDir() / "indexes" / "coinstats", nCacheSize, fMemory, fWipe));
+}
+
+CCoinStatsIndex::~CCoinStatsIndex()
+{
+    Stop();
+}
+
+bool CCoinStatsIndex::Start()
+{
+    std::pair<uint256, MuHash3072> best;
+    if (db->Exists(DB_BEST_BLOCK) && !db->Read(DB_BEST_BLOCK, best)) {
+        return error("%s: failed to read the best block of the coin stats index", __func__);
+    }
+
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindex = nullptr;
+        if (!best.first.IsNull()) {
+            BlockMap::const_iterator it = mapBlockIndex.find(best.first);
+            if (it == mapBlockIndex.end()) {
+                return error("%s: best block %s of the coin stats index not found", __func__, best.first.ToString());
+            }
+            pindex = it->second;
+        }
+        CCoinStatsIndexEntry entry;
+        if (pindex && !LookupStats(pindex, entry)) {
+            return error("%s: coin stats of block %s not found", __func__, pindex->GetBlockHash().ToString());
+        }
+        // A best block which is not part of the active chain anymore is rewound by the sync thread
+        LOCK(cs);
+        pindexBest = pindex;
+        bestEntry = entry;
+        bestMuHash = best.second;
+    }
+
+    interrupt.reset();
+    RegisterValidationInterface(this);
+    syncThread = std::thread(&TraceThread<std::function<void()> >, "coinstats", std::function<void()>(std::bind(&CCoinStatsIndex::ThreadSync, this)));
+    return true;
+}
+
+void CCoinStatsIndex::Interrupt()
+{
+    interrupt();
+}
+
+void CCoinStatsIndex::Stop()
+{
+    UnregisterValidationInterface(this);
+    Interrupt();
+    if (syncThread.joinable()) {
+        syncThread.join();
+    }
+}
+
+const CBlockIndex* CCoinStatsIndex::GetBestBlock() const
+{
+    LOCK(cs);
+    return pindexBest;
+}
+
+bool CCoinStatsIndex::LookupStats(const CBlockIndex* pindex, CCoinStatsIndexEntry& entryOut) const
+{
+    return db->Read(std::make_pair(DB_STATS, pindex->GetBlockHash()), entryOut);
+}
+
+bool CCoinStatsIndex::ApplyBlock(const CBlock& block, const CBlockUndo& blockUndo, int nHeight, BlockDelta& deltaOut)
+{
+    // the outputs of the genesis block are not added to the UTXO set
+    if (nHeight == 0) {
+        return true;
+    }
+    if (block.vtx.empty() || blockUndo.vtxundo.size() != block.vtx.size() - 1) {
+        return false;
+    }
+
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        const bool fCoinBase = tx.IsCoinBase();
+        const bool fCoinStake = tx.IsCoinStake();
+
+        for (uint32_t j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& out = tx.vout[j];
+            if (out.scriptPubKey.IsUnspendable()) {
+                continue;
+            }
+            MuHashCoin(deltaOut.muhash, COutPoint(tx.GetHash(), j), Coin(out, nHeight, fCoinBase, fCoinStake), false);
+            deltaOut.nTransactionOutputs++;
+            deltaOut.nBogoSize += GetBogoSize(out.scriptPubKey);
+            deltaOut.nTotalAmount += out.nValue;
+        }
+
+        if (fCoinBase) {
+            continue;
+        }
+        const CTxUndo& txUndo = blockUndo.vtxundo[i - 1];
+        if (txUndo.vprevout.size() != tx.vin.size()) {
+            return false;
+        }
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin& coin = txUndo.vprevout[j];
+            MuHashCoin(deltaOut.muhash, tx.vin[j].prevout, coin, true);
+            deltaOut.nTransactionOutputs--;
+            deltaOut.nBogoSize -= GetBogoSize(coin.out.scriptPubKey);
+            deltaOut.nTotalAmount -= coin.out.nValue;
+        }
+    }
+    return true;
+}
+
+bool CCoinStatsIndex::ComputeDelta(const CBlockIndex* pindex, const CDiskBlockPos& pos, const CDiskBlockPos& undoPos, BlockDelta& deltaOut) const
+{
+    CBlock block;
+    if (!ReadValidatedBlockFromDisk(block, pos, pindex->GetBlockHash())) {
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    // the genesis block has no undo data
+    CBlockUndo blockUndo;
+    if (pindex->pprev && !UndoReadFromDisk(blockUndo, undoPos, pindex->pprev->GetBlockHash())) {
+        return error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (!ApplyBlock(block, blockUndo, pindex->nHeight, deltaOut)) {
+        return error("%s: undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool CCoinStatsIndex::WriteBlocks(const std::vector<const CBlockIndex*>& vBlocks, const std::vector<BlockDelta>& vDeltas, ctpl::thread_pool* workerPool)
+{
+    assert(!vBlocks.empty() && vBlocks.size() == vDeltas.size());
+
+    MuHash3072 muhash;
+    CCoinStatsIndexEntry entry;
+    {
+        LOCK(cs);
+        if (vBlocks.front()->pprev != pindexBest) {
+            return error("%s: block %s does not connect to the best indexed block", __func__, vBlocks.front()->GetBlockHash().ToString());
+        }
+        muhash = bestMuHash;
+        entry = bestEntry;
+    }
+
+    // Combining the hashes is cheap, finalizing them computes a modular inverse per block
+    std::vector<MuHash3072> vMuHashes;
+    std::vector<CCoinStatsIndexEntry> vEntries;
+    vMuHashes.reserve(vBlocks.size());
+    vEntries.reserve(vBlocks.size());
+    for (const auto& delta : vDeltas) {
+        muhash *= delta.muhash;
+        entry.nTransactionOutputs += delta.nTransactionOutputs;
+        entry.nBogoSize += delta.nBogoSize;
+        entry.nTotalAmount += delta.nTotalAmount;
+        vMuHashes.push_back(muhash);
+        vEntries.push_back(entry);
+    }
+    if (workerPool) {
+        std::vector<std::future<void> > vFutures;
+        vFutures.reserve(vBlocks.size());
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            vFutures.emplace_back(workerPool->push([&vMuHashes, &vEntries, i](int) {
+                vMuHashes[i].Finalize(vEntries[i].muhash);
+            }));
+        }
+        for (auto& future : vFutures) {
+            future.get();
+        }
+    } else {
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            vMuHashes[i].Finalize(vEntries[i].muhash);
+        }
+    }
+
+    CDBBatch batch(*db);
+    for (size_t i = 0; i < vBlocks.size(); i++) {
+        batch.Write(std::make_pair(DB_STATS, vBlocks[i]->GetBlockHash()), vEntries[i]);
+    }
+    batch.Write(DB_BEST_BLOCK, std::make_pair(vBlocks.back()->GetBlockHash(), muhash));
+    if (!db->WriteBatch(batch)) {
+        return error("%s: failed to write coin stats", __func__);
+    }
+
+    LOCK(cs);
+    pindexBest = vBlocks.back();
+    bestEntry = vEntries.back();
+    bestMuHash = muhash;
+    return true;
+}
+
+bool CCoinStatsIndex::RewindTo(const CBlockIndex* pindexFork)
+{
+    const CBlockIndex* pindex;
+    MuHash3072 muhash;
+    {
+        LOCK(cs);
+        pindex = pindexBest;
+        muhash = bestMuHash;
+    }
+
+    for (; pindex != pindexFork; pindex = pindex->pprev) {
+        CDiskBlockPos pos, undoPos;
+        {
+            LOCK(cs_main);
+            pos = pindex->GetBlockPos();
+            undoPos = pindex->GetUndoPos();
+        }
+        BlockDelta delta;
+        if (!ComputeDelta(pindex, pos, undoPos, delta)) {
+            return false;
+        }
+        muhash /= delta.muhash;
+    }
+
+    // the statistics of the fork point are still stored by its block hash
+    CCoinStatsIndexEntry entry;
+    if (pindex && !LookupStats(pindex, entry)) {
+        return error("%s: coin stats of block %s not found", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (!db->Write(DB_BEST_BLOCK, std::make_pair(pindex ? pindex->GetBlockHash() : uint256(), muhash))) {
+        return error("%s: failed to write the best block", __func__);
+    }
+
+    LOCK(cs);
+    pindexBest = pindex;
+    bestEntry = entry;
+    bestMuHash = muhash;
+    return true;
+}
+
+void CCoinStatsIndex::ThreadSync()
+{
+    ctpl::thread_pool workerPool(std::max(1, std::min(GetNumCores(), MAX_COINSTATSINDEX_THREADS)));
+    RenameThreadPool(workerPool, "cosanta-coinstats");
+
+    int64_t nLastLogTime = 0;
+    while (!interrupt) {
+        std::vector<const CBlockIndex*> vBlocks;
+        std::vector<std::pair<CDiskBlockPos, CDiskBlockPos> > vPos;
+        const CBlockIndex* pindexFork = nullptr;
+        {
+            LOCK(cs_main);
+            const CBlockIndex* pindex = GetBestBlock();
+            if (pindex && !chainActive.Contains(pindex)) {
+                // the best indexed block was disconnected, its changes have to be reverted up to the fork point
+                pindexFork = chainActive.FindFork(pindex);
+            }
+
+            if (!pindexFork) {
+                const CBlockIndex* pindexNext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+                if (!pindexNext) {
+                    // Blocks connected from now on are indexed by BlockConnected. Notifications
+                    // of blocks which are already indexed are ignored there.
+                    fSynced = true;
+                    LogPrintf("coin stats index is enabled at height %d\n", pindex ? pindex->nHeight : -1);
+                    return;
+                }
+
+                for (; pindexNext && vBlocks.size() < COINSTATSINDEX_SYNC_BATCH; pindexNext = chainActive.Next(pindexNext)) {
+                    vBlocks.push_back(pindexNext);
+                    vPos.emplace_back(pindexNext->GetBlockPos(), pindexNext->GetUndoPos());
+                }
+            }
+        }
+
+        if (pindexFork) {
+            if (!RewindTo(pindexFork)) {
+                LogPrintf("%s: failed to rewind the coin stats index to block %s\n", __func__, pindexFork->GetBlockHash().ToString());
+                return;
+            }
+            continue;
+        }
+
+        // The changes of the blocks are independent of each other, only their order matters when combining them
+        std::vector<BlockDelta> vDeltas(vBlocks.size());
+        std::vector<std::future<bool> > vFutures;
+        vFutures.reserve(vBlocks.size());
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            vFutures.emplace_back(workerPool.push([this, &vBlocks, &vPos, &vDeltas, i](int) {
+                return ComputeDelta(vBlocks[i], vPos[i].first, vPos[i].second, vDeltas[i]);
+            }));
+        }
+        bool fOk = true;
+        for (auto& future : vFutures) {
+            fOk &= future.get();
+        }
+        if (!fOk) {
+            LogPrintf("%s: failed to hash blocks, the coin stats index is not synced\n", __func__);
+            return;
+        }
+
+        if (!WriteBlocks(vBlocks, vDeltas, &workerPool)) {
+            return;
+        }
+
+        if (GetTime() >= nLastLogTime + 30) {
+            LogPrintf("Syncing coin stats index with block chain from height %d\n", vBlocks.back()->nHeight);
+            nLastLogTime = GetTime();
+        }
+    }
+}
+
+void CCoinStatsIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted)
+{
+    if (!fSynced) {
+        return;
+    }
+
+    const CBlockIndex* pindexPrev = GetBestBlock();
+    if (pindexPrev != pindex->pprev) {
+        if (pindexPrev && pindexPrev->GetAncestor(pindex->nHeight) == pindex) {
+            // already indexed by the initial sync
+            return;
+        }
+        LogPrintf("%s: WARNING: block %s does not connect to the best indexed block %s, not updating the index\n", __func__,
+                  pindex->GetBlockHash().ToString(), pindexPrev ? pindexPrev->GetBlockHash().ToString() : "null");
+        return;
+    }
+
+    CBlockUndo blockUndo;
+    if (pindex->pprev) {
+        CDiskBlockPos undoPos;
+        {
+            LOCK(cs_main);
+            undoPos = pindex->GetUndoPos();
+        }
+        if (!UndoReadFromDisk(blockUndo, undoPos, pindex->pprev->GetBlockHash())) {
+            error("%s: failed to read undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    BlockDelta delta;
+    if (!ApplyBlock(*block, blockUndo, pindex->nHeight, delta)) {
+        error("%s: undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+        return;
+    }
+    WriteBlocks({pindex}, {delta}, nullptr);
+}
+
+void CCoinStatsIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindexDisconnected)
+{
+    if (!fSynced || GetBestBlock() != pindexDisconnected) {
+        return;
+    }
+
+    RewindTo(pindexDisconnected->pprev);
+}
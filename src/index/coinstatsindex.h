@@ -0,0 +1,141 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_INDEX_COINSTATSINDEX_H
+#define COSANTA_INDEX_COINSTATSINDEX_H
+
+#include "amount.h"
+#include "crypto/muhash.h"
+#include "dbwrapper.h"
+#include "serialize.h"
+#include "sync.h"
+#include "threadinterrupt.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class CBlock;
+class CBlockIndex;
+class CBlockUndo;
+class COutPoint;
+class Coin;
+struct CDiskBlockPos;
+
+namespace ctpl {
+class thread_pool;
+}
+
+static const bool DEFAULT_COINSTATSINDEX = false;
+//! Max memory allocated to the coin stats index database cache in MiB
+static const int64_t nMaxCoinStatsIndexCache = 64;
+//! Number of blocks the initial sync hashes at once
+static const unsigned int COINSTATSINDEX_SYNC_BATCH = 1000;
+//! Maximum number of threads hashing blocks during the initial sync
+static const int MAX_COINSTATSINDEX_THREADS = 8;
+
+/** Statistics of the UTXO set after a block has been connected */
+struct CCoinStatsIndexEntry
+{
+    uint64_t nTransactionOutputs{0};
+    uint64_t nBogoSize{0};
+    CAmount nTotalAmount{0};
+    //! Finalized MuHash3072 of all unspent outputs
+    uint256 muhash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nTransactionOutputs);
+        READWRITE(nBogoSize);
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * Maintains the statistics reported by gettxoutsetinfo for every block of the
+ * active chain, so that they don't have to be computed by walking the whole
+ * chainstate.
+ *
+ * The UTXO set is committed to with a MuHash3072, which is updated with the
+ * outputs created and spent by every block. As the changes of a block are
+ * independent of all other blocks, the background thread of the initial sync
+ * hashes a batch of blocks in parallel and then only combines the results in
+ * order. Once it has caught up with the tip, new blocks are indexed from the
+ * BlockConnected notification and disconnected blocks are divided out of the
+ * running hash again. Entries are stored by block hash, so entries of blocks
+ * which were disconnected stay valid.
+ */
+class CCoinStatsIndex final : public CValidationInterface
+{
+private:
+    /** Changes of the UTXO set by one block */
+    struct BlockDelta
+    {
+        MuHash3072 muhash;
+        int64_t nTransactionOutputs{0};
+        int64_t nBogoSize{0};
+        CAmount nTotalAmount{0};
+    };
+
+    std::unique_ptr<CDBWrapper> db;
+
+    mutable CCriticalSection cs;
+    //! The last block of the active chain which has been indexed
+    const CBlockIndex* pindexBest{nullptr};
+    //! The statistics and the running hash of the UTXO set at pindexBest
+    CCoinStatsIndexEntry bestEntry;
+    MuHash3072 bestMuHash;
+
+    //! Whether the initial sync has caught up with the tip, updates come from BlockConnected afterwards
+    std::atomic<bool> fSynced{false};
+
+    std::thread syncThread;
+    CThreadInterrupt interrupt;
+
+    void ThreadSync();
+
+    static bool ApplyBlock(const CBlock& block, const CBlockUndo& blockUndo, int nHeight, BlockDelta& deltaOut);
+    /** Read a block of the active chain and its undo data and compute its changes of the UTXO set */
+    bool ComputeDelta(const CBlockIndex* pindex, const CDiskBlockPos& pos, const CDiskBlockPos& undoPos, BlockDelta& deltaOut) const;
+
+    /** Apply the changes of consecutive blocks following pindexBest and make the last one the best block */
+    bool WriteBlocks(const std::vector<const CBlockIndex*>& vBlocks, const std::vector<BlockDelta>& vDeltas, ctpl::thread_pool* workerPool);
+
+    /** Revert the changes of the blocks between pindexBest and its ancestor pindexFork */
+    bool RewindTo(const CBlockIndex* pindexFork);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindexDisconnected) override;
+
+public:
+    CCoinStatsIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinStatsIndex();
+
+    /** Load the best block, register for validation notifications and start the sync thread */
+    bool Start();
+    void Interrupt();
+    /** Stop the sync thread and unregister from validation notifications */
+    void Stop();
+
+    bool IsSynced() const { return fSynced; }
+    const CBlockIndex* GetBestBlock() const;
+
+    /** Get the statistics of the UTXO set after a block, returns false if it has not been indexed (yet) */
+    bool LookupStats(const CBlockIndex* pindex, CCoinStatsIndexEntry& entryOut) const;
+};
+
+/** Add an unspent output to the MuHash of a UTXO set, or remove it */
+void MuHashCoin(MuHash3072& muhash, const COutPoint& outpoint, const Coin& coin, bool fRemove);
+
+/** The coin stats index, only set if -coinstatsindex is enabled */
+extern std::unique_ptr<CCoinStatsIndex> coinStatsIndex;
+
+#endif // COSANTA_INDEX_COINSTATSINDEX_H
@@ -22,6 +22,8 @@
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "index/blockfilterindex.h"
+#include "index/coinstatsindex.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -44,6 +46,7 @@
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
+#include "utxosnapshot.h"
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 #ifdef ENABLE_WALLET
@@ -94,7 +97,10 @@
 #include <openssl/crypto.h>
 
 #if ENABLE_ZMQ
+#include "zmq/zmqabstractnotifier.h"
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqpublishnotifier.h"
+#include "zmq/zmqrpc.h"
 #endif
 
 bool fFeeEstimatesInitialized = false;
@@ -106,10 +112,6 @@ static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = nullptr;
-#endif
-
 static CDSNotificationInterface* pdsNotificationInterface = nullptr;
 
 #ifdef WIN32
@@ -201,6 +203,10 @@ void Interrupt(boost::thread_group& threadGroup)
     InterruptREST();
     InterruptTorControl();
     llmq::InterruptLLMQSystem();
+    if (blockFilterIndex)
+        blockFilterIndex->Interrupt();
+    if (coinStatsIndex)
+        coinStatsIndex->Interrupt();
     if (g_connman)
         g_connman->Interrupt();
     threadGroup.interrupt_all();
@@ -249,6 +255,13 @@ void PrepareShutdown()
     peerLogic.reset();
     g_connman.reset();
 
+    if (blockFilterIndex) {
+        blockFilterIndex->Stop();
+    }
+    if (coinStatsIndex) {
+        coinStatsIndex->Stop();
+    }
+
     if (!fLiteMode && !fRPCInWarmup) {
         // STORE DATA CACHES INTO SERIALIZED DAT FILES
         CFlatDB<CMasternodeMetaMan> flatdb1("mncache.dat", "magicMasternodeCache");
@@ -297,10 +310,13 @@ void PrepareShutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+        StopInputPrefetchThreads();
         pcoinsTip.reset();
         pcoinscatcher.reset();
         pcoinsdbview.reset();
         pblocktree.reset();
+        blockFilterIndex.reset();
+        coinStatsIndex.reset();
         llmq::DestroyLLMQSystem();
         deterministicMNManager.reset();
         evoDb.reset();
@@ -364,6 +380,7 @@ void Shutdown()
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    StopDebugLogWriter();
 }
 
 /**
@@ -436,6 +453,7 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadsnapshot=<file>", _("Bootstrap an empty data directory from a UTXO snapshot written by the dumptxoutset rpc call. The blocks below the snapshot are not downloaded and their history is not validated, only load snapshots of a node you trust"));
     strUsage += HelpMessageOpt("-debuglogfile=<file>", strprintf(_("Specify location of debug log file: this can be an absolute path or a path relative to the data directory (default: %s)"), DEFAULT_DEBUGLOGFILE));
     strUsage += HelpMessageOpt("-maxorphantxsize=<n>", strprintf(_("Maximum total size of all orphan transactions in megabytes (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
@@ -446,7 +464,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-syncmempool", strprintf(_("Sync mempool from other nodes on start (default: %u)"), DEFAULT_SYNC_MEMPOOL));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
-    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+    strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification and block input prefetch threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
@@ -464,6 +482,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-specialtxindex", strprintf(_("Maintain an index of special transactions by type and by ProTx, used by getspecialtxes and protx history (default: %u)"), DEFAULT_SPECIALTXINDEX));
+    strUsage += HelpMessageOpt("-coinstatsindex", strprintf(_("Maintain UTXO set statistics and a MuHash of the UTXO set for all blocks, used by the gettxoutsetinfo rpc call (default: %u)"), DEFAULT_COINSTATSINDEX));
+    strUsage += HelpMessageOpt("-blockfilterindex", strprintf(_("Maintain a compact filter index for all blocks, used to speed up wallet rescans and by the getblockfilter rpc call (default: %u)"), DEFAULT_BLOCKFILTERINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open (see the `addnode` RPC command help for more info)"));
@@ -484,6 +505,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-maxreceivebuffer=<n>", strprintf(_("Maximum per-connection receive buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXRECEIVEBUFFER));
     strUsage += HelpMessageOpt("-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)"), DEFAULT_MAXSENDBUFFER));
     strUsage += HelpMessageOpt("-maxtimeadjustment", strprintf(_("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)"), DEFAULT_MAX_TIME_ADJUSTMENT));
+    strUsage += HelpMessageOpt("-msghandthreads=<n>", strprintf(_("Number of threads processing peer messages, messages of LLMQ, governance, spork and MNAUTH are processed concurrently (1 to %d, default: %d)"), MAX_MSGHAND_THREADS, DEFAULT_MSGHAND_THREADS));
     strUsage += HelpMessageOpt("-onion=<ip:port>", strprintf(_("Use separate SOCKS5 proxy to reach peers via Tor hidden services (default: %s)"), "-proxy"));
     strUsage += HelpMessageOpt("-onlynet=<net>", _("Make outgoing connections only through network <net> (ipv4, ipv6 or onion). Incoming connections are not affected by this option. This option can be specified multiple times to allow multiple networks."));
     strUsage += HelpMessageOpt("-permitbaremultisig", strprintf(_("Relay non-P2SH multisig (default: %u)"), DEFAULT_PERMIT_BAREMULTISIG));
@@ -492,6 +514,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
+    strUsage += HelpMessageOpt("-socketevents=<mode>", strprintf(_("Socket events mode, which must be one of: %s (default: %s)"), GetSupportedSocketEventsModes(), DEFAULT_SOCKETEVENTS));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
     strUsage += HelpMessageOpt("-torpassword=<pass>", _("Tor control port password (default: empty)"));
@@ -529,6 +552,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtxlock=<address>", _("Enable publish raw transaction (locked via InstantSend) in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawinstantsenddoublespend=<address>", _("Enable publish raw transactions of attempted InstantSend double spend in <address>"));
+    strUsage += HelpMessageOpt("-zmqpub<type>hwm=<n>", strprintf(_("Set outbound message high water mark for the <type> notifier, e.g. -zmqpubrawblockhwm=<n> (default: %d)"), DEFAULT_ZMQ_SNDHWM));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-zmqqueuesize=<n>", strprintf("Maximum number of notifications waiting to be published, further notifications are dropped (default: %u)", DEFAULT_ZMQ_QUEUE_SIZE));
+    }
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -567,6 +594,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-logthreadnames", strprintf("Add thread names to debug messages (default: %u)", DEFAULT_LOGTHREADNAMES));
+        strUsage += HelpMessageOpt("-logqueuesize=<n>", strprintf("Number of lines queued for the background debug.log writer before lines are dropped, 0 writes synchronously (default: %u)", DEFAULT_LOGQUEUESIZE));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
@@ -644,7 +672,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls, a quarter of it is reserved for the priority lane (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcprioritymethod=<method>", "Serve RPC <method> (or REST path prefix) from the priority lane of the work queue. This option can be specified multiple times");
+        strUsage += HelpMessageOpt("-rpcheavymethod=<method>", "Serve RPC <method> (or REST path prefix) from the heavy lane of the work queue, which never occupies more than half of the -rpcthreads. This option can be specified multiple times");
+        strUsage += HelpMessageOpt("-rpcmethodlimit=<method>:<n>", "Execute at most <n> calls of RPC <method> (or REST path prefix) concurrently. This option can be specified multiple times");
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -999,7 +1030,8 @@ void InitParameterInteraction()
     bool fAdditionalIndexes =
         gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) ||
         gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) ||
-        gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+        gArgs.GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX) ||
+        gArgs.GetBoolArg("-specialtxindex", DEFAULT_SPECIALTXINDEX);
 
     if (fAdditionalIndexes && gArgs.GetArg("-checklevel", DEFAULT_CHECKLEVEL) < 4) {
         gArgs.ForceSetArg("-checklevel", "4");
@@ -1106,6 +1138,15 @@ bool AppInitParameterInteraction()
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX))
+            return InitError(_("Prune mode is incompatible with -blockfilterindex."));
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX))
+            return InitError(_("Prune mode is incompatible with -coinstatsindex."));
+    }
+
+    if (gArgs.IsArgSet("-loadsnapshot")) {
+        if (gArgs.GetBoolArg("-reindex", false) || gArgs.GetBoolArg("-reindex-chainstate", false))
+            return InitError(_("-loadsnapshot is incompatible with -reindex and -reindex-chainstate."));
     }
 
     if (gArgs.IsArgSet("-devnet")) {
@@ -1270,6 +1311,9 @@ bool AppInitParameterInteraction()
 #ifdef ENABLE_WALLET
     RegisterWalletRPC(tableRPC);
 #endif
+#if ENABLE_ZMQ
+    RegisterZMQRPCCommands(tableRPC);
+#endif
 
     nConnectTimeout = gArgs.GetArg("-timeout", DEFAULT_CONNECT_TIMEOUT);
     if (nConnectTimeout <= 0)
@@ -1425,6 +1469,37 @@ bool AppInitParameterInteraction()
         UpdateBudgetParameters(nMasternodePaymentsStartBlock, nBudgetPaymentsStartBlock, nSuperblockStartBlock);
     }
 
+    if (gArgs.IsArgSet("-snapshotparams")) {
+        // Allow adding a UTXO snapshot for testing
+        if (!chainparams.MineBlocksOnDemand()) {
+            return InitError("Snapshot parameters may only be overridden on regtest.");
+        }
+        std::string strSnapshotParams = gArgs.GetArg("-snapshotparams", "");
+        std::vector<std::string> vSnapshotParams;
+        boost::split(vSnapshotParams, strSnapshotParams, boost::is_any_of(":"));
+        if (vSnapshotParams.size() != 4) {
+            return InitError("Snapshot parameters malformed, expecting baseHeight:baseBlockHash:muhash:evohash");
+        }
+        int nBaseHeight;
+        if (!ParseInt32(vSnapshotParams[0], &nBaseHeight) || nBaseHeight < 0) {
+            return InitError(strprintf("Invalid nBaseHeight (%s)", vSnapshotParams[0]));
+        }
+        if (!IsHex(vSnapshotParams[1]) || vSnapshotParams[1].size() != 64) {
+            return InitError(strprintf("Invalid baseBlockHash (%s)", vSnapshotParams[1]));
+        }
+        if (!IsHex(vSnapshotParams[2]) || vSnapshotParams[2].size() != 64) {
+            return InitError(strprintf("Invalid muhash (%s)", vSnapshotParams[2]));
+        }
+        if (!IsHex(vSnapshotParams[3]) || vSnapshotParams[3].size() != 64) {
+            return InitError(strprintf("Invalid evohash (%s)", vSnapshotParams[3]));
+        }
+        UpdateSnapshotParameters(nBaseHeight, uint256S(vSnapshotParams[1]), uint256S(vSnapshotParams[2]), uint256S(vSnapshotParams[3]));
+    }
+
+    if (gArgs.IsArgSet("-loadsnapshot") && chainparams.Snapshots().empty()) {
+        return InitError(_("-loadsnapshot is not available, no UTXO snapshots are known for this network."));
+    }
+
     if (chainparams.NetworkIDString() == CBaseChainParams::DEVNET) {
         int nMinimumDifficultyBlocks = gArgs.GetArg("-minimumdifficultyblocks", chainparams.GetConsensus().nMinimumDifficultyBlocks);
         int nHighSubsidyBlocks = gArgs.GetArg("-highsubsidyblocks", chainparams.GetConsensus().nHighSubsidyBlocks);
@@ -1551,6 +1626,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (nScriptCheckThreads) {
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        // inputs of new blocks are read from the coins database by as many threads
+        StartInputPrefetchThreads(nScriptCheckThreads);
     }
 
     std::vector<std::string> vSporkAddresses;
@@ -1770,6 +1847,16 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nBlockFilterIndexCache = 0;
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        nBlockFilterIndexCache = std::min(nTotalCache / 8, nMaxBlockFilterIndexCache << 20);
+        nTotalCache -= nBlockFilterIndexCache;
+    }
+    int64_t nCoinStatsIndexCache = 0;
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        nCoinStatsIndexCache = std::min(nTotalCache / 8, nMaxCoinStatsIndexCache << 20);
+        nTotalCache -= nCoinStatsIndexCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1778,14 +1865,32 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nEvoDbCache = 1024 * 1024 * 16; // TODO
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    if (nBlockFilterIndexCache > 0) {
+        LogPrintf("* Using %.1fMiB for block filter index database\n", nBlockFilterIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (nCoinStatsIndexCache > 0) {
+        LogPrintf("* Using %.1fMiB for coin stats index database\n", nCoinStatsIndexCache * (1.0 / 1024 / 1024));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
     int64_t nStart = GetTimeMillis();
 
+    // The partial state of an interrupted UTXO snapshot import is wiped before
+    // the import is tried again, it is never used as a chain
+    bool fWipeSnapshot = false;
+    if (!fReindex && fs::exists(GetUTXOSnapshotMarkerPath())) {
+        if (!gArgs.IsArgSet("-loadsnapshot")) {
+            return InitError(_("The import of a UTXO snapshot was interrupted. Restart with -loadsnapshot to import it again, or with -reindex to wipe the partial state."));
+        }
+        LogPrintf("Wiping the partial state of an interrupted UTXO snapshot import\n");
+        fWipeSnapshot = true;
+    }
+
     while (!fLoaded && !fRequestShutdown) {
         bool fReset = fReindex;
+        bool fLoadSnapshot = gArgs.IsArgSet("-loadsnapshot");
         std::string strLoadError;
 
         uiInterface.InitMessage(_("Loading block index..."));
@@ -1797,15 +1902,23 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 pcoinsTip.reset();
                 pcoinsdbview.reset();
                 pcoinscatcher.reset();
-                pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset));
+                pblocktree.reset(new CBlockTreeDB(nBlockTreeDBCache, false, fReset || fWipeSnapshot));
                 llmq::DestroyLLMQSystem();
-                evoDb.reset(new CEvoDB(nEvoDbCache, false, fReset || fReindexChainState));
+                evoDb.reset(new CEvoDB(nEvoDbCache, false, fReset || fReindexChainState || fWipeSnapshot));
                 deterministicMNManager.reset(new CDeterministicMNManager(*evoDb));
 
-                llmq::InitLLMQSystem(*evoDb, &scheduler, false, fReset || fReindexChainState);
+                llmq::InitLLMQSystem(*evoDb, &scheduler, false, fReset || fReindexChainState || fWipeSnapshot);
+
+                if (fWipeSnapshot) {
+                    // the chainstate is only opened after the import, wipe it here
+                    CCoinsViewDB coinsdb(nCoinDBCache, false, true);
+                    fWipeSnapshot = false;
+                }
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
+                    // all databases were wiped, including a partial snapshot import
+                    fs::remove(GetUTXOSnapshotMarkerPath());
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
                     if (fPruneMode)
                         CleanupBlockRevFiles();
@@ -1860,13 +1973,55 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // Check for changed -specialtxindex state
+                if (fSpecialTxIndex != gArgs.GetBoolArg("-specialtxindex", DEFAULT_SPECIALTXINDEX)) {
+                    strLoadError = _("You need to rebuild the database using -reindex to change -specialtxindex");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
-                if (fHavePruned && !fPruneMode) {
+                if (fHavePruned && !fPruneMode && !fSnapshotChain) {
                     strLoadError = _("You need to rebuild the database using -reindex to go back to unpruned mode.  This will redownload the entire blockchain");
                     break;
                 }
 
+                // Import a UTXO snapshot into the empty databases, only tried once
+                // so that a failed import can be followed by a normal sync after -reindex
+                if (fLoadSnapshot) {
+                    fLoadSnapshot = false;
+                    fs::path pathSnapshot(gArgs.GetArg("-loadsnapshot", ""));
+                    std::string strSnapshotError;
+                    if (!mapBlockIndex.empty()) {
+                        // A data directory bootstrapped from the snapshot before is
+                        // used as is, so -loadsnapshot may stay in the config
+                        CUTXOSnapshotMetadata metadata;
+                        if (!ReadUTXOSnapshotMetadata(pathSnapshot, metadata, strSnapshotError)) {
+                            strLoadError = strprintf(_("Error loading UTXO snapshot: %s"), strSnapshotError);
+                            break;
+                        }
+                        BlockMap::iterator it = mapBlockIndex.find(metadata.baseBlockHash);
+                        if (!fSnapshotChain || it == mapBlockIndex.end() || it->second->nHeight != (int)metadata.nBaseHeight) {
+                            strLoadError = _("-loadsnapshot requires an empty data directory");
+                            break;
+                        }
+                        LogPrintf("Skipping the import of UTXO snapshot %s, the snapshot chain contains its base block %s\n",
+                                  pathSnapshot.string(), metadata.baseBlockHash.ToString());
+                    } else {
+                        uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                        if (!LoadUTXOSnapshot(pathSnapshot, nCoinDBCache, strSnapshotError)) {
+                            strLoadError = strprintf(_("Error loading UTXO snapshot: %s"), strSnapshotError);
+                            break;
+                        }
+                        // load the imported block index, this also reads the snapshotchain flag
+                        UnloadBlockIndex();
+                        if (!LoadBlockIndex(chainparams)) {
+                            strLoadError = _("Error loading block database");
+                            break;
+                        }
+                    }
+                }
+
                 // At this point blocktree args are consistent with what's on disk.
                 // If we're not mid-reindex (based on disk + args), add a genesis block on disk
                 // (otherwise we use the one already on disk).
@@ -1983,7 +2138,32 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         ::feeEstimator.Read(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // ********************************************************* Step 7c: start block filter index
+    if (gArgs.GetBoolArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX)) {
+        if (fSnapshotChain) {
+            return InitError(_("-blockfilterindex is not available for a chain loaded from a UTXO snapshot."));
+        }
+        blockFilterIndex.reset(new CBlockFilterIndex(BlockFilterType::BASIC, nBlockFilterIndexCache, false, fReindex));
+        if (!blockFilterIndex->Start()) {
+            return InitError(_("Error opening block filter index database"));
+        }
+    }
+
+    // ********************************************************* Step 7d: start coin stats index
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        if (fSnapshotChain) {
+            return InitError(_("-coinstatsindex is not available for a chain loaded from a UTXO snapshot."));
+        }
+        coinStatsIndex.reset(new CCoinStatsIndex(nCoinStatsIndexCache, false, fReindex));
+        if (!coinStatsIndex->Start()) {
+            return InitError(_("Error opening coin stats index database"));
+        }
+    }
+
     // ********************************************************* Step 8: load wallet
+    // wallets index their denominated outputs while loading
+    CPrivateSend::InitStandardDenominations();
+
 #ifdef ENABLE_WALLET
     if (!OpenWallets())
         return false;
@@ -2003,6 +2183,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // if pruning, unset the service bit and perform the initial blockstore prune
     // after any wallet rescanning has taken place.
+    if (fSnapshotChain && !fPruneMode) {
+        LogPrintf("Unsetting NODE_NETWORK on a chain loaded from a UTXO snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
     if (fPruneMode) {
         LogPrintf("Unsetting NODE_NETWORK on prune mode\n");
         nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
@@ -2085,8 +2269,6 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 #endif // ENABLE_WALLET
 
-    CPrivateSend::InitStandardDenominations();
-
     // ********************************************************* Step 10b: Load cache data
 
     // LOAD SERIALIZED DAT FILES INTO DATA CACHES FOR INTERNAL USE
@@ -2158,6 +2340,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     if (fMasternodeMode) {
         scheduler.scheduleEvery(boost::bind(&CPrivateSendServer::DoMaintenance, boost::ref(privateSendServer), boost::ref(*g_connman)), 1 * 1000);
+        // the thread processing DSSIGNFINALTX verifies as well
+        privateSendServer.StartScriptCheckThreads(threadGroup, std::min(nScriptCheckThreads, MAX_PRIVATESEND_SCRIPTCHECK_THREADS) - 1);
 #ifdef ENABLE_WALLET
     } else if (privateSendClient.fEnablePrivateSend) {
         scheduler.scheduleEvery(boost::bind(&CPrivateSendClientManager::DoMaintenance, boost::ref(privateSendClient), boost::ref(*g_connman)), 1 * 1000);
@@ -2238,6 +2422,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     connOptions.nReceiveFloodSize = 1000*gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
+    connOptions.nMessageHandlerThreads = std::max(1, std::min((int)gArgs.GetArg("-msghandthreads", DEFAULT_MSGHAND_THREADS), MAX_MSGHAND_THREADS));
+
+    std::string strSocketEventsMode = gArgs.GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (!ParseSocketEventsMode(strSocketEventsMode, connOptions.socketEventsMode)) {
+        return InitError(strprintf(_("Invalid -socketevents ('%s') specified. Only these modes are supported: %s"), strSocketEventsMode, GetSupportedSocketEventsModes()));
+    }
+
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
 
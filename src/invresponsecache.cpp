@@ -0,0 +1,80 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "invresponsecache.h"
+
+CInvResponseCache::CInvResponseCache(size_t nMaxEntriesIn, size_t nMaxBytesIn, int64_t nExpireTimeIn) :
+    nMaxEntries(nMaxEntriesIn),
+    nMaxBytes(nMaxBytesIn),
+    nExpireTime(nExpireTimeIn)
+{
+}
+
+void CInvResponseCache::Erase(EntryList::iterator it)
+{
+    stats.nBytes -= it->payload->data.size();
+    mapEntries.erase(it->key);
+    lruList.erase(it);
+}
+
+CSharedNetPayload CInvResponseCache::Get(const CInv& inv, int64_t nNow)
+{
+    LOCK(cs);
+
+    auto mi = mapEntries.find(std::make_pair(inv.hash, inv.type));
+    if (mi == mapEntries.end()) {
+        stats.nMisses++;
+        return nullptr;
+    }
+    auto it = mi->second;
+    if (it->nTime + nExpireTime < nNow) {
+        Erase(it);
+        stats.nMisses++;
+        return nullptr;
+    }
+
+    lruList.splice(lruList.begin(), lruList, it);
+    stats.nHits++;
+    stats.nBytesSaved += it->payload->data.size();
+    return it->payload;
+}
+
+void CInvResponseCache::Insert(const CInv& inv, CSharedNetPayload payload, int64_t nNow)
+{
+    if (payload->data.size() > nMaxBytes) {
+        return;
+    }
+
+    LOCK(cs);
+
+    Key key = std::make_pair(inv.hash, inv.type);
+    auto mi = mapEntries.find(key);
+    if (mi != mapEntries.end()) {
+        Erase(mi->second);
+    }
+
+    stats.nBytes += payload->data.size();
+    lruList.push_front(Entry{key, std::move(payload), nNow});
+    mapEntries.emplace(key, lruList.begin());
+
+    while (!lruList.empty() && (lruList.size() > nMaxEntries || stats.nBytes > nMaxBytes)) {
+        Erase(std::prev(lruList.end()));
+    }
+}
+
+void CInvResponseCache::Clear()
+{
+    LOCK(cs);
+    lruList.clear();
+    mapEntries.clear();
+    stats.nBytes = 0;
+}
+
+CInvResponseCache::Stats CInvResponseCache::GetStats() const
+{
+    LOCK(cs);
+    Stats ret = stats;
+    ret.nEntries = lruList.size();
+    return ret;
+}
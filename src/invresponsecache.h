@@ -0,0 +1,90 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_INVRESPONSECACHE_H
+#define COSANTA_INVRESPONSECACHE_H
+
+#include "net.h"
+#include "protocol.h"
+#include "saltedhasher.h"
+#include "streams.h"
+#include "sync.h"
+#include "uint256.h"
+#include "version.h"
+
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+#include <stdint.h>
+
+/**
+ * Bounded cache of serialized getdata responses, keyed by inventory type and hash.
+ *
+ * Fresh governance votes, recovered sigs or chainlocks are requested by many
+ * peers within seconds. Their payload is serialized once and then handed to the
+ * send queues of all requesting peers by reference. Entries are evicted in LRU
+ * order when the byte or entry limit is hit, and ignored once they are older
+ * than the expiry time. The owner stays responsible for checking that an object
+ * may still be served, the cache only spares the serialization. Only objects
+ * whose network serialization does not depend on the peer's protocol version
+ * may be cached.
+ */
+class CInvResponseCache
+{
+public:
+    struct Stats {
+        size_t nEntries{0};
+        size_t nBytes{0};
+        uint64_t nHits{0};
+        uint64_t nMisses{0};
+        uint64_t nBytesSaved{0};
+    };
+
+private:
+    typedef std::pair<uint256, int> Key;
+
+    struct Entry {
+        Key key;
+        CSharedNetPayload payload;
+        int64_t nTime;
+    };
+    typedef std::list<Entry> EntryList;
+
+    mutable CCriticalSection cs;
+    //! most recently used entries first
+    EntryList lruList;
+    std::unordered_map<Key, EntryList::iterator, StaticSaltedHasher> mapEntries;
+
+    const size_t nMaxEntries;
+    const size_t nMaxBytes;
+    const int64_t nExpireTime;
+
+    Stats stats;
+
+    void Erase(EntryList::iterator it);
+    void Insert(const CInv& inv, CSharedNetPayload payload, int64_t nNow);
+
+public:
+    CInvResponseCache(size_t nMaxEntriesIn, size_t nMaxBytesIn, int64_t nExpireTimeIn);
+
+    /** Returns the cached payload for inv, or nullptr if there is none or it has expired */
+    CSharedNetPayload Get(const CInv& inv, int64_t nNow);
+
+    /** Serializes obj and caches the result for inv */
+    template <typename T>
+    CSharedNetPayload Put(const CInv& inv, const T& obj, int64_t nNow)
+    {
+        std::vector<unsigned char> data;
+        CVectorWriter{SER_NETWORK, PROTOCOL_VERSION, data, 0, obj};
+        auto payload = std::make_shared<const CNetMsgPayload>(std::move(data));
+        Insert(inv, payload, nNow);
+        return payload;
+    }
+
+    void Clear();
+    Stats GetStats() const;
+};
+
+#endif // COSANTA_INVRESPONSECACHE_H
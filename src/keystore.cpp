@@ -26,10 +26,17 @@ bool CBasicKeyStore::GetPubKey(const CKeyID &address, CPubKey &vchPubKeyOut) con
     return true;
 }
 
+uint64_t CBasicKeyStore::GetKeyStoreGeneration() const
+{
+    LOCK(cs_KeyStore);
+    return nKeyStoreGeneration;
+}
+
 bool CBasicKeyStore::AddKeyPubKey(const CKey& key, const CPubKey &pubkey)
 {
     LOCK(cs_KeyStore);
     mapKeys[pubkey.GetID()] = key;
+    nKeyStoreGeneration++;
     return true;
 }
 
@@ -67,6 +74,7 @@ bool CBasicKeyStore::AddCScript(const CScript& redeemScript)
 
     LOCK(cs_KeyStore);
     mapScripts[CScriptID(redeemScript)] = redeemScript;
+    nKeyStoreGeneration++;
     return true;
 }
 
@@ -111,6 +119,7 @@ bool CBasicKeyStore::AddWatchOnly(const CScript &dest)
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey))
         mapWatchKeys[pubKey.GetID()] = pubKey;
+    nKeyStoreGeneration++;
     return true;
 }
 
@@ -121,6 +130,7 @@ bool CBasicKeyStore::RemoveWatchOnly(const CScript &dest)
     CPubKey pubKey;
     if (ExtractPubKey(dest, pubKey))
         mapWatchKeys.erase(pubKey.GetID());
+    nKeyStoreGeneration++;
     return true;
 }
 
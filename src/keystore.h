@@ -60,8 +60,12 @@ protected:
     WatchOnlySet setWatchOnly GUARDED_BY(cs_KeyStore);
     /* the HD chain data model*/
     CHDChain hdChain GUARDED_BY(cs_KeyStore);
+    //! Incremented by every change of the keys, scripts and watch-only entries
+    uint64_t nKeyStoreGeneration GUARDED_BY(cs_KeyStore){0};
 
 public:
+    /** Changes whenever a key, script or watch-only entry is added or removed */
+    uint64_t GetKeyStoreGeneration() const;
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
     bool AddKey(const CKey &key) { return AddKeyPubKey(key, key.GetPubKey()); }
     bool GetPubKey(const CKeyID &address, CPubKey& vchPubKeyOut) const override;
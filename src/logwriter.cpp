@@ -0,0 +1,148 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logwriter.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+CAsyncLogWriter::CAsyncLogWriter(FILE* _file, const fs::path& _path, size_t nQueueSize) :
+    queue(nQueueSize),
+    file(_file),
+    path(_path)
+{
+}
+
+CAsyncLogWriter::~CAsyncLogWriter()
+{
+    Stop();
+}
+
+void CAsyncLogWriter::Start()
+{
+    assert(!writerThread.joinable());
+    fStopRequested = false;
+    writerThread = std::thread(&CAsyncLogWriter::ThreadWriter, this);
+}
+
+void CAsyncLogWriter::Stop()
+{
+    if (!writerThread.joinable()) {
+        return;
+    }
+    fStopRequested = true;
+    cond.notify_one();
+    writerThread.join();
+}
+
+bool CAsyncLogWriter::Write(std::string&& str)
+{
+    if (!queue.TryPush(std::move(str))) {
+        nDroppedLines++;
+        return false;
+    }
+    nQueuedLines++;
+    if (fWriterIdle.load(std::memory_order_relaxed)) {
+        cond.notify_one();
+    }
+    return true;
+}
+
+bool CAsyncLogWriter::Flush(int64_t nTimeoutMillis)
+{
+    if (!writerThread.joinable()) {
+        return false;
+    }
+    uint64_t nTarget = nQueuedLines;
+    int64_t nStart = GetTimeMillis();
+    while (nWrittenLines < nTarget) {
+        if (GetTimeMillis() - nStart >= nTimeoutMillis) {
+            return false;
+        }
+        cond.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void CAsyncLogWriter::WriteUnqueued(const std::string& str, int64_t nTimeoutMillis)
+{
+    int64_t nStart = GetTimeMillis();
+    Flush(nTimeoutMillis);
+
+    std::unique_lock<std::mutex> lock(csFile, std::defer_lock);
+    while (!lock.try_lock()) {
+        if (GetTimeMillis() - nStart >= 2 * nTimeoutMillis) {
+            // the writer is stuck, losing the line would be worse
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    fwrite(str.data(), 1, str.size(), file);
+    fflush(file);
+}
+
+size_t CAsyncLogWriter::WriteBatch(std::string& buf)
+{
+    buf.clear();
+
+    uint64_t nDropped = nDroppedLines;
+    if (nDropped != nReportedDroppedLines) {
+        buf += "*** " + std::to_string(nDropped - nReportedDroppedLines) + " log lines dropped, log queue full ***\n";
+        nReportedDroppedLines = nDropped;
+    }
+
+    size_t nLines = 0;
+    std::string line;
+    while (nLines < MAX_BATCH_LINES && queue.TryPop(line)) {
+        buf += line;
+        nLines++;
+    }
+
+    if (buf.empty()) {
+        return 0;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(csFile);
+        // reopen the log file, if requested
+        if (fReopenDebugLog) {
+            fReopenDebugLog = false;
+            FILE* newFile = fsbridge::freopen(path, "a", file);
+            if (newFile) {
+                file = newFile;
+            }
+        }
+
+        fwrite(buf.data(), 1, buf.size(), file);
+        fflush(file);
+    }
+    nWrittenLines += nLines;
+
+    // the dropped lines notice counts as a batch on its own
+    return std::max(nLines, (size_t)1);
+}
+
+void CAsyncLogWriter::ThreadWriter()
+{
+    RenameThread("cosanta-logwriter");
+
+    std::string buf;
+    buf.reserve(64 * 1024);
+
+    while (true) {
+        if (WriteBatch(buf) != 0) {
+            continue;
+        }
+        if (fStopRequested) {
+            // everything queued before the stop request has been written by now
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(cs);
+        fWriterIdle = true;
+        cond.wait_for(lock, std::chrono::milliseconds(100));
+        fWriterIdle = false;
+    }
+}
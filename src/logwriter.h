@@ -0,0 +1,163 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_LOGWRITER_H
+#define COSANTA_LOGWRITER_H
+
+#include "fs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Bounded lock-free multi-producer/single-consumer ring buffer.
+ *
+ * Every slot carries a sequence number which tells producers and the consumer
+ * whether the slot is free or holds a value for the current lap. Producers
+ * claim a slot with a single CAS on the enqueue position, the consumer does not
+ * need any atomic read-modify-write at all. Capacity is rounded up to the next
+ * power of two.
+ */
+template <typename T>
+class CMPSCRingBuffer
+{
+private:
+    struct Slot {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> enqueuePos{0};
+    size_t dequeuePos{0};
+
+    static size_t RoundUpPow2(size_t n)
+    {
+        size_t r = 2;
+        while (r < n) {
+            r <<= 1;
+        }
+        return r;
+    }
+
+public:
+    explicit CMPSCRingBuffer(size_t capacity) :
+        mask(RoundUpPow2(capacity) - 1),
+        slots(new Slot[mask + 1])
+    {
+        for (size_t i = 0; i <= mask; i++) {
+            slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    CMPSCRingBuffer(const CMPSCRingBuffer&) = delete;
+    CMPSCRingBuffer& operator=(const CMPSCRingBuffer&) = delete;
+
+    size_t Capacity() const { return mask + 1; }
+
+    /** Returns false (and leaves v untouched) if the buffer is full. Safe to call from any thread. */
+    bool TryPush(T&& v)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = slots[pos & mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = std::move(v);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Returns false if nothing is ready to be consumed. Must only be called from the consumer thread. */
+    bool TryPop(T& v)
+    {
+        Slot& slot = slots[dequeuePos & mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(dequeuePos + 1) < 0) {
+            return false;
+        }
+        v = std::move(slot.value);
+        slot.value = T();
+        slot.seq.store(dequeuePos + mask + 1, std::memory_order_release);
+        dequeuePos++;
+        return true;
+    }
+};
+
+/**
+ * Writes log lines to a file from a dedicated thread.
+ *
+ * Callers only push the already formatted line into a CMPSCRingBuffer and never
+ * block on file I/O. The writer thread drains the buffer in batches and issues a
+ * single fwrite/fflush per batch. When the buffer is full, lines are dropped and
+ * counted, the writer then reports the number of dropped lines in the log itself.
+ */
+class CAsyncLogWriter
+{
+private:
+    CMPSCRingBuffer<std::string> queue;
+    //! Held while a batch is written to file or file is reopened
+    std::mutex csFile;
+    FILE* file;
+    const fs::path path;
+
+    std::thread writerThread;
+    std::mutex cs;
+    std::condition_variable cond;
+    std::atomic<bool> fStopRequested{false};
+    std::atomic<bool> fWriterIdle{false};
+
+    std::atomic<uint64_t> nDroppedLines{0};
+    uint64_t nReportedDroppedLines{0};
+    // incremented by the writer thread after each batch has been flushed
+    std::atomic<uint64_t> nWrittenLines{0};
+    std::atomic<uint64_t> nQueuedLines{0};
+
+    void ThreadWriter();
+    size_t WriteBatch(std::string& buf);
+
+public:
+    /** Maximum number of lines written with a single fwrite() call */
+    static const size_t MAX_BATCH_LINES = 1024;
+
+    CAsyncLogWriter(FILE* _file, const fs::path& _path, size_t nQueueSize);
+    ~CAsyncLogWriter();
+
+    void Start();
+    /** Stops the writer thread after all queued lines have been written */
+    void Stop();
+    /** Waits (at most nTimeoutMillis) until all lines queued so far have been written and flushed */
+    bool Flush(int64_t nTimeoutMillis);
+
+    /** Queues a line for writing, returns false if it had to be dropped */
+    bool Write(std::string&& str);
+    /**
+     * Writes a line right away, after the lines queued so far. Used by the crash
+     * handlers, so it gives up waiting for the writer thread after
+     * nTimeoutMillis, which might be the crashing thread itself.
+     */
+    void WriteUnqueued(const std::string& str, int64_t nTimeoutMillis);
+
+    uint64_t GetDroppedLines() const { return nDroppedLines; }
+    size_t GetQueueSize() const { return queue.Capacity(); }
+};
+
+#endif // COSANTA_LOGWRITER_H
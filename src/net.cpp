@@ -36,12 +36,17 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -931,33 +936,98 @@ const uint256& CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
+/** Maximum number of buffers handed to a single scatter-gather send call */
+static const size_t MAX_SEND_BUFFERS = 64;
+
+typedef std::pair<const unsigned char*, size_t> SendBuffer;
+
+/** Sends the buffers in order with a single call, returns the number of bytes sent like send() */
+static int SendBuffers(SOCKET hSocket, const SendBuffer* buffers, size_t nBuffers)
+{
+#ifdef WIN32
+    // no sendmsg() here, send the buffers one by one until the socket is full
+    int nTotal = 0;
+    for (size_t i = 0; i < nBuffers; i++) {
+        int nBytes = send(hSocket, reinterpret_cast<const char*>(buffers[i].first), buffers[i].second, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (nBytes <= 0) {
+            // report errors only if nothing was sent, they show up again with the next call
+            return nTotal ? nTotal : nBytes;
+        }
+        nTotal += nBytes;
+        if ((size_t)nBytes < buffers[i].second) {
+            break;
+        }
+    }
+    return nTotal;
+#else
+    struct iovec iov[MAX_SEND_BUFFERS];
+    for (size_t i = 0; i < nBuffers; i++) {
+        iov[i].iov_base = const_cast<unsigned char*>(buffers[i].first);
+        iov[i].iov_len = buffers[i].second;
+    }
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nBuffers;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        // Gather the unsent headers and payloads of the queued messages, so that they go out
+        // with a single call and shared payloads never have to be copied into a send buffer
+        SendBuffer buffers[MAX_SEND_BUFFERS];
+        size_t nBuffers = 0;
+        size_t nGathered = 0;
+        size_t nOffset = pnode->nSendOffset;
+        for (auto it2 = it; it2 != pnode->vSendMsg.end() && nBuffers + 2 <= MAX_SEND_BUFFERS; ++it2) {
+            assert(it2->size() > nOffset);
+            const auto& header = it2->header;
+            const auto& payload = it2->payload->data;
+            if (nOffset < header.size()) {
+                buffers[nBuffers++] = SendBuffer(header.data() + nOffset, header.size() - nOffset);
+                nOffset = 0;
+            } else {
+                nOffset -= header.size();
+            }
+            if (nOffset < payload.size()) {
+                buffers[nBuffers++] = SendBuffer(payload.data() + nOffset, payload.size() - nOffset);
+            }
+            nGathered += it2->size() - (it2 == it ? pnode->nSendOffset : 0);
+            nOffset = 0;
+        }
+
         int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendBuffers(pnode->hSocket, buffers, nBuffers);
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                size_t nRemaining = it->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= it->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nGathered) {
+                // could not send all gathered data; stop sending more
                 break;
             }
         } else {
@@ -981,6 +1051,9 @@ size_t CConnman::SocketSendData(CNode *pnode) EXCLUSIVE_LOCKS_REQUIRED(pnode->cs
     }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     pnode->nSendMsgSize = pnode->vSendMsg.size();
+    if (pnode->vSendMsg.empty() && nSentSize) {
+        UpdateSocketEvents(pnode);
+    }
     return nSentSize;
 }
 
@@ -1249,6 +1322,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        UpdateSocketEvents(pnode);
         WakeSelect();
     }
 }
@@ -1365,6 +1439,47 @@ void CConnman::InactivityCheck(CNode *pnode)
     }
 }
 
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& modeRet)
+{
+#ifdef USE_POLL
+    if (str == "poll") {
+        modeRet = SocketEventsMode::Poll;
+        return true;
+    }
+#else
+    if (str == "select") {
+        modeRet = SocketEventsMode::Select;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        modeRet = SocketEventsMode::EPoll;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode)
+{
+    switch (mode) {
+    case SocketEventsMode::Select: return "select";
+    case SocketEventsMode::Poll: return "poll";
+    case SocketEventsMode::EPoll: return "epoll";
+    }
+    return "";
+}
+
+std::string GetSupportedSocketEventsModes()
+{
+    std::string strModes = DEFAULT_SOCKETEVENTS;
+#ifdef USE_EPOLL
+    strModes += ", epoll";
+#endif
+    return strModes;
+}
+
 bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     for (const ListenSocket& hListenSocket : vhListenSocket) {
@@ -1412,7 +1527,7 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &s
 }
 
 #ifdef USE_POLL
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+void CConnman::SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1459,7 +1574,7 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
     }
 }
 #else
-void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+void CConnman::SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
     if (!GenerateSelectSet(recv_select_set, send_select_set, error_select_set)) {
@@ -1559,13 +1674,163 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+
+#ifdef USE_EPOLL
+bool CConnman::InitEpoll()
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd == -1) {
+        LogPrintf("epoll_create1 failed: %s\n", NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+
+    std::vector<int> vFds;
+    for (const ListenSocket& hListenSocket : vhListenSocket) {
+        vFds.push_back(hListenSocket.socket);
+    }
+    if (wakeupPipe[0] != -1) {
+        vFds.push_back(wakeupPipe[0]);
+    }
+    for (int fd : vFds) {
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            LogPrintf("epoll_ctl failed: %s\n", NetworkErrorString(WSAGetLastError()));
+            close(epollFd);
+            epollFd = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+void CConnman::UpdateEpollRegistrations()
+{
+    std::set<CNode*> setChanged;
+    {
+        LOCK(cs_setSocketEventsChanged);
+        setChanged.swap(setSocketEventsChanged);
+    }
+
+    for (CNode* pnode : setChanged) {
+        // same as GenerateSelectSet, drain the send buffer before receiving more
+        bool fSend;
+        {
+            LOCK(pnode->cs_vSend);
+            fSend = !pnode->vSendMsg.empty();
+        }
+        uint32_t nEvents = fSend ? EPOLLOUT : (pnode->fPauseRecv ? 0 : EPOLLIN);
+
+        LOCK(pnode->cs_hSocket);
+        // closing the socket removed it from the epoll set already
+        if (pnode->hSocket == INVALID_SOCKET)
+            continue;
+        if (pnode->fSocketEventsRegistered && pnode->nSocketEvents == nEvents)
+            continue;
+
+        // errors and hangups are always reported
+        struct epoll_event event;
+        event.events = nEvents;
+        event.data.fd = pnode->hSocket;
+        if (epoll_ctl(epollFd, pnode->fSocketEventsRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+            LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+            pnode->fDisconnect = true;
+            continue;
+        }
+        pnode->fSocketEventsRegistered = true;
+        pnode->nSocketEvents = nEvents;
+    }
+}
+
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+    UpdateEpollRegistrations();
+
+    const int nMaxEvents = 256;
+    struct epoll_event events[nMaxEvents];
+
+    wakeupSelectNeeded = true;
+    int n = epoll_wait(epollFd, events, nMaxEvents, SELECT_TIMEOUT_MILLISECONDS);
+    wakeupSelectNeeded = false;
+    if (interruptNet)
+        return;
+
+    if (n < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("epoll_wait error %s\n", NetworkErrorString(nErr));
+            interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+        return;
+    }
+
+    for (int i = 0; i < n; i++) {
+        const struct epoll_event& e = events[i];
+        if (e.data.fd == wakeupPipe[0]) {
+            // drain the wakeup pipe
+            char buf[128];
+            while (true) {
+                int r = read(wakeupPipe[0], buf, sizeof(buf));
+                if (r <= 0) {
+                    break;
+                }
+            }
+            continue;
+        }
+        if (e.events & EPOLLIN)                recv_set.insert(e.data.fd);
+        if (e.events & EPOLLOUT)               send_set.insert(e.data.fd);
+        if (e.events & (EPOLLERR | EPOLLHUP))  error_set.insert(e.data.fd);
+    }
+}
+#endif
+
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode == SocketEventsMode::EPoll) {
+        SocketEventsEpoll(recv_set, send_set, error_set);
+        return;
+    }
+#endif
+#ifdef USE_POLL
+    SocketEventsPoll(recv_set, send_set, error_set);
+#else
+    SocketEventsSelect(recv_set, send_set, error_set);
+#endif
+}
+
+void CConnman::UpdateSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (socketEventsMode != SocketEventsMode::EPoll)
+        return;
+    LOCK(cs_setSocketEventsChanged);
+    setSocketEventsChanged.emplace(pnode);
+#endif
+}
+
+CConnman::SocketLoopStats CConnman::GetSocketLoopStats() const
+{
+    SocketLoopStats stats;
+    stats.nIterations = nSocketLoopIterations;
+    stats.nWaitTime = nSocketLoopWaitTime;
+    stats.nHandleTime = nSocketLoopHandleTime;
+    stats.nMaxHandleTime = nSocketLoopMaxHandleTime;
+    return stats;
+}
+
 void CConnman::SocketHandler()
 {
+    int64_t nTimeStart = GetTimeMicros();
     std::set<SOCKET> recv_set, send_set, error_set;
     SocketEvents(recv_set, send_set, error_set);
 
     if (interruptNet) return;
 
+    int64_t nTimeEvents = GetTimeMicros();
+    nSocketLoopWaitTime += nTimeEvents - nTimeStart;
+
     //
     // Accept new connections
     //
@@ -1619,6 +1884,13 @@ void CConnman::SocketHandler()
 
     }
     ReleaseNodeVector(vNodesCopy);
+
+    int64_t nHandleTime = GetTimeMicros() - nTimeEvents;
+    nSocketLoopHandleTime += nHandleTime;
+    if (nHandleTime > nSocketLoopMaxHandleTime) {
+        nSocketLoopMaxHandleTime = nHandleTime;
+    }
+    nSocketLoopIterations++;
 }
 
 size_t CConnman::SocketRecvData(CNode *pnode)
@@ -1646,13 +1918,17 @@ size_t CConnman::SocketRecvData(CNode *pnode)
                     break;
                 nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
             }
+            bool fWasPausedRecv = pnode->fPauseRecv;
             {
                 LOCK(pnode->cs_vProcessMsg);
                 pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
                 pnode->nProcessQueueSize += nSizeAdded;
                 pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
             }
-            WakeMessageHandler();
+            if (!fWasPausedRecv && pnode->fPauseRecv) {
+                UpdateSocketEvents(pnode);
+            }
+            WakeMessageHandler(pnode->GetId());
         }
     }
     else if (nBytes == 0)
@@ -1704,9 +1980,24 @@ void CConnman::WakeMessageHandler()
 {
     {
         std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        for (const auto& wakeup : vMsgProcWakeup) {
+            wakeup->fWake = true;
+        }
+    }
+    for (const auto& wakeup : vMsgProcWakeup) {
+        wakeup->cond.notify_one();
+    }
+}
+
+void CConnman::WakeMessageHandler(NodeId id)
+{
+    // each peer is always handled by the same thread
+    MessageHandlerWakeup& wakeup = *vMsgProcWakeup[id % nMessageHandlerThreads];
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        wakeup.fWake = true;
     }
-    condMsgProc.notify_one();
+    wakeup.cond.notify_one();
 }
 
 void CConnman::WakeSelect()
@@ -2393,6 +2684,7 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+        UpdateSocketEvents(pnode);
         WakeSelect();
     }
 }
@@ -2401,12 +2693,13 @@ void CConnman::OpenMasternodeConnection(const CAddress &addrConnect) {
     OpenNetworkConnection(addrConnect, false, nullptr, nullptr, false, false, false, true);
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread)
 {
     int64_t nLastSendMessagesTimeMasternodes = 0;
 
     while (!flagInterruptMsgProc)
     {
+        int64_t nTimeStart = GetTimeMicros();
         std::vector<CNode*> vNodesCopy = CopyNodeVector();
 
         bool fMoreWork = false;
@@ -2419,6 +2712,10 @@ void CConnman::ThreadMessageHandler()
 
         for (CNode* pnode : vNodesCopy)
         {
+            // each peer is always handled by the same thread
+            if (pnode->GetId() % nMessageHandlerThreads != nThread)
+                continue;
+
             if (pnode->fDisconnect)
                 continue;
 
@@ -2438,15 +2735,26 @@ void CConnman::ThreadMessageHandler()
         }
 
         ReleaseNodeVector(vNodesCopy);
+        vMsgProcBusyTime[nThread] += GetTimeMicros() - nTimeStart;
 
+        MessageHandlerWakeup& wakeup = *vMsgProcWakeup[nThread];
         std::unique_lock<std::mutex> lock(mutexMsgProc);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            wakeup.cond.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&wakeup] { return wakeup.fWake; });
         }
-        fMsgProcWake = false;
+        wakeup.fWake = false;
     }
 }
 
+std::vector<int64_t> CConnman::GetMessageHandlerBusyTimes() const
+{
+    std::vector<int64_t> vBusyTimes;
+    for (const auto& nBusyTime : vMsgProcBusyTime) {
+        vBusyTimes.push_back(nBusyTime);
+    }
+    return vBusyTimes;
+}
+
 
 // ppcoin: stake minter thread
 void CConnman::ThreadStakeMinter()
@@ -2736,8 +3044,12 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         std::unique_lock<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = false;
+        vMsgProcWakeup.clear();
+        for (int i = 0; i < nMessageHandlerThreads; i++) {
+            vMsgProcWakeup.emplace_back(new MessageHandlerWakeup());
+        }
     }
+    vMsgProcBusyTime = std::vector<std::atomic<int64_t>>(nMessageHandlerThreads);
 
 #ifndef WIN32
     if (pipe(wakeupPipe) != 0) {
@@ -2755,6 +3067,17 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     }
 #endif
 
+#ifdef USE_EPOLL
+    if (socketEventsMode == SocketEventsMode::EPoll && !InitEpoll()) {
+        if (clientInterface) {
+            clientInterface->ThreadSafeMessageBox(
+                _("Failed to initialize epoll, use a different -socketevents mode."),
+                "", CClientUIInterface::MSG_ERROR);
+        }
+        return false;
+    }
+#endif
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(&TraceThread<std::function<void()> >, "net", std::function<void()>(std::bind(&CConnman::ThreadSocketHandler, this)));
 
@@ -2781,7 +3104,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
     threadOpenMasternodeConnections = std::thread(&TraceThread<std::function<void()> >, "mncon", std::function<void()>(std::bind(&CConnman::ThreadOpenMasternodeConnections, this)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        vThreadMessageHandler.emplace_back(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpData, this), DUMP_ADDRESSES_INTERVAL * 1000);
@@ -2828,7 +3153,7 @@ void CConnman::Interrupt()
         std::lock_guard<std::mutex> lock(mutexMsgProc);
         flagInterruptMsgProc = true;
     }
-    condMsgProc.notify_all();
+    WakeMessageHandler();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2848,8 +3173,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (auto& threadMessageHandler : vThreadMessageHandler) {
+        if (threadMessageHandler.joinable())
+            threadMessageHandler.join();
+    }
+    vThreadMessageHandler.clear();
     if (threadOpenMasternodeConnections.joinable())
         threadOpenMasternodeConnections.join();
     if (threadOpenConnections.joinable())
@@ -2896,6 +3224,14 @@ void CConnman::Stop()
     if (wakeupPipe[1] != -1) close(wakeupPipe[1]);
     wakeupPipe[0] = wakeupPipe[1] = -1;
 #endif
+#ifdef USE_EPOLL
+    if (epollFd != -1) close(epollFd);
+    epollFd = -1;
+    {
+        LOCK(cs_setSocketEventsChanged);
+        setSocketEventsChanged.clear();
+    }
+#endif
 }
 
 void CConnman::DeleteNode(CNode* pnode)
@@ -2906,6 +3242,12 @@ void CConnman::DeleteNode(CNode* pnode)
     if(fUpdateConnectionTime) {
         addrman.Connected(pnode->addr);
     }
+#ifdef USE_EPOLL
+    {
+        LOCK(cs_setSocketEventsChanged);
+        setSocketEventsChanged.erase(pnode);
+    }
+#endif
     delete pnode;
 }
 
@@ -3447,17 +3789,20 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg, bool allowOptimisticSend)
 {
-    size_t nMessageSize = msg.data.size();
+    CQueuedNetMsg queuedMsg;
+    queuedMsg.payload = std::move(msg.sharedData);
+    if (!queuedMsg.payload) {
+        queuedMsg.payload = std::make_shared<const CNetMsgPayload>(std::move(msg.data));
+    }
+    size_t nMessageSize = queuedMsg.payload->data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<unsigned char> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    queuedMsg.header.reserve(CMessageHeader::HEADER_SIZE);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    memcpy(hdr.pchChecksum, queuedMsg.payload->hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, queuedMsg.header, 0, hdr};
 
     size_t nBytesSent = 0;
     {
@@ -3471,9 +3816,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg, bool allowOpti
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.push_back(std::move(queuedMsg));
         pnode->nSendMsgSize = pnode->vSendMsg.size();
 
         // If write queue empty, attempt "optimistic write"
@@ -3482,6 +3825,10 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg, bool allowOpti
         // wake up select() call in case there was no pending data before (so it was not selecting this socket for sending)
         else if (!hasPendingData && wakeupSelectNeeded)
             WakeSelect();
+
+        if (!hasPendingData && !pnode->vSendMsg.empty()) {
+            UpdateSocketEvents(pnode);
+        }
     }
     if (nBytesSent)
         RecordBytesSent(nBytesSent);
@@ -98,6 +98,28 @@ static const size_t SETASKFOR_MAX_SZ = 2 * MAX_INV_SZ;
  *  Masternodes are forced to accept at least this many connections
  */
 static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
+/** -msghandthreads default */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+/** -socketevents default */
+#ifdef USE_POLL
+static const char* const DEFAULT_SOCKETEVENTS = "poll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
+/** How the socket handler thread waits for socket events */
+enum class SocketEventsMode {
+    Select,
+    Poll,
+    EPoll,
+};
+
+bool ParseSocketEventsMode(const std::string& str, SocketEventsMode& modeRet);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Comma separated names of the modes supported by this build */
+std::string GetSupportedSocketEventsModes();
 /** The default for -maxuploadtarget. 0 = Unlimited */
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** The default timeframe for -maxuploadtarget. 1 day. */
@@ -125,6 +147,24 @@ struct AddedNodeInfo
 class CNodeStats;
 class CClientUIInterface;
 
+/**
+ * Immutable serialized message payload. It is queued by reference for every peer it is sent to,
+ * and the checksum for the message header is computed only once.
+ */
+class CNetMsgPayload
+{
+public:
+    const std::vector<unsigned char> data;
+    const uint256 hash;
+
+    explicit CNetMsgPayload(std::vector<unsigned char>&& dataIn) :
+        data(std::move(dataIn)),
+        hash(Hash(data.data(), data.data() + data.size()))
+    {
+    }
+};
+typedef std::shared_ptr<const CNetMsgPayload> CSharedNetPayload;
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -136,6 +176,17 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string command;
+    //! If set, this payload is sent by reference instead of data
+    CSharedNetPayload sharedData;
+};
+
+/** A message in the send queue of a peer, the header is followed by the payload */
+struct CQueuedNetMsg
+{
+    std::vector<unsigned char> header;
+    CSharedNetPayload payload;
+
+    size_t size() const { return header.size() + payload->data.size(); }
 };
 
 class NetEventsInterface;
@@ -170,6 +221,17 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        SocketEventsMode socketEventsMode = SocketEventsMode::Select;
+        int nMessageHandlerThreads = 1;
+    };
+
+    /** Timing of the socket handler loop, in microseconds */
+    struct SocketLoopStats
+    {
+        uint64_t nIterations;
+        int64_t nWaitTime;
+        int64_t nHandleTime;
+        int64_t nMaxHandleTime;
     };
 
     void Init(const Options& connOptions) {
@@ -183,6 +245,8 @@ public:
         m_msgproc = connOptions.m_msgproc;
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
+        socketEventsMode = connOptions.socketEventsMode;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHAND_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -454,9 +518,22 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message processor threads */
     void WakeMessageHandler();
+    /** Wake the message processor thread handling the peer */
+    void WakeMessageHandler(NodeId id);
     void WakeSelect();
 
+    SocketEventsMode GetSocketEventsMode() const { return socketEventsMode; }
+    SocketLoopStats GetSocketLoopStats() const;
+    /** Time each message handler thread spent processing messages, in microseconds */
+    std::vector<int64_t> GetMessageHandlerBusyTimes() const;
+    /**
+     * Has to be called after the send buffer of a node became empty or non-empty and after fPauseRecv changed.
+     * With -socketevents=epoll this queues the node for its registration to be updated, nothing is done otherwise.
+     */
+    void UpdateSocketEvents(CNode* pnode);
+
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
         Variable intervals will result in privacy decrease.
@@ -478,13 +555,23 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#ifdef USE_POLL
+    void SocketEventsPoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#else
+    void SocketEventsSelect(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
+#ifdef USE_EPOLL
+    bool InitEpoll();
+    void UpdateEpollRegistrations();
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
+#endif
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -580,10 +667,14 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Wake flag and condition variable of a message processor thread, the flag is guarded by mutexMsgProc */
+    struct MessageHandlerWakeup {
+        bool fWake{false};
+        std::condition_variable cond;
+    };
+    /** one per message processor thread, so a peer only wakes the thread handling it */
+    std::vector<std::unique_ptr<MessageHandlerWakeup>> vMsgProcWakeup;
 
-    std::condition_variable condMsgProc;
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
@@ -595,12 +686,29 @@ private:
 #endif
     std::atomic<bool> wakeupSelectNeeded{false};
 
+    SocketEventsMode socketEventsMode{SocketEventsMode::Select};
+#ifdef USE_EPOLL
+    /** epoll instance the listening sockets, the wakeup pipe and the node sockets stay registered with */
+    int epollFd{-1};
+    /** nodes whose epoll registration has to be updated by the socket handler thread */
+    CCriticalSection cs_setSocketEventsChanged;
+    std::set<CNode*> setSocketEventsChanged;
+#endif
+
+    std::atomic<uint64_t> nSocketLoopIterations{0};
+    std::atomic<int64_t> nSocketLoopWaitTime{0};
+    std::atomic<int64_t> nSocketLoopHandleTime{0};
+    std::atomic<int64_t> nSocketLoopMaxHandleTime{0};
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadOpenMasternodeConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> vThreadMessageHandler;
+    /** Peers are assigned to message handler threads by id, which keeps their messages in order */
+    int nMessageHandlerThreads{1};
+    std::vector<std::atomic<int64_t>> vMsgProcBusyTime;
     std::thread threadStakeMint;
 
     /** flag for deciding to connect to an extra outbound peer,
@@ -782,7 +890,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend);
-    std::list<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::list<CQueuedNetMsg> vSendMsg GUARDED_BY(cs_vSend);
     std::atomic<size_t> nSendMsgSize;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
@@ -842,6 +950,9 @@ public:
 
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // Events the socket is registered for with -socketevents=epoll, only used by the socket handler thread
+    bool fSocketEventsRegistered{false};
+    uint32_t nSocketEvents{0};
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
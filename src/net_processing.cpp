@@ -13,6 +13,7 @@
 #include "consensus/validation.h"
 #include "hash.h"
 #include "init.h"
+#include "invresponsecache.h"
 #include "validation.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -62,6 +63,7 @@
 
 std::atomic<int64_t> nTimeBestReceived(0); // Used only to inform the wallet of when we last received a block
 bool g_enable_bip61 = DEFAULT_ENABLE_BIP61;
+CInvResponseCache invResponseCache(INV_RESPONSE_CACHE_MAX_ENTRIES, INV_RESPONSE_CACHE_MAX_BYTES, INV_RESPONSE_CACHE_EXPIRY);
 
 struct IteratorComparator
 {
@@ -172,10 +174,12 @@ namespace {
     /** When our tip was last updated. */
     std::atomic<int64_t> g_last_tip_update(0);
 
-    /** Relay map, protected by cs_main. */
+    /** Protects mapRelay and vRelayExpiration, so that getdata can be served without cs_main. */
+    CCriticalSection cs_mapRelay;
+    /** Relay map, protected by cs_mapRelay. */
     typedef std::map<uint256, CTransactionRef> MapRelay;
     MapRelay mapRelay;
-    /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_main). */
+    /** Expiration-time ordered list of (expire time, relay map entry) pairs, protected by cs_mapRelay. */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration;
 } // namespace
 
@@ -909,10 +913,28 @@ static CCriticalSection cs_most_recent_block;
 static std::shared_ptr<const CBlock> most_recent_block;
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block;
 static uint256 most_recent_block_hash;
+// Serialized most_recent_compact_block and most_recent_block, shared by all peers they are sent to.
+// The block is only serialized once it is requested.
+static CSharedNetPayload most_recent_compact_block_payload;
+static CSharedNetPayload most_recent_block_payload;
+
+/** Returns the serialized block if it is most_recent_block, or nullptr otherwise */
+static CSharedNetPayload GetRecentBlockPayload(const std::shared_ptr<const CBlock>& pblock)
+{
+    LOCK(cs_most_recent_block);
+    if (!pblock || pblock != most_recent_block) {
+        return nullptr;
+    }
+    if (!most_recent_block_payload) {
+        most_recent_block_payload = CNetMsgMaker(PROTOCOL_VERSION).MakePayload(*pblock);
+    }
+    return most_recent_block_payload;
+}
 
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    CSharedNetPayload cmpctblockPayload = msgMaker.MakePayload(*pcmpctblock);
 
     LOCK(cs_main);
 
@@ -928,10 +950,11 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_payload = cmpctblockPayload;
+        most_recent_block_payload = nullptr;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, &hashBlock](CNode* pnode) {
-        // TODO: Avoid the repeated-serialization here
+    connman->ForEachNode([this, &cmpctblockPayload, pindex, &msgMaker, &hashBlock](CNode* pnode) {
         if (pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -943,7 +966,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode, msgMaker.MakeShared(NetMsgType::CMPCTBLOCK, cmpctblockPayload));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1148,11 +1171,13 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
     bool send = false;
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
+    CSharedNetPayload a_recent_compact_block_payload;
     const Consensus::Params& consensusParams = chainparams.GetConsensus();
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
+        a_recent_compact_block_payload = most_recent_compact_block_payload;
     }
 
     bool need_activate_chain = false;
@@ -1221,8 +1246,17 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
             pblock = pblockRead;
         }
         if (pblock) {
+            // A fresh block is requested by many peers at once, serialize it only once for all of them
+            auto pushBlock = [&]() {
+                CSharedNetPayload blockPayload = GetRecentBlockPayload(pblock);
+                if (blockPayload) {
+                    connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::BLOCK, std::move(blockPayload)));
+                } else {
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                }
+            };
             if (inv.type == MSG_BLOCK)
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                pushBlock();
             else if (inv.type == MSG_FILTERED_BLOCK) {
                 bool sendMerkleBlock = false;
                 CMerkleBlock merkleBlock;
@@ -1256,13 +1290,13 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
                     mi->second->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
                     if (a_recent_compact_block &&
                         a_recent_compact_block->header.GetHash() == mi->second->GetBlockHash()) {
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                        connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::CMPCTBLOCK, a_recent_compact_block_payload));
                     } else {
                         CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
                         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CMPCTBLOCK, cmpctblock));
                     }
                 } else {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+                    pushBlock();
                 }
             }
         }
@@ -1287,9 +1321,10 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
     std::deque<CInv>::iterator it = pfrom->vRecvGetData.begin();
     std::vector<CInv> vNotFound;
     const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    const int64_t nNow = GetTime();
     {
-        LOCK(cs_main);
-
+        // Non-block inventory is answered under the locks of the subsystems owning it,
+        // cs_main is only taken for block requests in ProcessGetBlockData.
         while (it != pfrom->vRecvGetData.end() && it->IsKnownType()) {
             if (interruptMsgProc)
                 return;
@@ -1310,12 +1345,19 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
                 if (inv.type == MSG_DSTX) {
                     dstx = CPrivateSend::GetDSTX(inv.hash);
                 }
-                auto mi = mapRelay.find(inv.hash);
-                if (mi != mapRelay.end()) {
+                CTransactionRef txRelay;
+                {
+                    LOCK(cs_mapRelay);
+                    auto mi = mapRelay.find(inv.hash);
+                    if (mi != mapRelay.end()) {
+                        txRelay = mi->second;
+                    }
+                }
+                if (txRelay) {
                     if (dstx) {
                         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::DSTX, dstx));
                     } else {
-                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *mi->second));
+                        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::TX, *txRelay));
                     }
                     push = true;
                 } else if (pfrom->timeLastMempoolReq) {
@@ -1343,37 +1385,39 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
 
             if (!push && inv.type == MSG_GOVERNANCE_OBJECT) {
                 LogPrint(BCLog::NET, "ProcessGetData -- MSG_GOVERNANCE_OBJECT: inv = %s\n", inv.ToString());
-                CDataStream ss(SER_NETWORK, pfrom->GetSendVersion());
-                bool topush = false;
-                {
-                    if(governance.HaveObjectForHash(inv.hash)) {
+                CSharedNetPayload payload;
+                if(governance.HaveObjectForHash(inv.hash)) {
+                    payload = invResponseCache.Get(inv, nNow);
+                    if(!payload) {
+                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         if(governance.SerializeObjectForHash(inv.hash, ss)) {
-                            topush = true;
+                            payload = invResponseCache.Put(inv, ss, nNow);
                         }
                     }
                 }
-                LogPrint(BCLog::NET, "ProcessGetData -- MSG_GOVERNANCE_OBJECT: topush = %d, inv = %s\n", topush, inv.ToString());
-                if(topush) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNGOVERNANCEOBJECT, ss));
+                LogPrint(BCLog::NET, "ProcessGetData -- MSG_GOVERNANCE_OBJECT: topush = %d, inv = %s\n", payload != nullptr, inv.ToString());
+                if(payload) {
+                    connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::MNGOVERNANCEOBJECT, std::move(payload)));
                     push = true;
                 }
             }
 
             if (!push && inv.type == MSG_GOVERNANCE_OBJECT_VOTE) {
-                CDataStream ss(SER_NETWORK, pfrom->GetSendVersion());
-                bool topush = false;
-                {
-                    if(governance.HaveVoteForHash(inv.hash)) {
+                CSharedNetPayload payload;
+                if(governance.HaveVoteForHash(inv.hash)) {
+                    payload = invResponseCache.Get(inv, nNow);
+                    if(!payload) {
+                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
                         ss.reserve(1000);
                         if(governance.SerializeVoteForHash(inv.hash, ss)) {
-                            topush = true;
+                            payload = invResponseCache.Put(inv, ss, nNow);
                         }
                     }
                 }
-                if(topush) {
+                if(payload) {
                     LogPrint(BCLog::NET, "ProcessGetData -- pushing: inv = %s\n", inv.ToString());
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::MNGOVERNANCEOBJECTVOTE, ss));
+                    connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::MNGOVERNANCEOBJECTVOTE, std::move(payload)));
                     push = true;
                 }
             }
@@ -1415,9 +1459,17 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
                 }
             }
             if (!push && (inv.type == MSG_QUORUM_RECOVERED_SIG)) {
-                llmq::CRecoveredSig o;
-                if (llmq::quorumSigningManager->GetRecoveredSigForGetData(inv.hash, o)) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::QSIGREC, o));
+                // Recovered sigs are immutable, a cached one only skips the active quorum check
+                // for the short lifetime of the cache entry
+                CSharedNetPayload payload = invResponseCache.Get(inv, nNow);
+                if (!payload) {
+                    llmq::CRecoveredSig o;
+                    if (llmq::quorumSigningManager->GetRecoveredSigForGetData(inv.hash, o)) {
+                        payload = invResponseCache.Put(inv, o, nNow);
+                    }
+                }
+                if (payload) {
+                    connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::QSIGREC, std::move(payload)));
                     push = true;
                 }
             }
@@ -1425,7 +1477,11 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
             if (!push && (inv.type == MSG_CLSIG)) {
                 llmq::CChainLockSig o;
                 if (llmq::chainLocksHandler->GetChainLockByHash(inv.hash, o)) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CLSIG, o));
+                    CSharedNetPayload payload = invResponseCache.Get(inv, nNow);
+                    if (!payload) {
+                        payload = invResponseCache.Put(inv, o, nNow);
+                    }
+                    connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::CLSIG, std::move(payload)));
                     push = true;
                 }
             }
@@ -1433,7 +1489,11 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
             if (!push && (inv.type == MSG_ISLOCK)) {
                 llmq::CInstantSendLock o;
                 if (llmq::quorumInstantSendManager->GetInstantSendLockByHash(inv.hash, o)) {
-                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::ISLOCK, o));
+                    CSharedNetPayload payload = invResponseCache.Get(inv, nNow);
+                    if (!payload) {
+                        payload = invResponseCache.Put(inv, o, nNow);
+                    }
+                    connman->PushMessage(pfrom, msgMaker.MakeShared(NetMsgType::ISLOCK, std::move(payload)));
                     push = true;
                 }
             }
@@ -1444,7 +1504,7 @@ void static ProcessGetData(CNode* pfrom, const CChainParams& chainparams, CConnm
             // Track requests for our stuff.
             GetMainSignals().Inventory(inv.hash);
         }
-    } // release cs_main
+    }
 
     if (it != pfrom->vRecvGetData.end() && !pfrom->fPauseSend) {
         const CInv &inv = *it;
@@ -1770,6 +1830,37 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
     }
 }
 
+/**
+ * Messages which are only handled by managers doing their own locking (LLMQ, governance, sporks, MNAUTH) and which
+ * therefore may be processed concurrently by the message handler threads
+ */
+static bool IsConcurrentMessage(const std::string& strCommand)
+{
+    static const std::set<std::string> setConcurrentMessages = {
+        NetMsgType::SPORK,
+        NetMsgType::GETSPORKS,
+        NetMsgType::MNGOVERNANCESYNC,
+        NetMsgType::MNGOVERNANCEOBJECT,
+        NetMsgType::MNGOVERNANCEOBJECTVOTE,
+        NetMsgType::MNAUTH,
+        NetMsgType::QSENDRECSIGS,
+        NetMsgType::QFCOMMITMENT,
+        NetMsgType::QCONTRIB,
+        NetMsgType::QCOMPLAINT,
+        NetMsgType::QJUSTIFICATION,
+        NetMsgType::QPCOMMITMENT,
+        NetMsgType::QWATCH,
+        NetMsgType::QSIGSESANN,
+        NetMsgType::QSIGSHARESINV,
+        NetMsgType::QGETSIGSHARES,
+        NetMsgType::QBSIGSHARES,
+        NetMsgType::QSIGREC,
+        NetMsgType::CLSIG,
+        NetMsgType::ISLOCK,
+    };
+    return setConcurrentMessages.count(strCommand) != 0;
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -2326,7 +2417,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // If pruning, don't inv blocks unless we have on disk and are likely to still have
             // for some reasonable time window (1 hour) that block relay might require.
             const int nPrunedBlocksLikelyToHave = MIN_BLOCKS_TO_KEEP - 3600 / chainparams.GetConsensus().nPowTargetSpacing;
-            if (fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave))
+            if ((fPruneMode && (!(pindex->nStatus & BLOCK_HAVE_DATA) || pindex->nHeight <= chainActive.Tip()->nHeight - nPrunedBlocksLikelyToHave)) ||
+                (fSnapshotChain && !(pindex->nStatus & BLOCK_HAVE_DATA)))
             {
                 LogPrint(BCLog::NET, " getblocks stopping, pruned or too old block at %d %s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
                 break;
@@ -3285,8 +3377,10 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     //
     bool fMoreWork = false;
 
-    if (!pfrom->vRecvGetData.empty())
+    if (!pfrom->vRecvGetData.empty()) {
+        LOCK(cs_serialProcessing);
         ProcessGetData(pfrom, chainparams, connman, interruptMsgProc);
+    }
 
     if (!pfrom->orphan_work_set.empty()) {
         LOCK2(cs_main, g_cs_orphans);
@@ -3305,6 +3399,7 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     std::list<CNetMessage> msgs;
+    bool fWasPausedRecv = pfrom->fPauseRecv;
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -3315,6 +3410,9 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
         fMoreWork = !pfrom->vProcessMsg.empty();
     }
+    if (fWasPausedRecv && !pfrom->fPauseRecv) {
+        connman->UpdateSocketEvents(pfrom);
+    }
     CNetMessage& msg(msgs.front());
 
     msg.SetVersion(pfrom->GetRecvVersion());
@@ -3353,7 +3451,14 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
     bool fRet = false;
     try
     {
-        fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        // messages of a peer are always processed in order by the same thread, only messages of
+        // different peers run concurrently
+        if (IsConcurrentMessage(strCommand)) {
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        } else {
+            LOCK(cs_serialProcessing);
+            fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime, chainparams, connman, interruptMsgProc);
+        }
         if (interruptMsgProc)
             return false;
         if (!pfrom->vRecvGetData.empty())
@@ -3548,6 +3653,7 @@ public:
 bool PeerLogicValidation::SendMessages(CNode* pto)
 {
     const Consensus::Params& consensusParams = Params().GetConsensus();
+    LOCK(cs_serialProcessing);
     {
         // Don't send anything until the version handshake is complete
         if (!pto->fSuccessfullyConnected || pto->fDisconnect)
@@ -3743,7 +3849,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     {
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                            connman->PushMessage(pto, msgMaker.Make(NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+                            connman->PushMessage(pto, msgMaker.MakeShared(NetMsgType::CMPCTBLOCK, most_recent_compact_block_payload));
                             fGotBlockFromCache = true;
                         }
                     }
@@ -3928,6 +4034,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     vInv.push_back(CInv(nInvType, hash));
                     nRelayedTransactions++;
                     {
+                        LOCK(cs_mapRelay);
                         // Expire old relay messages
                         while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
                         {
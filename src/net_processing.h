@@ -43,6 +43,17 @@ static constexpr bool DEFAULT_ENABLE_BIP61 = true;
 /** Enable BIP61 (sending reject messages) */
 extern bool g_enable_bip61;
 
+/** Maximum number of serialized getdata responses kept for reuse */
+static const size_t INV_RESPONSE_CACHE_MAX_ENTRIES = 20000;
+/** Maximum total size of serialized getdata responses kept for reuse */
+static const size_t INV_RESPONSE_CACHE_MAX_BYTES = 16 * 1024 * 1024;
+/** Time in seconds after which a cached getdata response is serialized again */
+static const int64_t INV_RESPONSE_CACHE_EXPIRY = 60;
+
+class CInvResponseCache;
+/** Serialized governance and LLMQ getdata responses, shared between the peers requesting them */
+extern CInvResponseCache invResponseCache;
+
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
     CConnman* const connman;
@@ -79,6 +90,12 @@ public:
 
 private:
     int64_t m_stale_tip_check_time; //! Next time to check for stale tip
+
+    /**
+     * Held by the message handler threads while processing messages which are not handled by thread-safe
+     * managers (see IsConcurrentMessage) and while sending messages
+     */
+    CCriticalSection cs_serialProcessing;
 };
 
 struct CNodeStateStats {
@@ -31,6 +31,24 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** Serializes a payload once, so that it can be sent to any number of peers through MakeShared */
+    template <typename... Args>
+    CSharedNetPayload MakePayload(Args&&... args) const
+    {
+        std::vector<unsigned char> data;
+        CVectorWriter{ SER_NETWORK, nVersion, data, 0, std::forward<Args>(args)... };
+        return std::make_shared<const CNetMsgPayload>(std::move(data));
+    }
+
+    /** Makes a message from an already serialized payload, which is queued by reference instead of being copied */
+    CSerializedNetMsg MakeShared(std::string sCommand, CSharedNetPayload payload) const
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.sharedData = std::move(payload);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
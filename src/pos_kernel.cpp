@@ -6,7 +6,6 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <boost/assign/list_of.hpp>
-#include <boost/lexical_cast.hpp>
 
 #include "chainparams.h"
 #include "db.h"
@@ -496,9 +495,9 @@ bool CheckStakeKernelHash(
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.nTime).c_str(),
                 blockFrom.nHeight,
                 DateTimeStrFormat("%Y-%m-%d %H:%M:%S", blockFrom.GetBlockTime()).c_str());
-            LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%s nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
+            LogPrintf("CheckStakeKernelHash() : pass protocol=%s modifier=%u nTimeBlockFrom=%u prevoutHash=%s nTimeTxPrev=%u nPrevout=%u nTimeTx=%u hashProof=%s\n",
                 "0.3",
-                boost::lexical_cast<std::string>(nStakeModifier).c_str(),
+                nStakeModifier,
                 nTimeBlockFrom, prevout.hash.ToString().c_str(), nTimeBlockFrom, prevout.n, try_time,
                 hashProofOfStake.ToString().c_str());
         }
@@ -522,8 +521,22 @@ bool CheckProofOfStake(CValidationState &state, const CBlockHeader &header, cons
     CTransactionRef txinPrevRef;
     CBlockIndex* pindex_tx = nullptr;
     CBlockIndex* pindex_prev = nullptr;
-
-    if (!GetTransaction(prevout.hash, txinPrevRef, consensus, txinHashBlock, true)) {
+    bool fStakeCoinBase = false;
+    Coin coinStake;
+
+    if (GetTransaction(prevout.hash, txinPrevRef, consensus, txinHashBlock, true)) {
+        fStakeCoinBase = txinPrevRef->IsCoinBase();
+    } else if (fSnapshotChain && pcoinsTip->GetCoin(prevout, coinStake) && coinStake.nHeight <= (uint32_t)chainActive.Height()) {
+        // The block of the stake input is below the base of the UTXO snapshot
+        // and was never downloaded, but the output itself is in the chainstate.
+        // Only its value and script are needed.
+        CMutableTransaction txStake;
+        txStake.vout.resize(prevout.n + 1);
+        txStake.vout[prevout.n] = coinStake.out;
+        txinPrevRef = MakeTransactionRef(std::move(txStake));
+        txinHashBlock = chainActive[coinStake.nHeight]->GetBlockHash();
+        fStakeCoinBase = coinStake.IsCoinBase();
+    } else {
         BlockMap::iterator it = mapBlockIndex.find(header.hashPrevBlock);
         
         if ((it != mapBlockIndex.end()) && chainActive.Contains(it->second)) {
@@ -595,7 +608,7 @@ bool CheckProofOfStake(CValidationState &state, const CBlockHeader &header, cons
     // NOTE: stake age check is part of CheckStakeKernelHash()
 
     // Check stake maturity (double checking with other functionality for DoS mitigation)
-    if (txinPrevRef->IsCoinBase() &&
+    if (fStakeCoinBase &&
         ((chainActive.Tip()->nHeight - pindex_tx->nHeight) <= COINBASE_MATURITY)
     ) {
         return state.DoS(100, false, REJECT_INVALID, "bad-stake-coinbase-maturity",
@@ -6,6 +6,7 @@
 #include "privatesend-server.h"
 
 #include "masternode/activemasternode.h"
+#include "checkqueue.h"
 #include "consensus/validation.h"
 #include "core_io.h"
 #include "init.h"
@@ -23,8 +24,27 @@
 
 #include <univalue.h>
 
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
 CPrivateSendServer privateSendServer;
 
+CPrivateSendServer::CPrivateSendServer() :
+    vecSessionCollaterals(),
+    nSessionMaxParticipants(0),
+    fUnitTest(false),
+    mapFinalTxInputs(),
+    finalTxData(),
+    nSessionVerifyTime(0),
+    nSessionVerifiedInputs(0),
+    scriptCheckQueue()
+{
+}
+
+CPrivateSendServer::~CPrivateSendServer()
+{
+}
+
 void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman)
 {
     if (!fMasternodeMode) return;
@@ -221,6 +241,12 @@ void CPrivateSendServer::ProcessMessage(CNode* pfrom, const std::string& strComm
         int nTxInIndex = 0;
         int nTxInsCount = (int)vecTxIn.size();
 
+        if (!IsInputScriptSigsValid(vecTxIn)) {
+            LogPrint(BCLog::PRIVATESEND, "DSSIGNFINALTX -- IsInputScriptSigsValid() failed, session: %d\n", nSessionID);
+            RelayStatus(STATUS_REJECTED, connman);
+            return;
+        }
+
         for (const auto& txin : vecTxIn) {
             nTxInIndex++;
             if (!AddScriptSig(txin)) {
@@ -240,6 +266,10 @@ void CPrivateSendServer::SetNull()
     // MN side
     vecSessionCollaterals.clear();
     nSessionMaxParticipants = 0;
+    mapFinalTxInputs.clear();
+    finalTxData.reset();
+    nSessionVerifyTime = 0;
+    nSessionVerifiedInputs = 0;
 
     CPrivateSendBaseSession::SetNull();
     CPrivateSendBaseManager::SetNull();
@@ -291,6 +321,20 @@ void CPrivateSendServer::CreateFinalTransaction(CConnman& connman)
     finalMutableTransaction = txNew;
     LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::CreateFinalTransaction -- finalMutableTransaction=%s", txNew.ToString());
 
+    // index inputs once, signatures are verified against the final transaction
+    mapFinalTxInputs.clear();
+    for (const auto& entry : vecEntries) {
+        for (const auto& txdsin : entry.vecTxDSIn) {
+            for (unsigned int i = 0; i < finalMutableTransaction.vin.size(); i++) {
+                if (finalMutableTransaction.vin[i].prevout == txdsin.prevout) {
+                    mapFinalTxInputs.emplace(txdsin.prevout, std::make_pair(i, txdsin.prevPubKey));
+                    break;
+                }
+            }
+        }
+    }
+    finalTxData.reset(new PrecomputedTransactionData(CTransaction(finalMutableTransaction)));
+
     // request signatures from clients
     SetState(POOL_STATE_SIGNING);
     RelayFinalTransaction(finalMutableTransaction, connman);
@@ -304,6 +348,8 @@ void CPrivateSendServer::CommitFinalTransaction(CConnman& connman)
     uint256 hashTx = finalTransaction->GetHash();
 
     LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::CommitFinalTransaction -- finalTransaction=%s", finalTransaction->ToString());
+    LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::CommitFinalTransaction -- verified %d inputs in %.2fms, nSessionID: %d\n",
+        nSessionVerifiedInputs, nSessionVerifyTime * 0.001, nSessionID);
 
     {
         // See if the transaction is valid
@@ -511,49 +557,86 @@ void CPrivateSendServer::CheckForCompleteQueue(CConnman& connman)
     }
 }
 
-// Check to make sure a given input matches an input in the pool and its scriptSig is valid
-bool CPrivateSendServer::IsInputScriptSigValid(const CTxIn& txin)
+// Check to make sure given inputs match inputs of the final transaction and their scriptSigs are valid
+bool CPrivateSendServer::IsInputScriptSigsValid(const std::vector<CTxIn>& vecTxIn)
 {
-    CMutableTransaction txNew;
-    txNew.vin.clear();
-    txNew.vout.clear();
-
-    int i = 0;
-    int nTxInIndex = -1;
-    CScript sigPubKey = CScript();
+    if (!finalTxData) {
+        LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigsValid -- no final transaction\n");
+        return false;
+    }
 
-    for (const auto& entry : vecEntries) {
-        for (const auto& txout : entry.vecTxOut) {
-            txNew.vout.push_back(txout);
-        }
-        for (const auto& txdsin : entry.vecTxDSIn) {
-            txNew.vin.push_back(txdsin);
+    int64_t nTimeStart = GetTimeMicros();
 
-            if (txdsin.prevout == txin.prevout) {
-                nTxInIndex = i;
-                sigPubKey = txdsin.prevPubKey;
-            }
-            i++;
+    // only the scriptSigs of the inputs being verified differ from the final transaction
+    CMutableTransaction txNew(finalMutableTransaction);
+    std::vector<std::pair<unsigned int, const CScript*> > vecInputs;
+    std::set<COutPoint> setPrevouts;
+    for (const auto& txin : vecTxIn) {
+        auto it = mapFinalTxInputs.find(txin.prevout);
+        if (it == mapFinalTxInputs.end() || !setPrevouts.insert(txin.prevout).second) {
+            LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigsValid -- Failed to find matching input in pool, %s\n", txin.ToString());
+            return false;
         }
+        txNew.vin[it->second.first].scriptSig = txin.scriptSig;
+        vecInputs.emplace_back(it->second.first, &it->second.second);
     }
 
-    if (nTxInIndex >= 0) { //might have to do this one input at a time?
-        txNew.vin[nTxInIndex].scriptSig = txin.scriptSig;
-        LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigValid -- verifying scriptSig %s\n", ScriptToAsmStr(txin.scriptSig).substr(0, 24));
+    const CTransaction txConst(txNew);
+    std::vector<CScriptCheck> vChecks;
+    vChecks.reserve(vecInputs.size());
+    for (const auto& input : vecInputs) {
         // TODO we're using amount=0 here but we should use the correct amount. This works because Cosanta ignores the amount while signing/verifying (only used in Bitcoin/Segwit)
-        if (!VerifyScript(txNew.vin[nTxInIndex].scriptSig, sigPubKey, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, MutableTransactionSignatureChecker(&txNew, nTxInIndex, 0))) {
-            LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigValid -- VerifyScript() failed on input %d\n", nTxInIndex);
-            return false;
-        }
-    } else {
-        LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigValid -- Failed to find matching input in pool, %s\n", txin.ToString());
+        vChecks.emplace_back(*input.second, 0, txConst, input.first, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, false, finalTxData.get());
+    }
+
+    bool fValid = RunScriptChecks(vChecks);
+
+    nSessionVerifyTime += GetTimeMicros() - nTimeStart;
+    nSessionVerifiedInputs += vecInputs.size();
+
+    if (!fValid) {
+        LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigsValid -- VerifyScript() failed\n");
         return false;
     }
 
-    LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigValid -- Successfully validated input and scriptSig\n");
+    LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::IsInputScriptSigsValid -- Successfully validated %d inputs and scriptSigs\n", vecInputs.size());
     return true;
 }
 
+void CPrivateSendServer::ThreadScriptCheck()
+{
+    RenameThread("cosanta-ps-scriptch");
+    scriptCheckQueue->Thread();
+}
+
+void CPrivateSendServer::StartScriptCheckThreads(boost::thread_group& threadGroup, int nThreads)
+{
+    if (nThreads <= 0) {
+        return;
+    }
+    assert(!scriptCheckQueue);
+    scriptCheckQueue.reset(new CCheckQueue<CScriptCheck>(128));
+    for (int i = 0; i < nThreads; i++) {
+        threadGroup.create_thread(boost::bind(&CPrivateSendServer::ThreadScriptCheck, this));
+    }
+}
+
+bool CPrivateSendServer::RunScriptChecks(std::vector<CScriptCheck>& vChecks)
+{
+    if (!scriptCheckQueue) {
+        for (auto& check : vChecks) {
+            if (!check()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    CCheckQueueControl<CScriptCheck> control(scriptCheckQueue.get());
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 //
 // Add a client's transaction inputs/outputs to the pool
 //
@@ -629,11 +712,6 @@ bool CPrivateSendServer::AddScriptSig(const CTxIn& txinNew)
         }
     }
 
-    if (!IsInputScriptSigValid(txinNew)) {
-        LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::AddScriptSig -- Invalid scriptSig\n");
-        return false;
-    }
-
     LogPrint(BCLog::PRIVATESEND, "CPrivateSendServer::AddScriptSig -- scriptSig=%s new\n", ScriptToAsmStr(txinNew.scriptSig).substr(0, 24));
 
     for (auto& txin : finalMutableTransaction.vin) {
@@ -884,4 +962,6 @@ void CPrivateSendServer::GetJsonInfo(UniValue& obj) const
     obj.push_back(Pair("denomination",  ValueFromAmount(amount)));
     obj.push_back(Pair("state",         GetStateString()));
     obj.push_back(Pair("entries_count", GetEntriesCount()));
+    obj.push_back(Pair("verified_inputs", nSessionVerifiedInputs));
+    obj.push_back(Pair("verification_time", nSessionVerifyTime * 0.001));
 }
@@ -8,9 +8,20 @@
 
 #include "net.h"
 #include "privatesend.h"
+#include "script/interpreter.h"
+
+#include <memory>
 
 class CPrivateSendServer;
+class CScriptCheck;
 class UniValue;
+template <typename T> class CCheckQueue;
+namespace boost {
+class thread_group;
+} // namespace boost
+
+/// Maximum number of threads verifying the scriptSigs of a final transaction, including the calling one
+static const int MAX_PRIVATESEND_SCRIPTCHECK_THREADS = 4;
 
 // The main object for accessing mixing
 extern CPrivateSendServer privateSendServer;
@@ -29,6 +40,21 @@ private:
 
     bool fUnitTest;
 
+    // Position of every input in finalMutableTransaction and the script it spends, by outpoint
+    std::map<COutPoint, std::pair<unsigned int, CScript> > mapFinalTxInputs;
+    // Signature hash data of finalMutableTransaction, scriptSigs don't change it
+    std::unique_ptr<PrecomputedTransactionData> finalTxData;
+
+    // Time spent verifying signatures in the current session, in microseconds
+    int64_t nSessionVerifyTime;
+    int nSessionVerifiedInputs;
+
+    // Verifies the scriptSigs of DSSIGNFINALTX messages. It's separate from the
+    // block script check queue, so mixing never holds up ConnectBlock().
+    std::unique_ptr<CCheckQueue<CScriptCheck> > scriptCheckQueue;
+
+    void ThreadScriptCheck();
+
     /// Add a clients entry to the pool
     bool AddEntry(CConnman& connman, const CPrivateSendEntry& entry, PoolMessage& nMessageIDRet);
     /// Add signature to a txin
@@ -56,8 +82,8 @@ private:
 
     /// Check that all inputs are signed. (Are all inputs signed?)
     bool IsSignaturesComplete();
-    /// Check to make sure a given input matches an input in the pool and its scriptSig is valid
-    bool IsInputScriptSigValid(const CTxIn& txin);
+    /// Check to make sure given inputs match inputs of the final transaction and their scriptSigs are valid
+    bool IsInputScriptSigsValid(const std::vector<CTxIn>& vecTxIn);
 
     // Set the 'state' value, with some logging and capturing when the state changed
     void SetState(PoolState nStateNew);
@@ -71,10 +97,8 @@ private:
     void SetNull();
 
 public:
-    CPrivateSendServer() :
-        vecSessionCollaterals(),
-        nSessionMaxParticipants(0),
-        fUnitTest(false) {}
+    CPrivateSendServer();
+    ~CPrivateSendServer();
 
     void ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, CConnman& connman);
 
@@ -83,6 +107,11 @@ public:
 
     void DoMaintenance(CConnman& connman);
 
+    /// Start nThreads threads which verify scriptSigs next to the thread processing the message
+    void StartScriptCheckThreads(boost::thread_group& threadGroup, int nThreads);
+    /// Run the checks on the script check threads if there are any, otherwise on this thread
+    bool RunScriptChecks(std::vector<CScriptCheck>& vChecks);
+
     void GetJsonInfo(UniValue& obj) const;
 };
 
@@ -4,8 +4,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "clientversion.h"
 #include "core_io.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
@@ -61,6 +63,56 @@ struct CCoin {
     }
 };
 
+/** Unspent output of an address, as sent by /rest/addressutxos */
+struct CRESTAddressUtxo {
+    uint256 txid;
+    uint32_t nIndex;
+    CAmount nValue;
+    CScript script;
+    int32_t nHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    CRESTAddressUtxo() : nIndex(0), nValue(0), nHeight(0) {}
+    CRESTAddressUtxo(const CAddressUnspentKey& key, const CAddressUnspentValue& value) :
+        txid(key.txhash), nIndex(key.index), nValue(value.satoshis), script(value.script), nHeight(value.blockHeight) {}
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(txid);
+        READWRITE(nIndex);
+        READWRITE(nValue);
+        READWRITE(script);
+        READWRITE(nHeight);
+    }
+};
+
+/** Balance change of an address, as sent by /rest/addressdeltas */
+struct CRESTAddressDelta {
+    uint256 txid;
+    uint32_t nIndex;
+    uint32_t nBlockIndex;
+    int32_t nHeight;
+    CAmount nValue;
+
+    ADD_SERIALIZE_METHODS;
+
+    CRESTAddressDelta() : nIndex(0), nBlockIndex(0), nHeight(0), nValue(0) {}
+    CRESTAddressDelta(const CAddressIndexKey& key, CAmount value) :
+        txid(key.txhash), nIndex(key.index), nBlockIndex(key.txindex), nHeight(key.blockHeight), nValue(value) {}
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action)
+    {
+        READWRITE(txid);
+        READWRITE(nIndex);
+        READWRITE(nBlockIndex);
+        READWRITE(nHeight);
+        READWRITE(nValue);
+    }
+};
+
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, std::string message)
 {
     req->WriteHeader("Content-Type", "text/plain");
@@ -122,6 +174,33 @@ static bool CheckWarmup(HTTPRequest* req)
     return true;
 }
 
+/**
+ * Serialize args and send them as binary or hex reply. The binary body is
+ * handed over to the HTTP server without another copy.
+ */
+template <typename... Args>
+static bool WriteSerializedReply(HTTPRequest* req, RetFormat rf, const Args&... args)
+{
+    std::vector<unsigned char> vchReply;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, vchReply, 0, args...);
+
+    if (rf == RF_BINARY) {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, std::move(vchReply));
+    } else {
+        std::string strHex = HexStr(vchReply.begin(), vchReply.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+    }
+    return true;
+}
+
+static bool ParseAddressStr(const std::string& strReq, uint160& hashBytes, int& type)
+{
+    CBitcoinAddress address(strReq);
+    return address.GetIndexKey(hashBytes, type);
+}
+
 static bool rest_headers(HTTPRequest* req,
                          const std::string& strURIPart)
 {
@@ -212,8 +291,10 @@ static bool rest_block(HTTPRequest* req,
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
     CBlockIndex* pblockindex = nullptr;
+    CDiskBlockPos pos;
+    unsigned int nBlockSize;
+    FILE* file;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -223,29 +304,54 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        // Opening under cs_main keeps the file from being pruned in between,
+        // once open it stays readable until closed
+        pos = pblockindex->GetBlockPos();
+        file = OpenRawBlockFile(pos, Params().MessageStart(), nBlockSize);
     }
+    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
+    // The on-disk serialization of a block is the network serialization
+    std::vector<unsigned char> vchBlock;
+    if (rf == RF_BINARY) {
+        // send the bytes straight from the block file without reading them
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        if (req->WriteReplyFile(HTTP_OK, filein.Get(), pos.nPos, nBlockSize))
+            return true;
+    }
+    try {
+        vchBlock.resize(nBlockSize);
+        filein.read((char*)vchBlock.data(), nBlockSize);
+    } catch (const std::exception& e) {
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, hashStr + " could not be read");
+    }
 
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
-        req->WriteHeader("Content-Type", "application/octet-stream");
-        req->WriteReply(HTTP_OK, binaryBlock);
+        req->WriteReply(HTTP_OK, std::move(vchBlock));
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(vchBlock.begin(), vchBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
     }
 
     case RF_JSON: {
+        CBlock block;
+        try {
+            CDataStream ssBlock(vchBlock, SER_NETWORK, PROTOCOL_VERSION);
+            ssBlock >> block;
+        } catch (const std::exception& e) {
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, hashStr + " could not be read");
+        }
+        if (block.GetHash() != hash)
+            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+
         UniValue objBlock;
         {
             LOCK(cs_main);
@@ -594,6 +700,171 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_addressutxos(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string addrStr;
+    const RetFormat rf = ParseDataFormat(addrStr, strURIPart);
+
+    if (!fAddressIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled (start with -addressindex)");
+
+    uint160 hashBytes;
+    int type = 0;
+    if (!ParseAddressStr(addrStr, hashBytes, type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + addrStr);
+
+    if (rf != RF_BINARY && rf != RF_HEX && rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    // Outputs connected after the tip was taken may already be part of the result
+    int nChainHeight;
+    uint256 hashTip;
+    {
+        LOCK(cs_main);
+        nChainHeight = chainActive.Height();
+        hashTip = chainActive.Tip()->GetBlockHash();
+    }
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if (!GetAddressUnspent(hashBytes, type, unspentOutputs))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address " + addrStr);
+
+    std::vector<CRESTAddressUtxo> utxos;
+    utxos.reserve(unspentOutputs.size());
+    for (const auto& p : unspentOutputs) {
+        utxos.emplace_back(p.first, p.second);
+    }
+    std::sort(utxos.begin(), utxos.end(), [](const CRESTAddressUtxo& a, const CRESTAddressUtxo& b) {
+        return a.nHeight < b.nHeight;
+    });
+
+    if (rf != RF_JSON)
+        return WriteSerializedReply(req, rf, nChainHeight, hashTip, utxos);
+
+    UniValue objResponse(UniValue::VOBJ);
+    objResponse.push_back(Pair("chainHeight", nChainHeight));
+    objResponse.push_back(Pair("chaintipHash", hashTip.GetHex()));
+    UniValue arrUtxos(UniValue::VARR);
+    for (const CRESTAddressUtxo& utxo : utxos) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", utxo.txid.GetHex()));
+        obj.push_back(Pair("outputIndex", (int)utxo.nIndex));
+        obj.push_back(Pair("script", HexStr(utxo.script.begin(), utxo.script.end())));
+        obj.push_back(Pair("satoshis", utxo.nValue));
+        obj.push_back(Pair("height", utxo.nHeight));
+        arrUtxos.push_back(obj);
+    }
+    objResponse.push_back(Pair("utxos", arrUtxos));
+
+    std::string strJSON = objResponse.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+static bool rest_addressdeltas(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // <address>[/<start>/<end>]
+    std::vector<std::string> uriParts;
+    boost::split(uriParts, param, boost::is_any_of("/"));
+    if (uriParts.size() != 1 && uriParts.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "No address specified. Use /rest/addressdeltas/<address>[/<start>/<end>].<ext>.");
+
+    if (!fAddressIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled (start with -addressindex)");
+
+    uint160 hashBytes;
+    int type = 0;
+    if (!ParseAddressStr(uriParts[0], hashBytes, type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + uriParts[0]);
+
+    int32_t nStart = 0;
+    int32_t nEnd = 0;
+    if (uriParts.size() == 3) {
+        if (!ParseInt32(uriParts[1], &nStart) || !ParseInt32(uriParts[2], &nEnd) || nStart <= 0 || nEnd < nStart)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid height range: " + uriParts[1] + "/" + uriParts[2]);
+    }
+
+    if (rf != RF_BINARY && rf != RF_HEX && rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    if (!GetAddressIndex(hashBytes, type, addressIndex, nStart, nEnd))
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address " + uriParts[0]);
+
+    std::vector<CRESTAddressDelta> deltas;
+    deltas.reserve(addressIndex.size());
+    for (const auto& p : addressIndex) {
+        deltas.emplace_back(p.first, p.second);
+    }
+
+    if (rf != RF_JSON)
+        return WriteSerializedReply(req, rf, deltas);
+
+    UniValue arrDeltas(UniValue::VARR);
+    for (const CRESTAddressDelta& delta : deltas) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("satoshis", delta.nValue));
+        obj.push_back(Pair("txid", delta.txid.GetHex()));
+        obj.push_back(Pair("index", (int)delta.nIndex));
+        obj.push_back(Pair("blockindex", (int)delta.nBlockIndex));
+        obj.push_back(Pair("height", delta.nHeight));
+        arrDeltas.push_back(obj);
+    }
+
+    std::string strJSON = arrDeltas.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+static bool rest_spentinfo(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    // <txid>-<n>
+    size_t nSep = param.find('-');
+    uint256 txid;
+    int32_t nOutput;
+    if (nSep == std::string::npos || !ParseHashStr(param.substr(0, nSep), txid) ||
+        !ParseInt32(param.substr(nSep + 1), &nOutput) || nOutput < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid outpoint: " + param);
+
+    if (!fSpentIndex)
+        return RESTERR(req, HTTP_NOT_FOUND, "Spent index not enabled (start with -spentindex)");
+
+    if (rf != RF_BINARY && rf != RF_HEX && rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    CSpentIndexKey key(txid, nOutput);
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        return RESTERR(req, HTTP_NOT_FOUND, param + " not spent or unknown");
+
+    if (rf != RF_JSON)
+        return WriteSerializedReply(req, rf, value.txid, (uint32_t)value.inputIndex, (int32_t)value.blockHeight);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+
+    std::string strJSON = obj.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -606,6 +877,9 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/addressutxos/", rest_addressutxos},
+      {"/rest/addressdeltas/", rest_addressdeltas},
+      {"/rest/spentinfo/", rest_spentinfo},
 };
 
 bool StartREST()
@@ -27,7 +27,10 @@
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
+#include "utxosnapshot.h"
 #include "hash.h"
+#include "index/blockfilterindex.h"
+#include "index/coinstatsindex.h"
 #include "warnings.h"
 
 #include "evo/specialtx.h"
@@ -779,6 +782,70 @@ UniValue getblockheader(const JSONRPCRequest& request)
     return blockheaderToJSON(pblockindex);
 }
 
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"     (string, required) The hash of the block\n"
+            "2. \"filtertype\"    (string, optional, default=\"basic\") The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"   (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 blockHash = ParseHashV(request.params[0], "blockhash");
+    std::string strFilterType = BlockFilterTypeName(BlockFilterType::BASIC);
+    if (!request.params[1].isNull()) {
+        strFilterType = request.params[1].get_str();
+    }
+
+    BlockFilterType filterType;
+    if (!BlockFilterTypeByName(strFilterType, filterType)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    if (!blockFilterIndex || blockFilterIndex->GetFilterType() != filterType) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + strFilterType);
+    }
+
+    const CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator it = mapBlockIndex.find(blockHash);
+        if (it == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        pblockindex = it->second;
+    }
+
+    CBlockFilter filter;
+    uint256 filterHeader;
+    if (!blockFilterIndex->LookupFilter(pblockindex, filter) ||
+        !blockFilterIndex->LookupFilterHeader(pblockindex, filterHeader)) {
+        std::string strError = "Filter not found.";
+        if (!blockFilterIndex->IsSynced()) {
+            strError += " Block filters are still in the process of being indexed.";
+        } else {
+            strError += " This error is unexpected and indicates index corruption.";
+        }
+        throw JSONRPCError(RPC_MISC_ERROR, strError);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", filterHeader.GetHex()));
+    return ret;
+}
+
 UniValue getblockheaders(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
@@ -1056,6 +1123,7 @@ struct CCoinsStats
     uint64_t nTransactionOutputs;
     uint64_t nBogoSize;
     uint256 hashSerialized;
+    uint256 hashMuHash;
     uint64_t nDiskSize;
     CAmount nTotalAmount;
 
@@ -1081,11 +1149,12 @@ static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash,
 }
 
 //! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats, bool fMuHash)
 {
     std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
 
     CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    MuHash3072 muhash;
     stats.hashBlock = pcursor->GetBestBlock();
     {
         LOCK(cs_main);
@@ -1103,6 +1172,9 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
                 ApplyStats(stats, ss, prevkey, outputs);
                 outputs.clear();
             }
+            if (fMuHash) {
+                MuHashCoin(muhash, key, coin, false);
+            }
             prevkey = key.hash;
             outputs[key.n] = std::move(coin);
         } else {
@@ -1114,6 +1186,9 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         ApplyStats(stats, ss, prevkey, outputs);
     }
     stats.hashSerialized = ss.GetHash();
+    if (fMuHash) {
+        muhash.Finalize(stats.hashMuHash);
+    }
     stats.nDiskSize = view->EstimateSize();
     return true;
 }
@@ -1167,40 +1242,119 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
     return uint64_t(height);
 }
 
+static UniValue CoinStatsIndexToJSON(const CBlockIndex* pindex, const CCoinStatsIndexEntry& entry, const std::string& hashType)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", (int64_t)pindex->nHeight));
+    ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
+    ret.push_back(Pair("txouts", (int64_t)entry.nTransactionOutputs));
+    ret.push_back(Pair("bogosize", (int64_t)entry.nBogoSize));
+    if (hashType == "muhash") {
+        ret.push_back(Pair("muhash", entry.muhash.GetHex()));
+    }
+    ret.push_back(Pair("total_amount", ValueFromAmount(entry.nTotalAmount)));
+    return ret;
+}
+
 UniValue gettxoutsetinfo(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 0)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( \"hash_type\" hash_or_height )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless the statistics are read from -coinstatsindex.\n"
+            "\nArguments:\n"
+            "1. \"hash_type\"        (string, optional, default=hash_serialized_2) Which UTXO set hash should be calculated:\n"
+            "                       \"hash_serialized_2\", \"muhash\" or \"none\". With -coinstatsindex, \"muhash\" and \"none\"\n"
+            "                       are answered from the index without reading the UTXO set.\n"
+            "2. hash_or_height     (string or numeric, optional) The block hash or height of the target block, only\n"
+            "                       available with -coinstatsindex and a hash_type other than hash_serialized_2.\n"
             "\nResult:\n"
             "{\n"
-            "  \"height\":n,     (numeric) The current block height (index)\n"
-            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
-            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"height\":n,     (numeric) The block height (index) of the statistics\n"
+            "  \"bestblock\": \"hex\",   (string) the hash of the block of the statistics\n"
+            "  \"transactions\": n,      (numeric) The number of transactions, not available from the index\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
-            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash, only for hash_type hash_serialized_2\n"
+            "  \"muhash\": \"hash\",      (string) The rolling MuHash3072 of the UTXO set, only for hash_type muhash\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk, only at the tip\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
+            + HelpExampleCli("gettxoutsetinfo", "\"muhash\" 1000")
             + HelpExampleRpc("gettxoutsetinfo", "")
         );
 
+    std::string hashType = "hash_serialized_2";
+    if (!request.params[0].isNull()) {
+        hashType = request.params[0].get_str();
+        if (hashType != "hash_serialized_2" && hashType != "muhash" && hashType != "none") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s is not a valid hash_type", hashType));
+        }
+    }
+
+    if (!request.params[1].isNull()) {
+        if (!coinStatsIndex) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Querying specific blocks requires -coinstatsindex");
+        }
+        if (hashType == "hash_serialized_2") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "hash_serialized_2 is only available for the current UTXO set, use muhash or none");
+        }
+
+        const CBlockIndex* pindex;
+        {
+            LOCK(cs_main);
+            if (request.params[1].isNum()) {
+                int nHeight = request.params[1].get_int();
+                if (nHeight < 0 || nHeight > chainActive.Height()) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+                }
+                pindex = chainActive[nHeight];
+            } else {
+                uint256 hash = ParseHashV(request.params[1], "hash_or_height");
+                BlockMap::const_iterator it = mapBlockIndex.find(hash);
+                if (it == mapBlockIndex.end()) {
+                    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+                }
+                pindex = it->second;
+            }
+        }
+
+        CCoinStatsIndexEntry entry;
+        if (!coinStatsIndex->LookupStats(pindex, entry)) {
+            throw JSONRPCError(RPC_MISC_ERROR, strprintf("Coin stats of block %s are not indexed yet", pindex->GetBlockHash().ToString()));
+        }
+        return CoinStatsIndexToJSON(pindex, entry, hashType);
+    }
+
+    // the best block of the index may trail the tip by the notifications which are still queued
+    if (hashType != "hash_serialized_2" && coinStatsIndex && coinStatsIndex->IsSynced()) {
+        const CBlockIndex* pindex = coinStatsIndex->GetBestBlock();
+        CCoinStatsIndexEntry entry;
+        if (pindex && coinStatsIndex->LookupStats(pindex, entry)) {
+            UniValue ret = CoinStatsIndexToJSON(pindex, entry, hashType);
+            ret.push_back(Pair("disk_size", pcoinsdbview->EstimateSize()));
+            return ret;
+        }
+    }
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
     FlushStateToDisk();
-    if (GetUTXOStats(pcoinsdbview.get(), stats)) {
+    if (GetUTXOStats(pcoinsdbview.get(), stats, hashType == "muhash")) {
         ret.push_back(Pair("height", (int64_t)stats.nHeight));
         ret.push_back(Pair("bestblock", stats.hashBlock.GetHex()));
         ret.push_back(Pair("transactions", (int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bogosize", (int64_t)stats.nBogoSize));
-        ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        if (hashType == "hash_serialized_2") {
+            ret.push_back(Pair("hash_serialized_2", stats.hashSerialized.GetHex()));
+        } else if (hashType == "muhash") {
+            ret.push_back(Pair("muhash", stats.hashMuHash.GetHex()));
+        }
         ret.push_back(Pair("disk_size", stats.nDiskSize));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     } else {
@@ -1209,6 +1363,50 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrite the UTXO set at the current tip to a snapshot file, together with the block index of the active chain\n"
+            "and the deterministic masternode list and LLMQ commitment state. A new node can be bootstrapped from it with -loadsnapshot.\n"
+            "\nArguments:\n"
+            "1. \"path\"          (string, required) Path of the snapshot file. Relative paths are relative to the data directory.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hex\",     (string) the hash of the block the snapshot was taken at\n"
+            "  \"base_height\": n,        (numeric) the height of that block\n"
+            "  \"coins_written\": n,      (numeric) the number of unspent outputs in the snapshot\n"
+            "  \"muhash\": \"hex\",        (string) the MuHash of the UTXO set, see gettxoutsetinfo\n"
+            "  \"evohash\": \"hex\",       (string) the hash of the masternode list and LLMQ commitment records\n"
+            "  \"path\": \"path\"          (string) the absolute path of the snapshot file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s already exists", path.string()));
+    }
+
+    CUTXOSnapshotMetadata metadata;
+    std::string strError;
+    if (!DumpUTXOSnapshot(path, metadata, strError)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, strprintf("Unable to write the snapshot: %s", strError));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", metadata.baseBlockHash.GetHex()));
+    ret.push_back(Pair("base_height", (int64_t)metadata.nBaseHeight));
+    ret.push_back(Pair("coins_written", (int64_t)metadata.nCoins));
+    ret.push_back(Pair("muhash", metadata.muhash.GetHex()));
+    ret.push_back(Pair("evohash", metadata.evohash.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1409,6 +1607,18 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"pruneheight\": xxxxxx,    (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,  (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"coins_cache\": {           (object) state of the in-memory UTXO set cache\n"
+            "     \"entries\": xxxxxx,        (numeric) the number of cached coins\n"
+            "     \"usage\": xxxxxx,          (numeric) the memory usage of the cache in bytes\n"
+            "     \"hits\": xxxxxx,           (numeric) the number of lookups answered from the cache since startup\n"
+            "     \"misses\": xxxxxx,         (numeric) the number of lookups which had to read the coins database\n"
+            "     \"hit_rate\": x.xxx,        (numeric) hits / (hits + misses)\n"
+            "     \"flushes\": xxxxxx,        (numeric) the number of flushes to the coins database since startup\n"
+            "     \"last_flush_time\": xxx,   (numeric) the time of the last flush in seconds since epoch (Jan 1 1970 GMT)\n"
+            "     \"last_flush_duration\": x.xxx,  (numeric) the duration of the last flush in seconds\n"
+            "     \"total_flush_duration\": x.xxx, (numeric) the duration of all flushes in seconds\n"
+            "     \"last_flush_evicted\": xxx, (numeric) the number of coins evicted by the last flush\n"
+            "  },\n"
             "  \"softforks\": [            (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",        (string) name of softfork\n"
@@ -1473,6 +1683,21 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         }
     }
 
+    UniValue coinsCache(UniValue::VOBJ);
+    uint64_t nCacheHits = pcoinsTip->GetCacheHits();
+    uint64_t nCacheMisses = pcoinsTip->GetCacheMisses();
+    coinsCache.push_back(Pair("entries",              (uint64_t)pcoinsTip->GetCacheSize()));
+    coinsCache.push_back(Pair("usage",                (uint64_t)pcoinsTip->DynamicMemoryUsage()));
+    coinsCache.push_back(Pair("hits",                 nCacheHits));
+    coinsCache.push_back(Pair("misses",               nCacheMisses));
+    coinsCache.push_back(Pair("hit_rate",             nCacheHits + nCacheMisses > 0 ? (double)nCacheHits / (nCacheHits + nCacheMisses) : 0.0));
+    coinsCache.push_back(Pair("flushes",              coinsFlushStats.nFlushes));
+    coinsCache.push_back(Pair("last_flush_time",      coinsFlushStats.nLastFlushTime));
+    coinsCache.push_back(Pair("last_flush_duration",  coinsFlushStats.nLastFlushDuration * 0.000001));
+    coinsCache.push_back(Pair("total_flush_duration", coinsFlushStats.nTotalFlushDuration * 0.000001));
+    coinsCache.push_back(Pair("last_flush_evicted",   coinsFlushStats.nLastFlushEvicted));
+    obj.push_back(Pair("coins_cache",           coinsCache));
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     CBlockIndex* tip = chainActive.Tip();
     UniValue softforks(UniValue::VARR);
@@ -2114,6 +2339,8 @@ UniValue getspecialtxes(const JSONRPCRequest& request)
             "\nIf verbosity is 0, returns tx hash for each transaction.\n"
             "If verbosity is 1, returns hex-encoded data for each transaction.\n"
             "If verbosity is 2, returns an Object with information for each transaction.\n"
+            "With -specialtxindex, transactions of blocks in the active chain are read from the index\n"
+            "instead of the block files.\n"
             "\nArguments:\n"
             "1. \"blockhash\"          (string, required) The block hash\n"
             "2. type                 (numeric, optional, default=-1) Filter special txes by type, -1 means all types\n"
@@ -2173,11 +2400,33 @@ UniValue getspecialtxes(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
     CBlockIndex* pblockindex = mapBlockIndex[hash];
-    const CBlock block = GetBlockChecked(pblockindex);
+
+    std::vector<CTransactionRef> vtx;
+    if (fSpecialTxIndex && chainActive.Contains(pblockindex) && nTxType >= -1 && nTxType <= std::numeric_limits<uint16_t>::max()) {
+        std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > specialTxIndex;
+        int nTypeBegin = nTxType == -1 ? TRANSACTION_PROVIDER_REGISTER : nTxType;
+        int nTypeEnd = nTxType == -1 ? TRANSACTION_QUORUM_COMMITMENT : nTxType;
+        for (int nType = nTypeBegin; nType <= nTypeEnd; nType++) {
+            if (!GetSpecialTxIndex(nType, pblockindex->nHeight, pblockindex->nHeight, specialTxIndex)) {
+                throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read special tx index");
+            }
+        }
+        // keep the order of the block when several types are returned
+        std::sort(specialTxIndex.begin(), specialTxIndex.end(),
+            [](const std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue>& a, const std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue>& b) {
+                return a.first.txIndex < b.first.txIndex;
+            });
+        for (const auto& p : specialTxIndex) {
+            vtx.push_back(p.second.tx);
+        }
+    } else {
+        const CBlock block = GetBlockChecked(pblockindex);
+        vtx = block.vtx;
+    }
 
     int nTxNum = 0;
     UniValue result(UniValue::VARR);
-    for(const auto& tx : block.vtx)
+    for(const auto& tx : vtx)
     {
         if (tx->nVersion != 3 || tx->nType == TRANSACTION_NORMAL // ensure it's in fact a special tx
             || (nTxType != -1 && tx->nType != nTxType)) { // ensure special tx type matches filter, if given
@@ -2220,6 +2469,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getblockheaders",        &getblockheaders,        {"blockhash","count","verbose"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash","filtertype"} },
     { "blockchain",         "getmerkleblocks",        &getmerkleblocks,        {"filter","blockhash","count"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {"count","branchlen"} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
@@ -2230,8 +2480,9 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "getspecialtxes",         &getspecialtxes,         {"blockhash", "type", "count", "skip", "verbosity"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {"hash_type", "hash_or_height"} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
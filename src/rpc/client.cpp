@@ -97,6 +97,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "sendmany", 6, "use_is" },
     { "sendmany", 7, "use_ps" },
     { "sendmany", 8, "conf_target" },
+    { "sendmanybatch", 0, "batch" },
+    { "sendmanybatch", 1, "minconf" },
+    { "sendmanybatch", 2, "addlocked" },
+    { "sendmanybatch", 4, "use_ps" },
+    { "sendmanybatch", 5, "conf_target" },
     { "addmultisigaddress", 0, "nrequired" },
     { "addmultisigaddress", 1, "keys" },
     { "createmultisig", 0, "nrequired" },
@@ -141,6 +146,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "verifychain", 1, "nblocks" },
     { "getblockstats", 0, "hash_or_height" },
     { "getblockstats", 1, "stats" },
+    { "gettxoutsetinfo", 1, "hash_or_height" },
     { "pruneblockchain", 0, "height" },
     { "keypoolrefill", 0, "newsize" },
     { "getrawmempool", 0, "verbose" },
@@ -1181,6 +1181,10 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"logqueue\": {             (json object) Information about the debug.log writer queue\n"
+            "    \"size\": xxxxx,          (numeric) Number of lines the queue can hold, 0 if lines are written synchronously\n"
+            "    \"dropped\": xxxxx,       (numeric) Number of lines dropped because the queue was full\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -1194,6 +1198,10 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        UniValue logqueue(UniValue::VOBJ);
+        logqueue.push_back(Pair("size", (uint64_t)GetLogQueueSize()));
+        logqueue.push_back(Pair("dropped", GetDroppedLogLines()));
+        obj.push_back(Pair("logqueue", logqueue));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -9,6 +9,7 @@
 #include "chainparams.h"
 #include "clientversion.h"
 #include "core_io.h"
+#include "invresponsecache.h"
 #include "validation.h"
 #include "net.h"
 #include "net_processing.h"
@@ -438,6 +439,25 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
             "  \"timeoffset\": xxxxx,                   (numeric) the time offset\n"
             "  \"connections\": xxxxx,                  (numeric) the number of connections\n"
             "  \"networkactive\": true|false,           (bool) whether p2p networking is enabled\n"
+            "  \"socketevents\": \"xxx\",                (string) the socket events mode, either epoll, poll or select\n"
+            "  \"socketloop\": {                        (json object) timing of the socket handler loop\n"
+            "    \"iterations\": xxxxx,                 (numeric) number of iterations\n"
+            "    \"avgwait\": xxxxx,                    (numeric) average time waiting for socket events, in microseconds\n"
+            "    \"avghandle\": xxxxx,                  (numeric) average time handling socket events, in microseconds\n"
+            "    \"maxhandle\": xxxxx,                  (numeric) maximum time handling socket events, in microseconds\n"
+            "  },\n"
+            "  \"msghandthreads\": [                    (array) per message handler thread\n"
+            "    xxxxx,                             (numeric) time spent processing messages, in milliseconds\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"invcache\": {                          (json object) cache of serialized governance and LLMQ getdata responses\n"
+            "    \"entries\": xxxxx,                    (numeric) number of cached responses\n"
+            "    \"bytes\": xxxxx,                      (numeric) total size of cached responses\n"
+            "    \"hits\": xxxxx,                       (numeric) number of responses served from the cache\n"
+            "    \"misses\": xxxxx,                     (numeric) number of responses which had to be serialized\n"
+            "    \"hitratio\": x.xxx,                   (numeric) hits / (hits + misses)\n"
+            "    \"bytessaved\": xxxxx,                 (numeric) bytes which did not have to be serialized again\n"
+            "  },\n"
             "  \"networks\": [                          (array) information per network\n"
             "  {\n"
             "    \"name\": \"xxx\",                     (string) network (ipv4, ipv6 or onion)\n"
@@ -477,7 +497,30 @@ UniValue getnetworkinfo(const JSONRPCRequest& request)
     if (g_connman) {
         obj.push_back(Pair("networkactive", g_connman->GetNetworkActive()));
         obj.push_back(Pair("connections",   (int)g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL)));
+        obj.push_back(Pair("socketevents",  GetSocketEventsModeName(g_connman->GetSocketEventsMode())));
+        CConnman::SocketLoopStats stats = g_connman->GetSocketLoopStats();
+        UniValue socketLoop(UniValue::VOBJ);
+        socketLoop.push_back(Pair("iterations", stats.nIterations));
+        socketLoop.push_back(Pair("avgwait",    stats.nIterations ? stats.nWaitTime / (int64_t)stats.nIterations : 0));
+        socketLoop.push_back(Pair("avghandle",  stats.nIterations ? stats.nHandleTime / (int64_t)stats.nIterations : 0));
+        socketLoop.push_back(Pair("maxhandle",  stats.nMaxHandleTime));
+        obj.push_back(Pair("socketloop",    socketLoop));
+        UniValue msgHandThreads(UniValue::VARR);
+        for (int64_t nBusyTime : g_connman->GetMessageHandlerBusyTimes()) {
+            msgHandThreads.push_back(nBusyTime / 1000);
+        }
+        obj.push_back(Pair("msghandthreads", msgHandThreads));
     }
+    CInvResponseCache::Stats invCacheStats = invResponseCache.GetStats();
+    UniValue invCache(UniValue::VOBJ);
+    invCache.push_back(Pair("entries",      (uint64_t)invCacheStats.nEntries));
+    invCache.push_back(Pair("bytes",        (uint64_t)invCacheStats.nBytes));
+    invCache.push_back(Pair("hits",         invCacheStats.nHits));
+    invCache.push_back(Pair("misses",       invCacheStats.nMisses));
+    uint64_t nRequests = invCacheStats.nHits + invCacheStats.nMisses;
+    invCache.push_back(Pair("hitratio",     nRequests ? (double)invCacheStats.nHits / nRequests : 0.0));
+    invCache.push_back(Pair("bytessaved",   invCacheStats.nBytesSaved));
+    obj.push_back(Pair("invcache",      invCache));
     obj.push_back(Pair("networks",      GetNetworksInfo()));
     obj.push_back(Pair("relayfee",      ValueFromAmount(::minRelayTxFee.GetFeePerK())));
     obj.push_back(Pair("incrementalfee", ValueFromAmount(::incrementalRelayFee.GetFeePerK())));
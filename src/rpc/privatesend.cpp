@@ -121,6 +121,8 @@ UniValue getprivatesendinfo(const JSONRPCRequest& request)
                 "  \"denomination\": xxx,               (numeric) The denomination of the mixing session in " + CURRENCY_UNIT + "\n"
                 "  \"state\": \"...\",                    (string) Current state of the mixing session\n"
                 "  \"entries_count\": xxx,              (numeric) The number of entries in the mixing session\n"
+                "  \"verified_inputs\": xxx,            (numeric) The number of input signatures verified in the mixing session\n"
+                "  \"verification_time\": xxx,          (numeric) Time spent verifying signatures in the mixing session, in milliseconds\n"
                 "}\n"
                 "\nExamples:\n"
                 + HelpExampleCli("getprivatesendinfo", "")
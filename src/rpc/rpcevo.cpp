@@ -33,6 +33,8 @@ extern UniValue signrawtransaction(const JSONRPCRequest& request);
 extern UniValue sendrawtransaction(const JSONRPCRequest& request);
 #endif//ENABLE_WALLET
 
+extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
+
 std::string GetHelpString(int nParamNum, std::string strParamName)
 {
     static const std::map<std::string, std::string> mapParamHelp = {
@@ -1123,6 +1125,83 @@ UniValue protx_diff(const JSONRPCRequest& request)
     return ret;
 }
 
+void protx_history_help()
+{
+    throw std::runtime_error(
+            "protx history \"proTxHash\" ( detailed )\n"
+            "\nReturns the ProRegTx and all later ProUpServTx, ProUpRegTx and ProUpRevTx of a masternode,\n"
+            "including masternodes which are not part of the current list anymore. Requires -specialtxindex.\n"
+            "\nArguments:\n"
+            + GetHelpString(1, "proTxHash") +
+            "2. \"detailed\"            (bool, optional, default=false) Include the decoded transactions.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"height\" : n,          (numeric) The height of the block containing the transaction\n"
+            "    \"blockhash\" : \"hash\", (string) The hash of the block containing the transaction\n"
+            "    \"type\" : n,            (numeric) The special transaction type\n"
+            "    \"txid\" : \"hash\",      (string) The transaction id\n"
+            "    \"tx\" : {...}           (json object) The transaction in the format of getrawtransaction, if detailed\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("protx", "history \"0123456701234567012345670123456701234567012345670123456701234567\"")
+    );
+}
+
+UniValue protx_history(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3) {
+        protx_history_help();
+    }
+
+    uint256 proTxHash = ParseHashV(request.params[1], "proTxHash");
+    bool detailed = !request.params[2].isNull() ? ParseBoolV(request.params[2], "detailed") : false;
+
+    if (!fSpecialTxIndex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Special tx index not enabled, restart with -specialtxindex and -reindex");
+    }
+
+    LOCK(cs_main);
+
+    std::vector<std::pair<CProTxIndexKey, uint16_t> > proTxIndex;
+    if (!GetProTxIndex(proTxHash, 0, std::numeric_limits<int>::max(), proTxIndex)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read special tx index");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const auto& p : proTxIndex) {
+        const CProTxIndexKey& key = p.first;
+
+        // the transaction itself is stored in the entry of its type and height
+        std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > specialTxIndex;
+        if (!GetSpecialTxIndex(p.second, key.blockHeight, key.blockHeight, specialTxIndex)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read special tx index");
+        }
+        auto it = std::find_if(specialTxIndex.begin(), specialTxIndex.end(), [&](const std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue>& e) {
+            return e.first.txIndex == key.txIndex;
+        });
+        if (it == specialTxIndex.end()) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, strprintf("Special tx index is missing tx %d at height %d", key.txIndex, key.blockHeight));
+        }
+        const CSpecialTxIndexValue& value = it->second;
+
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("height", key.blockHeight));
+        obj.push_back(Pair("blockhash", value.blockHash.ToString()));
+        obj.push_back(Pair("type", (int)p.second));
+        obj.push_back(Pair("txid", value.tx->GetHash().ToString()));
+        if (detailed) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(*value.tx, value.blockHash, objTx);
+            obj.push_back(Pair("tx", objTx));
+        }
+        ret.push_back(obj);
+    }
+
+    return ret;
+}
+
 [[ noreturn ]] void protx_help()
 {
     throw std::runtime_error(
@@ -1140,6 +1219,7 @@ UniValue protx_diff(const JSONRPCRequest& request)
 #endif
             "  list              - List ProTxs\n"
             "  info              - Return information about a ProTx\n"
+            "  history           - Return all ProTxs of a masternode (requires -specialtxindex)\n"
 #ifdef ENABLE_WALLET
             "  update_service    - Create and send ProUpServTx to network\n"
             "  update_registrar  - Create and send ProUpRegTx to network\n"
@@ -1177,6 +1257,8 @@ UniValue protx(const JSONRPCRequest& request)
         return protx_list(request);
     } else if (command == "info") {
         return protx_info(request);
+    } else if (command == "history") {
+        return protx_history(request);
     } else if (command == "diff") {
         return protx_diff(request);
     } else {
@@ -9,6 +9,7 @@
 
 #include "base58.h"
 #include "fs.h"
+#include "httpserver.h"
 #include "init.h"
 #include "random.h"
 #include "sync.h"
@@ -34,6 +35,36 @@ static bool fRPCInWarmup GUARDED_BY(cs_rpcWarmup) = true;
 static std::string rpcWarmupStatus GUARDED_BY(cs_rpcWarmup) = "RPC server started";
 /* Timer-creating functions */
 static RPCTimerInterface* timerInterface = nullptr;
+
+struct RPCCommandExecutionInfo
+{
+    std::string method;
+    int64_t start;
+};
+
+struct RPCServerInfo
+{
+    CCriticalSection cs;
+    std::list<RPCCommandExecutionInfo> active_commands GUARDED_BY(cs);
+};
+
+static RPCServerInfo g_rpc_server_info;
+
+/** Keeps a command in RPCServerInfo::active_commands while it executes */
+struct RPCCommandExecution
+{
+    std::list<RPCCommandExecutionInfo>::iterator it;
+    explicit RPCCommandExecution(const std::string& method)
+    {
+        LOCK(g_rpc_server_info.cs);
+        it = g_rpc_server_info.active_commands.insert(g_rpc_server_info.active_commands.end(), {method, GetTimeMicros()});
+    }
+    ~RPCCommandExecution()
+    {
+        LOCK(g_rpc_server_info.cs);
+        g_rpc_server_info.active_commands.erase(it);
+    }
+};
 /* Map of name to timer. */
 static std::map<std::string, std::unique_ptr<RPCTimerBase> > deadlineTimers;
 
@@ -321,6 +352,99 @@ UniValue uptime(const JSONRPCRequest& jsonRequest)
     return GetTime() - GetStartupTime();
 }
 
+static UniValue TimingHistogramToJSON(const HTTPTimingHistogram& histogram)
+{
+    UniValue buckets(UniValue::VOBJ);
+    for (size_t i = 0; i < histogram.buckets.size(); i++) {
+        std::string key = i < HTTPTimingHistogram::BUCKET_LIMITS_MS.size() ?
+                          strprintf("<%dms", HTTPTimingHistogram::BUCKET_LIMITS_MS[i]) :
+                          strprintf(">=%dms", HTTPTimingHistogram::BUCKET_LIMITS_MS.back());
+        buckets.push_back(Pair(key, histogram.buckets[i]));
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("total_ms", histogram.nTotalMicros / 1000));
+    obj.push_back(Pair("max_ms", histogram.nMaxMicros / 1000));
+    obj.push_back(Pair("histogram", buckets));
+    return obj;
+}
+
+UniValue getrpcinfo(const JSONRPCRequest& jsonRequest)
+{
+    if (jsonRequest.fHelp || jsonRequest.params.size() > 0)
+        throw std::runtime_error(
+                "getrpcinfo\n"
+                        "\nReturns details of the RPC server.\n"
+                        "\nResult:\n"
+                        "{\n"
+                        "  \"active_commands\": [       (array) All active commands\n"
+                        "    {                        (object) Information about an active command\n"
+                        "      \"method\": \"xxx\",       (string) The name of the RPC command\n"
+                        "      \"duration\": n          (numeric) The running time in microseconds\n"
+                        "    },\n"
+                        "    ...\n"
+                        "  ],\n"
+                        "  \"logpath\": \"xxx\",          (string) The complete file path to the debug log\n"
+                        "  \"work_queue\": {            (object) Work queue statistics of the RPC/REST server, per method\n"
+                        "    \"method\": {             (object) RPC method, \"batch\", \"unknown\" or REST path prefix\n"
+                        "      \"lane\": \"xxx\",          (string) Work queue lane: priority, default or heavy\n"
+                        "      \"max_active\": n,        (numeric) Limit of concurrently executing calls, 0 if unlimited\n"
+                        "      \"active\": n,            (numeric) Number of calls currently executing\n"
+                        "      \"queued\": n,            (numeric) Number of calls waiting in the work queue\n"
+                        "      \"calls\": n,             (numeric) Number of finished calls\n"
+                        "      \"rejected\": n,          (numeric) Number of calls rejected because the work queue was full\n"
+                        "      \"queue_wait\": {         (object) Time spent waiting in the work queue\n"
+                        "        \"total_ms\": n,        (numeric) Sum over all calls\n"
+                        "        \"max_ms\": n,          (numeric) Longest single call\n"
+                        "        \"histogram\": {        (object) Number of calls per time bucket\n"
+                        "          \"<1ms\": n,\n"
+                        "          ...\n"
+                        "          \">=5000ms\": n\n"
+                        "        }\n"
+                        "      },\n"
+                        "      \"execution\": {...}      (object) Time spent executing, same layout as queue_wait\n"
+                        "    },\n"
+                        "    ...\n"
+                        "  }\n"
+                        "}\n"
+                        "\nExamples:\n"
+                + HelpExampleCli("getrpcinfo", "")
+                + HelpExampleRpc("getrpcinfo", "")
+        );
+
+    UniValue active_commands(UniValue::VARR);
+    {
+        LOCK(g_rpc_server_info.cs);
+        for (const RPCCommandExecutionInfo& info : g_rpc_server_info.active_commands) {
+            UniValue entry(UniValue::VOBJ);
+            entry.push_back(Pair("method", info.method));
+            entry.push_back(Pair("duration", GetTimeMicros() - info.start));
+            active_commands.push_back(entry);
+        }
+    }
+
+    UniValue work_queue(UniValue::VOBJ);
+    for (const auto& p : GetHTTPWorkStats()) {
+        const HTTPWorkStats& stats = p.second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("lane", HTTPWorkLaneName(stats.lane)));
+        obj.push_back(Pair("max_active", (uint64_t)stats.nMaxActive));
+        obj.push_back(Pair("active", (uint64_t)stats.nActive));
+        obj.push_back(Pair("queued", (uint64_t)stats.nQueued));
+        obj.push_back(Pair("calls", stats.nCalls));
+        obj.push_back(Pair("rejected", stats.nRejected));
+        obj.push_back(Pair("queue_wait", TimingHistogramToJSON(stats.queueWait)));
+        obj.push_back(Pair("execution", TimingHistogramToJSON(stats.execution)));
+        work_queue.push_back(Pair(p.first, obj));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("active_commands", active_commands));
+    ret.push_back(Pair("logpath", GetDebugLogPath().string()));
+    ret.push_back(Pair("work_queue", work_queue));
+    return ret;
+}
+
 /**
  * Call Table
  */
@@ -331,6 +455,7 @@ static const CRPCCommand vRPCCommands[] =
     { "control",            "help",                   &help,                   {"command"}  },
     { "control",            "stop",                   &stop,                   {"wait"}  },
     { "control",            "uptime",                 &uptime,                 {}  },
+    { "control",            "getrpcinfo",             &getrpcinfo,             {}  },
 };
 
 CRPCTable::CRPCTable()
@@ -558,6 +683,7 @@ UniValue CRPCTable::execute(const JSONRPCRequest &request) const
 
     try
     {
+        RPCCommandExecution execution(request.strMethod);
         // Execute, convert arguments to array if necessary
         if (request.params.isObject()) {
             return pcmd->actor(transformNamedArguments(request, pcmd->argNames));
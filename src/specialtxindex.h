@@ -0,0 +1,152 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_SPECIALTXINDEX_H
+#define COSANTA_SPECIALTXINDEX_H
+
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** -specialtxindex entry of a special transaction, ordered by type, height and position in the block */
+struct CSpecialTxIndexKey {
+    uint16_t type;
+    int blockHeight;
+    unsigned int txIndex;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 12;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, type);
+        // Heights are stored big-endian for binary search through LevelDB
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txIndex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        type = ser_readdata32be(s);
+        blockHeight = ser_readdata32be(s);
+        txIndex = ser_readdata32be(s);
+    }
+
+    CSpecialTxIndexKey(uint16_t nType, int nHeight, unsigned int nTxIndex) {
+        type = nType;
+        blockHeight = nHeight;
+        txIndex = nTxIndex;
+    }
+
+    CSpecialTxIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        blockHeight = 0;
+        txIndex = 0;
+    }
+};
+
+struct CSpecialTxIndexIteratorHeightKey {
+    uint16_t type;
+    int blockHeight;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, type);
+        ser_writedata32be(s, blockHeight);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        type = ser_readdata32be(s);
+        blockHeight = ser_readdata32be(s);
+    }
+
+    CSpecialTxIndexIteratorHeightKey(uint16_t nType, int nHeight) {
+        type = nType;
+        blockHeight = nHeight;
+    }
+
+    CSpecialTxIndexIteratorHeightKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        blockHeight = 0;
+    }
+};
+
+/** The transaction itself is kept in the index, so that queries don't have to read block files */
+struct CSpecialTxIndexValue {
+    uint256 blockHash;
+    CTransactionRef tx;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(blockHash);
+        READWRITE(tx);
+    }
+
+    CSpecialTxIndexValue(const uint256& hash, const CTransactionRef& txIn) {
+        blockHash = hash;
+        tx = txIn;
+    }
+
+    CSpecialTxIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHash.SetNull();
+        tx = nullptr;
+    }
+};
+
+/** -specialtxindex entry of a ProTx (register, update or revoke), ordered by proTxHash and height */
+struct CProTxIndexKey {
+    uint256 proTxHash;
+    int blockHeight;
+    unsigned int txIndex;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 40;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        proTxHash.Serialize(s);
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txIndex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        proTxHash.Unserialize(s);
+        blockHeight = ser_readdata32be(s);
+        txIndex = ser_readdata32be(s);
+    }
+
+    CProTxIndexKey(const uint256& hash, int nHeight, unsigned int nTxIndex) {
+        proTxHash = hash;
+        blockHeight = nHeight;
+        txIndex = nTxIndex;
+    }
+
+    CProTxIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        proTxHash.SetNull();
+        blockHeight = 0;
+        txIndex = 0;
+    }
+};
+
+#endif // COSANTA_SPECIALTXINDEX_H
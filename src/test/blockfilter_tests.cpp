@@ -0,0 +1,134 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+
+#include "primitives/block.h"
+#include "script/script.h"
+#include "undo.h"
+#include "test/test_cosanta.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(gcsfilter_test)
+{
+    CGCSFilter::ElementSet included_elements, excluded_elements;
+    for (int i = 0; i < 100; ++i) {
+        CGCSFilter::Element element1(32);
+        element1[0] = i;
+        included_elements.insert(std::move(element1));
+
+        CGCSFilter::Element element2(32);
+        element2[1] = i;
+        excluded_elements.insert(std::move(element2));
+    }
+
+    CGCSFilter filter(0, 0, 10, 1 << 10, included_elements);
+    BOOST_CHECK_EQUAL(filter.GetN(), included_elements.size());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(filter.Match(element));
+
+        auto insertion = excluded_elements.insert(element);
+        BOOST_CHECK(filter.MatchAny(excluded_elements));
+        excluded_elements.erase(insertion.first);
+    }
+
+    // the decoded filter matches the same elements
+    CGCSFilter decoded(0, 0, 10, 1 << 10, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(decoded.GetN(), filter.GetN());
+    BOOST_CHECK(decoded.GetEncoded() == filter.GetEncoded());
+    for (const auto& element : included_elements) {
+        BOOST_CHECK(decoded.Match(element));
+    }
+
+    // trailing data and truncated encodings are rejected
+    std::vector<unsigned char> vchExtended = filter.GetEncoded();
+    vchExtended.push_back(0xff);
+    BOOST_CHECK_THROW(CGCSFilter(0, 0, 10, 1 << 10, vchExtended), std::ios_base::failure);
+    std::vector<unsigned char> vchTruncated = filter.GetEncoded();
+    vchTruncated.resize(vchTruncated.size() / 2);
+    BOOST_CHECK_THROW(CGCSFilter(0, 0, 10, 1 << 10, vchTruncated), std::ios_base::failure);
+
+    CGCSFilter empty;
+    BOOST_CHECK_EQUAL(empty.GetN(), 0U);
+    BOOST_CHECK(!empty.MatchAny(included_elements));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_test)
+{
+    CScript included_scripts[5], excluded_scripts[3];
+
+    // Some random output scripts.
+    included_scripts[0] << std::vector<unsigned char>(0, 65) << OP_CHECKSIG;
+    included_scripts[1] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(1, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    included_scripts[2] << OP_1 << std::vector<unsigned char>(2, 33) << OP_1 << OP_CHECKMULTISIG;
+
+    // Some random scripts spent by the block's inputs.
+    included_scripts[3] << OP_HASH160 << std::vector<unsigned char>(3, 20) << OP_EQUAL;
+    included_scripts[4] << OP_DUP << OP_HASH160 << std::vector<unsigned char>(4, 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    // OP_RETURN outputs and empty scripts are not part of the filter.
+    excluded_scripts[0] << OP_RETURN << OP_4 << OP_ADD << OP_8 << OP_EQUAL;
+    excluded_scripts[1] << std::vector<unsigned char>(5, 33) << OP_CHECKSIG;
+
+    CMutableTransaction tx_1;
+    tx_1.vout.emplace_back(100, included_scripts[0]);
+    tx_1.vout.emplace_back(200, included_scripts[1]);
+    tx_1.vout.emplace_back(0, excluded_scripts[0]);
+
+    CMutableTransaction tx_2;
+    tx_2.vout.emplace_back(300, included_scripts[2]);
+    tx_2.vout.emplace_back(0, excluded_scripts[2]);
+    tx_2.vout.emplace_back(400, excluded_scripts[2]); // Script is empty
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx_1));
+    block.vtx.push_back(MakeTransactionRef(tx_2));
+
+    CBlockUndo block_undo;
+    block_undo.vtxundo.emplace_back();
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(500, included_scripts[3]), 1000, true, false);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(600, included_scripts[4]), 10000, false, false);
+    block_undo.vtxundo.back().vprevout.emplace_back(CTxOut(700, excluded_scripts[2]), 100000, false, false);
+
+    CBlockFilter block_filter(BlockFilterType::BASIC, block, block_undo);
+    BOOST_CHECK(block_filter.GetBlockHash() == block.GetHash());
+    const CGCSFilter& filter = block_filter.GetFilter();
+    BOOST_CHECK_EQUAL(filter.GetN(), 5U);
+
+    for (const CScript& script : included_scripts) {
+        BOOST_CHECK(filter.Match(CGCSFilter::Element(script.begin(), script.end())));
+    }
+    for (const CScript& script : excluded_scripts) {
+        BOOST_CHECK(!filter.Match(CGCSFilter::Element(script.begin(), script.end())));
+    }
+
+    // Test serialization/unserialization.
+    CBlockFilter block_filter2(BlockFilterType::BASIC, block.GetHash(), block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter2.GetFilterType() == block_filter.GetFilterType());
+    BOOST_CHECK(block_filter2.GetBlockHash() == block_filter.GetBlockHash());
+    BOOST_CHECK(block_filter2.GetEncodedFilter() == block_filter.GetEncodedFilter());
+    BOOST_CHECK(block_filter2.GetHash() == block_filter.GetHash());
+
+    // the header commits to the previous one
+    uint256 header1 = block_filter.ComputeHeader(uint256());
+    uint256 header2 = block_filter.ComputeHeader(header1);
+    BOOST_CHECK(header1 != header2);
+    BOOST_CHECK(block_filter2.ComputeHeader(header1) == header2);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_type_names)
+{
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(BlockFilterType::BASIC), "basic");
+    BOOST_CHECK_EQUAL(BlockFilterTypeName(static_cast<BlockFilterType>(1)), "");
+
+    BlockFilterType filter_type;
+    BOOST_CHECK(BlockFilterTypeByName("basic", filter_type));
+    BOOST_CHECK(filter_type == BlockFilterType::BASIC);
+    BOOST_CHECK(!BlockFilterTypeByName("unknown", filter_type));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
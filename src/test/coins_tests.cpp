@@ -9,6 +9,7 @@
 #include "undo.h"
 #include "utilstrencodings.h"
 #include "test/test_cosanta.h"
+#include "txdb.h"
 #include "validation.h"
 #include "consensus/validation.h"
 
@@ -856,4 +857,142 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+BOOST_AUTO_TEST_CASE(ccoins_add_prefetched)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+
+    COutPoint outSpent(InsecureRand256(), 0);
+    COutPoint outNew(InsecureRand256(), 1);
+    Coin coin(CTxOut(1000, CScript() << OP_TRUE), 1, false, false);
+
+    CCoinsMap mapBase;
+    mapBase[outSpent].coin = coin;
+    mapBase[outSpent].flags = CCoinsCacheEntry::DIRTY;
+    base.BatchWrite(mapBase, InsecureRand256());
+
+    // a spend which has not been flushed yet must not be undone by the stale coin of the base
+    cache.AccessCoin(outSpent);
+    BOOST_CHECK(cache.SpendCoin(outSpent));
+    BOOST_CHECK(cache.IsCached(outSpent));
+    BOOST_CHECK(!cache.HaveCoinInCache(outSpent));
+    BOOST_CHECK(!cache.IsCached(outNew));
+
+    std::vector<std::pair<COutPoint, Coin> > vCoins;
+    vCoins.emplace_back(outSpent, coin);
+    vCoins.emplace_back(outNew, coin);
+    BOOST_CHECK_EQUAL(cache.AddPrefetchedCoins(vCoins), 1U);
+    BOOST_CHECK(!cache.HaveCoinInCache(outSpent));
+    BOOST_CHECK(cache.HaveCoinInCache(outNew));
+    // prefetched coins are clean, they only mirror the base
+    BOOST_CHECK_EQUAL(cache.map()[outNew].flags, 0);
+    BOOST_CHECK(cache.AccessCoin(outNew) == coin);
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync_trim)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    CTxOut txout(1000, CScript() << OP_TRUE);
+    Coin coin;
+
+    COutPoint outOld(InsecureRand256(), 0);
+    COutPoint outNew(InsecureRand256(), 0);
+    COutPoint outSpent(InsecureRand256(), 0);
+    cache.AddCoin(outOld, Coin(txout, 1, false, false), false);
+    cache.AddCoin(outNew, Coin(txout, 100, false, false), false);
+    cache.AddCoin(outSpent, Coin(txout, 50, false, false), false);
+    cache.SetBestBlock(InsecureRand256());
+
+    // the coins are written, but stay cached as clean entries
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 3U);
+    BOOST_CHECK_EQUAL(cache.map()[outOld].flags, 0);
+    BOOST_CHECK_EQUAL(cache.map()[outSpent].flags, 0);
+    BOOST_CHECK(base.GetCoin(outOld, coin));
+    cache.SelfTest();
+
+    // spent entries are dropped once the spend has been written
+    BOOST_CHECK(cache.SpendCoin(outSpent));
+    BOOST_CHECK(cache.IsCached(outSpent));
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!cache.IsCached(outSpent));
+    BOOST_CHECK(!base.GetCoin(outSpent, coin) || coin.IsSpent());
+    cache.SelfTest();
+
+    // the lowest heights are evicted first, dirty entries are never evicted
+    COutPoint outDirty(InsecureRand256(), 0);
+    cache.AddCoin(outDirty, Coin(txout, 0, false, false), false);
+    BOOST_CHECK_EQUAL(cache.Trim(cache.DynamicMemoryUsage()), 0U);
+    BOOST_CHECK_EQUAL(cache.Trim(cache.DynamicMemoryUsage() - 1), 1U);
+    BOOST_CHECK(!cache.IsCached(outOld));
+    BOOST_CHECK(cache.IsCached(outNew));
+    BOOST_CHECK_EQUAL(cache.Trim(0), 1U);
+    BOOST_CHECK(!cache.IsCached(outNew));
+    BOOST_CHECK(cache.HaveCoinInCache(outDirty));
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync_in_place)
+{
+    CCoinsViewDB base(1 << 20, true);
+    CCoinsViewCacheTest cache(&base);
+    CTxOut txout(1000, CScript() << OP_TRUE);
+    Coin coin;
+
+    COutPoint outClean(InsecureRand256(), 0);
+    COutPoint outSpent(InsecureRand256(), 0);
+    cache.AddCoin(outClean, Coin(txout, 1, false, false), false);
+    cache.AddCoin(outSpent, Coin(txout, 2, false, false), false);
+    cache.SetBestBlock(InsecureRand256());
+
+    // the database writes the entries from the cache, they stay cached as clean entries
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 2U);
+    BOOST_CHECK_EQUAL(cache.map()[outClean].flags, 0);
+    BOOST_CHECK_EQUAL(cache.map()[outSpent].flags, 0);
+    BOOST_CHECK(base.GetCoin(outClean, coin));
+    BOOST_CHECK(base.GetCoin(outSpent, coin));
+    BOOST_CHECK_EQUAL(base.GetBestBlock().GetHex(), cache.GetBestBlock().GetHex());
+    cache.SelfTest();
+
+    BOOST_CHECK(cache.SpendCoin(outSpent));
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK(!cache.IsCached(outSpent));
+    BOOST_CHECK(!base.GetCoin(outSpent, coin));
+    BOOST_CHECK(cache.HaveCoinInCache(outClean));
+    BOOST_CHECK_EQUAL(base.GetBestBlock().GetHex(), cache.GetBestBlock().GetHex());
+    cache.SelfTest();
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_trim_sampled)
+{
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    CTxOut txout(1000, CScript() << OP_TRUE);
+
+    // more clean entries than COINS_TRIM_SAMPLE_SIZE, one per height
+    const uint32_t nCoins = 20000;
+    std::vector<COutPoint> vOutpoints;
+    for (uint32_t i = 0; i < nCoins; i++) {
+        vOutpoints.emplace_back(InsecureRand256(), 0);
+        cache.AddCoin(vOutpoints.back(), Coin(txout, i, false, false), false);
+    }
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Sync());
+
+    size_t nTarget = cache.DynamicMemoryUsage() / 2;
+    size_t nEvicted = cache.Trim(nTarget);
+    BOOST_CHECK(cache.DynamicMemoryUsage() <= nTarget);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), nCoins - nEvicted);
+    // about half of the entries are evicted, the coins of the highest heights are kept
+    BOOST_CHECK(nEvicted > nCoins / 4 && nEvicted < nCoins * 3 / 4);
+    for (uint32_t i = nCoins * 3 / 4; i < nCoins; i++) {
+        BOOST_CHECK(cache.IsCached(vOutpoints[i]));
+    }
+    cache.SelfTest();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
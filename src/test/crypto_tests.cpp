@@ -6,6 +6,7 @@
 #include "crypto/aes.h"
 #include "crypto/chacha20.h"
 #include "crypto/chacha_poly_aead.h"
+#include "crypto/muhash.h"
 #include "crypto/poly1305.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
@@ -784,4 +785,70 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+static MuHash3072 MuHashFromInt(unsigned char i)
+{
+    unsigned char tmp[32] = {i, 0};
+    MuHash3072 ret;
+    ret.Insert(tmp, sizeof(tmp));
+    return ret;
+}
+
+BOOST_AUTO_TEST_CASE(muhash_tests)
+{
+    uint256 out;
+    MuHash3072 acc = MuHashFromInt(0);
+    acc *= MuHashFromInt(1);
+    acc /= MuHashFromInt(2);
+    acc.Finalize(out);
+    BOOST_CHECK_EQUAL(out.GetHex(), "10d312b100cbd32ada024a6646e40d3482fcff103668d2625f10002a607d5863");
+
+    // The order of insertions and removals does not matter
+    for (int iter = 0; iter < 10; ++iter) {
+        uint256 res;
+        int table[4];
+        for (int i = 0; i < 4; ++i) {
+            table[i] = InsecureRandBits(3);
+        }
+        for (int order = 0; order < 4; ++order) {
+            MuHash3072 x = MuHashFromInt(table[0]);
+            for (int i = 1; i < 4; ++i) {
+                x *= MuHashFromInt(table[(order + i) % 4]);
+            }
+            x /= MuHashFromInt(table[order]);
+            x *= MuHashFromInt(table[order]);
+            uint256 out2;
+            x.Finalize(out2);
+            if (order == 0) {
+                res = out2;
+            } else {
+                BOOST_CHECK(res == out2);
+            }
+        }
+    }
+
+    // Removing an element which was inserted results in the empty set
+    unsigned char data[32] = {0x42};
+    MuHash3072 x;
+    uint256 hashEmpty;
+    x.Finalize(hashEmpty);
+    x.Insert(data, sizeof(data));
+    x.Finalize(out);
+    BOOST_CHECK(out != hashEmpty);
+    x.Remove(data, sizeof(data));
+    x.Finalize(out);
+    BOOST_CHECK(out == hashEmpty);
+
+    // The state survives serialization
+    MuHash3072 y = MuHashFromInt(3);
+    y /= MuHashFromInt(4);
+    CDataStream ss(SER_DISK, 0);
+    ss << y;
+    MuHash3072 z;
+    ss >> z;
+    uint256 outy, outz;
+    y.Finalize(outy);
+    z.Finalize(outz);
+    BOOST_CHECK(outy == outz);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -451,6 +451,20 @@ BOOST_FIXTURE_TEST_CASE(dip3_protx, TestChainDIP3Setup)
     }
     BOOST_ASSERT(foundRevived);
 
+    // the payee queue maintained from list diffs matches sorting all MNs, which is what a list falls back to
+    // after it was modified directly
+    auto mnList = deterministicMNManager->GetListAtChainTip();
+    auto mnListModified = mnList;
+    dmn = mnListModified.GetMN(dmnHashes[0]);
+    mnListModified.UpdateMN(dmn, dmn->pdmnState);
+    auto projectedPayees = mnList.GetProjectedMNPayees(mnList.GetValidMNsCount());
+    auto sortedPayees = mnListModified.GetProjectedMNPayees(mnListModified.GetValidMNsCount());
+    BOOST_CHECK_EQUAL(projectedPayees.size(), sortedPayees.size());
+    for (size_t i = 0; i < projectedPayees.size() && i < sortedPayees.size(); i++) {
+        BOOST_CHECK_EQUAL(projectedPayees[i]->proTxHash.ToString(), sortedPayees[i]->proTxHash.ToString());
+    }
+    BOOST_CHECK_EQUAL(mnList.GetMNPayee()->proTxHash.ToString(), mnListModified.GetMNPayee()->proTxHash.ToString());
+
     const_cast<Consensus::Params&>(Params().GetConsensus()).DIP0003EnforcementHeight = DIP0003EnforcementHeightBackup;
 }
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,200 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "httprpc.h"
+#include "httpworkqueue.h"
+#include "util.h"
+#include "test/test_cosanta.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+struct TestWorkItem
+{
+    explicit TestWorkItem(const std::string& _name) : name(_name) {}
+    void operator()() {}
+
+    const std::string name;
+    HTTPWorkLane lane{HTTP_LANE_DEFAULT};
+    int64_t nEnqueueTime{0};
+};
+
+typedef WorkQueue<TestWorkItem> TestWorkQueue;
+
+bool Enqueue(TestWorkQueue& queue, const std::string& name)
+{
+    std::unique_ptr<TestWorkItem> item(new TestWorkItem(name));
+    if (queue.Enqueue(item.get())) {
+        item.release();
+        return true;
+    }
+    return false;
+}
+
+std::string PopName(TestWorkQueue& queue)
+{
+    std::unique_ptr<TestWorkItem> item = queue.TryPop();
+    if (!item) {
+        return "";
+    }
+    std::string name = item->name;
+    queue.Finish(*item, 0);
+    return name;
+}
+
+const std::map<std::string, HTTPWorkLane> testLanes = {
+    {"prio", HTTP_LANE_PRIORITY},
+    {"heavy", HTTP_LANE_HEAVY},
+};
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(httpworkqueue_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(peek_jsonrpc_method)
+{
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod("{\"method\":\"getblock\",\"params\":[]}"), "getblock");
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod("{\"jsonrpc\": \"1.0\", \"id\": 1, \"method\" : \"protx\", \"params\": [\"list\"]}"), "protx");
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod("\r\n [{\"method\":\"getblock\"}]"), "batch");
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod("{\"id\":1,\"params\":[]}"), "");
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod("{\"method\":42}"), "");
+    // truncated by the peek size
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod("{\"method\":\"getbl"), "");
+    BOOST_CHECK_EQUAL(PeekJSONRPCMethod(""), "");
+}
+
+BOOST_AUTO_TEST_CASE(lane_classification)
+{
+    std::map<std::string, HTTPWorkLane> laneByName;
+    std::map<std::string, size_t> maxActiveByName;
+    BOOST_CHECK(InitHTTPWorkLanes(laneByName, maxActiveByName));
+    BOOST_CHECK(laneByName.at("getblockcount") == HTTP_LANE_PRIORITY);
+    BOOST_CHECK(laneByName.at("getrpcinfo") == HTTP_LANE_PRIORITY);
+    BOOST_CHECK(laneByName.at("protx") == HTTP_LANE_HEAVY);
+    BOOST_CHECK(laneByName.at("getaddressdeltas") == HTTP_LANE_HEAVY);
+    BOOST_CHECK(!laneByName.count("getblock"));
+    BOOST_CHECK(maxActiveByName.empty());
+
+    gArgs.ForceSetMultiArgs("-rpcprioritymethod", {"getblock"});
+    gArgs.ForceSetMultiArgs("-rpcheavymethod", {"getblockcount", "/rest/tx/"});
+    gArgs.ForceSetMultiArgs("-rpcmethodlimit", {"protx:2", "/rest/tx/:1"});
+    laneByName.clear();
+    maxActiveByName.clear();
+    BOOST_CHECK(InitHTTPWorkLanes(laneByName, maxActiveByName));
+    BOOST_CHECK(laneByName.at("getblock") == HTTP_LANE_PRIORITY);
+    BOOST_CHECK(laneByName.at("getblockcount") == HTTP_LANE_HEAVY);
+    BOOST_CHECK(laneByName.at("/rest/tx/") == HTTP_LANE_HEAVY);
+    BOOST_CHECK_EQUAL(maxActiveByName.at("protx"), 2);
+    BOOST_CHECK_EQUAL(maxActiveByName.at("/rest/tx/"), 1);
+
+    // requests are accounted in the lane of their name, unknown names go to the default lane
+    TestWorkQueue queue(16, 4, laneByName, maxActiveByName);
+    BOOST_CHECK(Enqueue(queue, "getblock"));
+    BOOST_CHECK(Enqueue(queue, "protx"));
+    BOOST_CHECK(Enqueue(queue, "unknown"));
+    auto stats = queue.GetStats();
+    BOOST_CHECK(stats.at("getblock").lane == HTTP_LANE_PRIORITY);
+    BOOST_CHECK(stats.at("protx").lane == HTTP_LANE_HEAVY);
+    BOOST_CHECK_EQUAL(stats.at("protx").nMaxActive, 2);
+    BOOST_CHECK(stats.at("unknown").lane == HTTP_LANE_DEFAULT);
+    BOOST_CHECK_EQUAL(stats.at("unknown").nQueued, 1);
+
+    gArgs.ForceSetMultiArgs("-rpcmethodlimit", {"protx"});
+    BOOST_CHECK(!InitHTTPWorkLanes(laneByName, maxActiveByName));
+    gArgs.ForceSetMultiArgs("-rpcmethodlimit", {"protx:0"});
+    BOOST_CHECK(!InitHTTPWorkLanes(laneByName, maxActiveByName));
+
+    gArgs.ForceSetMultiArgs("-rpcprioritymethod", {});
+    gArgs.ForceSetMultiArgs("-rpcheavymethod", {});
+    gArgs.ForceSetMultiArgs("-rpcmethodlimit", {});
+}
+
+BOOST_AUTO_TEST_CASE(total_depth_rejection)
+{
+    // depth 16: 4 slots are reserved for the priority lane, the heavy lane gets at most 6
+    TestWorkQueue queue(16, 4, testLanes, {});
+    for (int i = 0; i < 6; i++) {
+        BOOST_CHECK(Enqueue(queue, "heavy"));
+    }
+    BOOST_CHECK(!Enqueue(queue, "heavy"));
+    for (int i = 0; i < 6; i++) {
+        BOOST_CHECK(Enqueue(queue, "default"));
+    }
+    BOOST_CHECK(!Enqueue(queue, "default"));
+    for (int i = 0; i < 4; i++) {
+        BOOST_CHECK(Enqueue(queue, "prio"));
+    }
+    // the documented total depth is never exceeded
+    BOOST_CHECK(!Enqueue(queue, "prio"));
+
+    auto stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.at("heavy").nRejected, 1);
+    BOOST_CHECK_EQUAL(stats.at("default").nRejected, 1);
+    BOOST_CHECK_EQUAL(stats.at("prio").nRejected, 1);
+    BOOST_CHECK_EQUAL(stats.at("heavy").nQueued + stats.at("default").nQueued + stats.at("prio").nQueued, 16);
+
+    // priority requests fill all of the queue if nothing else is queued
+    TestWorkQueue queue2(16, 4, testLanes, {});
+    for (int i = 0; i < 16; i++) {
+        BOOST_CHECK(Enqueue(queue2, "prio"));
+    }
+    BOOST_CHECK(!Enqueue(queue2, "prio"));
+    BOOST_CHECK(!Enqueue(queue2, "default"));
+
+    // a depth of 1 can not reserve anything
+    TestWorkQueue queue3(1, 4, testLanes, {});
+    BOOST_CHECK(Enqueue(queue3, "default"));
+    BOOST_CHECK(!Enqueue(queue3, "prio"));
+    BOOST_CHECK_EQUAL(PopName(queue3), "default");
+    BOOST_CHECK(Enqueue(queue3, "heavy"));
+}
+
+BOOST_AUTO_TEST_CASE(lane_scheduling)
+{
+    // two threads: the last one is kept for the priority lane
+    TestWorkQueue queue(16, 2, testLanes, {});
+    BOOST_CHECK(Enqueue(queue, "default"));
+    BOOST_CHECK(Enqueue(queue, "heavy"));
+    BOOST_CHECK(Enqueue(queue, "prio"));
+
+    std::unique_ptr<TestWorkItem> a = queue.TryPop();
+    BOOST_REQUIRE(a);
+    BOOST_CHECK_EQUAL(a->name, "prio");
+    std::unique_ptr<TestWorkItem> b = queue.TryPop();
+    BOOST_REQUIRE(b);
+    BOOST_CHECK_EQUAL(b->name, "default");
+    // only one thread may work on non-priority lanes
+    BOOST_CHECK(!queue.TryPop());
+    BOOST_CHECK(Enqueue(queue, "prio"));
+    BOOST_CHECK_EQUAL(PopName(queue), "prio");
+
+    queue.Finish(*b, 0);
+    BOOST_CHECK_EQUAL(PopName(queue), "heavy");
+    queue.Finish(*a, 0);
+    BOOST_CHECK(!queue.TryPop());
+
+    auto stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.at("prio").nCalls, 2);
+    BOOST_CHECK_EQUAL(stats.at("default").nCalls, 1);
+    BOOST_CHECK_EQUAL(stats.at("heavy").nCalls, 1);
+    BOOST_CHECK_EQUAL(stats.at("heavy").nActive, 0);
+}
+
+BOOST_AUTO_TEST_CASE(method_limit)
+{
+    TestWorkQueue queue(16, 8, testLanes, {{"limited", 1}});
+    BOOST_CHECK(Enqueue(queue, "limited"));
+    BOOST_CHECK(Enqueue(queue, "limited"));
+    BOOST_CHECK(Enqueue(queue, "other"));
+
+    std::unique_ptr<TestWorkItem> a = queue.TryPop();
+    BOOST_REQUIRE(a);
+    BOOST_CHECK_EQUAL(a->name, "limited");
+    // the second "limited" stays queued, "other" overtakes it
+    BOOST_CHECK_EQUAL(PopName(queue), "other");
+    BOOST_CHECK(!queue.TryPop());
+    queue.Finish(*a, 0);
+    BOOST_CHECK_EQUAL(PopName(queue), "limited");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,79 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "invresponsecache.h"
+#include "test/test_cosanta.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(invresponsecache_tests, BasicTestingSetup)
+
+static CInv MakeInv(int type, int n)
+{
+    return CInv(type, ArithToUint256(arith_uint256(n)));
+}
+
+BOOST_AUTO_TEST_CASE(invresponsecache_hits)
+{
+    CInvResponseCache cache(10, 1000, 60);
+    CInv inv = MakeInv(MSG_CLSIG, 1);
+
+    BOOST_CHECK(!cache.Get(inv, 0));
+
+    std::vector<unsigned char> obj{1, 2, 3};
+    auto payload = cache.Put(inv, obj, 0);
+    // serialized with the size prefix
+    BOOST_CHECK_EQUAL(payload->data.size(), 4);
+
+    // handed out by reference, not copied
+    BOOST_CHECK(cache.Get(inv, 10) == payload);
+    BOOST_CHECK(cache.Get(inv, 60) == payload);
+
+    // same hash with another type is a different object
+    BOOST_CHECK(!cache.Get(MakeInv(MSG_ISLOCK, 1), 10));
+
+    // expired entries are dropped
+    BOOST_CHECK(!cache.Get(inv, 61));
+
+    CInvResponseCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 2);
+    BOOST_CHECK_EQUAL(stats.nMisses, 3);
+    BOOST_CHECK_EQUAL(stats.nBytesSaved, 8);
+    BOOST_CHECK_EQUAL(stats.nEntries, 0);
+    BOOST_CHECK_EQUAL(stats.nBytes, 0);
+}
+
+BOOST_AUTO_TEST_CASE(invresponsecache_limits)
+{
+    CInvResponseCache cache(3, 100, 60);
+
+    for (int i = 0; i < 3; i++) {
+        cache.Put(MakeInv(MSG_GOVERNANCE_OBJECT_VOTE, i), std::vector<unsigned char>(9), 0);
+    }
+    // touch the oldest entry, so that the second one is evicted next
+    BOOST_CHECK(cache.Get(MakeInv(MSG_GOVERNANCE_OBJECT_VOTE, 0), 0));
+    cache.Put(MakeInv(MSG_GOVERNANCE_OBJECT_VOTE, 3), std::vector<unsigned char>(9), 0);
+    BOOST_CHECK(cache.Get(MakeInv(MSG_GOVERNANCE_OBJECT_VOTE, 0), 0));
+    BOOST_CHECK(!cache.Get(MakeInv(MSG_GOVERNANCE_OBJECT_VOTE, 1), 0));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 3);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 30);
+
+    // the byte limit evicts as many entries as needed
+    cache.Put(MakeInv(MSG_GOVERNANCE_OBJECT, 0), std::vector<unsigned char>(80), 0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 2);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 91);
+    BOOST_CHECK(cache.Get(MakeInv(MSG_GOVERNANCE_OBJECT_VOTE, 0), 0));
+
+    // objects larger than the whole cache are not kept
+    cache.Put(MakeInv(MSG_GOVERNANCE_OBJECT, 1), std::vector<unsigned char>(200), 0);
+    BOOST_CHECK(!cache.Get(MakeInv(MSG_GOVERNANCE_OBJECT, 1), 0));
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 2);
+
+    cache.Clear();
+    BOOST_CHECK_EQUAL(cache.GetStats().nEntries, 0);
+    BOOST_CHECK_EQUAL(cache.GetStats().nBytes, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "logwriter.h"
+#include "test/test_cosanta.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(logwriter_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(ringbuffer_basics)
+{
+    CMPSCRingBuffer<std::string> rb(3);
+    BOOST_CHECK_EQUAL(rb.Capacity(), 4);
+
+    std::string s;
+    BOOST_CHECK(!rb.TryPop(s));
+
+    for (int i = 0; i < 4; i++) {
+        BOOST_CHECK(rb.TryPush(std::to_string(i)));
+    }
+    std::string overflow = "overflow";
+    BOOST_CHECK(!rb.TryPush(std::move(overflow)));
+    BOOST_CHECK_EQUAL(overflow, "overflow");
+
+    // wraps around correctly and keeps FIFO order
+    for (int lap = 0; lap < 3; lap++) {
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(rb.TryPop(s));
+            BOOST_CHECK_EQUAL(s, std::to_string(lap * 4 + i));
+        }
+        BOOST_CHECK(!rb.TryPop(s));
+        for (int i = 0; i < 4; i++) {
+            BOOST_CHECK(rb.TryPush(std::to_string((lap + 1) * 4 + i)));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ringbuffer_multi_producer)
+{
+    const int nThreads = 4;
+    const int nPerThread = 10000;
+    CMPSCRingBuffer<int> rb(256);
+
+    std::vector<std::thread> producers;
+    for (int t = 0; t < nThreads; t++) {
+        producers.emplace_back([&rb, t]() {
+            for (int i = 0; i < nPerThread; i++) {
+                int v = t * nPerThread + i;
+                while (!rb.TryPush(std::move(v))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // per producer, values must arrive in the order they were pushed
+    std::vector<int> last(nThreads, -1);
+    int nReceived = 0;
+    while (nReceived < nThreads * nPerThread) {
+        int v;
+        if (!rb.TryPop(v)) {
+            std::this_thread::yield();
+            continue;
+        }
+        int t = v / nPerThread;
+        BOOST_REQUIRE(v % nPerThread > last[t]);
+        last[t] = v % nPerThread;
+        nReceived++;
+    }
+    for (auto& p : producers) {
+        p.join();
+    }
+    int v;
+    BOOST_CHECK(!rb.TryPop(v));
+}
+
+BOOST_AUTO_TEST_CASE(asynclogwriter_write_and_flush)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    FILE* file = fsbridge::fopen(path, "w+");
+    BOOST_REQUIRE(file != nullptr);
+
+    {
+        CAsyncLogWriter writer(file, path, 16);
+        writer.Start();
+        for (int i = 0; i < 10; i++) {
+            BOOST_CHECK(writer.Write("line " + std::to_string(i) + "\n"));
+        }
+        BOOST_CHECK(writer.Flush(10000));
+        BOOST_CHECK_EQUAL(writer.GetDroppedLines(), 0);
+        writer.Stop();
+    }
+
+    std::string content;
+    rewind(file);
+    char buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        content.append(buf, n);
+    }
+    fclose(file);
+    fs::remove(path);
+
+    std::string expected;
+    for (int i = 0; i < 10; i++) {
+        expected += "line " + std::to_string(i) + "\n";
+    }
+    BOOST_CHECK_EQUAL(content, expected);
+}
+
+BOOST_AUTO_TEST_CASE(asynclogwriter_write_unqueued)
+{
+    fs::path path = fs::temp_directory_path() / fs::unique_path();
+    FILE* file = fsbridge::fopen(path, "w+");
+    BOOST_REQUIRE(file != nullptr);
+
+    {
+        CAsyncLogWriter writer(file, path, 1024);
+        writer.Start();
+        for (int i = 0; i < 100; i++) {
+            BOOST_CHECK(writer.Write("line " + std::to_string(i) + "\n"));
+        }
+        // the crash report follows the lines queued before it
+        writer.WriteUnqueued("crash\n", 10000);
+        writer.Stop();
+    }
+
+    std::string content;
+    rewind(file);
+    char buf[256];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        content.append(buf, n);
+    }
+    fclose(file);
+    fs::remove(path);
+
+    std::string expected;
+    for (int i = 0; i < 100; i++) {
+        expected += "line " + std::to_string(i) + "\n";
+    }
+    expected += "crash\n";
+    BOOST_CHECK_EQUAL(content, expected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
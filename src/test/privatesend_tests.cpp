@@ -0,0 +1,120 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "key.h"
+#include "keystore.h"
+#include "privatesend/privatesend-server.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "validation.h"
+#include "test/test_cosanta.h"
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(privatesend_tests, BasicTestingSetup)
+
+static const unsigned int FINAL_TX_FLAGS = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC;
+
+// A transaction spending every output of txFrom, signed by keystore
+static CMutableTransaction CreateSignedSpend(const CKeyStore& keystore, const CMutableTransaction& txFrom)
+{
+    CMutableTransaction txTo;
+    for (unsigned int i = 0; i < txFrom.vout.size(); i++) {
+        txTo.vin.emplace_back(COutPoint(txFrom.GetHash(), i));
+    }
+    txTo.vout.emplace_back(txFrom.vout.size() * COIN, CScript() << OP_TRUE);
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        BOOST_CHECK(SignSignature(keystore, txFrom, txTo, i, SIGHASH_ALL));
+    }
+    return txTo;
+}
+
+static std::vector<CScriptCheck> CreateChecks(const CMutableTransaction& txFrom, const CTransaction& txTo, PrecomputedTransactionData* txdata)
+{
+    std::vector<CScriptCheck> vChecks;
+    for (unsigned int i = 0; i < txTo.vin.size(); i++) {
+        vChecks.emplace_back(txFrom.vout[i].scriptPubKey, 0, txTo, i, FINAL_TX_FLAGS, false, txdata);
+    }
+    return vChecks;
+}
+
+BOOST_AUTO_TEST_CASE(script_check_txdata)
+{
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CMutableTransaction txFrom;
+    txFrom.vout.resize(2);
+    for (auto& txout : txFrom.vout) {
+        txout.nValue = COIN;
+        txout.scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+    }
+    CMutableTransaction txTo = CreateSignedSpend(keystore, txFrom);
+    // the second input carries the signature of the first one
+    txTo.vin[1].scriptSig = txTo.vin[0].scriptSig;
+    const CTransaction tx(txTo);
+    PrecomputedTransactionData txdata(tx);
+
+    // checks with and without precomputed data agree
+    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+        CScriptCheck checkTxdata(txFrom.vout[i].scriptPubKey, 0, tx, i, FINAL_TX_FLAGS, false, &txdata);
+        CScriptCheck checkNoTxdata(txFrom.vout[i].scriptPubKey, 0, tx, i, FINAL_TX_FLAGS, false, nullptr);
+        BOOST_CHECK_EQUAL(checkTxdata(), i == 0);
+        BOOST_CHECK_EQUAL(checkNoTxdata(), i == 0);
+        BOOST_CHECK_EQUAL(checkTxdata.GetScriptError(), checkNoTxdata.GetScriptError());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(final_tx_script_checks)
+{
+    CBasicKeyStore keystore;
+    std::vector<CKey> keys(4);
+    for (auto& key : keys) {
+        key.MakeNewKey(true);
+        keystore.AddKey(key);
+    }
+
+    CMutableTransaction txFrom;
+    txFrom.vout.resize(32);
+    for (unsigned int i = 0; i < txFrom.vout.size(); i++) {
+        txFrom.vout[i].nValue = COIN;
+        txFrom.vout[i].scriptPubKey = GetScriptForDestination(keys[i % keys.size()].GetPubKey().GetID());
+    }
+    const CMutableTransaction txValid = CreateSignedSpend(keystore, txFrom);
+    CMutableTransaction txInvalid(txValid);
+    txInvalid.vin[17].scriptSig = txInvalid.vin[16].scriptSig;
+
+    const CTransaction tx(txValid);
+    PrecomputedTransactionData txdata(tx);
+    const CTransaction txBad(txInvalid);
+    PrecomputedTransactionData txdataBad(txBad);
+
+    CPrivateSendServer server;
+
+    // without script check threads everything is verified on this thread
+    std::vector<CScriptCheck> vChecks = CreateChecks(txFrom, tx, &txdata);
+    BOOST_CHECK(server.RunScriptChecks(vChecks));
+    vChecks = CreateChecks(txFrom, txBad, &txdataBad);
+    BOOST_CHECK(!server.RunScriptChecks(vChecks));
+
+    boost::thread_group threadGroup;
+    server.StartScriptCheckThreads(threadGroup, MAX_PRIVATESEND_SCRIPTCHECK_THREADS - 1);
+    for (int i = 0; i < 10; i++) {
+        vChecks = CreateChecks(txFrom, tx, &txdata);
+        BOOST_CHECK(server.RunScriptChecks(vChecks));
+        vChecks = CreateChecks(txFrom, txBad, &txdataBad);
+        BOOST_CHECK(!server.RunScriptChecks(vChecks));
+    }
+    // the queue is usable again after a failed batch
+    vChecks = CreateChecks(txFrom, tx, &txdata);
+    BOOST_CHECK(server.RunScriptChecks(vChecks));
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -28,6 +28,8 @@ static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_SPENTINDEX = 'p';
+static const char DB_SPECIALTXINDEX = 'x';
+static const char DB_PROTXINDEX = 'X';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -88,6 +90,14 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, true);
+}
+
+bool CCoinsViewDB::BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    return WriteCoins(mapCoins, hashBlock, false);
+}
+
+bool CCoinsViewDB::WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -122,8 +132,13 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (fErase) {
+            CCoinsMap::iterator itOld = it++;
+            mapCoins.erase(itOld);
+        } else {
+            it->second.flags = 0;
+            ++it;
+        }
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -242,6 +257,14 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     return WriteBatch(batch, true);
 }
 
+bool CBlockTreeDB::WriteBlockIndex(const std::vector<CDiskBlockIndex>& vBlockIndex) {
+    CDBBatch batch(*this);
+    for (const CDiskBlockIndex& diskindex : vBlockIndex) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, diskindex.GetBlockHash()), diskindex);
+    }
+    return WriteBatch(batch, true);
+}
+
 bool CBlockTreeDB::HasTxIndex(const uint256& txid) {
     return Exists(std::make_pair(DB_TXINDEX, txid));
 }
@@ -385,6 +408,78 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
+bool CBlockTreeDB::WriteSpecialTxIndex(const std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &vect,
+                                       const std::vector<std::pair<CProTxIndexKey, uint16_t> > &vectProTx) {
+    CDBBatch batch(*this);
+    for (const auto& p : vect)
+        batch.Write(std::make_pair(DB_SPECIALTXINDEX, p.first), p.second);
+    for (const auto& p : vectProTx)
+        batch.Write(std::make_pair(DB_PROTXINDEX, p.first), p.second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseSpecialTxIndex(const std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &vect,
+                                       const std::vector<std::pair<CProTxIndexKey, uint16_t> > &vectProTx) {
+    CDBBatch batch(*this);
+    for (const auto& p : vect)
+        batch.Erase(std::make_pair(DB_SPECIALTXINDEX, p.first));
+    for (const auto& p : vectProTx)
+        batch.Erase(std::make_pair(DB_PROTXINDEX, p.first));
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpecialTxIndex(uint16_t type, int start, int end,
+                                      std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &vect) {
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_SPECIALTXINDEX, CSpecialTxIndexIteratorHeightKey(type, start)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CSpecialTxIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_SPECIALTXINDEX && key.second.type == type && key.second.blockHeight <= end) {
+            CSpecialTxIndexValue value;
+            if (pcursor->GetValue(value)) {
+                vect.push_back(std::make_pair(key.second, value));
+                pcursor->Next();
+            } else {
+                return error("failed to get special tx index value");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadProTxIndex(const uint256 &proTxHash, int start, int end,
+                                  std::vector<std::pair<CProTxIndexKey, uint16_t> > &vect) {
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(std::make_pair(DB_PROTXINDEX, CProTxIndexKey(proTxHash, start, 0)));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CProTxIndexKey> key;
+        if (pcursor->GetKey(key) && key.first == DB_PROTXINDEX && key.second.proTxHash == proTxHash && key.second.blockHeight <= end) {
+            uint16_t type;
+            if (pcursor->GetValue(type)) {
+                vect.push_back(std::make_pair(key.second, type));
+                pcursor->Next();
+            } else {
+                return error("failed to get ProTx index value");
+            }
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
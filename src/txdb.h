@@ -11,6 +11,7 @@
 #include "dbwrapper.h"
 #include "chain.h"
 #include "spentindex.h"
+#include "specialtxindex.h"
 
 #include <map>
 #include <string>
@@ -70,6 +71,9 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! Write the DIRTY entries of mapCoins, which are erased from the map or only have their flags cleared
+    bool WriteCoins(CCoinsMap &mapCoins, const uint256 &hashBlock, bool fErase);
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -79,6 +83,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteInPlace(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
@@ -118,6 +123,7 @@ public:
     CBlockTreeDB& operator=(const CBlockTreeDB&) = delete;
 
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    bool WriteBlockIndex(const std::vector<CDiskBlockIndex>& vBlockIndex);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
@@ -137,6 +143,14 @@ public:
                           int start = 0, int end = 0);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, std::vector<uint256> &vect);
+    bool WriteSpecialTxIndex(const std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &vect,
+                             const std::vector<std::pair<CProTxIndexKey, uint16_t> > &vectProTx);
+    bool EraseSpecialTxIndex(const std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &vect,
+                             const std::vector<std::pair<CProTxIndexKey, uint16_t> > &vectProTx);
+    bool ReadSpecialTxIndex(uint16_t type, int start, int end,
+                            std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &vect);
+    bool ReadProTxIndex(const uint256 &proTxHash, int start, int end,
+                        std::vector<std::pair<CProTxIndexKey, uint16_t> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
@@ -15,6 +15,7 @@
 #include "chainparamsbase.h"
 #include "ctpl.h"
 #include "fs.h"
+#include "logwriter.h"
 #include "random.h"
 #include "serialize.h"
 #include "stacktraces.h"
@@ -200,6 +201,19 @@ static FILE* fileout = nullptr;
 static boost::mutex* mutexDebugLog = nullptr;
 static std::list<std::string>* vMsgsBeforeOpenLog;
 
+/**
+ * When set, lines for debug.log are handed to the writer thread instead of
+ * being written under mutexDebugLog. The writer is leaked on exit as well,
+ * StopDebugLogWriter() only stops its thread.
+ */
+static std::atomic<CAsyncLogWriter*> logWriter{nullptr};
+/**
+ * Number of LogPrintStr() calls currently using the writer. StopDebugLogWriter()
+ * waits for it to drop to zero before it stops the writer thread, so that lines
+ * from threads which picked up the writer just before it was unset are not lost.
+ */
+static std::atomic<int> nLogWriterUsers{0};
+
 static int FileWriteStr(const std::string &str, FILE *fp)
 {
     return fwrite(str.data(), 1, str.size(), fp);
@@ -236,18 +250,75 @@ bool OpenDebugLog()
         return false;
     }
 
-    setbuf(fileout, nullptr); // unbuffered
+    int64_t nQueueSize = gArgs.GetArg("-logqueuesize", DEFAULT_LOGQUEUESIZE);
+    if (nQueueSize <= 0) {
+        setbuf(fileout, nullptr); // unbuffered
+    }
     // dump buffered messages from before we opened the log
     while (!vMsgsBeforeOpenLog->empty()) {
         FileWriteStr(vMsgsBeforeOpenLog->front(), fileout);
         vMsgsBeforeOpenLog->pop_front();
     }
+    fflush(fileout);
 
     delete vMsgsBeforeOpenLog;
     vMsgsBeforeOpenLog = nullptr;
+
+    if (nQueueSize > 0) {
+        CAsyncLogWriter* writer = new CAsyncLogWriter(fileout, pathDebug, (size_t)std::min(nQueueSize, MAX_LOGQUEUESIZE));
+        writer->Start();
+        logWriter = writer;
+    }
     return true;
 }
 
+void StopDebugLogWriter()
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    // Hold mutexDebugLog until the writer thread is gone, callers falling back to
+    // the synchronous path must not write (or reopen) fileout concurrently with it
+    boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+
+    CAsyncLogWriter* writer = logWriter.exchange(nullptr);
+    if (!writer) {
+        return;
+    }
+    while (nLogWriterUsers > 0) {
+        std::this_thread::yield();
+    }
+    writer->Stop();
+}
+
+void LogPrintStrUnqueued(const std::string& str)
+{
+    if (fPrintToConsole || !fPrintToDebugLog) {
+        LogPrintStr(str);
+        return;
+    }
+    nLogWriterUsers++;
+    CAsyncLogWriter* writer = logWriter.load();
+    if (writer) {
+        std::string strTimestamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()) + " " + str;
+        writer->WriteUnqueued(strTimestamped, LOG_CRASH_FLUSH_TIMEOUT);
+        nLogWriterUsers--;
+        return;
+    }
+    nLogWriterUsers--;
+    LogPrintStr(str);
+}
+
+size_t GetLogQueueSize()
+{
+    CAsyncLogWriter* writer = logWriter.load();
+    return writer ? writer->GetQueueSize() : 0;
+}
+
+uint64_t GetDroppedLogLines()
+{
+    CAsyncLogWriter* writer = logWriter.load();
+    return writer ? writer->GetDroppedLines() : 0;
+}
+
 struct CLogCategoryDesc
 {
     uint64_t flag;
@@ -453,6 +524,18 @@ int LogPrintStr(const std::string &str)
     }
     else if (fPrintToDebugLog)
     {
+        nLogWriterUsers++;
+        CAsyncLogWriter* writer = logWriter.load();
+        if (writer) {
+            ret = strTimestamped.length();
+            if (!writer->Write(std::move(strTimestamped))) {
+                ret = 0;
+            }
+            nLogWriterUsers--;
+            return ret;
+        }
+        nLogWriterUsers--;
+
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
         boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
 
@@ -473,6 +556,8 @@ int LogPrintStr(const std::string &str)
             }
 
             ret = FileWriteStr(strTimestamped, fileout);
+            // no-op while unbuffered, needed once the async writer has been stopped
+            fflush(fileout);
         }
     }
     return ret;
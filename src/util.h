@@ -57,6 +57,11 @@ static const bool DEFAULT_LOGTIMEMICROS  = false;
 static const bool DEFAULT_LOGIPS         = false;
 static const bool DEFAULT_LOGTIMESTAMPS  = true;
 static const bool DEFAULT_LOGTHREADNAMES = false;
+/** Number of lines which can be queued for the debug.log writer thread, 0 writes synchronously */
+static const int64_t DEFAULT_LOGQUEUESIZE = 16384;
+static const int64_t MAX_LOGQUEUESIZE = 1 << 20;
+/** Time the crash handlers wait for the debug.log writer thread to write the queued lines */
+static const int64_t LOG_CRASH_FLUSH_TIMEOUT = 1000;
 extern const char * const DEFAULT_DEBUGLOGFILE;
 
 /** Signals for translation. */
@@ -194,24 +199,46 @@ template<typename T, typename... Args> static inline void MarkUsed(const T& t, c
 // unconditionally log to debug.log! It should not be the case that an inbound
 // peer can fill up a users disk with debug.log entries.
 
+#if defined(__GNUC__)
+#define LOG_NOINLINE __attribute__((noinline))
+#else
+#define LOG_NOINLINE
+#endif
+
+/**
+ * Formats and sends a message to the log output. Kept out of line so that a
+ * LogPrint call site only costs a category check (and a not taken branch) as
+ * long as its category is disabled, the formatting code does not end up in
+ * the caller's hot loop.
+ */
+template<typename... Args>
+LOG_NOINLINE void LogPrintFormatted(const char* fmt, const Args&... args)
+{
+    std::string log_msg;
+    try {
+        log_msg = tfm::format(fmt, args...);
+    } catch (tinyformat::format_error &e) {
+        /* Original format string will have newline so don't add one here */
+        log_msg = "Error \"" + std::string(e.what()) + "\" while formatting log message: " + FormatStringFromLogArgs(fmt, args...);
+    }
+    LogPrintStr(log_msg);
+}
+
 #ifdef USE_COVERAGE
 #define LogPrintf(...) do { MarkUsed(__VA_ARGS__); } while(0)
 #define LogPrint(category, ...) do { MarkUsed(__VA_ARGS__); } while(0)
 #else
-#define LogPrintf(...) do { \
-    std::string _log_msg_; /* Unlikely name to avoid shadowing variables */ \
-    try { \
-        _log_msg_ = tfm::format(__VA_ARGS__); \
-    } catch (tinyformat::format_error &e) { \
-        /* Original format string will have newline so don't add one here */ \
-        _log_msg_ = "Error \"" + std::string(e.what()) + "\" while formatting log message: " + FormatStringFromLogArgs(__VA_ARGS__); \
-    } \
-    LogPrintStr(_log_msg_); \
-} while(0)
+#define LogPrintf(...) LogPrintFormatted(__VA_ARGS__)
 
+/**
+ * Arguments are only evaluated when the category is enabled, so passing
+ * hash.ToString() and friends is free on disabled categories. Categories must
+ * be compile time constants from BCLog::LogFlags.
+ */
 #define LogPrint(category, ...) do { \
+    static_assert((category) != BCLog::NONE, "LogPrint requires a compile time log category"); \
     if (LogAcceptCategory((category))) { \
-        LogPrintf(__VA_ARGS__); \
+        LogPrintFormatted(__VA_ARGS__); \
     } \
 } while(0)
 #endif
@@ -244,6 +271,18 @@ fs::path GetSpecialFolderPath(int nFolder, bool fCreate = true);
 #endif
 fs::path GetDebugLogPath();
 bool OpenDebugLog();
+/** Stops the debug.log writer thread after it wrote all queued lines, logging continues synchronously */
+void StopDebugLogWriter();
+/**
+ * Writes str to debug.log right away instead of queueing it for the writer thread,
+ * after the lines queued so far. Used by the crash handlers, which wait at most
+ * LOG_CRASH_FLUSH_TIMEOUT for the writer.
+ */
+void LogPrintStrUnqueued(const std::string& str);
+/** Number of lines the debug.log writer queue can hold, 0 if lines are written synchronously */
+size_t GetLogQueueSize();
+/** Number of lines dropped because the debug.log writer queue was full */
+uint64_t GetDroppedLogLines();
 void ShrinkDebugFile();
 void runCommand(const std::string& strCommand);
 
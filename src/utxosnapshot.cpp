@@ -0,0 +1,423 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "utxosnapshot.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "crypto/muhash.h"
+#include "dbwrapper.h"
+#include "index/coinstatsindex.h"
+#include "streams.h"
+#include "sync.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include "evo/evodb.h"
+#include "hash.h"
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/** Database keys and values which are copied without being interpreted */
+struct CSnapshotRawData
+{
+    std::vector<unsigned char> vch;
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write((const char*)vch.data(), vch.size());
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        vch.resize(s.size());
+        s.read((char*)vch.data(), vch.size());
+    }
+};
+
+void WriteSnapshotCoins(CAutoFile& afile, const uint256& txid, std::vector<std::pair<uint32_t, Coin> >& vOutputs)
+{
+    uint32_t nOutputs = vOutputs.size();
+    afile << txid;
+    afile << VARINT(nOutputs);
+    for (auto& output : vOutputs) {
+        afile << VARINT(output.first);
+        afile << output.second;
+    }
+}
+
+/** Add an evo record, as it is stored in the snapshot, to the hash of all evo records */
+void HashSnapshotEvoRecord(CHashWriter& hasher, const CSnapshotRawData& key, const CSnapshotRawData& value)
+{
+    hasher << key.vch;
+    hasher << value.vch;
+}
+
+/** Check a snapshot header against the network and the known snapshots of the chain parameters */
+bool CheckSnapshotMetadata(const CUTXOSnapshotMetadata& metadata, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+
+    if (memcmp(metadata.pchMessageStart, chainparams.MessageStart(), sizeof(metadata.pchMessageStart)) != 0) {
+        strError = "the snapshot is for a different network";
+        return false;
+    }
+    if (metadata.nVersion != CUTXOSnapshotMetadata::CURRENT_VERSION) {
+        strError = strprintf("unsupported snapshot version %u", metadata.nVersion);
+        return false;
+    }
+    if (metadata.nBlockIndexEntries != (uint64_t)metadata.nBaseHeight + 1) {
+        strError = "the block index of the snapshot is incomplete";
+        return false;
+    }
+
+    const MapSnapshots& mapSnapshots = chainparams.Snapshots();
+    auto it = mapSnapshots.find((int)metadata.nBaseHeight);
+    if (it == mapSnapshots.end()) {
+        strError = strprintf("no snapshot at height %d is known", metadata.nBaseHeight);
+        return false;
+    }
+    if (it->second.hashBaseBlock != metadata.baseBlockHash) {
+        strError = strprintf("the base block %s does not match the known %s", metadata.baseBlockHash.ToString(), it->second.hashBaseBlock.ToString());
+        return false;
+    }
+    if (it->second.muhash != metadata.muhash) {
+        strError = strprintf("the UTXO set hash %s does not match the known %s", metadata.muhash.ToString(), it->second.muhash.ToString());
+        return false;
+    }
+    if (it->second.evohash != metadata.evohash) {
+        strError = strprintf("the evo records hash %s does not match the known %s", metadata.evohash.ToString(), it->second.evohash.ToString());
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+fs::path GetUTXOSnapshotMarkerPath()
+{
+    return GetDataDir() / "utxosnapshot.incomplete";
+}
+
+bool ReadUTXOSnapshotMetadata(const fs::path& path, CUTXOSnapshotMetadata& metadata, std::string& strError)
+{
+    CAutoFile afile(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        strError = strprintf("unable to open %s", path.string());
+        return false;
+    }
+
+    try {
+        afile >> metadata;
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to read the snapshot: %s", e.what());
+        return false;
+    }
+    return CheckSnapshotMetadata(metadata, strError);
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, CUTXOSnapshotMetadata& metadata, std::string& strError)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::unique_ptr<CDBIterator> pevoIterator;
+    std::vector<CDiskBlockIndex> vBlockIndex;
+
+    {
+        LOCK(cs_main);
+        FlushStateToDisk();
+
+        const CBlockIndex* pindexBase = chainActive.Tip();
+        if (pindexBase == nullptr) {
+            strError = "no active chain";
+            return false;
+        }
+
+        // both iterators read from an implicit database snapshot, so the state
+        // can't change underneath the dump once cs_main is released
+        pcursor.reset(pcoinsdbview->Cursor());
+        pevoIterator.reset(evoDb->GetRawDB().NewIterator());
+        if (pcursor->GetBestBlock() != pindexBase->GetBlockHash()) {
+            strError = "chainstate is not consistent with the tip";
+            return false;
+        }
+
+        metadata.baseBlockHash = pindexBase->GetBlockHash();
+        metadata.nBaseHeight = pindexBase->nHeight;
+
+        // the blocks themselves are not part of the snapshot
+        vBlockIndex.reserve(pindexBase->nHeight + 1);
+        for (const CBlockIndex* pindex = chainActive.Genesis(); pindex != nullptr; pindex = chainActive.Next(pindex)) {
+            CDiskBlockIndex diskindex(pindex);
+            diskindex.nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            diskindex.nFile = 0;
+            diskindex.nDataPos = 0;
+            diskindex.nUndoPos = 0;
+            vBlockIndex.push_back(diskindex);
+        }
+    }
+
+    fs::path pathTmp = path;
+    pathTmp += ".incomplete";
+    CAutoFile afile(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        strError = strprintf("unable to open %s for writing", pathTmp.string());
+        return false;
+    }
+
+    LogPrintf("%s: writing UTXO snapshot at height %d to %s\n", __func__, metadata.nBaseHeight, path.string());
+
+    try {
+        memcpy(metadata.pchMessageStart, Params().MessageStart(), sizeof(metadata.pchMessageStart));
+        // the counts are only known at the end, the header is rewritten then
+        afile << metadata;
+
+        for (const CDiskBlockIndex& diskindex : vBlockIndex) {
+            afile << diskindex;
+        }
+        metadata.nBlockIndexEntries = vBlockIndex.size();
+
+        MuHash3072 muhash;
+        uint256 prevTxid;
+        std::vector<std::pair<uint32_t, Coin> > vOutputs;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                strError = "unable to read the chainstate";
+                return false;
+            }
+            if (!vOutputs.empty() && key.hash != prevTxid) {
+                WriteSnapshotCoins(afile, prevTxid, vOutputs);
+                vOutputs.clear();
+            }
+            MuHashCoin(muhash, key, coin, false);
+            prevTxid = key.hash;
+            vOutputs.emplace_back(key.n, std::move(coin));
+            ++metadata.nCoins;
+            pcursor->Next();
+        }
+        if (!vOutputs.empty()) {
+            WriteSnapshotCoins(afile, prevTxid, vOutputs);
+        }
+        muhash.Finalize(metadata.muhash);
+
+        // the evo database is not obfuscated, so all records are copied as they are
+        CHashWriter evoHasher(SER_DISK, CLIENT_VERSION);
+        for (pevoIterator->SeekToFirst(); pevoIterator->Valid(); pevoIterator->Next()) {
+            boost::this_thread::interruption_point();
+            CSnapshotRawData key, value;
+            if (!pevoIterator->GetKey(key) || !pevoIterator->GetValue(value)) {
+                strError = "unable to read the evo database";
+                return false;
+            }
+            afile << key.vch;
+            afile << value.vch;
+            HashSnapshotEvoRecord(evoHasher, key, value);
+            ++metadata.nEvoRecords;
+        }
+        metadata.evohash = evoHasher.GetHash();
+
+        if (fseek(afile.Get(), 0, SEEK_SET) != 0) {
+            strError = "unable to rewind the snapshot file";
+            return false;
+        }
+        afile << metadata;
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to write the snapshot: %s", e.what());
+        return false;
+    }
+
+    FileCommit(afile.Get());
+    afile.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        strError = strprintf("unable to rename %s to %s", pathTmp.string(), path.string());
+        return false;
+    }
+
+    LogPrintf("%s: wrote %u coins, %u block index entries and %u evo records\n", __func__,
+              metadata.nCoins, metadata.nBlockIndexEntries, metadata.nEvoRecords);
+    return true;
+}
+
+bool LoadUTXOSnapshot(const fs::path& path, size_t nCoinDBCache, std::string& strError)
+{
+    const CChainParams& chainparams = Params();
+
+    CAutoFile afile(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (afile.IsNull()) {
+        strError = strprintf("unable to open %s", path.string());
+        return false;
+    }
+
+    try {
+        CUTXOSnapshotMetadata metadata;
+        afile >> metadata;
+        if (!CheckSnapshotMetadata(metadata, strError)) {
+            return false;
+        }
+
+        LogPrintf("%s: loading UTXO snapshot of block %s at height %d\n", __func__,
+                  metadata.baseBlockHash.ToString(), metadata.nBaseHeight);
+
+        // Block index of the chain up to the base block. The entries are
+        // checked to form a chain from the genesis block, but are only written
+        // after the chainstate has been verified.
+        std::vector<CDiskBlockIndex> vBlockIndex;
+        for (uint64_t i = 0; i < metadata.nBlockIndexEntries; ++i) {
+            CDiskBlockIndex diskindex;
+            afile >> diskindex;
+
+            CBlockHeader header = diskindex.GetBlockHeader();
+            header.hashPrevBlock = diskindex.hashPrev;
+            if (diskindex.nHeight != (int)i || header.GetHash() != diskindex.GetBlockHash() ||
+                (diskindex.nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_FAILED_MASK)) ||
+                !diskindex.IsValid(BLOCK_VALID_TRANSACTIONS)) {
+                strError = strprintf("invalid block index entry at height %d", i);
+                return false;
+            }
+            if (i == 0 ? diskindex.GetBlockHash() != chainparams.GetConsensus().hashGenesisBlock
+                       : diskindex.hashPrev != vBlockIndex.back().GetBlockHash()) {
+                strError = strprintf("block index entry at height %d does not connect", i);
+                return false;
+            }
+            vBlockIndex.push_back(diskindex);
+        }
+        if (vBlockIndex.back().GetBlockHash() != metadata.baseBlockHash) {
+            strError = "the block index does not end at the base block";
+            return false;
+        }
+
+        // Chainstate, written in batches of SNAPSHOT_LOAD_COINS_BATCH coins
+        {
+            CCoinsViewDB coinsdb(nCoinDBCache, false, false);
+            if (!coinsdb.GetBestBlock().IsNull() || !coinsdb.GetHeadBlocks().empty()) {
+                strError = "the chainstate database is not empty";
+                return false;
+            }
+            if (!evoDb->GetRawDB().IsEmpty()) {
+                strError = "the evo database is not empty";
+                return false;
+            }
+
+            // Nothing is written before the marker exists, it is only
+            // removed once the import is complete
+            FILE* file = fsbridge::fopen(GetUTXOSnapshotMarkerPath(), "wb");
+            if (file == nullptr) {
+                strError = strprintf("unable to create %s", GetUTXOSnapshotMarkerPath().string());
+                return false;
+            }
+            FileCommit(file);
+            fclose(file);
+
+            MuHash3072 muhash;
+            CCoinsMap mapCoins;
+            uint64_t nCoins = 0;
+            while (nCoins < metadata.nCoins) {
+                uint256 txid;
+                uint32_t nOutputs = 0;
+                afile >> txid;
+                afile >> VARINT(nOutputs);
+                if (nOutputs == 0 || nOutputs > metadata.nCoins - nCoins) {
+                    strError = strprintf("invalid number of outputs of %s", txid.ToString());
+                    return false;
+                }
+                for (uint32_t i = 0; i < nOutputs; ++i) {
+                    uint32_t n = 0;
+                    Coin coin;
+                    afile >> VARINT(n);
+                    afile >> coin;
+                    if (coin.IsSpent() || coin.nHeight > metadata.nBaseHeight) {
+                        strError = strprintf("invalid coin %s:%u", txid.ToString(), n);
+                        return false;
+                    }
+                    COutPoint outpoint(txid, n);
+                    MuHashCoin(muhash, outpoint, coin, false);
+                    CCoinsCacheEntry& entry = mapCoins[outpoint];
+                    entry.coin = std::move(coin);
+                    entry.flags = CCoinsCacheEntry::DIRTY;
+                }
+                nCoins += nOutputs;
+
+                if (mapCoins.size() >= SNAPSHOT_LOAD_COINS_BATCH) {
+                    // BatchWrite empties the map
+                    if (!coinsdb.BatchWrite(mapCoins, metadata.baseBlockHash)) {
+                        strError = "failed to write to the chainstate database";
+                        return false;
+                    }
+                    LogPrintf("%s: loaded %u of %u coins\n", __func__, nCoins, metadata.nCoins);
+                }
+            }
+            if (!coinsdb.BatchWrite(mapCoins, metadata.baseBlockHash)) {
+                strError = "failed to write to the chainstate database";
+                return false;
+            }
+
+            uint256 hashMuHash;
+            muhash.Finalize(hashMuHash);
+            if (hashMuHash != metadata.muhash) {
+                strError = strprintf("the UTXO set hash %s does not match the expected %s", hashMuHash.ToString(), metadata.muhash.ToString());
+                return false;
+            }
+            LogPrintf("%s: loaded %u coins, UTXO set hash %s\n", __func__, nCoins, hashMuHash.ToString());
+        }
+
+        // Deterministic masternode lists and mined LLMQ commitments. They are
+        // authenticated by the known hash of all records, a mismatch leaves
+        // the marker behind and the partial state is wiped on the next start.
+        {
+            CDBWrapper& evodb = evoDb->GetRawDB();
+            size_t nBatchSize = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+            CDBBatch batch(evodb);
+            CHashWriter evoHasher(SER_DISK, CLIENT_VERSION);
+            for (uint64_t i = 0; i < metadata.nEvoRecords; ++i) {
+                CSnapshotRawData key, value;
+                afile >> key.vch;
+                afile >> value.vch;
+                HashSnapshotEvoRecord(evoHasher, key, value);
+                batch.Write(key, value);
+                if (batch.SizeEstimate() > nBatchSize) {
+                    if (!evodb.WriteBatch(batch)) {
+                        strError = "failed to write to the evo database";
+                        return false;
+                    }
+                    batch.Clear();
+                }
+            }
+            if (!evodb.WriteBatch(batch, true)) {
+                strError = "failed to write to the evo database";
+                return false;
+            }
+            uint256 hashEvo = evoHasher.GetHash();
+            if (hashEvo != metadata.evohash) {
+                strError = strprintf("the evo records hash %s does not match the expected %s", hashEvo.ToString(), metadata.evohash.ToString());
+                return false;
+            }
+            if (!evoDb->VerifyBestBlock(metadata.baseBlockHash)) {
+                strError = "the evo database of the snapshot does not match the base block";
+                return false;
+            }
+        }
+
+        // Finally make the chain known, the block index is what the next
+        // LoadBlockIndex() finds. The snapshotchain flag completes the
+        // import and is written last.
+        if (!pblocktree->WriteBlockIndex(vBlockIndex) || !pblocktree->WriteFlag("snapshotchain", true) || !pblocktree->Sync()) {
+            strError = "failed to write to the block index database";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        strError = strprintf("unable to read the snapshot: %s", e.what());
+        return false;
+    }
+
+    fs::remove(GetUTXOSnapshotMarkerPath());
+    return true;
+}
@@ -0,0 +1,91 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef COSANTA_UTXOSNAPSHOT_H
+#define COSANTA_UTXOSNAPSHOT_H
+
+#include "fs.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+
+//! Number of coins the snapshot loader writes to the chainstate at once
+static const unsigned int SNAPSHOT_LOAD_COINS_BATCH = 100000;
+
+/**
+ * Header of a UTXO snapshot file.
+ *
+ * The header is followed by the block index entries of the chain from the
+ * genesis block up to the base block, the unspent outputs at the base block,
+ * grouped by transaction, and the raw records of the evo database (the
+ * deterministic masternode lists and the mined LLMQ commitments). All fields
+ * have a fixed size, so that the dump can rewrite the header with the final
+ * counts once everything has been streamed.
+ */
+class CUTXOSnapshotMetadata
+{
+public:
+    static const uint32_t CURRENT_VERSION = 2;
+
+    uint32_t nVersion{CURRENT_VERSION};
+    unsigned char pchMessageStart[4]{};
+    uint256 baseBlockHash;
+    uint32_t nBaseHeight{0};
+    uint64_t nBlockIndexEntries{0};
+    uint64_t nCoins{0};
+    uint64_t nEvoRecords{0};
+    //! Finalized MuHash3072 of all unspent outputs in the snapshot, as reported by gettxoutsetinfo
+    uint256 muhash;
+    //! SHA256d of the keys and values of all evo records in the snapshot
+    uint256 evohash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(FLATDATA(pchMessageStart));
+        READWRITE(nVersion);
+        READWRITE(baseBlockHash);
+        READWRITE(nBaseHeight);
+        READWRITE(nBlockIndexEntries);
+        READWRITE(nCoins);
+        READWRITE(nEvoRecords);
+        READWRITE(muhash);
+        READWRITE(evohash);
+    }
+};
+
+/**
+ * Write the chainstate, the block index of the active chain and the evo
+ * database at the current tip to a snapshot file. The state is flushed and
+ * read through database snapshots, so cs_main is only held while the dump is
+ * being set up.
+ */
+bool DumpUTXOSnapshot(const fs::path& path, CUTXOSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Path of the file which exists in the data directory while a snapshot is
+ * being imported. If it is found at startup, the databases hold the partial
+ * state of an interrupted import.
+ */
+fs::path GetUTXOSnapshotMarkerPath();
+
+/**
+ * Read the header of a snapshot file and check it against the snapshots known
+ * to the chain parameters.
+ */
+bool ReadUTXOSnapshotMetadata(const fs::path& path, CUTXOSnapshotMetadata& metadata, std::string& strError);
+
+/**
+ * Import a snapshot into the empty block tree, chainstate and evo databases.
+ * Must be called during startup, after LoadBlockIndex() found an empty block
+ * tree and before the chainstate database is opened. Only snapshots whose base
+ * block and UTXO set hash match an entry of CChainParams::Snapshots() are
+ * accepted, the evo records must match the known hash as well. The marker file is created before anything is written and removed
+ * after the snapshotchain flag, which is written last.
+ */
+bool LoadUTXOSnapshot(const fs::path& path, size_t nCoinDBCache, std::string& strError);
+
+#endif // COSANTA_UTXOSNAPSHOT_H
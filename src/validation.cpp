@@ -17,6 +17,7 @@
 #include "consensus/merkle.h"
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
+#include "ctpl.h"
 #include "cuckoocache.h"
 #include "fs.h"
 #include "hash.h"
@@ -85,14 +86,17 @@ bool fTxIndex = true;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fSpecialTxIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
+bool fSnapshotChain = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+CCoinsFlushStats coinsFlushStats;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -878,6 +882,30 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool GetSpecialTxIndex(uint16_t type, int start, int end,
+                       std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &specialTxIndex)
+{
+    if (!fSpecialTxIndex)
+        return error("special tx index not enabled");
+
+    if (!pblocktree->ReadSpecialTxIndex(type, start, end, specialTxIndex))
+        return error("unable to get special transactions");
+
+    return true;
+}
+
+bool GetProTxIndex(const uint256 &proTxHash, int start, int end,
+                   std::vector<std::pair<CProTxIndexKey, uint16_t> > &proTxIndex)
+{
+    if (!fSpecialTxIndex)
+        return error("special tx index not enabled");
+
+    if (!pblocktree->ReadProTxIndex(proTxHash, start, end, proTxIndex))
+        return error("unable to get ProTx history");
+
+    return true;
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -995,6 +1023,27 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     return true;
 }
 
+bool ReadValidatedBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const uint256& hash)
+{
+    block.SetNull();
+
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+
+    try {
+        filein >> block;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+
+    if (block.GetHash() != hash)
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, hash.ToString(), pos.ToString());
+
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
 {
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), consensusParams))
@@ -1005,6 +1054,44 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+FILE* OpenRawBlockFile(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, unsigned int& nBlockSize)
+{
+    // The message start and size are written right in front of the block
+    if (pos.IsNull() || pos.nPos < 8) {
+        error("%s: invalid position %s", __func__, pos.ToString());
+        return nullptr;
+    }
+    CDiskBlockPos hpos = pos;
+    hpos.nPos -= 8;
+
+    CAutoFile filein(OpenBlockFile(hpos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+        return nullptr;
+    }
+
+    try {
+        CMessageHeader::MessageStartChars blk_start;
+        filein >> blk_start >> nBlockSize;
+        if (memcmp(blk_start, messageStart, CMessageHeader::MESSAGE_START_SIZE)) {
+            error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                  HexStr(blk_start, blk_start + CMessageHeader::MESSAGE_START_SIZE),
+                  HexStr(messageStart, messageStart + CMessageHeader::MESSAGE_START_SIZE));
+            return nullptr;
+        }
+        if (nBlockSize > MaxBlockSize(true)) {
+            error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__,
+                  pos.ToString(), nBlockSize, MaxBlockSize(true));
+            return nullptr;
+        }
+    } catch (const std::exception& e) {
+        error("%s: Read from block file failed: %s for %s", __func__, e.what(), pos.ToString());
+        return nullptr;
+    }
+
+    return filein.release();
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1318,8 +1405,11 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 
 bool CScriptCheck::operator()() {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
-    PrecomputedTransactionData txdata(*ptxTo);
-    return VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, txdata, cacheStore), &error);
+    if (txdata) {
+        return VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, *txdata, cacheStore), &error);
+    }
+    PrecomputedTransactionData txdataTmp(*ptxTo);
+    return VerifyScript(scriptSig, scriptPubKey, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, amount, txdataTmp, cacheStore), &error);
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1470,6 +1560,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -1496,6 +1588,8 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1557,6 +1651,25 @@ int ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out)
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
+/** Collects the -specialtxindex entries of all special transactions in a block */
+static void GetSpecialTxIndexEntries(const CBlock& block, const CBlockIndex* pindex,
+                                     std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> >& specialTxIndex,
+                                     std::vector<std::pair<CProTxIndexKey, uint16_t> >& proTxIndex)
+{
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransactionRef& tx = block.vtx[i];
+        if (tx->nVersion != 3 || tx->nType == TRANSACTION_NORMAL) {
+            continue;
+        }
+        specialTxIndex.push_back(std::make_pair(CSpecialTxIndexKey(tx->nType, pindex->nHeight, i), CSpecialTxIndexValue(pindex->GetBlockHash(), tx)));
+
+        uint256 proTxHash;
+        if (GetProTxHash(*tx, proTxHash)) {
+            proTxIndex.push_back(std::make_pair(CProTxIndexKey(proTxHash, pindex->nHeight, i), tx->nType));
+        }
+    }
+}
+
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  When FAILED is returned, view is left in an indeterminate state. */
 static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex* pindex, CCoinsViewCache& view)
@@ -1728,6 +1841,16 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
         }
     }
 
+    if (fSpecialTxIndex) {
+        std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > specialTxIndex;
+        std::vector<std::pair<CProTxIndexKey, uint16_t> > proTxIndex;
+        GetSpecialTxIndexEntries(block, pindex, specialTxIndex, proTxIndex);
+        if (!pblocktree->EraseSpecialTxIndex(specialTxIndex, proTxIndex)) {
+            AbortNode("Failed to delete special tx index");
+            return DISCONNECT_FAILED;
+        }
+    }
+
     evoDb->WriteBestBlock(pindex->pprev->GetBlockHash());
 
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
@@ -1765,6 +1888,40 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/** Threads reading the inputs of a block from the coins database, nullptr if prefetching is disabled */
+static std::unique_ptr<ctpl::thread_pool> inputPrefetchPool;
+
+void StartInputPrefetchThreads(int nThreads)
+{
+    assert(!inputPrefetchPool);
+    inputPrefetchPool.reset(new ctpl::thread_pool(nThreads));
+    RenameThreadPool(*inputPrefetchPool, "cosanta-prefetch");
+}
+
+/** Inputs of a block which are read from the coins database by the input prefetch threads */
+struct CInputPrefetchJob
+{
+    int nHeight{0};
+    //! coinsFlushStats.nFlushes when the reads were started
+    uint64_t nFlushes{0};
+    unsigned int nHits{0};
+    std::vector<COutPoint> vMissing;
+    std::vector<std::vector<std::pair<COutPoint, Coin> > > vCoins;
+    std::vector<std::future<void> > vFutures;
+};
+
+/** Prefetches started by AcceptBlock() by block hash, protected by cs_main */
+static std::map<uint256, std::shared_ptr<CInputPrefetchJob> > mapInputPrefetchJobs;
+
+void StopInputPrefetchThreads()
+{
+    if (inputPrefetchPool) {
+        inputPrefetchPool->stop(true);
+        inputPrefetchPool.reset();
+    }
+    mapInputPrefetchJobs.clear();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2325,6 +2482,14 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash())))
             return AbortNode(state, "Failed to write timestamp index");
 
+    if (fSpecialTxIndex) {
+        std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > specialTxIndex;
+        std::vector<std::pair<CProTxIndexKey, uint16_t> > proTxIndex;
+        GetSpecialTxIndexEntries(block, pindex, specialTxIndex, proTxIndex);
+        if (!specialTxIndex.empty() && !pblocktree->WriteSpecialTxIndex(specialTxIndex, proTxIndex))
+            return AbortNode(state, "Failed to write special tx index");
+    }
+
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2439,8 +2604,23 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // The cache stays warm, only if it is full the coins of the lowest
+            // heights are evicted from it.
+            int64_t nFlushStart = GetTimeMicros();
+            if (!pcoinsTip->Sync())
                 return AbortNode(state, "Failed to write to coin database");
+            uint64_t nEvicted = 0;
+            if (fCacheLarge || fCacheCritical) {
+                nEvicted = pcoinsTip->Trim(nCoinCacheUsage / 100 * COINS_CACHE_TRIM_PERCENT);
+            }
+            int64_t nFlushEnd = GetTimeMicros();
+            coinsFlushStats.nFlushes++;
+            coinsFlushStats.nLastFlushTime = nFlushEnd / 1000000;
+            coinsFlushStats.nLastFlushDuration = nFlushEnd - nFlushStart;
+            coinsFlushStats.nTotalFlushDuration += nFlushEnd - nFlushStart;
+            coinsFlushStats.nLastFlushEvicted = nEvicted;
+            LogPrint(BCLog::BENCHMARK, "Flushed coins cache: %.2fms, %u entries evicted, %u entries (%.1fMiB) kept\n",
+                     (nFlushEnd - nFlushStart) * 0.001, nEvicted, pcoinsTip->GetCacheSize(), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)));
         if (!evoDb->CommitRootTransaction()) {
             return AbortNode(state, "Failed to commit EvoDB");
         }
@@ -2595,7 +2775,138 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
+static uint64_t nPrefetchHits = 0;
+static uint64_t nPrefetchMisses = 0;
+
+/**
+ * Start reading the coins spent by a block which are not in pcoinsTip yet from
+ * the coins database. The reads are split among the input prefetch threads and
+ * don't need cs_main, the job keeps the results until the block is connected.
+ */
+static std::shared_ptr<CInputPrefetchJob> StartPrefetchBlockInputs(const CBlock& block, int nHeight)
+{
+    AssertLockHeld(cs_main);
+    auto job = std::make_shared<CInputPrefetchJob>();
+    job->nHeight = nHeight;
+    job->nFlushes = coinsFlushStats.nFlushes;
+
+    // outputs created by the block itself are not in the database
+    std::set<uint256> setBlockTxids;
+    for (const auto& tx : block.vtx) {
+        setBlockTxids.insert(tx->GetHash());
+    }
+
+    for (const auto& tx : block.vtx) {
+        if (tx->IsCoinBase()) {
+            continue;
+        }
+        for (const CTxIn& txin : tx->vin) {
+            if (setBlockTxids.count(txin.prevout.hash)) {
+                continue;
+            }
+            if (pcoinsTip->IsCached(txin.prevout)) {
+                job->nHits++;
+            } else {
+                job->vMissing.push_back(txin.prevout);
+            }
+        }
+    }
+
+    if (!job->vMissing.empty()) {
+        size_t nThreads = std::min<size_t>(inputPrefetchPool->size(), (job->vMissing.size() + MIN_PREFETCH_INPUTS_PER_THREAD - 1) / MIN_PREFETCH_INPUTS_PER_THREAD);
+        size_t nPerThread = (job->vMissing.size() + nThreads - 1) / nThreads;
+        job->vCoins.resize(nThreads);
+        job->vFutures.reserve(nThreads);
+        for (size_t i = 0; i < nThreads; i++) {
+            // the job is shared with the task, so that a dropped job stays valid until the task finished
+            job->vFutures.emplace_back(inputPrefetchPool->push([job, nPerThread, i](int) {
+                size_t nEnd = std::min(job->vMissing.size(), (i + 1) * nPerThread);
+                try {
+                    for (size_t j = i * nPerThread; j < nEnd; j++) {
+                        Coin coin;
+                        if (pcoinsdbview->GetCoin(job->vMissing[j], coin)) {
+                            job->vCoins[i].emplace_back(job->vMissing[j], std::move(coin));
+                        }
+                    }
+                } catch (const std::exception& e) {
+                    // read errors are reported by the error catcher of pcoinsTip once ConnectBlock reads the coin
+                    LogPrintf("PrefetchBlockInputs: %s\n", e.what());
+                }
+            }));
+        }
+    }
+    return job;
+}
+
+/**
+ * Called by AcceptBlock() once a block is stored. The inputs of blocks close
+ * to the tip are read while the block waits for ActivateBestChain(), so the
+ * reads overlap with the validation of the blocks before it.
+ */
+static void QueuePrefetchBlockInputs(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!inputPrefetchPool || mapInputPrefetchJobs.size() >= MAX_QUEUED_INPUT_PREFETCHES ||
+        pindex->nHeight <= chainActive.Height() || pindex->nHeight > chainActive.Height() + (int)MAX_QUEUED_INPUT_PREFETCHES) {
+        return;
+    }
+    mapInputPrefetchJobs.emplace(pindex->GetBlockHash(), StartPrefetchBlockInputs(block, pindex->nHeight));
+}
+
+/**
+ * Add the coins spent by a block which are not in pcoinsTip yet to pcoinsTip,
+ * so that ConnectBlock doesn't stall on a synchronous database read for every
+ * cache miss. The reads were usually started by AcceptBlock(), otherwise they
+ * are started here. The cache itself is only modified by the calling thread.
+ * Coins which can't be read are left to ConnectBlock.
+ */
+static void PrefetchBlockInputs(const CBlock& block, const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!inputPrefetchPool) {
+        return;
+    }
+    int64_t nTimeStart = GetTimeMicros();
+
+    std::shared_ptr<CInputPrefetchJob> job;
+    auto it = mapInputPrefetchJobs.find(pindex->GetBlockHash());
+    bool fQueued = it != mapInputPrefetchJobs.end();
+    if (fQueued) {
+        job = it->second;
+    } else {
+        job = StartPrefetchBlockInputs(block, pindex->nHeight);
+    }
+    // drop this and the prefetches of blocks which won't be connected on this chain
+    for (it = mapInputPrefetchJobs.begin(); it != mapInputPrefetchJobs.end(); ) {
+        if (it->second->nHeight <= pindex->nHeight) {
+            it = mapInputPrefetchJobs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (auto& future : job->vFutures) {
+        future.get();
+    }
+    size_t nAdded = 0;
+    // A flush removes spent coins from pcoinsTip after writing them, so reads
+    // started before it may return coins which are spent by now
+    bool fStale = job->nFlushes != coinsFlushStats.nFlushes;
+    if (!fStale) {
+        for (auto& vThreadCoins : job->vCoins) {
+            nAdded += pcoinsTip->AddPrefetchedCoins(vThreadCoins);
+        }
+    }
+
+    nPrefetchHits += job->nHits;
+    nPrefetchMisses += job->vMissing.size();
+    int64_t nTimeEnd = GetTimeMicros(); nTimePrefetch += nTimeEnd - nTimeStart;
+    LogPrint(BCLog::BENCHMARK, "    - Prefetch inputs: %.2fms [%.2fs] (%u hits, %u misses, %u read%s%s) [%u hits, %u misses]\n",
+             (nTimeEnd - nTimeStart) * 0.001, nTimePrefetch * 0.000001, job->nHits, job->vMissing.size(), nAdded,
+             fQueued ? ", queued" : "", fStale ? ", stale" : "", nPrefetchHits, nPrefetchMisses);
+}
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
 static int64_t nTimePostConnect = 0;
@@ -2693,6 +3004,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     {
         auto dbTx = evoDb->BeginTransaction();
 
+        PrefetchBlockInputs(blockConnecting, pindexNew);
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
         GetMainSignals().BlockChecked(blockConnecting, state);
@@ -3690,6 +4002,8 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
         return AbortNode(state, std::string("System error: ") + e.what());
     }
 
+    QueuePrefetchBlockInputs(block, pindex);
+
     if (fCheckForPruning)
         FlushStateToDisk(chainparams, state, FLUSH_STATE_NONE); // we just allocated more disk space for block files
 
@@ -4077,6 +4391,14 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether the chain was loaded from a UTXO snapshot. The missing
+    // blocks below its base are treated like pruned ones.
+    pblocktree->ReadFlag("snapshotchain", fSnapshotChain);
+    if (fSnapshotChain) {
+        LogPrintf("LoadBlockIndexDB(): Chain was loaded from a UTXO snapshot\n");
+        fHavePruned = true;
+    }
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -4098,6 +4420,10 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadFlag("spentindex", fSpentIndex);
     LogPrintf("%s: spent index %s\n", __func__, fSpentIndex ? "enabled" : "disabled");
 
+    // Check whether we have a special tx index
+    pblocktree->ReadFlag("specialtxindex", fSpecialTxIndex);
+    LogPrintf("%s: special tx index %s\n", __func__, fSpecialTxIndex ? "enabled" : "disabled");
+
     return true;
 }
 
@@ -4173,7 +4499,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
         if (pindex->nHeight < chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+        if ((fPruneMode || fSnapshotChain) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
             // If pruning, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
@@ -4352,6 +4678,7 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    fSnapshotChain = false;
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
@@ -4387,6 +4714,10 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // Use the provided setting for -spentindex in the new database
         fSpentIndex = gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
         pblocktree->WriteFlag("spentindex", fSpentIndex);
+
+        // Use the provided setting for -specialtxindex in the new database
+        fSpecialTxIndex = gArgs.GetBoolArg("-specialtxindex", DEFAULT_SPECIALTXINDEX);
+        pblocktree->WriteFlag("specialtxindex", fSpecialTxIndex);
     }
     return true;
 }
@@ -21,6 +21,7 @@
 #include "sync.h"
 #include "versionbits.h"
 #include "spentindex.h"
+#include "specialtxindex.h"
 
 #include <algorithm>
 #include <exception>
@@ -35,6 +36,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
@@ -83,6 +85,10 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Minimum number of block inputs read by one input prefetch thread */
+static const unsigned int MIN_PREFETCH_INPUTS_PER_THREAD = 16;
+/** Maximum number of accepted blocks whose inputs are read ahead of connecting them */
+static const unsigned int MAX_QUEUED_INPUT_PREFETCHES = 16;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -104,6 +110,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Percentage of the coins cache size (-dbcache) clean entries are evicted down to when the cache is full */
+static const unsigned int COINS_CACHE_TRIM_PERCENT = 50;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Block download timeout base, expressed in millionths of the block interval (i.e. 2.5 min) */
@@ -123,6 +131,7 @@ static const bool DEFAULT_TXINDEX = true;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+static const bool DEFAULT_SPECIALTXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -170,12 +179,27 @@ extern bool fTxIndex;
 extern bool fAddressIndex;
 extern bool fTimestampIndex;
 extern bool fSpentIndex;
+extern bool fSpecialTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+
+/** Statistics of the flushes of pcoinsTip to the coins database, protected by cs_main */
+struct CCoinsFlushStats
+{
+    uint64_t nFlushes{0};
+    //! Time of the last flush, in seconds since epoch
+    int64_t nLastFlushTime{0};
+    //! Duration of the last flush and of all flushes, in microseconds
+    int64_t nLastFlushDuration{0};
+    int64_t nTotalFlushDuration{0};
+    //! Number of clean entries evicted by the last flush
+    uint64_t nLastFlushEvicted{0};
+};
+extern CCoinsFlushStats coinsFlushStats;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** Absolute maximum transaction fee (in duffs) used by wallet and mempool (rejects high fee in sendrawtransaction) */
@@ -213,6 +237,8 @@ static const uint64_t nMinDiskSpace = 52428800;
 extern bool fHavePruned;
 /** True if we're running in -prune mode. */
 extern bool fPruneMode;
+/** True if the chain was bootstrapped from a UTXO snapshot, the blocks below its base were never downloaded. */
+extern bool fSnapshotChain;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
@@ -289,6 +315,10 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Start the threads which read the inputs of a block from the coins database before it is connected */
+void StartInputPrefetchThreads(int nThreads);
+/** Stop the input prefetch threads, blocks are connected without prefetching afterwards */
+void StopInputPrefetchThreads();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -423,6 +453,10 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+bool GetSpecialTxIndex(uint16_t type, int start, int end,
+                       std::vector<std::pair<CSpecialTxIndexKey, CSpecialTxIndexValue> > &specialTxIndex);
+bool GetProTxIndex(const uint256 &proTxHash, int start, int end,
+                   std::vector<std::pair<CProTxIndexKey, uint16_t> > &proTxIndex);
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -430,6 +464,20 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read a block which has been fully validated before, e.g. one of the active chain.
+ * Unlike ReadBlockFromDisk the block proof is not checked again, only the block hash.
+ * Does not require cs_main, the caller gets pos and hash from the block index.
+ */
+bool ReadValidatedBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const uint256& hash);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/**
+ * Open the block file at pos for reading the serialized block as stored on disk,
+ * without deserializing it. The message start and size header in front of the
+ * block are verified and nBlockSize is set to the size of the serialized block.
+ * The returned file is positioned at the start of the block, the caller owns it.
+ */
+FILE* OpenRawBlockFile(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart, unsigned int& nBlockSize);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -122,6 +122,7 @@ bool CDBEnv::Open(const fs::path& pathIn)
     dbenv->set_errfile(fsbridge::fopen(pathErrorFile, "a")); /// debug
     dbenv->set_flags(DB_AUTO_COMMIT, 1);
     dbenv->set_flags(DB_TXN_WRITE_NOSYNC, 1);
+    nFlushInterval = std::max<int64_t>(0, gArgs.GetArg("-walletflushinterval", DEFAULT_WALLET_FLUSH_INTERVAL));
     dbenv->log_set_config(DB_LOG_AUTO_REMOVE, 1);
     int ret = dbenv->open(strPath.c_str(),
                          DB_CREATE |
@@ -384,12 +385,41 @@ bool CDBEnv::Salvage(const std::string& strFile, bool fAggressive, std::vector<C
 
 void CDBEnv::CheckpointLSN(const std::string& strFile)
 {
-    dbenv->txn_checkpoint(0, 0, 0);
+    Checkpoint();
     if (fMockDb)
         return;
     dbenv->lsn_reset(strFile.c_str(), 0);
 }
 
+void CDBEnv::Checkpoint(unsigned int nKBytes, unsigned int nMinutes)
+{
+    if (nKBytes == 0 && nMinutes == 0) {
+        ++nSyncs;
+        nLastSyncTime = GetTimeMillis();
+        fSyncPending = false;
+    }
+    dbenv->txn_checkpoint(nKBytes, nMinutes, 0);
+}
+
+bool CDBEnv::DeferSync()
+{
+    if (nFlushInterval == 0 || GetTimeMillis() - nLastSyncTime >= nFlushInterval)
+        return false;
+    fSyncPending = true;
+    return true;
+}
+
+void CDBEnv::SyncDeferred()
+{
+    if (!fSyncPending || GetTimeMillis() - nLastSyncTime < nFlushInterval)
+        return;
+    TRY_LOCK(cs_db, lockDb);
+    if (lockDb && fDbEnvInit) {
+        LogPrint(BCLog::DB, "CDBEnv::SyncDeferred: syncing wallet writes older than %dms\n", nFlushInterval);
+        Checkpoint();
+    }
+}
+
 
 CDB::CDB(CWalletDBWrapper& dbw, const char* pszMode, bool fFlushOnCloseIn) : pdb(nullptr), activeTxn(nullptr)
 {
@@ -461,8 +491,10 @@ void CDB::Flush()
     unsigned int nMinutes = 0;
     if (fReadOnly)
         nMinutes = 1;
+    else if (env->DeferSync())
+        return; // synced by SyncDeferred() once -walletflushinterval has passed
 
-    env->dbenv->txn_checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes, 0);
+    env->Checkpoint(nMinutes ? gArgs.GetArg("-dblogsize", DEFAULT_WALLET_DBLOGSIZE) * 1024 : 0, nMinutes);
 }
 
 void CWalletDBWrapper::IncrementUpdateCounter()
@@ -610,7 +642,7 @@ void CDBEnv::Flush(bool fShutdown)
                 // Move log data to the dat file
                 CloseDb(strFile);
                 LogPrint(BCLog::DB, "CDBEnv::Flush: %s checkpoint\n", strFile);
-                dbenv->txn_checkpoint(0, 0, 0);
+                Checkpoint();
                 LogPrint(BCLog::DB, "CDBEnv::Flush: %s detach\n", strFile);
                 if (!fMockDb)
                     dbenv->lsn_reset(strFile.c_str(), 0);
@@ -23,6 +23,8 @@
 
 static const unsigned int DEFAULT_WALLET_DBLOGSIZE = 100;
 static const bool DEFAULT_WALLET_PRIVDB = true;
+//! Milliseconds wallet writes may stay in the database log before they're synced to disk, 0 syncs when a handle is closed
+static const int64_t DEFAULT_WALLET_FLUSH_INTERVAL = 0;
 
 class CDBEnv
 {
@@ -33,10 +35,18 @@ private:
     // shutdown problems/crashes caused by a static initialized internal pointer.
     std::string strPath;
 
+    //! -walletflushinterval
+    int64_t nFlushInterval{DEFAULT_WALLET_FLUSH_INTERVAL};
+    std::atomic<int64_t> nLastSyncTime{0};
+    //! Whether a handle skipped its checkpoint because of nFlushInterval
+    std::atomic<bool> fSyncPending{false};
+
     void EnvShutdown();
 
 public:
     mutable CCriticalSection cs_db;
+    //! Number of checkpoints which synced the log and data files to disk
+    std::atomic<uint64_t> nSyncs{0};
     std::unique_ptr<DbEnv> dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
@@ -73,6 +83,12 @@ public:
     void Close();
     void Flush(bool fShutdown);
     void CheckpointLSN(const std::string& strFile);
+    /** Checkpoint the environment, without thresholds this syncs the log and data files to disk */
+    void Checkpoint(unsigned int nKBytes = 0, unsigned int nMinutes = 0);
+    /** Whether a handle closed within the flush interval may skip its checkpoint */
+    bool DeferSync();
+    /** Sync the writes deferred by the flush interval once it has passed */
+    void SyncDeferred();
 
     void CloseDb(const std::string& strFile);
 
@@ -124,6 +140,9 @@ public:
 
     void IncrementUpdateCounter();
 
+    /** Number of times the database environment was synced to disk */
+    uint64_t GetSyncCount() const { return env ? env->nSyncs.load() : 0; }
+
     std::atomic<unsigned int> nUpdateCounter;
     unsigned int nLastSeen;
     unsigned int nLastFlushed;
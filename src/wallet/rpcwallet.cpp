@@ -821,7 +821,6 @@ UniValue getbalance(const JSONRPCRequest& request)
         );
 
     ObserveSafeMode();
-    LOCK2(cs_main, pwallet->cs_wallet);
 
     const UniValue& account_value = request.params[0];
     const UniValue& minconf = request.params[1];
@@ -837,9 +836,12 @@ UniValue getbalance(const JSONRPCRequest& request)
             throw JSONRPCError(RPC_INVALID_PARAMETER,
                 "getbalance include_watchonly option is only currently supported if an account is specified");
         }
+        // maintained by the wallet, doesn't need cs_main unless there are pending updates
         return ValueFromAmount(pwallet->GetBalance());
     }
 
+    LOCK2(cs_main, pwallet->cs_wallet);
+
     const std::string& account_param = account_value.get_str();
     const std::string* account = account_param != "*" ? &account_param : nullptr;
 
@@ -870,7 +872,6 @@ UniValue getunconfirmedbalance(const JSONRPCRequest &request)
                 "Returns the server's total unconfirmed balance\n");
 
     ObserveSafeMode();
-    LOCK2(cs_main, pwallet->cs_wallet);
 
     return ValueFromAmount(pwallet->GetUnconfirmedBalance());
 }
@@ -1148,6 +1149,142 @@ UniValue sendmany(const JSONRPCRequest& request)
     return wtx.GetHash().GetHex();
 }
 
+UniValue sendmanybatch(const JSONRPCRequest& request)
+{
+    CWallet * const pwallet = GetWalletForJSONRPCRequest(request);
+    if (!EnsureWalletIsAvailable(pwallet, request.fHelp)) {
+        return NullUniValue;
+    }
+
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 7)
+        throw std::runtime_error(
+            "sendmanybatch [{\"address\":amount,...},...] ( minconf addlocked \"comment\" use_ps conf_target \"estimate_mode\")\n"
+            "\nCreate one transaction per json object of the batch, no input is spent by more than one of them."
+            "\nThe inputs of all transactions are signed together and the transactions are stored in one wallet database write."
+            + HelpRequiringPassphrase(pwallet) + "\n"
+            "\nArguments:\n"
+            "1. \"batch\"                 (array, required) A json array of json objects with addresses and amounts\n"
+            "    [\n"
+            "      {\n"
+            "        \"address\":amount   (numeric or string) The cosanta address is the key, the numeric amount (can be string) in " + CURRENCY_UNIT + " is the value\n"
+            "        ,...\n"
+            "      }\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. minconf                 (numeric, optional, default=1) Only use the balance confirmed at least this many times.\n"
+            "3. addlocked               (bool, optional, default=false) Whether to include transactions locked via InstantSend.\n"
+            "4. \"comment\"               (string, optional) A comment stored with every transaction\n"
+            "5. \"use_ps\"                (bool, optional, default=false) Use PrivateSend funds only\n"
+            "6. conf_target             (numeric, optional) Confirmation target (in blocks)\n"
+            "7. \"estimate_mode\"         (string, optional, default=UNSET) The fee estimate mode, must be one of:\n"
+            "       \"UNSET\"\n"
+            "       \"ECONOMICAL\"\n"
+            "       \"CONSERVATIVE\"\n"
+            "\nResult:\n"
+            "[                          (json array of string)\n"
+            "  \"txid\"                  (string) The transaction id for each object of the batch, in the same order\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            "\nSend to two addresses in two transactions:\n"
+            + HelpExampleCli("sendmanybatch", "\"[{\\\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwG\\\":0.01},{\\\"XuQQkwA4FYkq2XERzMY2CiAZhJTEDAbtcG\\\":0.02}]\"") +
+            "\nAs a json rpc call\n"
+            + HelpExampleRpc("sendmanybatch", "[{\"XwnLY9Tf7Zsef8gMGL2fhWA9ZmMjt4KPwG\":0.01},{\"XuQQkwA4FYkq2XERzMY2CiAZhJTEDAbtcG\":0.02}], 6, false, \"payouts\"")
+        );
+
+    ObserveSafeMode();
+    LOCK2(cs_main, pwallet->cs_wallet);
+
+    if (pwallet->GetBroadcastTransactions() && !g_connman) {
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    UniValue batch = request.params[0].get_array();
+    if (batch.empty())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, empty batch");
+    int nMinDepth = 1;
+    if (!request.params[1].isNull())
+        nMinDepth = request.params[1].get_int();
+    bool fAddLocked = (!request.params[2].isNull() && request.params[2].get_bool());
+
+    std::vector<CWalletTx> vwtx(batch.size());
+    if (!request.params[3].isNull() && !request.params[3].get_str().empty()) {
+        for (CWalletTx& wtx : vwtx) {
+            wtx.mapValue["comment"] = request.params[3].get_str();
+        }
+    }
+
+    CCoinControl coin_control;
+
+    if (!request.params[4].isNull()) {
+        coin_control.UsePrivateSend(request.params[4].get_bool());
+    }
+
+    if (!request.params[5].isNull()) {
+        coin_control.m_confirm_target = ParseConfirmTarget(request.params[5]);
+    }
+
+    if (!request.params[6].isNull()) {
+        if (!FeeModeFromString(request.params[6].get_str(), coin_control.m_fee_mode)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_mode parameter");
+        }
+    }
+
+    std::vector<std::vector<CRecipient> > vecBatch;
+    vecBatch.reserve(batch.size());
+
+    CAmount totalAmount = 0;
+    for (unsigned int i = 0; i < batch.size(); i++) {
+        const UniValue& sendTo = batch[i].get_obj();
+        std::set<CBitcoinAddress> setAddress;
+        std::vector<CRecipient> vecSend;
+        for (const std::string& name_ : sendTo.getKeys())
+        {
+            CBitcoinAddress address(name_);
+            if (!address.IsValid())
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid Cosanta address: ")+name_);
+
+            if (setAddress.count(address))
+                throw JSONRPCError(RPC_INVALID_PARAMETER, std::string("Invalid parameter, duplicated address: ")+name_);
+            setAddress.insert(address);
+
+            CScript scriptPubKey = GetScriptForDestination(address.Get());
+            CAmount nAmount = AmountFromValue(sendTo[name_]);
+            if (nAmount <= 0)
+                throw JSONRPCError(RPC_TYPE_ERROR, "Invalid amount for send");
+            totalAmount += nAmount;
+
+            CRecipient recipient = {scriptPubKey, nAmount, false};
+            vecSend.push_back(recipient);
+        }
+        vecBatch.push_back(std::move(vecSend));
+    }
+
+    EnsureWalletIsUnlocked(pwallet);
+
+    // Check funds
+    CAmount nBalance = pwallet->GetLegacyBalance(ISMINE_SPENDABLE, nMinDepth, nullptr, fAddLocked);
+    if (totalAmount > nBalance)
+        throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, "Insufficient funds");
+
+    // Send
+    std::vector<std::unique_ptr<CReserveKey> > vKeyChange;
+    CAmount nFeeRequired = 0;
+    std::string strFailReason;
+
+    if (!pwallet->CreateTransactions(vecBatch, vwtx, vKeyChange, nFeeRequired, strFailReason, coin_control))
+        throw JSONRPCError(RPC_WALLET_INSUFFICIENT_FUNDS, strFailReason);
+    std::vector<CValidationState> vStates;
+    if (!pwallet->CommitTransactions(vwtx, vKeyChange, g_connman.get(), vStates))
+        throw JSONRPCError(RPC_WALLET_ERROR, "Transaction commit failed");
+
+    UniValue result(UniValue::VARR);
+    for (const CWalletTx& wtx : vwtx) {
+        result.push_back(wtx.GetHash().GetHex());
+    }
+    return result;
+}
+
 // Defined in rpc/misc.cpp
 extern CScript _createmultisig_redeemScript(CWallet * const pwallet, const UniValue& params);
 
@@ -2585,6 +2722,12 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"keys_left\": xxxx,          (numeric) how many new keys are left since last automatic backup\n"
             "  \"unlocked_until\": ttt,      (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,         (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
+            "  \"dbsyncs\": xxxx,            (numeric) how many times the wallet database environment was synced to disk\n"
+            "  \"scanning\":                 (json object) current scanning details, or false if no scan is in progress\n"
+            "    {\n"
+            "      \"duration\" : xxxx        (numeric) elapsed seconds since scan start\n"
+            "      \"progress\" : x.xxxx,     (numeric) scanning progress percentage [0.0, 1.0]\n"
+            "    },\n"
             "  \"hdchainid\": \"<hash>\",      (string) the ID of the HD chain\n"
             "  \"hdaccountcount\": xxx,      (numeric) how many accounts of the HD chain are in this wallet\n"
             "    [\n"
@@ -2610,10 +2753,11 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
 
     obj.push_back(Pair("walletname", pwallet->GetName()));
     obj.push_back(Pair("walletversion", pwallet->GetVersion()));
-    obj.push_back(Pair("balance",       ValueFromAmount(pwallet->GetBalance())));
-    obj.push_back(Pair("privatesend_balance",       ValueFromAmount(pwallet->GetAnonymizedBalance())));
-    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(pwallet->GetUnconfirmedBalance())));
-    obj.push_back(Pair("immature_balance",    ValueFromAmount(pwallet->GetImmatureBalance())));
+    CWalletBalances balances = pwallet->GetBalances();
+    obj.push_back(Pair("balance",       ValueFromAmount(balances.nTrusted)));
+    obj.push_back(Pair("privatesend_balance",       ValueFromAmount(balances.nAnonymized)));
+    obj.push_back(Pair("unconfirmed_balance", ValueFromAmount(balances.nUntrustedPending)));
+    obj.push_back(Pair("immature_balance",    ValueFromAmount(balances.nImmature)));
     obj.push_back(Pair("txcount",       (int)pwallet->mapWallet.size()));
     obj.push_back(Pair("keypoololdest", pwallet->GetOldestKeyPoolTime()));
     obj.push_back(Pair("keypoolsize",   (int64_t)pwallet->KeypoolCountExternalKeys()));
@@ -2624,6 +2768,15 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
     if (pwallet->IsCrypted())
         obj.push_back(Pair("unlocked_until", pwallet->nRelockTime));
     obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
+    obj.push_back(Pair("dbsyncs",       (uint64_t)pwallet->GetDBHandle().GetSyncCount()));
+    if (pwallet->IsScanning()) {
+        UniValue scanning(UniValue::VOBJ);
+        scanning.push_back(Pair("duration", pwallet->GetScanningDuration() / 1000));
+        scanning.push_back(Pair("progress", pwallet->GetScanningProgress()));
+        obj.push_back(Pair("scanning", scanning));
+    } else {
+        obj.push_back(Pair("scanning", false));
+    }
     if (fHDEnabled) {
         obj.push_back(Pair("hdchainid", hdChainCurrent.GetID().GetHex()));
         obj.push_back(Pair("hdaccountcount", (int64_t)hdChainCurrent.CountAccounts()));
@@ -3189,44 +3342,53 @@ UniValue rescanblockchain(const JSONRPCRequest& request)
             );
     }
 
-    LOCK2(cs_main, pwallet->cs_wallet);
+    if (pwallet->IsScanning()) {
+        throw JSONRPCError(RPC_WALLET_ERROR, "Wallet is currently rescanning. Abort existing rescan or wait.");
+    }
 
-    CBlockIndex *pindexStart = chainActive.Genesis();
+    CBlockIndex *pindexStart = nullptr;
     CBlockIndex *pindexStop = nullptr;
-    if (!request.params[0].isNull()) {
-        pindexStart = chainActive[request.params[0].get_int()];
-        if (!pindexStart) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start_height");
-        }
-    }
+    {
+        LOCK(cs_main);
 
-    if (!request.params[1].isNull()) {
-        pindexStop = chainActive[request.params[1].get_int()];
-        if (!pindexStop) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid stop_height");
+        pindexStart = chainActive.Genesis();
+        if (!request.params[0].isNull()) {
+            pindexStart = chainActive[request.params[0].get_int()];
+            if (!pindexStart) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid start_height");
+            }
         }
-        else if (pindexStop->nHeight < pindexStart->nHeight) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater then start_height");
+
+        if (!request.params[1].isNull()) {
+            pindexStop = chainActive[request.params[1].get_int()];
+            if (!pindexStop) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid stop_height");
+            }
+            else if (pindexStop->nHeight < pindexStart->nHeight) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "stop_height must be greater then start_height");
+            }
         }
-    }
 
-    // We can't rescan beyond non-pruned blocks, stop and throw an error
-    if (fPruneMode) {
-        CBlockIndex *block = pindexStop ? pindexStop : chainActive.Tip();
-        while (block && block->nHeight >= pindexStart->nHeight) {
-            if (!(block->nStatus & BLOCK_HAVE_DATA)) {
-                throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+        // We can't rescan beyond non-pruned blocks, stop and throw an error
+        if (fPruneMode) {
+            CBlockIndex *block = pindexStop ? pindexStop : chainActive.Tip();
+            while (block && block->nHeight >= pindexStart->nHeight) {
+                if (!(block->nStatus & BLOCK_HAVE_DATA)) {
+                    throw JSONRPCError(RPC_MISC_ERROR, "Can't rescan beyond pruned data. Use RPC call getblockchaininfo to determine your pruned height.");
+                }
+                block = block->pprev;
             }
-            block = block->pprev;
         }
     }
 
+    // Blocks are read and matched without holding cs_main and cs_wallet
     CBlockIndex *stopBlock = pwallet->ScanForWalletTransactions(pindexStart, pindexStop, true);
     if (!stopBlock) {
         if (pwallet->IsAbortingRescan()) {
             throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted.");
         }
         // if we got a nullptr returned, ScanForWalletTransactions did rescan up to the requested stopindex
+        LOCK(cs_main);
         stopBlock = pindexStop ? pindexStop : chainActive.Tip();
     }
     else {
@@ -3298,6 +3460,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "move",                     &movecmd,                  {"fromaccount","toaccount","amount","minconf","comment"} },
     { "wallet",             "sendfrom",                 &sendfrom,                 {"fromaccount","toaddress","amount","minconf","addlocked","comment","comment_to"} },
     { "wallet",             "sendmany",                 &sendmany,                 {"fromaccount","amounts","minconf","addlocked","comment","subtractfeefrom","use_ps","conf_target","estimate_mode"} },
+    { "wallet",             "sendmanybatch",            &sendmanybatch,            {"batch","minconf","addlocked","comment","use_ps","conf_target","estimate_mode"} },
     { "wallet",             "sendtoaddress",            &sendtoaddress,            {"address","amount","comment","comment_to","subtractfeefromamount","use_ps","conf_target","estimate_mode"} },
     { "wallet",             "setaccount",               &setaccount,               {"address","account"} },
     { "wallet",             "settxfee",                 &settxfee,                 {"amount"} },
@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "consensus/validation.h"
+#include "privatesend/privatesend-client.h"
 #include "rpc/server.h"
 #include "test/test_cosanta.h"
 #include "validation.h"
@@ -365,6 +366,60 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(branch_and_bound)
+{
+    CoinSet setCoinsRet;
+    CAmount nValueRet;
+
+    LOCK(testWallet.cs_wallet);
+
+    empty_wallet();
+
+    // an exact match is preferred over the lowest larger coin
+    add_coin(3 * CENT);
+    add_coin(5 * CENT);
+    add_coin(7 * CENT);
+    add_coin(11 * CENT);
+    add_coin(13 * CENT);
+    add_coin(50 * CENT);
+
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(23 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 23 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+
+    empty_wallet();
+
+    // many coins of the same value don't blow up the search
+    for (int i = 0; i < 1000; i++)
+        add_coin(1 * COIN);
+    add_coin(1 * CENT);
+
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(570 * COIN + 1 * CENT, 1, 6, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 570 * COIN + 1 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 571U);
+
+    empty_wallet();
+
+    // a set within the tolerance is kept even though a larger coin exists,
+    // the tolerance is below MIN_CHANGE so the larger coin would need change
+    add_coin(3 * CENT);
+    add_coin(5 * CENT);
+    add_coin(7 * CENT);
+    add_coin(8 * CENT);
+    add_coin(50 * CENT);
+
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(23 * CENT - 1000, 1, 6, 0, vCoins, setCoinsRet, nValueRet, CoinType::ALL_COINS, 1000));
+    BOOST_CHECK_EQUAL(nValueRet, 23 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 4U);
+
+    // without the tolerance the excess of 1000 is too small for change and the larger coin is used
+    BOOST_CHECK(testWallet.SelectCoinsMinConf(23 * CENT - 1000, 1, 6, 0, vCoins, setCoinsRet, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 50 * CENT);
+    BOOST_CHECK_EQUAL(setCoinsRet.size(), 1U);
+
+    empty_wallet();
+}
+
 static void AddKey(CWallet& wallet, const CKey& key)
 {
     LOCK(wallet.cs_wallet);
@@ -444,6 +499,58 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }
 }
 
+// Verify the rescan filter snapshot matches outputs to the wallet's keys and
+// notices keys being added after it was taken.
+BOOST_FIXTURE_TEST_CASE(rescan_filter, TestChain100Setup)
+{
+    CWallet wallet;
+    AddKey(wallet, coinbaseKey);
+
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CMutableTransaction tx;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * COIN;
+    tx.vout[0].scriptPubKey = GetScriptForDestination(otherKey.GetPubKey().GetID());
+
+    LOCK(wallet.cs_wallet);
+    std::shared_ptr<const CWalletScanFilter> filter = wallet.GetScanFilter();
+    BOOST_CHECK(filter->MayBeMine(coinbaseTxns.back()));
+    BOOST_CHECK(!filter->MayBeMine(tx));
+
+    wallet.AddKeyPubKey(otherKey, otherKey.GetPubKey());
+    BOOST_CHECK(wallet.GetScanFilterGeneration() != filter->nGeneration);
+    filter = wallet.GetScanFilter();
+    BOOST_CHECK(filter->MayBeMine(tx));
+
+    // bare P2PK outputs match as well
+    tx.vout[0].scriptPubKey = GetScriptForRawPubKey(otherKey.GetPubKey());
+    BOOST_CHECK(filter->MayBeMine(tx));
+
+    // removing one watch-only script and adding another keeps the number of
+    // entries, the generation must change nevertheless
+    CKey watchKey1, watchKey2;
+    watchKey1.MakeNewKey(true);
+    watchKey2.MakeNewKey(true);
+    BOOST_CHECK(wallet.AddWatchOnly(GetScriptForRawPubKey(watchKey1.GetPubKey()), 0));
+    filter = wallet.GetScanFilter();
+    BOOST_CHECK(wallet.RemoveWatchOnly(GetScriptForRawPubKey(watchKey1.GetPubKey())));
+    BOOST_CHECK(wallet.AddWatchOnly(GetScriptForRawPubKey(watchKey2.GetPubKey()), 0));
+    BOOST_CHECK(wallet.GetScanFilterGeneration() != filter->nGeneration);
+
+    // a bare multisig output which is ours only through our keys can't be
+    // matched against block filters
+    BOOST_CHECK(!wallet.HasKeyOnlyMultisigOutputs());
+    CScript multisig = GetScriptForMultisig(1, {coinbaseKey.GetPubKey(), otherKey.GetPubKey()});
+    tx.vout[0].scriptPubKey = multisig;
+    BOOST_CHECK(filter->MayBeMine(tx));
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx)));
+    BOOST_CHECK(wallet.HasKeyOnlyMultisigOutputs());
+    // once the script is known, its outputs are part of the filter scripts
+    BOOST_CHECK(wallet.AddCScript(multisig));
+    BOOST_CHECK(!wallet.HasKeyOnlyMultisigOutputs());
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -529,6 +636,161 @@ BOOST_FIXTURE_TEST_CASE(coin_mark_dirty_immature_credit, TestChain100Setup)
     BOOST_CHECK_EQUAL(wtx.GetImmatureCredit(), 500*COIN);
 }
 
+// Check that the incrementally maintained balances follow transactions added
+// to the wallet and blocks being connected, and match a full recompute.
+BOOST_FIXTURE_TEST_CASE(cached_balances_invalidation, TestChain100Setup)
+{
+    CWallet wallet;
+    AddKey(wallet, coinbaseKey);
+
+    // Compute an empty tally
+    CWalletBalances balances = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nTrusted, 0);
+    BOOST_CHECK_EQUAL(balances.nImmature, 0);
+
+    auto tally = [&wallet](CAmount& nTrusted, CAmount& nImmature) {
+        LOCK2(cs_main, wallet.cs_wallet);
+        nTrusted = 0;
+        nImmature = 0;
+        for (const auto& entry : wallet.mapWallet) {
+            const CWalletTx& wtx = entry.second;
+            if (wtx.IsTrusted()) {
+                nTrusted += wtx.GetAvailableCredit();
+            }
+            nImmature += wtx.GetImmatureCredit();
+        }
+    };
+
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(wallet.ScanForWalletTransactions(chainActive.Genesis(), nullptr) == nullptr);
+    }
+
+    CAmount nTrusted;
+    CAmount nImmature;
+    tally(nTrusted, nImmature);
+    BOOST_CHECK(nImmature > 0);
+
+    // only the transactions added by the rescan are accounted
+    balances = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nTrusted, nTrusted);
+    BOOST_CHECK_EQUAL(balances.nImmature, nImmature);
+    BOOST_CHECK_EQUAL(wallet.GetBalance(), nTrusted);
+    BOOST_CHECK_EQUAL(wallet.GetImmatureBalance(), nImmature);
+
+    // a new block adds an immature coinbase and lets an older one mature,
+    // both only through the transactions marked dirty and the volatile ones
+    CBlock block = CreateAndProcessBlock({}, GetScriptForRawPubKey(coinbaseKey.GetPubKey()));
+    {
+        LOCK(cs_main);
+        wallet.BlockConnected(std::make_shared<const CBlock>(block), chainActive.Tip(), {});
+    }
+    tally(nTrusted, nImmature);
+    balances = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(balances.nTrusted, nTrusted);
+    BOOST_CHECK_EQUAL(balances.nImmature, nImmature);
+
+    wallet.MarkBalancesDirty();
+    CWalletBalances full = wallet.GetBalances();
+    BOOST_CHECK_EQUAL(full.nTrusted, balances.nTrusted);
+    BOOST_CHECK_EQUAL(full.nImmature, balances.nImmature);
+    BOOST_CHECK_EQUAL(full.nUntrustedPending, balances.nUntrustedPending);
+}
+
+// Check that PrivateSend rounds follow chains of denominated wallet
+// transactions and are recomputed once an earlier transaction of the chain
+// is added to the wallet or the key of one of its outputs is imported.
+BOOST_FIXTURE_TEST_CASE(privatesend_rounds_cache, TestChain100Setup)
+{
+    CPrivateSend::InitStandardDenominations();
+    const CAmount nDenom = (1 * COIN) + 1000;
+    const CScript scriptPubKey = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    CWallet wallet;
+    AddKey(wallet, coinbaseKey);
+
+    CMutableTransaction tx1, tx2, tx3, tx4;
+    tx1.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    tx1.vout.emplace_back(nDenom, scriptPubKey);
+    tx2.vin.emplace_back(COutPoint(tx1.GetHash(), 0));
+    tx2.vout.emplace_back(nDenom, scriptPubKey);
+    tx3.vin.emplace_back(COutPoint(tx2.GetHash(), 0));
+    tx3.vout.emplace_back(nDenom, scriptPubKey);
+    tx4.vin.emplace_back(COutPoint(tx3.GetHash(), 0));
+    tx4.vout.emplace_back(nDenom, scriptPubKey);
+    tx4.vout.emplace_back(nDenom + 1, scriptPubKey);
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx2)));
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx3)));
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx4)));
+
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx1.GetHash(), 0)), -1);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx3.GetHash(), 0)), 1);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx2.GetHash(), 0)), 0);
+    // a denominated output next to a non-denominated one starts a new chain
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx4.GetHash(), 0)), 0);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx4.GetHash(), 1)), -2);
+
+    // tx1 is already spent by tx2, the rounds of its descendants change
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx1)));
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx3.GetHash(), 0)), 2);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx2.GetHash(), 0)), 1);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx1.GetHash(), 0)), 0);
+
+    // the input of tx6 spends a wallet transaction, but not one of our outputs
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+    CMutableTransaction tx5, tx6;
+    tx5.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    tx5.vout.emplace_back(nDenom, GetScriptForDestination(otherKey.GetPubKey().GetID()));
+    tx6.vin.emplace_back(COutPoint(tx5.GetHash(), 0));
+    tx6.vout.emplace_back(nDenom, scriptPubKey);
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx5)));
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx6)));
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx6.GetHash(), 0)), 0);
+
+    // importing the key makes it ours, the chain gets longer
+    BOOST_CHECK(wallet.AddKeyPubKey(otherKey, otherKey.GetPubKey()));
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx6.GetHash(), 0)), 1);
+    BOOST_CHECK_EQUAL(wallet.GetRealOutpointPrivateSendRounds(COutPoint(tx3.GetHash(), 0)), 2);
+}
+
+// Check that denominated outputs are indexed by denomination and removed
+// from their bucket once they are spent.
+BOOST_FIXTURE_TEST_CASE(denominated_utxo_buckets, TestChain100Setup)
+{
+    CPrivateSend::InitStandardDenominations();
+    const CAmount nDenom1 = (1 * COIN) + 1000;
+    const CAmount nDenom10 = (10 * COIN) + 10000;
+    const CScript scriptPubKey = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    CWallet wallet;
+    AddKey(wallet, coinbaseKey);
+
+    CMutableTransaction tx1;
+    tx1.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    tx1.vout.emplace_back(nDenom1, scriptPubKey);
+    tx1.vout.emplace_back(nDenom1, scriptPubKey);
+    tx1.vout.emplace_back(nDenom10, scriptPubKey);
+    tx1.vout.emplace_back(nDenom1 + 1, scriptPubKey);
+
+    LOCK2(cs_main, wallet.cs_wallet);
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx1)));
+    BOOST_CHECK_EQUAL(wallet.CountInputsWithAmount(nDenom1), 2);
+    BOOST_CHECK_EQUAL(wallet.CountInputsWithAmount(nDenom10), 1);
+    BOOST_CHECK_EQUAL(wallet.CountInputsWithAmount(nDenom1 + 1), 1);
+    BOOST_CHECK_EQUAL(wallet.CountInputsWithAmount((.1 * COIN) + 100), 0);
+
+    CMutableTransaction tx2;
+    tx2.vin.emplace_back(COutPoint(tx1.GetHash(), 0));
+    tx2.vin.emplace_back(COutPoint(tx1.GetHash(), 2));
+    tx2.vout.emplace_back(nDenom1 + nDenom10 - 1000, GetScriptForDestination(CKeyID()));
+    wallet.AddToWallet(CWalletTx(&wallet, MakeTransactionRef(tx2)));
+    BOOST_CHECK_EQUAL(wallet.CountInputsWithAmount(nDenom1), 1);
+    BOOST_CHECK_EQUAL(wallet.CountInputsWithAmount(nDenom10), 0);
+}
+
 static int64_t AddTx(CWallet& wallet, uint32_t lockTime, int64_t mockTime, int64_t blockTime)
 {
     CMutableTransaction tx;
@@ -598,6 +860,40 @@ BOOST_AUTO_TEST_CASE(LoadReceiveRequests)
     BOOST_CHECK_EQUAL(values[1], "val_rr1");
 }
 
+BOOST_AUTO_TEST_CASE(walletdb_group_commit)
+{
+    CWalletDBWrapper& dbw = pwalletMain->GetDBHandle();
+    CBlockLocator locator({uint256S("0x01")});
+    {
+        CWalletDB walletdb(dbw);
+        CWalletDBGroupCommit groupCommit(walletdb);
+        {
+            // nested scopes join the outer transaction
+            CWalletDBGroupCommit nested(walletdb);
+            BOOST_CHECK(walletdb.WriteBestBlock(locator));
+        }
+        BOOST_CHECK(!walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.WritePool(1, CKeyPool()));
+        BOOST_CHECK(groupCommit.Commit());
+        // no transaction is left open
+        BOOST_CHECK(walletdb.TxnBegin());
+        BOOST_CHECK(walletdb.TxnAbort());
+    }
+
+    // closing a handle syncs the database environment
+    uint64_t nSyncs = dbw.GetSyncCount();
+    {
+        CWalletDB walletdb(dbw);
+        CBlockLocator locatorRead;
+        BOOST_CHECK(walletdb.ReadBestBlock(locatorRead));
+        BOOST_CHECK(locatorRead.vHave == locator.vHave);
+        CKeyPool keypool;
+        BOOST_CHECK(walletdb.ReadPool(1, keypool));
+        BOOST_CHECK(walletdb.ErasePool(1));
+    }
+    BOOST_CHECK_EQUAL(dbw.GetSyncCount(), nSyncs + 1);
+}
+
 class ListCoinsTestingSetup : public TestChain100Setup
 {
 public:
@@ -686,4 +982,96 @@ BOOST_FIXTURE_TEST_CASE(ListCoins, ListCoinsTestingSetup)
     BOOST_CHECK_EQUAL(list.begin()->second.size(), 2);
 }
 
+BOOST_FIXTURE_TEST_CASE(CreateTransactions, ListCoinsTestingSetup)
+{
+    // Split the coinbase coin into two coins of the wallet
+    AddTx(CRecipient{GetScriptForRawPubKey(coinbaseKey.GetPubKey()), 1 * COIN, false /* subtract fee */});
+    std::vector<COutput> available;
+    wallet->AvailableCoins(available);
+    BOOST_CHECK_EQUAL(available.size(), 2);
+
+    // Both transactions are funded from the wallet state before the batch, the
+    // second one has to use the remaining coin
+    std::vector<std::vector<CRecipient> > vecBatch = {
+        {CRecipient{GetScriptForRawPubKey({}), 10 * COIN, false /* subtract fee */}},
+        {CRecipient{GetScriptForRawPubKey({}), COIN / 2, false /* subtract fee */}},
+    };
+    std::vector<CWalletTx> vwtx;
+    std::vector<std::unique_ptr<CReserveKey> > vReserveKeys;
+    CAmount nFee;
+    std::string error;
+    CCoinControl dummy;
+    BOOST_CHECK(wallet->CreateTransactions(vecBatch, vwtx, vReserveKeys, nFee, error, dummy));
+    BOOST_CHECK_EQUAL(vwtx.size(), 2);
+    BOOST_CHECK_EQUAL(vReserveKeys.size(), 2);
+    BOOST_CHECK(nFee > 0);
+
+    std::set<COutPoint> setInputs;
+    for (const CWalletTx& wtx : vwtx) {
+        for (const CTxIn& txin : wtx.tx->vin) {
+            BOOST_CHECK(setInputs.insert(txin.prevout).second);
+            BOOST_CHECK(!txin.scriptSig.empty());
+        }
+    }
+    BOOST_CHECK_EQUAL(setInputs.size(), 2);
+    {
+        LOCK(wallet->cs_wallet);
+        for (const COutPoint& outpoint : setInputs) {
+            BOOST_CHECK(!wallet->IsLockedCoin(outpoint.hash, outpoint.n));
+        }
+    }
+
+    // A third transaction can't be funded as well
+    vecBatch.push_back({CRecipient{GetScriptForRawPubKey({}), COIN / 2, false /* subtract fee */}});
+    std::vector<CWalletTx> vwtxFail;
+    std::vector<std::unique_ptr<CReserveKey> > vReserveKeysFail;
+    BOOST_CHECK(!wallet->CreateTransactions(vecBatch, vwtxFail, vReserveKeysFail, nFee, error, dummy));
+
+    std::vector<CValidationState> vStates;
+    int64_t nOrderPosNext;
+    {
+        LOCK(wallet->cs_wallet);
+        nOrderPosNext = wallet->nOrderPosNext;
+    }
+    BOOST_CHECK(wallet->CommitTransactions(vwtx, vReserveKeys, nullptr, vStates));
+    LOCK(wallet->cs_wallet);
+    // the order positions written with the transactions are the ones in memory
+    BOOST_CHECK_EQUAL(wallet->nOrderPosNext, nOrderPosNext + 2);
+    for (size_t i = 0; i < vwtx.size(); i++) {
+        BOOST_CHECK(wallet->mapWallet.count(vwtx[i].GetHash()));
+        BOOST_CHECK_EQUAL(wallet->mapWallet.at(vwtx[i].GetHash()).nOrderPos, nOrderPosNext + (int64_t)i);
+    }
+    for (const COutPoint& outpoint : setInputs) {
+        BOOST_CHECK(wallet->IsSpent(outpoint.hash, outpoint.n));
+    }
+}
+
+// Zapped transactions must not leave their outputs in the amount buckets
+BOOST_FIXTURE_TEST_CASE(zap_denominated_utxo_buckets, ListCoinsTestingSetup)
+{
+    CPrivateSend::InitStandardDenominations();
+    const CAmount nDenom = (1 * COIN) + 1000;
+
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(COutPoint(GetRandHash(), 0));
+    mtx.vout.emplace_back(nDenom, GetScriptForDestination(coinbaseKey.GetPubKey().GetID()));
+    mtx.vout.emplace_back(nDenom, GetScriptForDestination(coinbaseKey.GetPubKey().GetID()));
+
+    LOCK2(cs_main, wallet->cs_wallet);
+    BOOST_CHECK(wallet->AddToWallet(CWalletTx(wallet.get(), MakeTransactionRef(mtx))));
+    BOOST_CHECK_EQUAL(wallet->CountInputsWithAmount(nDenom), 2);
+
+    std::vector<uint256> vHashIn{mtx.GetHash()};
+    std::vector<uint256> vHashOut;
+    BOOST_CHECK(wallet->ZapSelectTx(vHashIn, vHashOut) == DB_LOAD_OK);
+    BOOST_CHECK_EQUAL(vHashOut.size(), 1);
+    BOOST_CHECK(!wallet->mapWallet.count(mtx.GetHash()));
+    BOOST_CHECK_EQUAL(wallet->CountInputsWithAmount(nDenom), 0);
+    // the rounds of outpoints left behind without their transaction would be -1
+    const bool fEnablePrivateSendPrev = privateSendClient.fEnablePrivateSend;
+    privateSendClient.fEnablePrivateSend = true;
+    BOOST_CHECK_EQUAL(wallet->GetAverageAnonymizedRounds(), 0);
+    privateSendClient.fEnablePrivateSend = fEnablePrivateSendPrev;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -13,7 +13,9 @@
 #include "wallet/coincontrol.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "ctpl.h"
 #include "fs.h"
+#include "index/blockfilterindex.h"
 #include "init.h"
 #include "key.h"
 #include "keystore.h"
@@ -25,6 +27,7 @@
 #include "primitives/transaction.h"
 #include "script/script.h"
 #include "script/sign.h"
+#include "script/standard.h"
 #include "scheduler.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -169,7 +172,7 @@ CPubKey CWallet::GenerateNewKey(CWalletDB &walletdb, uint32_t nAccountIndex, boo
 
         // Compressed public keys were introduced in version 0.6.0
         if (fCompressed) {
-            SetMinVersion(FEATURE_COMPRPUBKEY);
+            SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
         }
 
         pubkey = secret.GetPubKey();
@@ -302,6 +305,10 @@ bool CWallet::LoadHDPubKey(const CHDPubKey &hdPubKey)
     AssertLockHeld(cs_wallet);
 
     mapHdPubKeys[hdPubKey.extPubKey.pubkey.GetID()] = hdPubKey;
+    {
+        LOCK(cs_KeyStore);
+        nKeyStoreGeneration++;
+    }
     return true;
 }
 
@@ -317,15 +324,19 @@ bool CWallet::AddHDPubKey(CWalletDB &walletdb, const CExtPubKey &extPubKey, bool
     hdPubKey.hdchainID = hdChainCurrent.GetID();
     hdPubKey.nChangeIndex = fInternal ? 1 : 0;
     mapHdPubKeys[extPubKey.pubkey.GetID()] = hdPubKey;
+    {
+        LOCK(cs_KeyStore);
+        nKeyStoreGeneration++;
+    }
 
     // check if we need to remove from watch-only
     CScript script;
     script = GetScriptForDestination(extPubKey.pubkey.GetID());
     if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+        RemoveWatchOnly(walletdb, script);
     script = GetScriptForRawPubKey(extPubKey.pubkey);
     if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+        RemoveWatchOnly(walletdb, script);
 
     return walletdb.WriteHDPubKey(hdPubKey, mapKeyMetadata[extPubKey.pubkey.GetID()]);
 }
@@ -351,11 +362,11 @@ bool CWallet::AddKeyPubKeyWithDB(CWalletDB &walletdb, const CKey& secret, const
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnly(walletdb, script);
     }
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script)) {
-        RemoveWatchOnly(script);
+        RemoveWatchOnly(walletdb, script);
     }
 
     if (!IsCrypted()) {
@@ -461,13 +472,19 @@ bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    CWalletDB walletdb(*dbw);
+    return RemoveWatchOnly(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnly(CWalletDB &walletdb, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
         return false;
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
-    if (!CWalletDB(*dbw).EraseWatchOnly(dest))
+    if (!walletdb.EraseWatchOnly(dest))
         return false;
 
     return true;
@@ -664,6 +681,7 @@ std::set<uint256> CWallet::GetConflicts(const uint256& txid) const
 
 void CWallet::Flush(bool shutdown)
 {
+    FlushPrivateSendRounds();
     dbw->Flush(shutdown);
 }
 
@@ -731,7 +749,7 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
 void CWallet::AddToSpends(const COutPoint& outpoint, const uint256& wtxid)
 {
     mapTxSpends.insert(std::make_pair(outpoint, wtxid));
-    setWalletUTXO.erase(outpoint);
+    EraseWalletUTXO(outpoint);
 
     std::pair<TxSpends::iterator, TxSpends::iterator> range;
     range = mapTxSpends.equal_range(outpoint);
@@ -1044,6 +1062,7 @@ void CWallet::MarkDirty()
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    MarkBalancesDirty();
 }
 
 bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
@@ -1051,6 +1070,12 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     LOCK(cs_wallet);
 
     CWalletDB walletdb(*dbw, "r+", fFlushOnClose);
+    return AddToWallet(wtxIn, walletdb);
+}
+
+bool CWallet::AddToWallet(const CWalletTx& wtxIn, CWalletDB& walletdb, bool fWritten)
+{
+    LOCK(cs_wallet);
 
     uint256 hash = wtxIn.GetHash();
 
@@ -1061,16 +1086,28 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     bool fInsertedNew = ret.second;
     if (fInsertedNew)
     {
-        wtx.nTimeReceived = GetAdjustedTime();
-        wtx.nOrderPos = IncOrderPosNext(&walletdb);
+        if (!fWritten) {
+            wtx.nTimeReceived = GetAdjustedTime();
+            wtx.nOrderPos = IncOrderPosNext(&walletdb);
+        }
         wtxOrdered.insert(std::make_pair(wtx.nOrderPos, TxPair(&wtx, nullptr)));
-        wtx.nTimeSmart = ComputeTimeSmart(wtx);
+        if (!fWritten) {
+            wtx.nTimeSmart = ComputeTimeSmart(wtx);
+        }
         AddToSpends(hash);
 
+        // rounds of outputs spending this transaction were computed without it
+        for (unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
+            if (mapTxSpends.count(COutPoint(hash, i))) {
+                InvalidatePrivateSendRounds({hash});
+                break;
+            }
+        }
+
         auto mnList = deterministicMNManager->GetListAtChainTip();
         for(unsigned int i = 0; i < wtx.tx->vout.size(); ++i) {
             if (IsMine(wtx.tx->vout[i]) && !IsSpent(hash, i)) {
-                setWalletUTXO.insert(COutPoint(hash, i));
+                AddWalletUTXO(COutPoint(hash, i), wtx.tx->vout[i].nValue);
                 if (deterministicMNManager->IsProTxWithCollateral(wtx.tx, i) || mnList.HasMNByCollateral(COutPoint(hash, i))) {
                     LockCoin(COutPoint(hash, i));
                 }
@@ -1109,7 +1146,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
     LogPrintf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
     // Write to disk
-    if (fInsertedNew || fUpdated)
+    if ((fInsertedNew && !fWritten) || fUpdated)
         if (!walletdb.WriteTx(wtx))
             return false;
 
@@ -1130,6 +1167,7 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose)
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    MarkBalanceDirty(hash);
 
     return true;
 }
@@ -1268,6 +1306,7 @@ bool CWallet::AbandonTransaction(const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.setAbandoned();
             wtx.MarkDirty();
+            MarkBalanceDirty(now);
             walletdb.WriteTx(wtx);
             NotifyTransactionChanged(this, wtx.GetHash(), CT_UPDATED);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them abandoned too
@@ -1333,6 +1372,7 @@ void CWallet::MarkConflicted(const uint256& hashBlock, const uint256& hashTx)
             wtx.nIndex = -1;
             wtx.hashBlock = hashBlock;
             wtx.MarkDirty();
+            MarkBalanceDirty(now);
             walletdb.WriteTx(wtx);
             // Iterate over all its outputs, and mark transactions in the wallet that spend them conflicted too
             TxSpends::const_iterator iter = mapTxSpends.lower_bound(COutPoint(now, 0));
@@ -1373,6 +1413,7 @@ void CWallet::SyncTransaction(const CTransactionRef& ptx, const CBlockIndex *pin
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    MarkBalanceDirty(tx.GetHash());
 }
 
 void CWallet::TransactionAddedToMempool(const CTransactionRef& ptx, int64_t nAcceptTime) {
@@ -1427,19 +1468,29 @@ void CWallet::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const
     // reset cache to make sure no longer immature coins are included
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    MarkVolatileBalancesDirty();
 }
 
 void CWallet::BlockDisconnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindexDisconnected) {
     LOCK2(cs_main, cs_wallet);
 
+    std::vector<uint256> vWalletTxs;
     for (const CTransactionRef& ptx : pblock->vtx) {
         // NOTE: do NOT pass pindex here
         SyncTransaction(ptx);
+        if (mapWallet.count(ptx->GetHash())) {
+            vWalletTxs.push_back(ptx->GetHash());
+        }
     }
 
+    InvalidatePrivateSendRounds(vWalletTxs);
+
     // reset cache to make sure no longer mature coins are excluded
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    // Coins of any depth may turn immature again, so don't try to track that
+    // per transaction. Reorgs are rare enough for a full recompute.
+    MarkBalancesDirty();
 }
 
 
@@ -1477,86 +1528,189 @@ CAmount CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
     return 0;
 }
 
-// Recursively determine the rounds of a given input (How deep is the PrivateSend chain for a given input)
-int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds) const
+// Determine the rounds of a given input (How deep is the PrivateSend chain for a given input).
+// Rounds of the ancestors are resolved iteratively, each outpoint is computed only once.
+int CWallet::GetRealOutpointPrivateSendRounds(const COutPoint& outpoint) const
 {
-    static std::map<uint256, CMutableTransaction> mDenomWtxes;
+    LOCK(cs_wallet);
 
-    if(nRounds >= MAX_PRIVATESEND_ROUNDS) {
-        // there can only be MAX_PRIVATESEND_ROUNDS rounds max
-        return MAX_PRIVATESEND_ROUNDS - 1;
+    // imported keys can change which of the inputs below are ours
+    const uint64_t nKeyStoreGeneration = GetKeyStoreGeneration();
+    if (nKeyStoreGeneration != nRoundsKeyStoreGeneration) {
+        InvalidatePrivateSendRounds(std::vector<uint256>(setRoundsForeignInputTxs.begin(), setRoundsForeignInputTxs.end()));
+        nRoundsKeyStoreGeneration = nKeyStoreGeneration;
     }
 
-    uint256 hash = outpoint.hash;
-    unsigned int nout = outpoint.n;
+    auto it = mapOutpointRoundsCache.find(outpoint);
+    if (it != mapOutpointRoundsCache.end()) {
+        return it->second;
+    }
 
-    const CWalletTx* wtx = GetWalletTx(hash);
-    if(wtx != nullptr)
-    {
-        std::map<uint256, CMutableTransaction>::const_iterator mdwi = mDenomWtxes.find(hash);
-        if (mdwi == mDenomWtxes.end()) {
-            // not known yet, let's add it
-            LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds INSERTING %s\n", hash.ToString());
-            mDenomWtxes[hash] = CMutableTransaction(*wtx);
-        } else if(mDenomWtxes[hash].vout[nout].nRounds != -10) {
-            // found and it's not an initial value, just return it
-            return mDenomWtxes[hash].vout[nout].nRounds;
+    const CWalletTx* wtx = GetWalletTx(outpoint.hash);
+    if (wtx == nullptr) {
+        return -1;
+    }
+    if (outpoint.n >= wtx->tx->vout.size()) {
+        // should never actually hit this
+        return -4;
+    }
+
+    // Depth-first walk over our inputs, an outpoint is resolved once all of
+    // the outpoints it spends are, i.e. in topological order.
+    std::vector<COutPoint> vToVisit{outpoint};
+    while (!vToVisit.empty()) {
+        const COutPoint current = vToVisit.back();
+        if (mapOutpointRoundsCache.count(current)) {
+            vToVisit.pop_back();
+            continue;
         }
 
+        // only outpoints of wallet transactions are ever visited
+        const CTransaction& tx = *mapWallet.at(current.hash).tx;
+        const CAmount nValue = tx.vout[current.n].nValue;
 
-        // bounds check
-        if (nout >= wtx->tx->vout.size()) {
-            // should never actually hit this
-            LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, -4);
-            return -4;
+        int nRounds;
+        if (CPrivateSend::IsCollateralAmount(nValue)) {
+            nRounds = -3;
+        } else if (!CPrivateSend::IsDenominatedAmount(nValue)) {
+            //make sure the final output is non-denominate
+            nRounds = -2;
+        } else if (!std::all_of(tx.vout.begin(), tx.vout.end(), [](const CTxOut& out) { return CPrivateSend::IsDenominatedAmount(out.nValue); })) {
+            // this one is denominated but there is another non-denominated output found in the same tx
+            nRounds = 0;
+        } else {
+            // only denoms here so let's look up
+            bool fPending = false;
+            int nShortest = -1;
+            for (const auto& txin : tx.vin) {
+                if (!IsMine(txin)) {
+                    if (mapWallet.count(txin.prevout.hash)) {
+                        setRoundsForeignInputTxs.insert(current.hash);
+                    }
+                    continue;
+                }
+                auto itPrev = mapOutpointRoundsCache.find(txin.prevout);
+                if (itPrev == mapOutpointRoundsCache.end()) {
+                    vToVisit.push_back(txin.prevout);
+                    fPending = true;
+                } else if (itPrev->second >= 0 && (nShortest == -1 || itPrev->second < nShortest)) {
+                    // denom found, find the shortest chain
+                    nShortest = itPrev->second;
+                }
+            }
+            if (fPending) {
+                continue;
+            }
+            // good, we a +1 to the shortest one but only MAX_PRIVATESEND_ROUNDS rounds max allowed,
+            // too bad if no denom was found, we are the first one in that chain
+            nRounds = nShortest == -1 ? 0 : std::min(nShortest + 1, MAX_PRIVATESEND_ROUNDS);
         }
 
-        if (CPrivateSend::IsCollateralAmount(wtx->tx->vout[nout].nValue)) {
-            mDenomWtxes[hash].vout[nout].nRounds = -3;
-            LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
-        }
+        vToVisit.pop_back();
+        mapOutpointRoundsCache.emplace(current, nRounds);
+        // written by FlushPrivateSendRounds(), this is called on hot paths
+        setRoundsDirty.insert(current);
+        LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", current.hash.ToString(), current.n, nRounds);
+    }
+
+    return mapOutpointRoundsCache.at(outpoint);
+}
+
+void CWallet::FlushPrivateSendRounds() const
+{
+    LOCK(cs_wallet);
+
+    if (setRoundsDirty.empty()) {
+        return;
+    }
 
-        //make sure the final output is non-denominate
-        if (!CPrivateSend::IsDenominatedAmount(wtx->tx->vout[nout].nValue)) { //NOT DENOM
-            mDenomWtxes[hash].vout[nout].nRounds = -2;
-            LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+    CWalletDB walletdb(*dbw);
+    CWalletDBGroupCommit groupCommit(walletdb);
+    for (const COutPoint& outpoint : setRoundsDirty) {
+        auto it = mapOutpointRoundsCache.find(outpoint);
+        if (it != mapOutpointRoundsCache.end()) {
+            walletdb.WritePrivateSendRounds(outpoint, it->second);
+        } else {
+            walletdb.ErasePrivateSendRounds(outpoint);
         }
+    }
+    if (!groupCommit.Commit()) {
+        LogPrintf("%s: couldn't write the PrivateSend rounds of %u outputs\n", __func__, setRoundsDirty.size());
+        return;
+    }
+    setRoundsDirty.clear();
+}
+
+void CWallet::LoadPrivateSendRounds(const COutPoint& outpoint, int nRounds)
+{
+    // rounds above the current maximum were stored by another version, recompute them
+    if (nRounds <= MAX_PRIVATESEND_ROUNDS) {
+        mapOutpointRoundsCache.emplace(outpoint, nRounds);
+    }
+}
+
+bool CWallet::HasForeignWalletInput(const CTransaction& tx) const
+{
+    AssertLockHeld(cs_wallet);
 
-        bool fAllDenoms = true;
-        for (const auto& out : wtx->tx->vout) {
-            fAllDenoms = fAllDenoms && CPrivateSend::IsDenominatedAmount(out.nValue);
+    for (const auto& txin : tx.vin) {
+        if (mapWallet.count(txin.prevout.hash) && !IsMine(txin)) {
+            return true;
         }
+    }
+    return false;
+}
 
-        // this one is denominated but there is another non-denominated output found in the same tx
-        if (!fAllDenoms) {
-            mDenomWtxes[hash].vout[nout].nRounds = 0;
-            LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-            return mDenomWtxes[hash].vout[nout].nRounds;
+// Drops the cached rounds of the outputs of the given transactions and of all
+// wallet transactions spending them, directly or through other wallet transactions.
+void CWallet::InvalidatePrivateSendRounds(const std::vector<uint256>& vHashes) const
+{
+    AssertLockHeld(cs_wallet);
+
+    if (mapOutpointRoundsCache.empty()) {
+        setRoundsForeignInputTxs.clear();
+        return;
+    }
+
+    bool fAnyErased = false;
+    std::set<uint256> setVisited;
+    std::vector<uint256> vToVisit(vHashes);
+    while (!vToVisit.empty()) {
+        const uint256 hash = vToVisit.back();
+        vToVisit.pop_back();
+        if (!setVisited.insert(hash).second) {
+            continue;
         }
+        setRoundsForeignInputTxs.erase(hash);
 
-        int nShortest = -10; // an initial value, should be no way to get this by calculations
-        bool fDenomFound = false;
-        // only denoms here so let's look up
-        for (const auto& txinNext : wtx->tx->vin) {
-            if (IsMine(txinNext)) {
-                int n = GetRealOutpointPrivateSendRounds(txinNext.prevout, nRounds + 1);
-                // denom found, find the shortest chain or initially assign nShortest with the first found value
-                if(n >= 0 && (n < nShortest || nShortest == -10)) {
-                    nShortest = n;
-                    fDenomFound = true;
-                }
+        const auto it = mapWallet.find(hash);
+        if (it == mapWallet.end()) {
+            continue;
+        }
+        bool fErased = false;
+        for (unsigned int i = 0; i < it->second.tx->vout.size(); ++i) {
+            const COutPoint outpoint(hash, i);
+            if (mapOutpointRoundsCache.erase(outpoint)) {
+                setRoundsDirty.insert(outpoint);
+                fErased = true;
+            }
+            const auto range = mapTxSpends.equal_range(outpoint);
+            for (auto itSpend = range.first; itSpend != range.second; ++itSpend) {
+                vToVisit.push_back(itSpend->second);
             }
         }
-        mDenomWtxes[hash].vout[nout].nRounds = fDenomFound
-                ? (nShortest >= MAX_PRIVATESEND_ROUNDS - 1 ? MAX_PRIVATESEND_ROUNDS : nShortest + 1) // good, we a +1 to the shortest one but only MAX_PRIVATESEND_ROUNDS rounds max allowed
-                : 0;            // too bad, we are the fist one in that chain
-        LogPrint(BCLog::PRIVATESEND, "GetRealOutpointPrivateSendRounds UPDATED   %s %3d %3d\n", hash.ToString(), nout, mDenomWtxes[hash].vout[nout].nRounds);
-        return mDenomWtxes[hash].vout[nout].nRounds;
+        if (fErased) {
+            MarkBalanceDirty(hash);
+            fAnyErased = true;
+        }
+    }
+
+    if (!fAnyErased) {
+        return;
     }
 
-    return nRounds - 1;
+    fAnonymizableTallyCached = false;
+    fAnonymizableTallyCachedNonDenom = false;
 }
 
 // respect current settings
@@ -1932,6 +2086,169 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
     return startTime;
 }
 
+bool CWalletScanFilter::MayBeMine(const CTransaction& tx) const
+{
+    for (const CTxOut& txout : tx.vout) {
+        if (setWatchOnly.count(txout.scriptPubKey)) {
+            return true;
+        }
+
+        txnouttype whichType;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (!Solver(txout.scriptPubKey, whichType, vSolutions)) {
+            continue;
+        }
+        switch (whichType) {
+        case TX_PUBKEY:
+            if (setIds.count(CPubKey(vSolutions[0]).GetID())) {
+                return true;
+            }
+            break;
+        case TX_PUBKEYHASH:
+        case TX_SCRIPTHASH:
+            if (setIds.count(uint160(vSolutions[0]))) {
+                return true;
+            }
+            break;
+        case TX_MULTISIG:
+            // first and last solutions are the number of required and total keys
+            for (size_t i = 1; i + 1 < vSolutions.size(); i++) {
+                if (setIds.count(CPubKey(vSolutions[i]).GetID())) {
+                    return true;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    return false;
+}
+
+bool CWalletScanFilter::MayMatchBlock(const CBlockFilter& blockFilter) const
+{
+    // The filter holds the scripts of the block's outputs and of the outputs
+    // it spends, so it also matches blocks spending our coins.
+    return !fBlockFilter || blockFilter.GetFilter().MatchAny(setScripts);
+}
+
+bool CWallet::HasKeyOnlyMultisigOutputs() const
+{
+    AssertLockHeld(cs_wallet);
+
+    for (const auto& entry : mapWallet) {
+        for (const CTxOut& txout : entry.second.tx->vout) {
+            txnouttype whichType;
+            std::vector<std::vector<unsigned char> > vSolutions;
+            if (!Solver(txout.scriptPubKey, whichType, vSolutions) || whichType != TX_MULTISIG) {
+                continue;
+            }
+            if (HaveCScript(CScriptID(txout.scriptPubKey)) || HaveWatchOnly(txout.scriptPubKey)) {
+                continue;
+            }
+            if (IsMine(txout) != ISMINE_NO) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+uint64_t CWallet::GetScanFilterGeneration() const
+{
+    AssertLockHeld(cs_wallet);
+    return GetKeyStoreGeneration();
+}
+
+std::shared_ptr<const CWalletScanFilter> CWallet::GetScanFilter() const
+{
+    AssertLockHeld(cs_wallet);
+
+    auto filter = std::make_shared<CWalletScanFilter>();
+    filter->nGeneration = GetScanFilterGeneration();
+
+    // Bare multisig outputs can be ours through our keys alone, without their
+    // script being known to the wallet. Block filters can't be matched against
+    // those, so wallets which own any of them read every block.
+    filter->fBlockFilter = blockFilterIndex != nullptr && !HasKeyOnlyMultisigOutputs();
+
+    auto addPubKey = [&filter](const CPubKey& pubkey) {
+        filter->AddId(pubkey.GetID());
+        if (filter->fBlockFilter) {
+            filter->AddScript(GetScriptForDestination(pubkey.GetID()));
+            filter->AddScript(GetScriptForRawPubKey(pubkey));
+        }
+    };
+
+    LOCK(cs_KeyStore);
+    for (const auto& entry : mapKeys) {
+        addPubKey(entry.second.GetPubKey());
+    }
+    for (const auto& entry : mapCryptedKeys) {
+        addPubKey(entry.second.first);
+    }
+    for (const auto& entry : mapHdPubKeys) {
+        addPubKey(entry.second.extPubKey.pubkey);
+    }
+    for (const auto& entry : mapScripts) {
+        filter->AddId(entry.first);
+        if (filter->fBlockFilter) {
+            filter->AddScript(GetScriptForDestination(CScriptID(entry.second)));
+            filter->AddScript(entry.second);
+        }
+    }
+    for (const CScript& script : setWatchOnly) {
+        filter->AddWatchOnly(script);
+        if (filter->fBlockFilter) {
+            filter->AddScript(script);
+        }
+    }
+    return filter;
+}
+
+namespace {
+
+/** A block read ahead of the wallet during a rescan, together with its filter results */
+struct CWalletScanBlock
+{
+    CBlock block;
+    bool fRead{false};
+    //! The block filter didn't match the wallet's scripts, the block was not read
+    bool fSkipped{false};
+    std::shared_ptr<const CWalletScanFilter> filter;
+    std::vector<bool> vMayBeMine;
+};
+
+std::shared_ptr<CWalletScanBlock> ReadAndFilterBlock(const CBlockIndex* pindex, const CDiskBlockPos& pos, std::shared_ptr<const CWalletScanFilter> filter)
+{
+    auto result = std::make_shared<CWalletScanBlock>();
+
+    CBlockFilter blockFilter;
+    if (filter->fBlockFilter && blockFilterIndex && blockFilterIndex->LookupFilter(pindex, blockFilter) &&
+        !filter->MayMatchBlock(blockFilter)) {
+        result->filter = std::move(filter);
+        result->fSkipped = true;
+        result->fRead = true;
+        return result;
+    }
+
+    // The block was fully validated when it was connected, so unlike
+    // ReadBlockFromDisk we only make sure that we read the right one.
+    if (!ReadValidatedBlockFromDisk(result->block, pos, pindex->GetBlockHash())) {
+        return result;
+    }
+
+    result->vMayBeMine.reserve(result->block.vtx.size());
+    for (const CTransactionRef& tx : result->block.vtx) {
+        result->vMayBeMine.push_back(filter->MayBeMine(*tx));
+    }
+    result->filter = std::move(filter);
+    result->fRead = true;
+    return result;
+}
+
+} // namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1943,6 +2260,14 @@ int64_t CWallet::RescanFromTime(int64_t startTime, bool update)
  *
  * If pindexStop is not a nullptr, the scan will stop at the block-index
  * defined by pindexStop
+ *
+ * Blocks are read and matched against a snapshot of the wallet's scripts by a
+ * pool of worker threads, up to WALLET_RESCAN_READAHEAD blocks ahead. cs_main
+ * and cs_wallet are only taken for queueing the next blocks and for adding the
+ * matching transactions of a single block to the wallet. Callers which hold
+ * them for the whole scan still benefit from reading and matching in parallel.
+ * With -blockfilterindex, blocks whose compact filter matches none of the
+ * wallet's scripts are skipped without being read.
  */
 CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, bool fUpdate)
 {
@@ -1955,41 +2280,121 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, CBlock
 
     CBlockIndex* pindex = pindexStart;
     CBlockIndex* ret = nullptr;
+
+    // Only the outermost scan reports progress, a nested one (e.g. from an import
+    // which holds cs_wallet) can still run safely next to a scan without locks.
+    const bool fReserved = !fScanningWallet.exchange(true);
+    if (fReserved) {
+        fAbortRescan = false;
+        nScanningStartTime = GetTimeMillis();
+        dScanningProgress = 0;
+    }
+
+    ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
+    double dProgressStart;
+    double dProgressTip;
+    std::shared_ptr<const CWalletScanFilter> filter;
     {
         LOCK2(cs_main, cs_wallet);
-        fAbortRescan = false;
-        fScanningWallet = true;
+        dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
+        dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+        filter = GetScanFilter();
+    }
+
+    ctpl::thread_pool workerPool(std::max(1, std::min(GetNumCores(), MAX_WALLET_RESCAN_THREADS)));
+    RenameThreadPool(workerPool, "cosanta-rescan");
+
+    std::deque<std::tuple<CBlockIndex*, CDiskBlockPos, std::future<std::shared_ptr<CWalletScanBlock>>>> queue;
+    CBlockIndex* pindexNext = pindexStart;
+    while (!fAbortRescan) {
+        // Refill the read-ahead queue in batches to take cs_main only once in a while
+        if (pindexNext && queue.size() <= WALLET_RESCAN_READAHEAD / 2) {
+            LOCK(cs_main);
+            while (pindexNext && queue.size() < WALLET_RESCAN_READAHEAD) {
+                const CBlockIndex* pindexRead = pindexNext;
+                const CDiskBlockPos pos = pindexNext->GetBlockPos();
+                queue.emplace_back(pindexNext, pos, workerPool.push([pindexRead, pos, filter](int) {
+                    return ReadAndFilterBlock(pindexRead, pos, filter);
+                }));
+                pindexNext = pindexNext == pindexStop ? nullptr : chainActive.Next(pindexNext);
+            }
+        }
+        if (queue.empty()) {
+            pindex = nullptr;
+            break;
+        }
 
-        ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
-        double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
-        while (pindex && !fAbortRescan)
-        {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+        pindex = std::get<0>(queue.front());
+        const CDiskBlockPos pos = std::get<1>(queue.front());
+        std::shared_ptr<CWalletScanBlock> scanned = std::get<2>(queue.front()).get();
+        queue.pop_front();
+
+        if (GetTime() >= nNow + 60) {
+            nNow = GetTime();
+            LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+        }
+
+        if (!scanned->fRead) {
+            ret = pindex;
+            continue;
+        }
+
+        LOCK2(cs_main, cs_wallet);
+        if (!chainActive.Contains(pindex)) {
+            // The remaining blocks of the new chain are added through BlockConnected
+            LogPrintf("Rescan stopped at block %d, it is no longer part of the active chain\n", pindex->nHeight);
+            pindex = nullptr;
+            break;
+        }
+
+        double dProgress = GuessVerificationProgress(chainParams.TxData(), pindex);
+        if (dProgressTip - dProgressStart > 0.0) {
+            dProgress = std::max(0.0, std::min(1.0, (dProgress - dProgressStart) / (dProgressTip - dProgressStart)));
+            if (pindex->nHeight % 100 == 0) {
+                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)(dProgress * 100))));
             }
+        }
+        if (fReserved) {
+            dScanningProgress = dProgress;
+        }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-            } else {
+        // Keys may have been added since the snapshot was taken, e.g. by topping up
+        // the keypool after one of its keys was found in an earlier block.
+        if (GetScanFilterGeneration() != filter->nGeneration) {
+            filter = GetScanFilter();
+        }
+        if (scanned->fSkipped && scanned->filter != filter) {
+            // the block filter was only matched against an older snapshot
+            scanned = ReadAndFilterBlock(pindex, pos, filter);
+            if (!scanned->fRead) {
                 ret = pindex;
+                continue;
             }
-            if (pindex == pindexStop) {
-                break;
-            }
-            pindex = chainActive.Next(pindex);
         }
-        if (pindex && fAbortRescan) {
-            LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+
+        const CBlock& block = scanned->block;
+        for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
+            const CTransactionRef& ptx = block.vtx[posInBlock];
+            bool fRelevant = scanned->filter == filter ? scanned->vMayBeMine[posInBlock] : filter->MayBeMine(*ptx);
+            // Spends of wallet outputs and updates of existing transactions
+            // are cheap to detect here and don't need the filter.
+            fRelevant = fRelevant || mapWallet.count(ptx->GetHash());
+            for (size_t i = 0; !fRelevant && i < ptx->vin.size(); i++) {
+                const COutPoint& prevout = ptx->vin[i].prevout;
+                fRelevant = mapTxSpends.count(prevout) || mapWallet.count(prevout.hash);
+            }
+            if (fRelevant && AddToWalletIfInvolvingMe(ptx, pindex, posInBlock, fUpdate) &&
+                GetScanFilterGeneration() != filter->nGeneration) {
+                filter = GetScanFilter();
+            }
         }
-        ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+    }
+    if (pindex && fAbortRescan) {
+        LogPrintf("Rescan aborted at block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+    }
+    ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
 
+    if (fReserved) {
         fScanningWallet = false;
     }
     return ret;
@@ -2406,11 +2811,23 @@ void CWallet::ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman
  */
 
 
-std::unordered_set<const CWalletTx*, WalletTxHasher> CWallet::GetSpendableTXs() const
+std::unordered_set<const CWalletTx*, WalletTxHasher> CWallet::GetSpendableTXs(CAmount nMinimumAmount, CAmount nMaximumAmount) const
 {
     AssertLockHeld(cs_wallet);
 
     std::unordered_set<const CWalletTx*, WalletTxHasher> ret;
+    if (nMinimumAmount > 0 || nMaximumAmount < MAX_MONEY) {
+        // only visit the UTXOs in the amount range
+        auto it = setWalletUTXOByAmount.lower_bound(std::make_pair(nMinimumAmount, COutPoint(uint256(), 0)));
+        for (; it != setWalletUTXOByAmount.end() && it->first <= nMaximumAmount; ++it) {
+            const auto jt = mapWallet.find(it->second.hash);
+            if (jt != mapWallet.end()) {
+                ret.emplace(&jt->second);
+            }
+        }
+        return ret;
+    }
+
     for (auto it = setWalletUTXO.begin(); it != setWalletUTXO.end(); ) {
         const auto& outpoint = *it;
         const auto jt = mapWallet.find(outpoint.hash);
@@ -2427,18 +2844,223 @@ std::unordered_set<const CWalletTx*, WalletTxHasher> CWallet::GetSpendableTXs()
     return ret;
 }
 
-CAmount CWallet::GetBalance() const
+std::unordered_set<const CWalletTx*, WalletTxHasher> CWallet::GetDenominatedTXs() const
 {
-    CAmount nTotal = 0;
+    AssertLockHeld(cs_wallet);
+
+    std::unordered_set<const CWalletTx*, WalletTxHasher> ret;
+    for (const auto& bucket : mapDenominatedUTXO) {
+        for (const auto& outpoint : bucket.second) {
+            const auto it = mapWallet.find(outpoint.hash);
+            if (it != mapWallet.end()) {
+                ret.emplace(&it->second);
+            }
+        }
+    }
+    return ret;
+}
+
+void CWallet::AddWalletUTXO(const COutPoint& outpoint, CAmount nValue)
+{
+    AssertLockHeld(cs_wallet);
+
+    setWalletUTXO.insert(outpoint);
+    setWalletUTXOByAmount.emplace(nValue, outpoint);
+    if (CPrivateSend::IsDenominatedAmount(nValue)) {
+        mapDenominatedUTXO[nValue].insert(outpoint);
+    }
+}
+
+// The transaction of the outpoint must still be in mapWallet, its output holds
+// the amount of the buckets the outpoint is erased from.
+void CWallet::EraseWalletUTXO(const COutPoint& outpoint)
+{
+    AssertLockHeld(cs_wallet);
+
+    if (!setWalletUTXO.erase(outpoint)) {
+        return;
+    }
+    const auto it = mapWallet.find(outpoint.hash);
+    if (it == mapWallet.end() || outpoint.n >= it->second.tx->vout.size()) {
+        return;
+    }
+    const CAmount nValue = it->second.tx->vout[outpoint.n].nValue;
+    setWalletUTXOByAmount.erase(std::make_pair(nValue, outpoint));
+    const auto itBucket = mapDenominatedUTXO.find(nValue);
+    if (itBucket != mapDenominatedUTXO.end()) {
+        itBucket->second.erase(outpoint);
+    }
+}
+
+CWalletBalances& CWalletBalances::operator+=(const CWalletBalances& b)
+{
+    nTrusted += b.nTrusted;
+    nUntrustedPending += b.nUntrustedPending;
+    nImmature += b.nImmature;
+    nWatchOnlyTrusted += b.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending += b.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature += b.nWatchOnlyImmature;
+    nDenominatedConfirmed += b.nDenominatedConfirmed;
+    nDenominatedUnconfirmed += b.nDenominatedUnconfirmed;
+    nAnonymized += b.nAnonymized;
+    return *this;
+}
+
+CWalletBalances& CWalletBalances::operator-=(const CWalletBalances& b)
+{
+    nTrusted -= b.nTrusted;
+    nUntrustedPending -= b.nUntrustedPending;
+    nImmature -= b.nImmature;
+    nWatchOnlyTrusted -= b.nWatchOnlyTrusted;
+    nWatchOnlyUntrustedPending -= b.nWatchOnlyUntrustedPending;
+    nWatchOnlyImmature -= b.nWatchOnlyImmature;
+    nDenominatedConfirmed -= b.nDenominatedConfirmed;
+    nDenominatedUnconfirmed -= b.nDenominatedUnconfirmed;
+    nAnonymized -= b.nAnonymized;
+    return *this;
+}
+
+void CWallet::MarkBalancesDirty()
+{
+    LOCK(cs_wallet);
+    fBalancesFullRecompute = true;
+
+    LOCK(cs_balances);
+    fBalancesCurrent = false;
+}
+
+void CWallet::MarkBalanceDirty(const uint256& hash) const
+{
+    AssertLockHeld(cs_wallet);
+    setBalanceDirtyTxs.insert(hash);
+    // spending outputs changes the balance of the transactions they came from
+    const auto it = mapWallet.find(hash);
+    if (it != mapWallet.end()) {
+        for (const CTxIn& txin : it->second.tx->vin) {
+            if (mapWallet.count(txin.prevout.hash)) {
+                setBalanceDirtyTxs.insert(txin.prevout.hash);
+            }
+        }
+    }
+
+    LOCK(cs_balances);
+    fBalancesCurrent = false;
+}
+
+void CWallet::MarkVolatileBalancesDirty()
+{
+    AssertLockHeld(cs_wallet);
+    setBalanceDirtyTxs.insert(setBalanceVolatileTxs.begin(), setBalanceVolatileTxs.end());
+
+    LOCK(cs_balances);
+    fBalancesCurrent = false;
+}
+
+void CWallet::UpdateTxBalance(const uint256& hash, int nPrivateSendRounds) const
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+
+    auto it = mapTxBalances.find(hash);
+    if (it != mapTxBalances.end()) {
+        totalBalances -= it->second;
+        mapTxBalances.erase(it);
+    }
+    setBalanceVolatileTxs.erase(hash);
+    setBalanceUnconfirmedTxs.erase(hash);
+
+    const auto jt = mapWallet.find(hash);
+    if (jt == mapWallet.end()) {
+        return;
+    }
+    // same set of transactions as GetSpendableTXs()
+    const auto itUTXO = setWalletUTXO.lower_bound(COutPoint(hash, 0));
+    if (itUTXO == setWalletUTXO.end() || itUTXO->hash != hash) {
+        return;
+    }
+
+    const CWalletTx* pcoin = &jt->second;
+    const bool fTrusted = pcoin->IsTrusted();
+    const int nDepth = pcoin->GetDepthInMainChain();
+
+    CWalletBalances balances;
+    if (fTrusted) {
+        balances.nTrusted = pcoin->GetAvailableCredit();
+        balances.nWatchOnlyTrusted = pcoin->GetAvailableWatchOnlyCredit();
+    } else if (nDepth == 0 && !pcoin->IsLockedByInstantSend() && pcoin->InMempool()) {
+        balances.nUntrustedPending = pcoin->GetAvailableCredit();
+        balances.nWatchOnlyUntrustedPending = pcoin->GetAvailableWatchOnlyCredit();
+    }
+    balances.nImmature = pcoin->GetImmatureCredit();
+    balances.nWatchOnlyImmature = pcoin->GetImmatureWatchOnlyCredit();
+
+    if (nPrivateSendRounds >= 0) {
+        balances.nAnonymized = pcoin->GetAnonymizedCredit();
+        balances.nDenominatedConfirmed = pcoin->GetDenominatedCredit(false);
+        balances.nDenominatedUnconfirmed = pcoin->GetDenominatedCredit(true);
+    }
+
+    mapTxBalances.emplace(hash, balances);
+    totalBalances += balances;
+    if (nDepth == 0 || pcoin->GetBlocksToMaturity() > 0) {
+        setBalanceVolatileTxs.insert(hash);
+    }
+    if (nDepth == 0) {
+        setBalanceUnconfirmedTxs.insert(hash);
+    }
+}
+
+CWalletBalances CWallet::GetBalances() const
+{
+    const int nPrivateSendRounds = privateSendClient.fEnablePrivateSend ? privateSendClient.nPrivateSendRounds : -1;
+    const unsigned int nMempoolUpdated = mempool.GetTransactionsUpdated();
     {
-        LOCK2(cs_main, cs_wallet);
+        LOCK(cs_balances);
+        if (fBalancesCurrent && nBalancesPrivateSendRounds == nPrivateSendRounds &&
+            (!fBalancesDependOnMempool || nBalancesMempoolUpdated == nMempoolUpdated)) {
+            return cachedBalances;
+        }
+    }
+
+    LOCK2(cs_main, cs_wallet);
+
+    if (fBalancesFullRecompute || nBalancesPrivateSendRounds != nPrivateSendRounds) {
+        mapTxBalances.clear();
+        setBalanceDirtyTxs.clear();
+        setBalanceVolatileTxs.clear();
+        setBalanceUnconfirmedTxs.clear();
+        totalBalances = CWalletBalances();
         for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableCredit();
+            UpdateTxBalance(pcoin->GetHash(), nPrivateSendRounds);
+        }
+        fBalancesFullRecompute = false;
+        nBalancesPrivateSendRounds = nPrivateSendRounds;
+    } else {
+        bool fMempoolChanged;
+        {
+            LOCK(cs_balances);
+            fMempoolChanged = nBalancesMempoolUpdated != nMempoolUpdated;
+        }
+        if (fMempoolChanged) {
+            setBalanceDirtyTxs.insert(setBalanceUnconfirmedTxs.begin(), setBalanceUnconfirmedTxs.end());
         }
+        for (const uint256& hash : setBalanceDirtyTxs) {
+            UpdateTxBalance(hash, nPrivateSendRounds);
+        }
+        setBalanceDirtyTxs.clear();
     }
 
-    return nTotal;
+    LOCK(cs_balances);
+    cachedBalances = totalBalances;
+    fBalancesCurrent = true;
+    fBalancesDependOnMempool = !setBalanceUnconfirmedTxs.empty();
+    nBalancesMempoolUpdated = nMempoolUpdated;
+    return cachedBalances;
+}
+
+CAmount CWallet::GetBalance() const
+{
+    return GetBalances().nTrusted;
 }
 
 CAmount CWallet::GetAnonymizableBalance(bool fSkipDenominated, bool fSkipUnconfirmed) const
@@ -2467,15 +3089,7 @@ CAmount CWallet::GetAnonymizedBalance() const
 {
     if(!privateSendClient.fEnablePrivateSend) return 0;
 
-    CAmount nTotal = 0;
-
-    LOCK2(cs_main, cs_wallet);
-
-    for (auto pcoin : GetSpendableTXs()) {
-        nTotal += pcoin->GetAnonymizedCredit();
-    }
-
-    return nTotal;
+    return GetBalances().nAnonymized;
 }
 
 // Note: calculated including unconfirmed,
@@ -2488,11 +3102,11 @@ float CWallet::GetAverageAnonymizedRounds() const
     int nCount = 0;
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& outpoint : setWalletUTXO) {
-        if(!IsDenominated(outpoint)) continue;
-
-        nTotal += GetCappedOutpointPrivateSendRounds(outpoint);
-        nCount++;
+    for (const auto& bucket : mapDenominatedUTXO) {
+        for (const auto& outpoint : bucket.second) {
+            nTotal += GetCappedOutpointPrivateSendRounds(outpoint);
+            nCount++;
+        }
     }
 
     if(nCount == 0) return 0;
@@ -2509,16 +3123,16 @@ CAmount CWallet::GetNormalizedAnonymizedBalance() const
     CAmount nTotal = 0;
 
     LOCK2(cs_main, cs_wallet);
-    for (const auto& outpoint : setWalletUTXO) {
-        const auto it = mapWallet.find(outpoint.hash);
-        if (it == mapWallet.end()) continue;
-
-        CAmount nValue = it->second.tx->vout[outpoint.n].nValue;
-        if (!CPrivateSend::IsDenominatedAmount(nValue)) continue;
-        if (it->second.GetDepthInMainChain() < 0) continue;
+    for (const auto& bucket : mapDenominatedUTXO) {
+        const CAmount nValue = bucket.first;
+        for (const auto& outpoint : bucket.second) {
+            const auto it = mapWallet.find(outpoint.hash);
+            if (it == mapWallet.end()) continue;
+            if (it->second.GetDepthInMainChain() < 0) continue;
 
-        int nRounds = GetCappedOutpointPrivateSendRounds(outpoint);
-        nTotal += nValue * nRounds / privateSendClient.nPrivateSendRounds;
+            int nRounds = GetCappedOutpointPrivateSendRounds(outpoint);
+            nTotal += nValue * nRounds / privateSendClient.nPrivateSendRounds;
+        }
     }
 
     return nTotal;
@@ -2528,79 +3142,33 @@ CAmount CWallet::GetDenominatedBalance(bool unconfirmed) const
 {
     if(!privateSendClient.fEnablePrivateSend) return 0;
 
-    CAmount nTotal = 0;
-
-    LOCK2(cs_main, cs_wallet);
-
-    for (auto pcoin : GetSpendableTXs()) {
-        nTotal += pcoin->GetDenominatedCredit(unconfirmed);
-    }
-
-    return nTotal;
+    CWalletBalances balances = GetBalances();
+    return unconfirmed ? balances.nDenominatedUnconfirmed : balances.nDenominatedConfirmed;
 }
 
 CAmount CWallet::GetUnconfirmedBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && !pcoin->IsLockedByInstantSend() && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            nTotal += pcoin->GetImmatureCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nImmature;
 }
 
 CAmount CWallet::GetWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (pcoin->IsTrusted())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-
-    return nTotal;
+    return GetBalances().nWatchOnlyTrusted;
 }
 
 CAmount CWallet::GetUnconfirmedWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            if (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0 && !pcoin->IsLockedByInstantSend() && pcoin->InMempool())
-                nTotal += pcoin->GetAvailableWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyUntrustedPending;
 }
 
 CAmount CWallet::GetImmatureWatchOnlyBalance() const
 {
-    CAmount nTotal = 0;
-    {
-        LOCK2(cs_main, cs_wallet);
-        for (auto pcoin : GetSpendableTXs()) {
-            nTotal += pcoin->GetImmatureWatchOnlyCredit();
-        }
-    }
-    return nTotal;
+    return GetBalances().nWatchOnlyImmature;
 }
 
 // Calculate total balance in a different way from GetBalance. The biggest
@@ -2671,7 +3239,10 @@ void CWallet::AvailableCoins(std::vector<COutput> &vCoins, bool fOnlySafe, const
 
         CAmount nTotal = 0;
 
-        for (auto pcoin : GetSpendableTXs()) {
+        // Denominated coins are indexed, there is no need to visit every wallet transaction
+        // and when an amount range is given, only the transactions with UTXOs in the range are visited
+        const auto setTXs = nCoinType == CoinType::ONLY_DENOMINATED ? GetDenominatedTXs() : GetSpendableTXs(nMinimumAmount, nMaximumAmount);
+        for (auto pcoin : setTXs) {
             const uint256& wtxid = pcoin->GetHash();
 
             if (!CheckFinalTx(*pcoin))
@@ -2867,6 +3438,79 @@ static void ApproximateBestSubset(const std::vector<CInputCoin>& vValue, const C
     }
 }
 
+/**
+ * Depth-first branch and bound search for an input set with a value in
+ * [nTargetValue, nTargetValue + nTolerance], so no change output is needed.
+ * vValue must be sorted by descending value, larger coins are tried first.
+ * The search gives up after BNB_MAX_TRIES branches or BNB_TIME_BUDGET.
+ */
+static bool SelectCoinsBnB(const std::vector<CInputCoin>& vValue, const CAmount& nTargetValue, const CAmount& nTolerance,
+                           std::vector<char>& vfBest, CAmount& nBest)
+{
+    CAmount nAvailable = 0;
+    for (const CInputCoin& coin : vValue) {
+        nAvailable += coin.txout.nValue;
+    }
+    if (nAvailable < nTargetValue) {
+        return false;
+    }
+
+    // vfSelected holds the decisions for the coins processed so far
+    std::vector<char> vfSelected;
+    vfSelected.reserve(vValue.size());
+    CAmount nSelected = 0;
+    bool fFound = false;
+
+    const int64_t nStart = GetTimeMicros();
+    for (int nTries = 0; nTries < BNB_MAX_TRIES; nTries++) {
+        if (nTries % 1000 == 0 && GetTimeMicros() - nStart > BNB_TIME_BUDGET) {
+            break;
+        }
+
+        bool fBacktrack = false;
+        if (nSelected + nAvailable < nTargetValue || nSelected > nTargetValue + nTolerance) {
+            // can't reach the target anymore or already overshot it
+            fBacktrack = true;
+        } else if (nSelected >= nTargetValue) {
+            if (!fFound || nSelected < nBest) {
+                vfBest = vfSelected;
+                vfBest.resize(vValue.size(), false);
+                nBest = nSelected;
+                fFound = true;
+            }
+            if (nSelected == nTargetValue) {
+                break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack) {
+            // walk back to the last included coin and try the branch without it
+            while (!vfSelected.empty() && !vfSelected.back()) {
+                vfSelected.pop_back();
+                nAvailable += vValue[vfSelected.size()].txout.nValue;
+            }
+            if (vfSelected.empty()) {
+                break;
+            }
+            vfSelected.back() = false;
+            nSelected -= vValue[vfSelected.size() - 1].txout.nValue;
+        } else {
+            const CAmount nValue = vValue[vfSelected.size()].txout.nValue;
+            nAvailable -= nValue;
+            if (!vfSelected.empty() && !vfSelected.back() && nValue == vValue[vfSelected.size() - 1].txout.nValue) {
+                // including this coin is equivalent to including the previous one, which was already explored
+                vfSelected.push_back(false);
+            } else {
+                vfSelected.push_back(true);
+                nSelected += nValue;
+            }
+        }
+    }
+
+    return fFound;
+}
+
 struct CompareByPriority
 {
     bool operator()(const COutput& t1,
@@ -2892,8 +3536,56 @@ bool less_then_denom (const COutput& out1, const COutput& out2)
     return (!found1 && found2);
 }
 
+std::vector<CCoinCandidate> CWallet::GetCoinCandidates(std::vector<COutput> vCoins, CoinType nCoinType) const
+{
+    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
+
+    if (nCoinType == CoinType::ONLY_DENOMINATED) {
+        // larger denoms first
+        std::sort(vCoins.rbegin(), vCoins.rend(), CompareByPriority());
+    } else {
+        // move denoms down on the list
+        // try not to use denominated coins when not needed, save denoms for privatesend
+        std::sort(vCoins.begin(), vCoins.end(), less_then_denom);
+    }
+
+    std::vector<CCoinCandidate> vCandidates;
+    vCandidates.reserve(vCoins.size());
+    for (const COutput& output : vCoins) {
+        if (!output.fSpendable)
+            continue;
+
+        if (nCoinType == CoinType::ONLY_DENOMINATED) {
+            // Make sure it's actually mixed
+            COutPoint outpoint = COutPoint(output.tx->GetHash(), output.i);
+            int nRounds = GetRealOutpointPrivateSendRounds(outpoint);
+            if (nRounds < privateSendClient.nPrivateSendRounds) continue;
+        }
+
+        vCandidates.emplace_back(output.tx, output.i, output.nDepth);
+    }
+
+    {
+        LOCK(mempool.cs);
+        for (CCoinCandidate& candidate : vCandidates) {
+            auto it = mempool.mapTx.find(candidate.coin.outpoint.hash);
+            if (it != mempool.mapTx.end()) {
+                candidate.nChainLength = std::max(it->GetCountWithAncestors(), it->GetCountWithDescendants());
+            }
+        }
+    }
+
+    return vCandidates;
+}
+
 bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, std::vector<COutput> vCoins,
-                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, CoinType nCoinType) const
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, CoinType nCoinType, CAmount nNoChangeTolerance) const
+{
+    return SelectCoinsMinConf(nTargetValue, nConfMine, nConfTheirs, nMaxAncestors, GetCoinCandidates(std::move(vCoins), nCoinType), setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance);
+}
+
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<CCoinCandidate>& vCandidates,
+                                 std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, CoinType nCoinType, CAmount nNoChangeTolerance) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
@@ -2903,22 +3595,14 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
     std::vector<CInputCoin> vValue;
     CAmount nTotalLower = 0;
 
-    random_shuffle(vCoins.begin(), vCoins.end(), GetRandInt);
-
     int tryDenomStart = 0;
     CAmount nMinChange = MIN_CHANGE;
 
     if (nCoinType == CoinType::ONLY_DENOMINATED) {
-        // larger denoms first
-        std::sort(vCoins.rbegin(), vCoins.rend(), CompareByPriority());
         // we actually want denoms only, so let's skip "non-denom only" step
         tryDenomStart = 1;
         // no change is allowed
         nMinChange = 0;
-    } else {
-        // move denoms down on the list
-        // try not to use denominated coins when not needed, save denoms for privatesend
-        std::sort(vCoins.begin(), vCoins.end(), less_then_denom);
     }
 
     // try to find nondenom first to prevent unneeded spending of mixed coins
@@ -2927,35 +3611,19 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         LogPrint(BCLog::SELECTCOINS, "tryDenom: %d\n", tryDenom);
         vValue.clear();
         nTotalLower = 0;
-        for (const COutput &output : vCoins)
+        for (const CCoinCandidate& candidate : vCandidates)
         {
-            if (!output.fSpendable)
-                continue;
-
-            const CWalletTx *pcoin = output.tx;
-
-            bool fLockedByIS = pcoin->IsLockedByInstantSend();
-
-            // if (logCategories != BCLog::NONE) LogPrint(BCLog::SELECTCOINS, "value %s confirms %d\n", FormatMoney(pcoin->vout[output.i].nValue), output.nDepth);
-            if (output.nDepth < (pcoin->IsFromMe(ISMINE_ALL) ? nConfMine : nConfTheirs) && !fLockedByIS)
+            if (candidate.nDepth < (candidate.fFromMe ? nConfMine : nConfTheirs) && !candidate.fLockedByIS)
                 continue;
 
-            if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
+            // same as CTxMemPool::TransactionWithinChainLimit
+            if (candidate.nChainLength != 0 && candidate.nChainLength >= nMaxAncestors)
                 continue;
 
-            int i = output.i;
-
-            CInputCoin coin = CInputCoin(pcoin, i);
+            const CInputCoin& coin = candidate.coin;
 
             if (tryDenom == 0 && CPrivateSend::IsDenominatedAmount(coin.txout.nValue)) continue; // we don't want denom values on first run
 
-            if (nCoinType == CoinType::ONLY_DENOMINATED) {
-                // Make sure it's actually mixed
-                COutPoint outpoint = COutPoint(pcoin->GetHash(), i);
-                int nRounds = GetRealOutpointPrivateSendRounds(outpoint);
-                if (nRounds < privateSendClient.nPrivateSendRounds) continue;
-            }
-
             if (coin.txout.nValue == nTargetValue)
             {
                 setCoinsRet.insert(coin);
@@ -3005,19 +3673,26 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         break;
     }
 
-    // Solve subset sum by stochastic approximation
     std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
     std::reverse(vValue.begin(), vValue.end());
     std::vector<char> vfBest;
     CAmount nBest;
 
-    ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
-    if (nBest != nTargetValue && nMinChange != 0 && nTotalLower >= nTargetValue + nMinChange)
-        ApproximateBestSubset(vValue, nTotalLower, nTargetValue + nMinChange, vfBest, nBest);
+    // Look for an input set which needs no change first, otherwise solve
+    // subset sum by stochastic approximation
+    bool fNoChange = SelectCoinsBnB(vValue, nTargetValue, nNoChangeTolerance, vfBest, nBest);
+    if (fNoChange) {
+        LogPrint(BCLog::SELECTCOINS, "CWallet::SelectCoinsMinConf found an input set without change\n");
+    } else {
+        ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
+        if (nBest != nTargetValue && nMinChange != 0 && nTotalLower >= nTargetValue + nMinChange)
+            ApproximateBestSubset(vValue, nTotalLower, nTargetValue + nMinChange, vfBest, nBest);
+    }
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
-    //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger &&
+    //                                   or the next bigger coin is closer), return the bigger coin.
+    // An input set without change is always kept, the bigger coin would need change.
+    if (!fNoChange && coinLowestLarger &&
         ((nBest != nTargetValue && nBest < nTargetValue + nMinChange) || coinLowestLarger->txout.nValue <= nBest))
     {
         setCoinsRet.insert(coinLowestLarger.get());
@@ -3115,14 +3790,20 @@ bool CWallet::SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAm
     size_t nMaxChainLength = std::min(gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT), gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT));
     bool fRejectLongChains = gArgs.GetBoolArg("-walletrejectlongchains", DEFAULT_WALLET_REJECT_LONG_CHAINS);
 
+    // Filter the coins once, every confirmation and chain limit below only looks at the candidates
+    const std::vector<CCoinCandidate> vCandidates = GetCoinCandidates(std::move(vCoins), nCoinType);
+    // Excess value which CreateTransaction would add to the fee rather than create dust change
+    const CAmount nNoChangeTolerance = GetDustThreshold(CTxOut(0, GetScriptForDestination(CKeyID())), GetDiscardRate(::feeEstimator)) - 1;
+    const CAmount nTargetLeft = nTargetValue - nValueFromPresetInputs;
+
     bool res = nTargetValue <= nValueFromPresetInputs ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 6, 0, vCoins, setCoinsRet, nValueRet, nCoinType) ||
-        SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 1, 1, 0, vCoins, setCoinsRet, nValueRet, nCoinType) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, 2, vCoins, setCoinsRet, nValueRet, nCoinType)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCoins, setCoinsRet, nValueRet, nCoinType)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength/2, vCoins, setCoinsRet, nValueRet, nCoinType)) ||
-        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, nMaxChainLength, vCoins, setCoinsRet, nValueRet, nCoinType)) ||
-        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetValue - nValueFromPresetInputs, 0, 1, std::numeric_limits<uint64_t>::max(), vCoins, setCoinsRet, nValueRet, nCoinType));
+        SelectCoinsMinConf(nTargetLeft, 1, 6, 0, vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance) ||
+        SelectCoinsMinConf(nTargetLeft, 1, 1, 0, vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetLeft, 0, 1, 2, vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetLeft, 0, 1, std::min((size_t)4, nMaxChainLength/3), vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetLeft, 0, 1, nMaxChainLength/2, vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance)) ||
+        (bSpendZeroConfChange && SelectCoinsMinConf(nTargetLeft, 0, 1, nMaxChainLength, vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance)) ||
+        (bSpendZeroConfChange && !fRejectLongChains && SelectCoinsMinConf(nTargetLeft, 0, 1, std::numeric_limits<uint64_t>::max(), vCandidates, setCoinsRet, nValueRet, nCoinType, nNoChangeTolerance));
 
     // because SelectCoinsMinConf clears the setCoinsRet, we now add the possible inputs to the coinset
     setCoinsRet.insert(setPresetCoins.begin(), setPresetCoins.end());
@@ -3548,7 +4229,13 @@ int CWallet::CountInputsWithAmount(CAmount nInputAmount) const
 
     LOCK2(cs_main, cs_wallet);
 
-    for (const auto& outpoint : setWalletUTXO) {
+    const auto itBucket = mapDenominatedUTXO.find(nInputAmount);
+    if (itBucket == mapDenominatedUTXO.end() && CPrivateSend::IsDenominatedAmount(nInputAmount)) {
+        return 0;
+    }
+    const std::set<COutPoint>& setOutpoints = itBucket != mapDenominatedUTXO.end() ? itBucket->second : setWalletUTXO;
+
+    for (const auto& outpoint : setOutpoints) {
         const auto it = mapWallet.find(outpoint.hash);
         if (it == mapWallet.end()) continue;
         if (it->second.tx->vout[outpoint.n].nValue != nInputAmount) continue;
@@ -4016,25 +4703,10 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
 
         if (nChangePosInOut == -1) reservekey.ReturnKey(); // Return any reserved key if we don't have change
 
-        if (sign)
+        if (sign && !SignTransactions({&txNew}))
         {
-            CTransaction txNewConst(txNew);
-            int nIn = 0;
-            for(const auto& txdsin : vecTxDSInTmp)
-            {
-                const CScript& scriptPubKey = txdsin.prevPubKey;
-                SignatureData sigdata;
-
-                if (!ProduceSignature(TransactionSignatureCreator(this, &txNewConst, nIn, SIGHASH_ALL), scriptPubKey, sigdata))
-                {
-                    strFailReason = _("Signing transaction failed");
-                    return false;
-                } else {
-                    UpdateTransaction(txNew, nIn, sigdata);
-                }
-
-                nIn++;
-            }
+            strFailReason = _("Signing transaction failed");
+            return false;
         }
 
         // Embed the constructed transaction data in wtxNew.
@@ -4068,6 +4740,188 @@ bool CWallet::CreateTransaction(const std::vector<CRecipient>& vecSend, CWalletT
     return true;
 }
 
+/** Copy the keys and redeem scripts needed to sign for scriptPubKey into keystoreOut */
+static void CopySigningKeys(const CKeyStore& keystore, const CScript& scriptPubKey, CBasicKeyStore& keystoreOut)
+{
+    txnouttype whichType;
+    std::vector<std::vector<unsigned char> > vSolutions;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return;
+
+    std::vector<CKeyID> vKeyIDs;
+    switch (whichType) {
+    case TX_PUBKEY:
+        vKeyIDs.push_back(CPubKey(vSolutions[0]).GetID());
+        break;
+    case TX_PUBKEYHASH:
+        vKeyIDs.push_back(CKeyID(uint160(vSolutions[0])));
+        break;
+    case TX_SCRIPTHASH: {
+        CScript redeemScript;
+        if (keystore.GetCScript(CScriptID(uint160(vSolutions[0])), redeemScript) && !keystoreOut.HaveCScript(CScriptID(redeemScript))) {
+            keystoreOut.AddCScript(redeemScript);
+            CopySigningKeys(keystore, redeemScript, keystoreOut);
+        }
+        break;
+    }
+    case TX_MULTISIG:
+        for (size_t i = 1; i + 1 < vSolutions.size(); i++) {
+            vKeyIDs.push_back(CPubKey(vSolutions[i]).GetID());
+        }
+        break;
+    default:
+        break;
+    }
+
+    for (const CKeyID& keyID : vKeyIDs) {
+        CKey key;
+        if (!keystoreOut.HaveKey(keyID) && keystore.GetKey(keyID, key)) {
+            keystoreOut.AddKey(key);
+        }
+    }
+}
+
+bool CWallet::SignTransaction(CMutableTransaction& tx)
+{
+    return SignTransactions({&tx});
+}
+
+bool CWallet::SignTransactions(const std::vector<CMutableTransaction*>& vTx)
+{
+    LOCK(cs_wallet);
+
+    // Signature hashes are computed over the unsigned transactions, the
+    // signatures are only filled in once all inputs have been signed
+    std::vector<CTransaction> vTxConst;
+    vTxConst.reserve(vTx.size());
+    std::vector<std::pair<size_t, unsigned int> > vInputs;
+    std::vector<const CScript*> vScriptPubKeys;
+    for (size_t i = 0; i < vTx.size(); i++) {
+        vTxConst.emplace_back(*vTx[i]);
+        for (unsigned int nIn = 0; nIn < vTx[i]->vin.size(); nIn++) {
+            const COutPoint& prevout = vTx[i]->vin[nIn].prevout;
+            const auto it = mapWallet.find(prevout.hash);
+            if (it == mapWallet.end() || prevout.n >= it->second.tx->vout.size()) {
+                return false;
+            }
+            vInputs.emplace_back(i, nIn);
+            vScriptPubKeys.push_back(&it->second.tx->vout[prevout.n].scriptPubKey);
+        }
+    }
+
+    std::vector<SignatureData> vSigData(vInputs.size());
+    auto signInput = [&](const CKeyStore& keystore, size_t n) {
+        const size_t i = vInputs[n].first;
+        return ProduceSignature(TransactionSignatureCreator(&keystore, &vTxConst[i], vInputs[n].second, SIGHASH_ALL), *vScriptPubKeys[n], vSigData[n]);
+    };
+
+    bool fOk = true;
+    if (vInputs.size() < WALLET_PARALLEL_SIGNING_MIN_INPUTS) {
+        for (size_t n = 0; n < vInputs.size() && fOk; n++) {
+            fOk = signInput(*this, n);
+        }
+    } else {
+        // GetKey locks cs_wallet, which is held here, so the workers sign
+        // with a copy of the keys the inputs need
+        CBasicKeyStore keystore;
+        for (const CScript* pscript : vScriptPubKeys) {
+            CopySigningKeys(*this, *pscript, keystore);
+        }
+
+        const int nThreads = std::max(1, std::min(GetNumCores(), MAX_WALLET_SIGNING_THREADS));
+        ctpl::thread_pool workerPool(nThreads);
+        RenameThreadPool(workerPool, "cosanta-sign");
+
+        // every worker signs a contiguous range of inputs
+        const size_t nChunkSize = (vInputs.size() + nThreads - 1) / nThreads;
+        std::vector<std::future<bool> > vFutures;
+        for (size_t nBegin = 0; nBegin < vInputs.size(); nBegin += nChunkSize) {
+            const size_t nEnd = std::min(nBegin + nChunkSize, vInputs.size());
+            vFutures.emplace_back(workerPool.push([&signInput, &keystore, nBegin, nEnd](int) {
+                for (size_t n = nBegin; n < nEnd; n++) {
+                    if (!signInput(keystore, n)) {
+                        return false;
+                    }
+                }
+                return true;
+            }));
+        }
+        for (auto& future : vFutures) {
+            fOk &= future.get();
+        }
+    }
+    if (!fOk) {
+        return false;
+    }
+
+    for (size_t n = 0; n < vInputs.size(); n++) {
+        UpdateTransaction(*vTx[vInputs[n].first], vInputs[n].second, vSigData[n]);
+    }
+    return true;
+}
+
+bool CWallet::CreateTransactions(const std::vector<std::vector<CRecipient> >& vecBatch, std::vector<CWalletTx>& vwtxNew, std::vector<std::unique_ptr<CReserveKey> >& vReserveKeys,
+                                 CAmount& nFeeRet, std::string& strFailReason, const CCoinControl& coin_control)
+{
+    nFeeRet = 0;
+    if (coin_control.HasSelected()) {
+        // the same inputs can't fund every transaction
+        strFailReason = _("Selected inputs are not supported for transaction batches");
+        return false;
+    }
+    // transactions passed in keep their metadata, e.g. comments
+    vwtxNew.resize(vecBatch.size());
+    vReserveKeys.clear();
+
+    LOCK2(cs_main, cs_wallet);
+
+    // Inputs of transactions created so far are locked, so they are not
+    // available to the next ones. They are unlocked again once the batch is
+    // created, committing the transactions marks them as spent.
+    std::vector<COutPoint> vLockedCoins;
+    bool fOk = true;
+    for (size_t i = 0; i < vecBatch.size() && fOk; i++) {
+        vReserveKeys.emplace_back(new CReserveKey(this));
+        CAmount nFee = 0;
+        int nChangePos = -1;
+        fOk = CreateTransaction(vecBatch[i], vwtxNew[i], *vReserveKeys[i], nFee, nChangePos, strFailReason, coin_control, false);
+        if (fOk) {
+            nFeeRet += nFee;
+            for (const CTxIn& txin : vwtxNew[i].tx->vin) {
+                LockCoin(txin.prevout);
+                vLockedCoins.push_back(txin.prevout);
+            }
+        }
+    }
+    for (const COutPoint& outpoint : vLockedCoins) {
+        UnlockCoin(outpoint);
+    }
+    if (!fOk) {
+        if (vecBatch.size() > 1) {
+            // the failed transaction is the last one a key was reserved for
+            strFailReason = strprintf(_("Transaction %d of the batch: %s"), vReserveKeys.size(), strFailReason);
+        }
+        return false;
+    }
+
+    std::vector<CMutableTransaction> vTx;
+    vTx.reserve(vwtxNew.size());
+    std::vector<CMutableTransaction*> vpTx;
+    for (const CWalletTx& wtx : vwtxNew) {
+        vTx.emplace_back(*wtx.tx);
+        vpTx.push_back(&vTx.back());
+    }
+    if (!SignTransactions(vpTx)) {
+        strFailReason = _("Signing transaction failed");
+        return false;
+    }
+    for (size_t i = 0; i < vwtxNew.size(); i++) {
+        vwtxNew[i].SetTx(MakeTransactionRef(std::move(vTx[i])));
+    }
+
+    return true;
+}
+
 // ppcoin: create coin stake transaction
 bool CWallet::CreateCoinStake(const CBlockIndex *pindex_prev, CBlock &curr_block, CMutableTransaction& coinbaseTx)
 {
@@ -4352,6 +5206,86 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CCon
     return true;
 }
 
+bool CWallet::CommitTransactions(std::vector<CWalletTx>& vwtxNew, std::vector<std::unique_ptr<CReserveKey> >& vReserveKeys, CConnman* connman, std::vector<CValidationState>& vStates)
+{
+    assert(vwtxNew.size() == vReserveKeys.size());
+    vStates.assign(vwtxNew.size(), CValidationState());
+
+    LOCK2(cs_main, cs_wallet);
+
+    // The new transactions are written in one database transaction before the
+    // wallet changes in memory or anything is relayed. If it fails, nothing
+    // changed and the reserved keys are returned by the caller.
+    CWalletDB walletdb(*dbw);
+    std::vector<bool> vfWritten(vwtxNew.size(), false);
+    {
+        CWalletDBGroupCommit groupCommit(walletdb);
+        int64_t nOrderPos = nOrderPosNext;
+        for (size_t i = 0; i < vwtxNew.size(); i++) {
+            CWalletTx& wtxNew = vwtxNew[i];
+            LogPrintf("CommitTransactions:\n%s", wtxNew.tx->ToString());
+            if (mapWallet.count(wtxNew.GetHash())) {
+                // merged into the known transaction by AddToWallet
+                continue;
+            }
+            wtxNew.nTimeReceived = GetAdjustedTime();
+            wtxNew.nOrderPos = nOrderPos++;
+            wtxNew.nTimeSmart = ComputeTimeSmart(wtxNew);
+            if (!walletdb.WriteTx(wtxNew)) {
+                groupCommit.Abort();
+                return error("CommitTransactions: couldn't write transaction %s", wtxNew.GetHash().ToString());
+            }
+            vfWritten[i] = true;
+        }
+        if (!walletdb.WriteOrderPosNext(nOrderPos)) {
+            groupCommit.Abort();
+            return error("CommitTransactions: couldn't write the next order position");
+        }
+        if (!groupCommit.Commit()) {
+            return error("CommitTransactions: couldn't commit the wallet database transaction");
+        }
+        nOrderPosNext = nOrderPos;
+    }
+
+    // Take key pairs from key pool so they won't be used again
+    for (const auto& reservekey : vReserveKeys) {
+        reservekey->KeepKey();
+    }
+
+    for (size_t i = 0; i < vwtxNew.size(); i++) {
+        AddToWallet(vwtxNew[i], walletdb, vfWritten[i]);
+    }
+
+    std::set<uint256> updated_hashes;
+    for (size_t i = 0; i < vwtxNew.size(); i++) {
+        CWalletTx& wtxNew = vwtxNew[i];
+
+        // Notify that old coins are spent
+        for (const CTxIn& txin : wtxNew.tx->vin) {
+            CWalletTx& coin = mapWallet[txin.prevout.hash];
+            privateSendClient.RemoveSkippedDenom(coin.tx->vout[txin.prevout.n].nValue);
+            // notify only once
+            if (!updated_hashes.insert(txin.prevout.hash).second) continue;
+
+            coin.BindWallet(this);
+            NotifyTransactionChanged(this, txin.prevout.hash, CT_UPDATED);
+        }
+
+        // Track how many getdata requests our transaction gets
+        mapRequestCount[wtxNew.GetHash()] = 0;
+
+        if (fBroadcastTransactions) {
+            // Broadcast
+            if (!wtxNew.AcceptToMemoryPool(maxTxFee, vStates[i])) {
+                LogPrintf("CommitTransactions(): Transaction cannot be broadcast immediately, %s\n", vStates[i].GetRejectReason());
+            } else {
+                wtxNew.RelayWalletTransaction(connman);
+            }
+        }
+    }
+    return true;
+}
+
 void CWallet::ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& entries) {
     CWalletDB walletdb(*dbw);
     return walletdb.ListAccountCreditDebit(strAccount, entries);
@@ -4408,10 +5342,19 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         for (auto& pair : mapWallet) {
             for(unsigned int i = 0; i < pair.second.tx->vout.size(); ++i) {
                 if (IsMine(pair.second.tx->vout[i]) && !IsSpent(pair.first, i)) {
-                    setWalletUTXO.insert(COutPoint(pair.first, i));
+                    AddWalletUTXO(COutPoint(pair.first, i), pair.second.tx->vout[i].nValue);
                 }
             }
         }
+
+        // stored rounds were computed with the keys we have now
+        for (const auto& entry : mapOutpointRoundsCache) {
+            const CWalletTx* wtx = GetWalletTx(entry.first.hash);
+            if (wtx && HasForeignWalletInput(*wtx->tx)) {
+                setRoundsForeignInputTxs.insert(entry.first.hash);
+            }
+        }
+        nRoundsKeyStoreGeneration = GetKeyStoreGeneration();
     }
 
     if (nLoadWalletRet != DB_LOAD_OK)
@@ -4444,8 +5387,19 @@ DBErrors CWallet::ZapSelectTx(std::vector<uint256>& vHashIn, std::vector<uint256
 {
     AssertLockHeld(cs_wallet); // mapWallet
     DBErrors nZapSelectTxRet = CWalletDB(*dbw,"cr+").ZapSelectTx(vHashIn, vHashOut);
-    for (uint256 hash : vHashOut)
-        mapWallet.erase(hash);
+    InvalidatePrivateSendRounds(vHashOut);
+    for (uint256 hash : vHashOut) {
+        const auto it = mapWallet.find(hash);
+        if (it == mapWallet.end()) {
+            continue;
+        }
+        // the amount buckets are looked up through the transaction, drop its
+        // outputs while it is still there
+        for (unsigned int i = 0; i < it->second.tx->vout.size(); ++i) {
+            EraseWalletUTXO(COutPoint(hash, i));
+        }
+        mapWallet.erase(it);
+    }
 
     if (nZapSelectTxRet == DB_NEED_REWRITE)
     {
@@ -4507,13 +5461,17 @@ bool CWallet::SetAddressBook(const CTxDestination& address, const std::string& s
     }
     NotifyAddressBookChanged(this, address, strName, ::IsMine(*this, address) != ISMINE_NO,
                              strPurpose, (fUpdated ? CT_UPDATED : CT_NEW) );
-    if (!strPurpose.empty() && !CWalletDB(*dbw).WritePurpose(CBitcoinAddress(address).ToString(), strPurpose))
+    CWalletDB walletdb(*dbw);
+    CWalletDBGroupCommit groupCommit(walletdb);
+    if (!strPurpose.empty() && !walletdb.WritePurpose(CBitcoinAddress(address).ToString(), strPurpose))
         return false;
-    return CWalletDB(*dbw).WriteName(CBitcoinAddress(address).ToString(), strName);
+    return walletdb.WriteName(CBitcoinAddress(address).ToString(), strName) && groupCommit.Commit();
 }
 
 bool CWallet::DelAddressBook(const CTxDestination& address)
 {
+    CWalletDB walletdb(*dbw);
+    CWalletDBGroupCommit groupCommit(walletdb);
     {
         LOCK(cs_wallet); // mapAddressBook
 
@@ -4521,15 +5479,15 @@ bool CWallet::DelAddressBook(const CTxDestination& address)
         std::string strAddress = CBitcoinAddress(address).ToString();
         for (const std::pair<std::string, std::string> &item : mapAddressBook[address].destdata)
         {
-            CWalletDB(*dbw).EraseDestData(strAddress, item.first);
+            walletdb.EraseDestData(strAddress, item.first);
         }
         mapAddressBook.erase(address);
     }
 
     NotifyAddressBookChanged(this, address, "", ::IsMine(*this, address) != ISMINE_NO, "", CT_DELETED);
 
-    CWalletDB(*dbw).ErasePurpose(CBitcoinAddress(address).ToString());
-    return CWalletDB(*dbw).EraseName(CBitcoinAddress(address).ToString());
+    walletdb.ErasePurpose(CBitcoinAddress(address).ToString());
+    return walletdb.EraseName(CBitcoinAddress(address).ToString()) && groupCommit.Commit();
 }
 
 const std::string& CWallet::GetAccountName(const CScript& scriptPubKey) const
@@ -4639,6 +5597,8 @@ bool CWallet::TopUpKeyPool(unsigned int kpSize)
         }
         bool fInternal = false;
         CWalletDB walletdb(*dbw);
+        // all new keys are committed to the database at once
+        CWalletDBGroupCommit groupCommit(walletdb);
         for (int64_t i = missingInternal + missingExternal; i--;)
         {
             if (i < missingInternal) {
@@ -5018,6 +5978,7 @@ void CWallet::LockCoin(const COutPoint& output)
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    MarkBalanceDirty(output.hash);
 }
 
 void CWallet::UnlockCoin(const COutPoint& output)
@@ -5029,6 +5990,7 @@ void CWallet::UnlockCoin(const COutPoint& output)
 
     fAnonymizableTallyCached = false;
     fAnonymizableTallyCachedNonDenom = false;
+    MarkBalanceDirty(output.hash);
 }
 
 void CWallet::UnlockAllCoins()
@@ -5386,7 +6348,7 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
         //We can't rescan beyond non-pruned blocks, stop and throw an error
         //this might happen if a user uses an old wallet within a pruned node
         // or if he ran -disablewallet for a longer time, then decided to re-enable
-        if (fPruneMode)
+        if (fPruneMode || fSnapshotChain)
         {
             CBlockIndex *block = chainActive.Tip();
             while (block && block->pprev && (block->pprev->nStatus & BLOCK_HAVE_DATA) && block->pprev->nTx > 0 && pindexRescan != block)
@@ -5625,6 +6587,8 @@ void CWallet::NotifyTransactionLock(const CTransaction &tx, const llmq::CInstant
     uint256 txHash = tx.GetHash();
     std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txHash);
     if (mi != mapWallet.end()){
+        // trusted state of the transaction and its unconfirmed descendants may have changed
+        MarkVolatileBalancesDirty();
         NotifyTransactionChanged(this, txHash, CT_UPDATED);
         NotifyISLockReceived();
         // notify an external script
@@ -5638,6 +6602,10 @@ void CWallet::NotifyTransactionLock(const CTransaction &tx, const llmq::CInstant
 
 void CWallet::NotifyChainLock(const CBlockIndex* pindexChainLock, const llmq::CChainLockSig& clsig)
 {
+    {
+        LOCK(cs_wallet);
+        MarkVolatileBalancesDirty();
+    }
     NotifyChainLockReceived(pindexChainLock->nHeight);
 }
 
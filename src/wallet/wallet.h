@@ -10,6 +10,8 @@
 
 #include "amount.h"
 #include "base58.h"
+#include "blockfilter.h"
+#include "crypto/common.h"
 #include "policy/feerate.h"
 #include "saltedhasher.h"
 #include "streams.h"
@@ -30,10 +32,13 @@
 #include <atomic>
 #include <deque>
 #include <map>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <stdint.h>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -88,6 +93,15 @@ enum {
  };
 static const int DEFAULT_STAKE_AUTOCOMBINE = AUTOCOMBINE_SAME;
 
+//! Number of blocks read and filtered ahead of the wallet during a rescan
+static const unsigned int WALLET_RESCAN_READAHEAD = 32;
+//! Maximum number of threads reading and filtering blocks during a rescan
+static const int MAX_WALLET_RESCAN_THREADS = 4;
+//! Maximum number of threads signing transaction inputs
+static const int MAX_WALLET_SIGNING_THREADS = 4;
+//! Minimum number of inputs to sign before the signing is spread across threads
+static const size_t WALLET_PARALLEL_SIGNING_MIN_INPUTS = 16;
+
 bool AutoBackupWallet (CWallet* wallet, const std::string& strWalletFile_, std::string& strBackupWarningRet, std::string& strBackupErrorRet);
 
 class CBlockIndex;
@@ -126,6 +140,65 @@ struct CompactTallyItem
     }
 };
 
+/** All balances of a wallet, as computed by a single pass over its spendable transactions */
+struct CWalletBalances
+{
+    CAmount nTrusted{0};                    //!< GetBalance()
+    CAmount nUntrustedPending{0};           //!< GetUnconfirmedBalance()
+    CAmount nImmature{0};                   //!< GetImmatureBalance()
+    CAmount nWatchOnlyTrusted{0};           //!< GetWatchOnlyBalance()
+    CAmount nWatchOnlyUntrustedPending{0};  //!< GetUnconfirmedWatchOnlyBalance()
+    CAmount nWatchOnlyImmature{0};          //!< GetImmatureWatchOnlyBalance()
+    CAmount nDenominatedConfirmed{0};       //!< GetDenominatedBalance(false)
+    CAmount nDenominatedUnconfirmed{0};     //!< GetDenominatedBalance(true)
+    CAmount nAnonymized{0};                 //!< GetAnonymizedBalance()
+
+    CWalletBalances& operator+=(const CWalletBalances& b);
+    CWalletBalances& operator-=(const CWalletBalances& b);
+};
+
+/**
+ * Snapshot of the keys and scripts of a wallet, used to filter blocks during a
+ * rescan without holding cs_wallet. MayBeMine() never returns false for a
+ * transaction with an output IsMine() would accept, it may return true for
+ * some which are not (e.g. a multisig output with only one of our keys).
+ *
+ * If the block filter index is enabled, the snapshot also holds the output
+ * scripts of the wallet's keys, scripts (including multisig scripts added to
+ * the wallet) and watch-only scripts, so blocks whose filter matches none of
+ * them don't need to be read at all. Bare multisig outputs which are ours only
+ * through our keys are not covered by those scripts, block filters are not
+ * used for wallets which own any of them.
+ */
+class CWalletScanFilter
+{
+private:
+    struct IdHasher
+    {
+        size_t operator()(const uint160& id) const { return ReadLE64(id.begin()); }
+    };
+
+    //! key ids and script ids
+    std::unordered_set<uint160, IdHasher> setIds;
+    std::set<CScript> setWatchOnly;
+    //! output scripts to match against block filters, only set if fBlockFilter
+    CGCSFilter::ElementSet setScripts;
+
+public:
+    //! CWallet::GetScanFilterGeneration() at the time the snapshot was taken
+    uint64_t nGeneration{0};
+    //! Whether the snapshot can be matched against block filters
+    bool fBlockFilter{false};
+
+    void AddId(const uint160& id) { setIds.insert(id); }
+    void AddWatchOnly(const CScript& script) { setWatchOnly.insert(script); }
+    void AddScript(const CScript& script) { setScripts.emplace(script.begin(), script.end()); }
+
+    bool MayBeMine(const CTransaction& tx) const;
+    /** Returns false only if no transaction of the block can be ours */
+    bool MayMatchBlock(const CBlockFilter& blockFilter) const;
+};
+
 /** A key pool entry */
 class CKeyPool
 {
@@ -597,7 +670,28 @@ public:
     std::string ToString() const;
 };
 
+/**
+ * A spendable output together with everything SelectCoinsMinConf filters on.
+ * SelectCoins computes these once and reuses them for every confirmation and
+ * chain limit it tries.
+ */
+struct CCoinCandidate
+{
+    CInputCoin coin;
+    int nDepth;
+    bool fFromMe;
+    bool fLockedByIS;
+    //! Larger of the mempool ancestor and descendant counts, 0 if the transaction is not in the mempool
+    uint64_t nChainLength{0};
+
+    CCoinCandidate(const CWalletTx* pcoin, int i, int nDepthIn) :
+        coin(pcoin, i), nDepth(nDepthIn), fFromMe(pcoin->IsFromMe(ISMINE_ALL)), fLockedByIS(pcoin->IsLockedByInstantSend()) {}
+};
 
+//! Maximum number of branches the branch and bound coin selection explores
+static const int BNB_MAX_TRIES = 100000;
+//! Time budget of the branch and bound coin selection in microseconds
+static const int64_t BNB_TIME_BUDGET = 100000;
 
 
 /** Private key that includes an expiration date in case it never gets used. */
@@ -720,6 +814,8 @@ private:
     static std::atomic<bool> fFlushScheduled;
     std::atomic<bool> fAbortRescan;
     std::atomic<bool> fScanningWallet;
+    std::atomic<int64_t> nScanningStartTime;
+    std::atomic<double> dScanningProgress;
 
     /**
      * Select a set of coins such that nValueRet >= nTargetValue and at least
@@ -728,6 +824,17 @@ private:
      */
     bool SelectCoins(const std::vector<COutput>& vAvailableCoins, const CAmount& nTargetValue, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, const CCoinControl *coinControl = nullptr) const;
 
+    /** Shuffle and order spendable coins for SelectCoinsMinConf and compute their properties */
+    std::vector<CCoinCandidate> GetCoinCandidates(std::vector<COutput> vCoins, CoinType nCoinType) const;
+
+    /**
+     * SelectCoinsMinConf on precomputed candidates. An input set exceeding
+     * nTargetValue by at most nNoChangeTolerance is searched for first, so no
+     * change output is needed.
+     */
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<CCoinCandidate>& vCandidates,
+                            std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, CoinType nCoinType, CAmount nNoChangeTolerance) const;
+
     CWalletDB *pwalletdbEncryption;
 
     //! the current wallet version: clients below this version are not able to load the wallet
@@ -745,6 +852,58 @@ private:
     mutable bool fAnonymizableTallyCachedNonDenom;
     mutable std::vector<CompactTallyItem> vecAnonymizableTallyCachedNonDenom;
 
+    /**
+     * Balances are maintained incrementally. Every wallet transaction with unspent
+     * outputs contributes its own CWalletBalances to the totals, which is only
+     * recomputed after MarkBalanceDirty() was called for the transaction (when it
+     * is added, updated, spent, abandoned or conflicted). Unconfirmed and immature
+     * transactions depend on the chain tip, they are kept in setBalanceVolatileTxs
+     * and recomputed on every block and lock. Unconfirmed ones are recomputed when
+     * the mempool changed as well.
+     * MarkBalancesDirty() forces a full recompute, for changes which are not bound
+     * to single transactions (reorgs, key imports, PrivateSend rounds).
+     *
+     * The totals are published in cachedBalances under cs_balances, so that
+     * GetBalances() only needs cs_main and cs_wallet when there is pending work.
+     */
+    mutable std::map<uint256, CWalletBalances> mapTxBalances;
+    mutable std::set<uint256> setBalanceDirtyTxs;
+    mutable std::set<uint256> setBalanceVolatileTxs;
+    mutable std::set<uint256> setBalanceUnconfirmedTxs;
+    mutable CWalletBalances totalBalances;
+    mutable bool fBalancesFullRecompute;
+    mutable int nBalancesPrivateSendRounds;
+    mutable CCriticalSection cs_balances;
+    mutable CWalletBalances cachedBalances;
+    mutable bool fBalancesCurrent;
+    mutable bool fBalancesDependOnMempool;
+    mutable unsigned int nBalancesMempoolUpdated;
+
+    /** Recomputes the contribution of a single transaction to totalBalances */
+    void UpdateTxBalance(const uint256& hash, int nPrivateSendRounds) const;
+
+    /**
+     * PrivateSend rounds of our outputs, computed on demand and stored in the
+     * wallet database by FlushPrivateSendRounds(). Rounds only depend on the wallet transactions spending
+     * each other, so they are dropped for the descendants of a transaction
+     * which is added while its outputs are already spent by the wallet, or
+     * which is disconnected from the chain.
+     */
+    mutable std::unordered_map<COutPoint, int, SaltedOutpointHasher> mapOutpointRoundsCache;
+    //! Outpoints whose rounds were computed or dropped since the last FlushPrivateSendRounds()
+    mutable std::set<COutPoint> setRoundsDirty;
+    /**
+     * Transactions whose rounds were computed while skipping inputs which spend
+     * outputs of wallet transactions that are not ours. New keys can make those
+     * outputs ours, so the rounds of these transactions and their descendants
+     * are dropped once the key store generation changed.
+     */
+    mutable std::set<uint256> setRoundsForeignInputTxs;
+    mutable uint64_t nRoundsKeyStoreGeneration{0};
+
+    bool HasForeignWalletInput(const CTransaction& tx) const;
+    void InvalidatePrivateSendRounds(const std::vector<uint256>& vHashes) const;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -756,6 +915,12 @@ private:
     void AddToSpends(const uint256& wtxid);
 
     std::set<COutPoint> setWalletUTXO;
+    //! Denominated outpoints of setWalletUTXO, bucketed by denomination
+    std::map<CAmount, std::set<COutPoint> > mapDenominatedUTXO;
+    //! setWalletUTXO sorted by amount
+    std::set<std::pair<CAmount, COutPoint> > setWalletUTXOByAmount;
+    void AddWalletUTXO(const COutPoint& outpoint, CAmount nValue);
+    void EraseWalletUTXO(const COutPoint& outpoint);
 
     /* Mark a transaction (and its in-wallet descendants) as conflicting with a particular block. */
     void MarkConflicted(const uint256& hashBlock, const uint256& hashTx);
@@ -793,8 +958,10 @@ private:
     // the next block comes in
     uint256 hashPrevBestCoinbase;
 
-    // A helper function which loops through wallet UTXOs
-    std::unordered_set<const CWalletTx*, WalletTxHasher> GetSpendableTXs() const;
+    // A helper function which loops through wallet UTXOs, limited to those in the given amount range
+    std::unordered_set<const CWalletTx*, WalletTxHasher> GetSpendableTXs(CAmount nMinimumAmount = 0, CAmount nMaximumAmount = MAX_MONEY) const;
+    // Same as GetSpendableTXs but only returns transactions with denominated UTXOs
+    std::unordered_set<const CWalletTx*, WalletTxHasher> GetDenominatedTXs() const;
 
 public:
     /*
@@ -888,10 +1055,17 @@ public:
         nRelockTime = 0;
         fAbortRescan = false;
         fScanningWallet = false;
+        nScanningStartTime = 0;
+        dScanningProgress = 0;
         fAnonymizableTallyCached = false;
         fAnonymizableTallyCachedNonDenom = false;
         vecAnonymizableTallyCached.clear();
         vecAnonymizableTallyCachedNonDenom.clear();
+        fBalancesFullRecompute = true;
+        nBalancesPrivateSendRounds = 0;
+        fBalancesCurrent = false;
+        fBalancesDependOnMempool = false;
+        nBalancesMempoolUpdated = 0;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -937,9 +1111,10 @@ public:
      * Shuffle and select coins until nTargetValue is reached while avoiding
      * small change; This method is stochastic for some inputs and upon
      * completion the coin set and corresponding actual target value is
-     * assembled
+     * assembled. An input set exceeding nTargetValue by at most
+     * nNoChangeTolerance is searched for first.
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, CoinType nCoinType = CoinType::ALL_COINS) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<CInputCoin>& setCoinsRet, CAmount& nValueRet, CoinType nCoinType = CoinType::ALL_COINS, CAmount nNoChangeTolerance = 0) const;
 
     // Coin selection
     bool SelectPSInOutPairsByDenominations(int nDenom, CAmount nValueMin, CAmount nValueMax, std::vector< std::pair<CTxDSIn, CTxOut> >& vecPSInOutPairsRet);
@@ -960,7 +1135,7 @@ public:
     int  CountInputsWithAmount(CAmount nInputAmount) const;
 
     // get the PrivateSend chain depth for a given input
-    int GetRealOutpointPrivateSendRounds(const COutPoint& outpoint, int nRounds = 0) const;
+    int GetRealOutpointPrivateSendRounds(const COutPoint& outpoint) const;
     // respect current settings
     int GetCappedOutpointPrivateSendRounds(const COutPoint& outpoint) const;
 
@@ -981,6 +1156,8 @@ public:
     void AbortRescan() { fAbortRescan = true; }
     bool IsAbortingRescan() { return fAbortRescan; }
     bool IsScanning() { return fScanningWallet; }
+    int64_t GetScanningDuration() const { return fScanningWallet ? GetTimeMillis() - nScanningStartTime : 0; }
+    double GetScanningProgress() const { return fScanningWallet ? (double)dScanningProgress : 0; }
 
     /**
      * keystore implementation
@@ -1021,6 +1198,10 @@ public:
     bool EraseDestData(const CTxDestination &dest, const std::string &key);
     //! Adds a destination data tuple to the store, without saving it to disk
     bool LoadDestData(const CTxDestination &dest, const std::string &key, const std::string &value);
+    //! Adds PrivateSend rounds of an outpoint to the cache, without saving them to disk
+    void LoadPrivateSendRounds(const COutPoint& outpoint, int nRounds);
+    //! Write the rounds computed or dropped since the last call in one database transaction
+    void FlushPrivateSendRounds() const;
     //! Look up a destination data tuple in the store, return true if found false otherwise
     bool GetDestData(const CTxDestination &dest, const std::string &key, std::string *value) const;
     //! Get all destination values matching a prefix.
@@ -1030,6 +1211,7 @@ public:
     bool AddWatchOnly(const CScript& dest, int64_t nCreateTime);
 
     bool RemoveWatchOnly(const CScript &dest) override;
+    bool RemoveWatchOnly(CWalletDB &walletdb, const CScript &dest);
     //! Adds a watch-only address to the store, without saving it to disk (used by LoadWallet)
     bool LoadWatchOnly(const CScript &dest);
 
@@ -1054,6 +1236,8 @@ public:
 
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn, bool fFlushOnClose=true);
+    /** With fWritten, a new wtxIn was already written with its nTimeReceived, nOrderPos and nTimeSmart */
+    bool AddToWallet(const CWalletTx& wtxIn, CWalletDB& walletdb, bool fWritten = false);
     bool LoadToWallet(const CWalletTx& wtxIn);
     void TransactionAddedToMempool(const CTransactionRef& tx, int64_t nAcceptTime) override;
     void BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex *pindex, const std::vector<CTransactionRef>& vtxConflicted) override;
@@ -1061,10 +1245,26 @@ public:
     bool AddToWalletIfInvolvingMe(const CTransactionRef& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     int64_t RescanFromTime(int64_t startTime, bool update);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, CBlockIndex* pindexStop, bool fUpdate = false);
+    /** Changes whenever keys, scripts or watch-only scripts are added to or removed from the wallet */
+    uint64_t GetScanFilterGeneration() const;
+    /** Whether the wallet owns bare multisig outputs whose script is neither a known script nor watch-only */
+    bool HasKeyOnlyMultisigOutputs() const;
+    std::shared_ptr<const CWalletScanFilter> GetScanFilter() const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     // ResendWalletTransactionsBefore may only be called if fBroadcastTransactions!
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
+    /**
+     * Returns all balances at once. Doesn't need cs_main or cs_wallet unless
+     * transactions were marked dirty since the last call.
+     */
+    CWalletBalances GetBalances() const;
+    /** Recompute all balances on the next GetBalances() call */
+    void MarkBalancesDirty();
+    /** Recompute the balance contribution of a transaction and of the transactions it spends */
+    void MarkBalanceDirty(const uint256& hash) const;
+    /** Recompute the balance contribution of all unconfirmed and immature transactions */
+    void MarkVolatileBalancesDirty();
     CAmount GetBalance() const;
     CAmount GetUnconfirmedBalance() const;
     CAmount GetImmatureBalance() const;
@@ -1088,6 +1288,8 @@ public:
      */
     bool FundTransaction(CMutableTransaction& tx, CAmount& nFeeRet, int& nChangePosInOut, std::string& strFailReason, bool lockUnspents, const std::set<int>& setSubtractFeeFromOutputs, CCoinControl);
     bool SignTransaction(CMutableTransaction& tx);
+    /** Sign the inputs of all transactions, spending outputs of wallet transactions, on a thread pool when there are many */
+    bool SignTransactions(const std::vector<CMutableTransaction*>& vTx);
 
     /**
      * Create a new transaction paying the recipients with a set of coins
@@ -1098,6 +1300,16 @@ public:
                            std::string& strFailReason, const CCoinControl& coin_control, bool sign = true, int nExtraPayloadSize = 0);
     bool CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey, CConnman* connman, CValidationState& state);
 
+    /**
+     * Create a transaction for each set of recipients against the same wallet
+     * state, no input is spent by more than one of them. The inputs of all
+     * transactions are signed together once every transaction is funded.
+     */
+    bool CreateTransactions(const std::vector<std::vector<CRecipient> >& vecBatch, std::vector<CWalletTx>& vwtxNew, std::vector<std::unique_ptr<CReserveKey> >& vReserveKeys,
+                            CAmount& nFeeRet, std::string& strFailReason, const CCoinControl& coin_control);
+    /** Commit the transactions created by CreateTransactions(), they are written to the wallet database in one transaction */
+    bool CommitTransactions(std::vector<CWalletTx>& vwtxNew, std::vector<std::unique_ptr<CReserveKey> >& vReserveKeys, CConnman* connman, std::vector<CValidationState>& vStates);
+
     bool CreateCollateralTransaction(CMutableTransaction& txCollateral, std::string& strReason);
     bool ConvertList(std::vector<CTxIn> vecTxIn, std::vector<CAmount>& vecAmounts);
     bool CreateCoinStake(const CBlockIndex *pindex_prev, CBlock& curr_block, CMutableTransaction& coinbaseTx);
@@ -501,6 +501,14 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
                 return false;
             }
         }
+        else if (strType == "psrounds")
+        {
+            COutPoint outpoint;
+            int nRounds;
+            ssKey >> outpoint;
+            ssValue >> nRounds;
+            pwallet->LoadPrivateSendRounds(outpoint, nRounds);
+        }
         else if (strType == "hdchain")
         {
             CHDChain chain;
@@ -788,7 +796,13 @@ void MaybeCompactWalletDB()
     if (fOneThread.exchange(true)) {
         return;
     }
+    for (CWalletRef pwallet : vpwallets) {
+        pwallet->FlushPrivateSendRounds();
+    }
+    // writes deferred by -walletflushinterval are synced regardless of -flushwallet
+    bitdb.SyncDeferred();
     if (!gArgs.GetBoolArg("-flushwallet", DEFAULT_FLUSHWALLET)) {
+        fOneThread = false;
         return;
     }
 
@@ -893,6 +907,16 @@ bool CWalletDB::WriteHDPubKey(const CHDPubKey& hdPubKey, const CKeyMetadata& key
     return WriteIC(std::make_pair(std::string("hdpubkey"), hdPubKey.extPubKey.pubkey), hdPubKey, false);
 }
 
+bool CWalletDB::WritePrivateSendRounds(const COutPoint& outpoint, int nRounds)
+{
+    return WriteIC(std::make_pair(std::string("psrounds"), outpoint), nRounds);
+}
+
+bool CWalletDB::ErasePrivateSendRounds(const COutPoint& outpoint)
+{
+    return EraseIC(std::make_pair(std::string("psrounds"), outpoint));
+}
+
 bool CWalletDB::TxnBegin()
 {
     return batch.TxnBegin();
@@ -40,6 +40,7 @@ class CAccountingEntry;
 struct CBlockLocator;
 class CKeyPool;
 class CMasterKey;
+class COutPoint;
 class CScript;
 class CWallet;
 class CWalletTx;
@@ -166,6 +167,9 @@ public:
     /// Erase destination data tuple from wallet database
     bool EraseDestData(const std::string &address, const std::string &key);
 
+    bool WritePrivateSendRounds(const COutPoint& outpoint, int nRounds);
+    bool ErasePrivateSendRounds(const COutPoint& outpoint);
+
     CAmount GetAccountCreditDebit(const std::string& strAccount);
     void ListAccountCreditDebit(const std::string& strAccount, std::list<CAccountingEntry>& acentries);
 
@@ -206,6 +210,45 @@ private:
     CWalletDBWrapper& m_dbw;
 };
 
+/**
+ * Groups the writes of a CWalletDB handle within its scope into one database
+ * transaction, which is committed when the scope ends. Writes through other
+ * handles meanwhile would wait for the locks of the transaction, so the
+ * handle has to be passed to everything writing in the scope. Nested scopes
+ * join the transaction of the outer one.
+ */
+class CWalletDBGroupCommit
+{
+private:
+    CWalletDB& walletdb;
+    bool fOwner;
+
+public:
+    explicit CWalletDBGroupCommit(CWalletDB& walletdbIn) : walletdb(walletdbIn), fOwner(walletdb.TxnBegin()) {}
+    ~CWalletDBGroupCommit() { Commit(); }
+
+    CWalletDBGroupCommit(const CWalletDBGroupCommit&) = delete;
+    CWalletDBGroupCommit& operator=(const CWalletDBGroupCommit&) = delete;
+
+    /** Commit the writes so far, returns false if the transaction failed */
+    bool Commit()
+    {
+        if (!fOwner)
+            return true;
+        fOwner = false;
+        return walletdb.TxnCommit();
+    }
+
+    /** Discard the writes so far */
+    void Abort()
+    {
+        if (!fOwner)
+            return;
+        fOwner = false;
+        walletdb.TxnAbort();
+    }
+};
+
 //! Compacts BDB state so that wallet.dat is self-contained (if there are changes)
 void MaybeCompactWalletDB();
 
@@ -22,7 +22,7 @@ bool CZMQAbstractNotifier::NotifyChainLock(const CBlockIndex * /*CBlockIndex*/,
     return true;
 }
 
-bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/)
+bool CZMQAbstractNotifier::NotifyTransaction(const CTransactionRef &/*ptx*/)
 {
     return true;
 }
@@ -8,10 +8,13 @@
 
 #include "zmqconfig.h"
 
+#include <atomic>
+
 class CBlockIndex;
 class CGovernanceObject;
 class CGovernanceVote;
 class CZMQAbstractNotifier;
+class CZMQPublishQueue;
 
 namespace llmq {
     class CChainLockSig;
@@ -20,10 +23,13 @@ namespace llmq {
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
+/** Default ZMQ_SNDHWM of notifier sockets, same as libzmq's own default */
+static const int DEFAULT_ZMQ_SNDHWM = 1000;
+
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(nullptr) { }
+    CZMQAbstractNotifier() : psocket(nullptr), outbound_message_high_water_mark(DEFAULT_ZMQ_SNDHWM), publishQueue(nullptr) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -36,13 +42,24 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    int GetOutboundMessageHighWaterMark() const { return outbound_message_high_water_mark; }
+    void SetOutboundMessageHighWaterMark(const int sndhwm) {
+        if (sndhwm >= 0) {
+            outbound_message_high_water_mark = sndhwm;
+        }
+    }
+    void SetPublishQueue(CZMQPublishQueue* queue) { publishQueue = queue; }
+
+    /** Messages which were dropped because the publish queue was full or sending failed */
+    uint64_t GetDroppedMessages() const { return nDroppedMessages; }
+    uint64_t GetPublishedMessages() const { return nPublishedMessages; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyChainLock(const CBlockIndex *pindex, const llmq::CChainLockSig& clsig);
-    virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyTransaction(const CTransactionRef &ptx);
     virtual bool NotifyTransactionLock(const CTransaction &transaction, const llmq::CInstantSendLock& islock);
     virtual bool NotifyGovernanceVote(const CGovernanceVote &vote);
     virtual bool NotifyGovernanceObject(const CGovernanceObject &object);
@@ -53,6 +70,11 @@ protected:
     void *psocket;
     std::string type;
     std::string address;
+    int outbound_message_high_water_mark; // aka SNDHWM
+    CZMQPublishQueue* publishQueue;
+
+    std::atomic<uint64_t> nDroppedMessages{0};
+    std::atomic<uint64_t> nPublishedMessages{0};
 };
 
 #endif // BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
@@ -11,6 +11,8 @@
 #include "streams.h"
 #include "util.h"
 
+CZMQNotificationInterface* pzmqNotificationInterface = nullptr;
+
 void zmqError(const char *str)
 {
     LogPrint(BCLog::ZMQ, "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
@@ -24,12 +26,21 @@ CZMQNotificationInterface::~CZMQNotificationInterface()
 {
     Shutdown();
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
+    for (std::list<CZMQAbstractNotifier*>::iterator i=allNotifiers.begin(); i!=allNotifiers.end(); ++i)
     {
         delete *i;
     }
 }
 
+std::list<const CZMQAbstractNotifier*> CZMQNotificationInterface::GetNotifiers() const
+{
+    std::list<const CZMQAbstractNotifier*> result;
+    for (const auto* n : allNotifiers) {
+        result.push_back(n);
+    }
+    return result;
+}
+
 CZMQNotificationInterface* CZMQNotificationInterface::Create()
 {
     CZMQNotificationInterface* notificationInterface = nullptr;
@@ -63,6 +74,7 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
             CZMQAbstractNotifier *notifier = factory();
             notifier->SetType(entry.first);
             notifier->SetAddress(address);
+            notifier->SetOutboundMessageHighWaterMark(static_cast<int>(gArgs.GetArg(arg + "hwm", DEFAULT_ZMQ_SNDHWM)));
             notifiers.push_back(notifier);
         }
     }
@@ -71,6 +83,13 @@ CZMQNotificationInterface* CZMQNotificationInterface::Create()
     {
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        notificationInterface->allNotifiers = notifiers;
+
+        int64_t nQueueSize = gArgs.GetArg("-zmqqueuesize", DEFAULT_ZMQ_QUEUE_SIZE);
+        notificationInterface->publishQueue.reset(new CZMQPublishQueue(std::max<int64_t>(nQueueSize, 1)));
+        for (auto* notifier : notifiers) {
+            notifier->SetPublishQueue(notificationInterface->publishQueue.get());
+        }
 
         if (!notificationInterface->Initialize())
         {
@@ -116,6 +135,8 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    publishQueue->Start();
+
     return true;
 }
 
@@ -125,7 +146,11 @@ void CZMQNotificationInterface::Shutdown()
     LogPrint(BCLog::ZMQ, "zmq: Shutdown notification interface\n");
     if (pcontext)
     {
-        for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
+        // sends whatever is still queued, the sockets must stay open until then
+        publishQueue->Stop();
+
+        // including the notifiers which failed and were no longer notified
+        for (std::list<CZMQAbstractNotifier*>::iterator i=allNotifiers.begin(); i!=allNotifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
             LogPrint(BCLog::ZMQ, "   Shutdown notifier %s at %s\n", notifier->GetType(), notifier->GetAddress());
@@ -151,7 +176,7 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindexNew, co
         }
         else
         {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             i = notifiers.erase(i);
         }
     }
@@ -168,7 +193,7 @@ void CZMQNotificationInterface::NotifyChainLock(const CBlockIndex *pindex, const
         }
         else
         {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             i = notifiers.erase(i);
         }
     }
@@ -178,18 +203,16 @@ void CZMQNotificationInterface::TransactionAddedToMempool(const CTransactionRef&
 {
     // Used by BlockConnected and BlockDisconnected as well, because they're
     // all the same external callback.
-    const CTransaction& tx = *ptx;
-
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
     {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx))
+        if (notifier->NotifyTransaction(ptx))
         {
             i++;
         }
         else
         {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             i = notifiers.erase(i);
         }
     }
@@ -222,7 +245,7 @@ void CZMQNotificationInterface::NotifyTransactionLock(const CTransaction &tx, co
         }
         else
         {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             i = notifiers.erase(i);
         }
     }
@@ -239,7 +262,7 @@ void CZMQNotificationInterface::NotifyGovernanceVote(const CGovernanceVote &vote
         }
         else
         {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             i = notifiers.erase(i);
         }
     }
@@ -256,7 +279,7 @@ void CZMQNotificationInterface::NotifyGovernanceObject(const CGovernanceObject &
         }
         else
         {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             i = notifiers.erase(i);
         }
     }
@@ -269,7 +292,7 @@ void CZMQNotificationInterface::NotifyInstantSendDoubleSpendAttempt(const CTrans
         if (notifier->NotifyInstantSendDoubleSpendAttempt(currentTx, previousTx)) {
             ++it;
         } else {
-            notifier->Shutdown();
+            // the socket is still used by the publisher thread, it is closed on shutdown
             it = notifiers.erase(it);
         }
     }
@@ -10,9 +10,11 @@
 #include <string>
 #include <map>
 #include <list>
+#include <memory>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class CZMQPublishQueue;
 
 class CZMQNotificationInterface final : public CValidationInterface
 {
@@ -21,6 +23,9 @@ public:
 
     static CZMQNotificationInterface* Create();
 
+    /** All configured notifiers, including ones which were shut down after a failure */
+    std::list<const CZMQAbstractNotifier*> GetNotifiers() const;
+
 protected:
     bool Initialize();
     void Shutdown();
@@ -42,6 +47,10 @@ private:
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    std::list<CZMQAbstractNotifier*> allNotifiers;
+    std::unique_ptr<CZMQPublishQueue> publishQueue;
 };
 
+extern CZMQNotificationInterface* pzmqNotificationInterface;
+
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -5,11 +5,14 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "clientversion.h"
 #include "streams.h"
 #include "zmqpublishnotifier.h"
 #include "validation.h"
 #include "util.h"
 
+#include <map>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK     = "hashblock";
@@ -29,47 +32,201 @@ static const char *MSG_RAWGVOTE      = "rawgovernancevote";
 static const char *MSG_RAWGOBJ       = "rawgovernanceobject";
 static const char *MSG_RAWISCON      = "rawinstantsenddoublespend";
 
-// Internal function to send multipart message
-static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
+// Payloads which are still referenced by a queued message, so that other topics can reuse them
+static std::mutex csSharedPayloads;
+static std::map<std::string, std::weak_ptr<CZMQPayload>> mapSharedPayloads;
+
+static CZMQPayloadRef FindSharedPayload(const std::string& key)
 {
-    va_list args;
-    va_start(args, size);
+    std::lock_guard<std::mutex> lock(csSharedPayloads);
+    auto it = mapSharedPayloads.find(key);
+    return it != mapSharedPayloads.end() ? it->second.lock() : nullptr;
+}
 
-    while (1)
-    {
-        zmq_msg_t msg;
+/** Registers payload under key, unless another payload is still registered for it, which is returned instead */
+static CZMQPayloadRef AddSharedPayload(const std::string& key, CZMQPayloadRef payload)
+{
+    std::lock_guard<std::mutex> lock(csSharedPayloads);
+    auto it = mapSharedPayloads.find(key);
+    if (it != mapSharedPayloads.end()) {
+        if (CZMQPayloadRef existing = it->second.lock()) {
+            return existing;
+        }
+    }
 
-        int rc = zmq_msg_init_size(&msg, size);
-        if (rc != 0)
-        {
-            zmqError("Unable to initialize ZMQ msg");
-            va_end(args);
-            return -1;
+    // forget payloads which have been sent in the meantime, amortized over the insertions since the last cleanup
+    static size_t nCleanupSize = 256;
+    if (mapSharedPayloads.size() >= nCleanupSize) {
+        for (auto jt = mapSharedPayloads.begin(); jt != mapSharedPayloads.end(); ) {
+            if (jt->second.expired()) {
+                jt = mapSharedPayloads.erase(jt);
+            } else {
+                ++jt;
+            }
         }
+        nCleanupSize = std::max<size_t>(256, mapSharedPayloads.size() * 2);
+    }
 
-        void *buf = zmq_msg_data(&msg);
-        memcpy(buf, data, size);
+    mapSharedPayloads[key] = payload;
+    return payload;
+}
+
+static CZMQPayloadRef GetSharedPayload(const std::string& key, CZMQPayload::Producer&& producer)
+{
+    CZMQPayloadRef payload = FindSharedPayload(key);
+    if (payload) {
+        return payload;
+    }
+    return AddSharedPayload(key, std::make_shared<CZMQPayload>(std::move(producer)));
+}
+
+static CZMQPayloadRef MakeHashPayload(const uint256& hash)
+{
+    std::vector<unsigned char> data(32);
+    for (unsigned int i = 0; i < 32; i++)
+        data[31 - i] = hash.begin()[i];
+    return std::make_shared<CZMQPayload>(std::move(data));
+}
 
-        data = va_arg(args, const void*);
+template <typename T>
+static CZMQPayloadRef MakeSerializedPayload(const T& obj)
+{
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0, obj);
+    return std::make_shared<CZMQPayload>(std::move(data));
+}
 
-        rc = zmq_msg_send(&msg, sock, data ? ZMQ_SNDMORE : 0);
-        if (rc == -1)
+// Reads the block as stored on disk, which is its network serialization
+static CZMQPayloadRef GetBlockPayload(const CBlockIndex* pindex)
+{
+    return GetSharedPayload("block" + pindex->GetBlockHash().ToString(), [pindex](std::vector<unsigned char>& data) {
+        unsigned int nBlockSize;
+        FILE* file;
         {
-            zmqError("Unable to send ZMQ msg");
-            zmq_msg_close(&msg);
-            va_end(args);
-            return -1;
+            // keep the block from being pruned until its file is open
+            LOCK(cs_main);
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA)) {
+                zmqError("Block not available anymore");
+                return false;
+            }
+            file = OpenRawBlockFile(pindex->GetBlockPos(), Params().MessageStart(), nBlockSize);
+        }
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            zmqError("Can't read block from disk");
+            return false;
+        }
+        data.resize(nBlockSize);
+        try {
+            filein.read((char*)data.data(), nBlockSize);
+        } catch (const std::exception& e) {
+            zmqError("Can't read block from disk");
+            return false;
         }
+        return true;
+    });
+}
+
+static CZMQPayloadRef GetTransactionPayload(const CTransactionRef& ptx)
+{
+    return GetSharedPayload("tx" + ptx->GetHash().ToString(), [ptx](std::vector<unsigned char>& data) {
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0, *ptx);
+        return true;
+    });
+}
+
+// The caller only holds a reference to tx, so unless it is still queued it has to be serialized right away
+static CZMQPayloadRef GetTransactionPayload(const CTransaction& tx)
+{
+    std::string key = "tx" + tx.GetHash().ToString();
+    CZMQPayloadRef payload = FindSharedPayload(key);
+    if (payload) {
+        return payload;
+    }
+    std::vector<unsigned char> data;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, 0, tx);
+    return AddSharedPayload(key, std::make_shared<CZMQPayload>(std::move(data)));
+}
+
+const std::vector<unsigned char>* CZMQPayload::Get()
+{
+    if (!fProduced) {
+        fValid = producer(data);
+        fProduced = true;
+        producer = nullptr;
+    }
+    return fValid ? &data : nullptr;
+}
+
+CZMQPublishQueue::CZMQPublishQueue(size_t nQueueSize) :
+    queue(nQueueSize)
+{
+}
+
+CZMQPublishQueue::~CZMQPublishQueue()
+{
+    Stop();
+}
+
+void CZMQPublishQueue::Start()
+{
+    assert(!publisherThread.joinable());
+    fStopRequested = false;
+    publisherThread = std::thread(&TraceThread<std::function<void()> >, "zmqpub", std::function<void()>(std::bind(&CZMQPublishQueue::ThreadPublish, this)));
+}
+
+void CZMQPublishQueue::Stop()
+{
+    if (!publisherThread.joinable()) {
+        return;
+    }
+    fStopRequested = true;
+    cond.notify_one();
+    publisherThread.join();
+}
+
+bool CZMQPublishQueue::Push(CZMQAbstractPublishNotifier* notifier, const char* command, CZMQPayloadRef payload)
+{
+    Message msg;
+    msg.notifier = notifier;
+    msg.command = command;
+    msg.payload = std::move(payload);
+    if (!queue.TryPush(std::move(msg))) {
+        return false;
+    }
+    if (fPublisherIdle.load(std::memory_order_relaxed)) {
+        cond.notify_one();
+    }
+    return true;
+}
 
-        zmq_msg_close(&msg);
+size_t CZMQPublishQueue::PublishBatch()
+{
+    size_t nMessages = 0;
+    Message msg;
+    while (nMessages < MAX_BATCH_MESSAGES && queue.TryPop(msg)) {
+        msg.notifier->SendMessage(msg.command, msg.payload);
+        msg.payload.reset();
+        nMessages++;
+    }
+    return nMessages;
+}
 
-        if (!data)
+void CZMQPublishQueue::ThreadPublish()
+{
+    while (true) {
+        if (PublishBatch() != 0) {
+            continue;
+        }
+        if (fStopRequested) {
             break;
+        }
 
-        size = va_arg(args, size_t);
+        std::unique_lock<std::mutex> lock(cs);
+        fPublisherIdle = true;
+        cond.wait_for(lock, std::chrono::milliseconds(100));
+        fPublisherIdle = false;
     }
-    va_end(args);
-    return 0;
 }
 
 bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
@@ -88,7 +245,16 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
             return false;
         }
 
-        int rc = zmq_bind(psocket, address.c_str());
+        LogPrint(BCLog::ZMQ, "zmq: Outbound message high water mark for %s at %s is %d\n", type, address, outbound_message_high_water_mark);
+
+        int rc = zmq_setsockopt(psocket, ZMQ_SNDHWM, &outbound_message_high_water_mark, sizeof(outbound_message_high_water_mark));
+        if (rc != 0) {
+            zmqError("Failed to set outbound message high water mark");
+            zmq_close(psocket);
+            return false;
+        }
+
+        rc = zmq_bind(psocket, address.c_str());
         if (rc!=0)
         {
             zmqError("Failed to bind address");
@@ -113,7 +279,10 @@ bool CZMQAbstractPublishNotifier::Initialize(void *pcontext)
 
 void CZMQAbstractPublishNotifier::Shutdown()
 {
-    assert(psocket);
+    if (!psocket) {
+        // never initialized, e.g. an earlier notifier failed to bind
+        return;
+    }
 
     int count = mapPublishNotifiers.count(address);
 
@@ -141,19 +310,84 @@ void CZMQAbstractPublishNotifier::Shutdown()
     psocket = nullptr;
 }
 
-bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
+bool CZMQAbstractPublishNotifier::Publish(const char *command, CZMQPayloadRef payload)
+{
+    if (fFailed) {
+        return false;
+    }
+    assert(publishQueue);
+    if (!publishQueue->Push(this, command, std::move(payload))) {
+        nDroppedMessages++;
+        LogPrint(BCLog::ZMQ, "zmq: Publish queue full, dropping %s\n", command);
+    }
+    return true;
+}
+
+static void zmq_release_payload(void* /*data*/, void* hint)
+{
+    delete static_cast<CZMQPayloadRef*>(hint);
+}
+
+bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const CZMQPayloadRef& payload)
 {
+    // messages queued before a send failed are dropped, the socket stays open until the queue is stopped
+    if (fFailed) {
+        nDroppedMessages++;
+        return false;
+    }
     assert(psocket);
 
+    const std::vector<unsigned char>* data = payload->Get();
+    if (!data) {
+        // nothing to publish, e.g. the block was pruned in the meantime
+        nDroppedMessages++;
+        return true;
+    }
+
     /* send three parts, command & data & a LE 4byte sequence number */
     unsigned char msgseq[sizeof(uint32_t)];
     WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), nullptr);
-    if (rc == -1)
+
+    zmq_msg_t msg;
+    // command strings are static and the payload stays alive until libzmq released it, neither is copied
+    int rc = zmq_msg_init_data(&msg, (void*)command, strlen(command), nullptr, nullptr);
+    if (rc == 0) {
+        rc = zmq_msg_send(&msg, psocket, ZMQ_SNDMORE | ZMQ_DONTWAIT);
+        if (rc == -1) {
+            zmq_msg_close(&msg);
+        }
+    }
+    if (rc != -1) {
+        CZMQPayloadRef* hint = new CZMQPayloadRef(payload);
+        rc = zmq_msg_init_data(&msg, (void*)data->data(), data->size(), zmq_release_payload, hint);
+        if (rc != 0) {
+            delete hint;
+        } else {
+            rc = zmq_msg_send(&msg, psocket, ZMQ_SNDMORE | ZMQ_DONTWAIT);
+            if (rc == -1) {
+                zmq_msg_close(&msg);
+            }
+        }
+    }
+    if (rc != -1) {
+        rc = zmq_msg_init_size(&msg, sizeof(msgseq));
+        if (rc == 0) {
+            memcpy(zmq_msg_data(&msg), msgseq, sizeof(msgseq));
+            rc = zmq_msg_send(&msg, psocket, ZMQ_DONTWAIT);
+            if (rc == -1) {
+                zmq_msg_close(&msg);
+            }
+        }
+    }
+    if (rc == -1) {
+        zmqError("Unable to send ZMQ msg");
+        fFailed = true;
         return false;
+    }
 
     /* increment memory only sequence number after sending */
     nSequence++;
+    nPublishedMessages++;
 
     return true;
 }
@@ -162,192 +396,131 @@ bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashblock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHBLOCK, data, 32);
+    return Publish(MSG_HASHBLOCK, MakeHashPayload(hash));
 }
 
 bool CZMQPublishHashChainLockNotifier::NotifyChainLock(const CBlockIndex *pindex, const llmq::CChainLockSig& clsig)
 {
     uint256 hash = pindex->GetBlockHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashchainlock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHCHAINLOCK, data, 32);
+    return Publish(MSG_HASHCHAINLOCK, MakeHashPayload(hash));
 }
 
-bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishHashTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx)
 {
-    uint256 hash = transaction.GetHash();
+    uint256 hash = ptx->GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashtx %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTX, data, 32);
+    return Publish(MSG_HASHTX, MakeHashPayload(hash));
 }
 
 bool CZMQPublishHashTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction, const llmq::CInstantSendLock& islock)
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashtxlock %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHTXLOCK, data, 32);
+    return Publish(MSG_HASHTXLOCK, MakeHashPayload(hash));
 }
 
 bool CZMQPublishHashGovernanceVoteNotifier::NotifyGovernanceVote(const CGovernanceVote &vote)
 {
     uint256 hash = vote.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashgovernancevote %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHGVOTE, data, 32);
+    return Publish(MSG_HASHGVOTE, MakeHashPayload(hash));
 }
 
 bool CZMQPublishHashGovernanceObjectNotifier::NotifyGovernanceObject(const CGovernanceObject &object)
 {
     uint256 hash = object.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashgovernanceobject %s\n", hash.GetHex());
-    char data[32];
-    for (unsigned int i = 0; i < 32; i++)
-        data[31 - i] = hash.begin()[i];
-    return SendMessage(MSG_HASHGOBJ, data, 32);
+    return Publish(MSG_HASHGOBJ, MakeHashPayload(hash));
 }
 
 bool CZMQPublishHashInstantSendDoubleSpendNotifier::NotifyInstantSendDoubleSpendAttempt(const CTransaction &currentTx, const CTransaction &previousTx)
 {
     uint256 currentHash = currentTx.GetHash(), previousHash = previousTx.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish hashinstantsenddoublespend %s conflicts against %s\n", currentHash.ToString(), previousHash.ToString());
-    char dataCurrentHash[32], dataPreviousHash[32];
-    for (unsigned int i = 0; i < 32; i++) {
-        dataCurrentHash[31 - i] = currentHash.begin()[i];
-        dataPreviousHash[31 - i] = previousHash.begin()[i];
-    }
-    return SendMessage(MSG_HASHISCON, dataCurrentHash, 32)
-        && SendMessage(MSG_HASHISCON, dataPreviousHash, 32);
+    return Publish(MSG_HASHISCON, MakeHashPayload(currentHash))
+        && Publish(MSG_HASHISCON, MakeHashPayload(previousHash));
 }
 
 
 bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
-
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
-    }
-
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    return Publish(MSG_RAWBLOCK, GetBlockPayload(pindex));
 }
 
 bool CZMQPublishRawChainLockNotifier::NotifyChainLock(const CBlockIndex *pindex, const llmq::CChainLockSig& clsig)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawchainlock %s\n", pindex->GetBlockHash().GetHex());
-
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
-
-        ss << block;
-    }
-
-    return SendMessage(MSG_RAWCHAINLOCK, &(*ss.begin()), ss.size());
+    return Publish(MSG_RAWCHAINLOCK, GetBlockPayload(pindex));
 }
 
 bool CZMQPublishRawChainLockSigNotifier::NotifyChainLock(const CBlockIndex *pindex, const llmq::CChainLockSig& clsig)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawchainlocksig %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    {
-        LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
+    CZMQPayloadRef blockPayload = GetBlockPayload(pindex);
+    return Publish(MSG_RAWCLSIG, std::make_shared<CZMQPayload>([blockPayload, clsig](std::vector<unsigned char>& data) {
+        const std::vector<unsigned char>* block = blockPayload->Get();
+        if (!block) {
             return false;
         }
-
-        ss << block;
-        ss << clsig;
-    }
-
-    return SendMessage(MSG_RAWCLSIG, &(*ss.begin()), ss.size());
+        data.reserve(block->size() + ::GetSerializeSize(clsig, SER_NETWORK, PROTOCOL_VERSION));
+        data.assign(block->begin(), block->end());
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, data.size(), clsig);
+        return true;
+    }));
 }
 
-bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
+bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransactionRef &ptx)
 {
-    uint256 hash = transaction.GetHash();
+    uint256 hash = ptx->GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtx %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
+    return Publish(MSG_RAWTX, GetTransactionPayload(ptx));
 }
 
 bool CZMQPublishRawTransactionLockNotifier::NotifyTransactionLock(const CTransaction &transaction, const llmq::CInstantSendLock& islock)
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtxlock %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    return SendMessage(MSG_RAWTXLOCK, &(*ss.begin()), ss.size());
+    return Publish(MSG_RAWTXLOCK, GetTransactionPayload(transaction));
 }
 
 bool CZMQPublishRawTransactionLockSigNotifier::NotifyTransactionLock(const CTransaction &transaction, const llmq::CInstantSendLock& islock)
 {
     uint256 hash = transaction.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawtxlocksig %s\n", hash.GetHex());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << transaction;
-    ss << islock;
-    return SendMessage(MSG_RAWTXLOCKSIG, &(*ss.begin()), ss.size());
+
+    CZMQPayloadRef txPayload = GetTransactionPayload(transaction);
+    return Publish(MSG_RAWTXLOCKSIG, std::make_shared<CZMQPayload>([txPayload, islock](std::vector<unsigned char>& data) {
+        const std::vector<unsigned char>* tx = txPayload->Get();
+        if (!tx) {
+            return false;
+        }
+        data.reserve(tx->size() + ::GetSerializeSize(islock, SER_NETWORK, PROTOCOL_VERSION));
+        data.assign(tx->begin(), tx->end());
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, data, data.size(), islock);
+        return true;
+    }));
 }
 
 bool CZMQPublishRawGovernanceVoteNotifier::NotifyGovernanceVote(const CGovernanceVote &vote)
 {
     uint256 nHash = vote.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawgovernanceobject: hash = %s, vote = %d\n", nHash.ToString(), vote.ToString());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << vote;
-    return SendMessage(MSG_RAWGVOTE, &(*ss.begin()), ss.size());
+    return Publish(MSG_RAWGVOTE, MakeSerializedPayload(vote));
 }
 
 bool CZMQPublishRawGovernanceObjectNotifier::NotifyGovernanceObject(const CGovernanceObject &govobj)
 {
     uint256 nHash = govobj.GetHash();
     LogPrint(BCLog::ZMQ, "zmq: Publish rawgovernanceobject: hash = %s, type = %d\n", nHash.ToString(), govobj.GetObjectType());
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss << govobj;
-    return SendMessage(MSG_RAWGOBJ, &(*ss.begin()), ss.size());
+    return Publish(MSG_RAWGOBJ, MakeSerializedPayload(govobj));
 }
 
 bool CZMQPublishRawInstantSendDoubleSpendNotifier::NotifyInstantSendDoubleSpendAttempt(const CTransaction &currentTx, const CTransaction &previousTx)
 {
     LogPrint(BCLog::ZMQ, "zmq: Publish rawinstantsenddoublespend %s conflicts with %s\n", currentTx.GetHash().ToString(), previousTx.GetHash().ToString());
-    CDataStream ssCurrent(SER_NETWORK, PROTOCOL_VERSION), ssPrevious(SER_NETWORK, PROTOCOL_VERSION);
-    ssCurrent << currentTx;
-    ssPrevious << previousTx;
-    return SendMessage(MSG_RAWISCON, &(*ssCurrent.begin()), ssCurrent.size())
-        && SendMessage(MSG_RAWISCON, &(*ssPrevious.begin()), ssPrevious.size());
+    return Publish(MSG_RAWISCON, GetTransactionPayload(currentTx))
+        && Publish(MSG_RAWISCON, GetTransactionPayload(previousTx));
 }
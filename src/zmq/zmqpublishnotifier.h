@@ -7,27 +7,121 @@
 #define BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
 
 #include "zmqabstractnotifier.h"
+#include "logwriter.h"
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 class CBlockIndex;
 class CGovernanceVote;
 class CGovernanceObject;
 
+/** Default number of messages which can wait for the publisher thread */
+static const size_t DEFAULT_ZMQ_QUEUE_SIZE = 4096;
+
+/**
+ * Body of a ZMQ message.
+ *
+ * The data is either passed in ready to send or produced on the publisher
+ * thread the first time it is needed. Payloads are shared between all queued
+ * messages carrying the same data (e.g. a block published as rawblock and
+ * rawchainlock) and handed to libzmq without copying.
+ */
+class CZMQPayload
+{
+public:
+    typedef std::function<bool(std::vector<unsigned char>&)> Producer;
+
+private:
+    Producer producer;
+    std::vector<unsigned char> data;
+    bool fProduced;
+    bool fValid;
+
+public:
+    explicit CZMQPayload(Producer&& _producer) : producer(std::move(_producer)), fProduced(false), fValid(false) {}
+    explicit CZMQPayload(std::vector<unsigned char>&& _data) : data(std::move(_data)), fProduced(true), fValid(true) {}
+
+    /** Returns nullptr if the data could not be produced. Must only be called from the publisher thread. */
+    const std::vector<unsigned char>* Get();
+};
+
+typedef std::shared_ptr<CZMQPayload> CZMQPayloadRef;
+
+class CZMQAbstractPublishNotifier;
+
+/**
+ * Sends messages of all publish notifiers from a dedicated thread.
+ *
+ * Validation callbacks only queue the message, serialization and socket I/O
+ * happen on the publisher thread. When the queue is full, messages are dropped
+ * and counted per notifier instead of blocking the caller.
+ */
+class CZMQPublishQueue
+{
+private:
+    struct Message {
+        CZMQAbstractPublishNotifier* notifier{nullptr};
+        const char* command{nullptr};
+        CZMQPayloadRef payload;
+    };
+
+    CMPSCRingBuffer<Message> queue;
+
+    std::thread publisherThread;
+    std::mutex cs;
+    std::condition_variable cond;
+    std::atomic<bool> fStopRequested{false};
+    std::atomic<bool> fPublisherIdle{false};
+
+    void ThreadPublish();
+    size_t PublishBatch();
+
+public:
+    /** Maximum number of messages sent before checking for shutdown */
+    static const size_t MAX_BATCH_MESSAGES = 256;
+
+    explicit CZMQPublishQueue(size_t nQueueSize);
+    ~CZMQPublishQueue();
+
+    void Start();
+    /** Stops the publisher thread after all queued messages have been sent */
+    void Stop();
+
+    /** Returns false if the message had to be dropped */
+    bool Push(CZMQAbstractPublishNotifier* notifier, const char* command, CZMQPayloadRef payload);
+
+    size_t GetQueueSize() const { return queue.Capacity(); }
+};
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
 private:
-    uint32_t nSequence; //!< upcounting per message sequence number
+    uint32_t nSequence; //!< upcounting per message sequence number, only used by the publisher thread
+    std::atomic<bool> fFailed{false};
+
+protected:
+    /* queue a message for the publisher thread, returns false once sending failed */
+    bool Publish(const char *command, CZMQPayloadRef payload);
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0) {}
 
     /* send zmq multipart message
        parts:
           * command
           * data
           * message sequence number
+       Only called from the publisher thread.
     */
-    bool SendMessage(const char *command, const void* data, size_t size);
+    bool SendMessage(const char *command, const CZMQPayloadRef& payload);
 
     bool Initialize(void *pcontext) override;
+    /* closes the socket, only called once the publisher thread was stopped */
     void Shutdown() override;
 };
 
@@ -46,7 +140,7 @@ public:
 class CZMQPublishHashTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(const CTransactionRef &ptx) override;
 };
 
 class CZMQPublishHashTransactionLockNotifier : public CZMQAbstractPublishNotifier
@@ -94,7 +188,7 @@ public:
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
 {
 public:
-    bool NotifyTransaction(const CTransaction &transaction) override;
+    bool NotifyTransaction(const CTransactionRef &ptx) override;
 };
 
 class CZMQPublishRawTransactionLockNotifier : public CZMQAbstractPublishNotifier
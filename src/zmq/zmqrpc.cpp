@@ -0,0 +1,62 @@
+// Copyright (c) 2020-2022 The Cosanta Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmq/zmqrpc.h"
+
+#include "rpc/server.h"
+#include "zmq/zmqabstractnotifier.h"
+#include "zmq/zmqnotificationinterface.h"
+
+#include <univalue.h>
+
+UniValue getzmqnotifications(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getzmqnotifications\n"
+            "\nReturns information about the active ZeroMQ notifications.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"type\": \"pubhashtx\",          (string) Type of notification\n"
+            "    \"address\": \"...\",             (string) Address of the publisher\n"
+            "    \"hwm\": n,                     (numeric) Outbound message high water mark\n"
+            "    \"published\": n,               (numeric) Number of messages sent\n"
+            "    \"dropped\": n                  (numeric) Number of messages dropped because the publish queue was full\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getzmqnotifications", "")
+            + HelpExampleRpc("getzmqnotifications", "")
+        );
+    }
+
+    UniValue result(UniValue::VARR);
+    if (pzmqNotificationInterface != nullptr) {
+        for (const auto* n : pzmqNotificationInterface->GetNotifiers()) {
+            UniValue obj(UniValue::VOBJ);
+            obj.push_back(Pair("type", n->GetType()));
+            obj.push_back(Pair("address", n->GetAddress()));
+            obj.push_back(Pair("hwm", n->GetOutboundMessageHighWaterMark()));
+            obj.push_back(Pair("published", n->GetPublishedMessages()));
+            obj.push_back(Pair("dropped", n->GetDroppedMessages()));
+            result.push_back(obj);
+        }
+    }
+
+    return result;
+}
+
+static const CRPCCommand commands[] =
+{ //  category              name                      actor (function)         argNames
+  //  --------------------- ------------------------  -----------------------  ----------
+    { "zmq",                "getzmqnotifications",    &getzmqnotifications,    {} },
+};
+
+void RegisterZMQRPCCommands(CRPCTable& t)
+{
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
+        t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+}
@@ -13,6 +13,11 @@ from test_framework.util import *
 from test_framework.script import *
 from test_framework.mininode import *
 import binascii
+import http.client
+import json
+import struct
+import urllib.parse
+from io import BytesIO
 
 class AddressIndexTest(BitcoinTestFramework):
 
@@ -44,7 +49,7 @@ class AddressIndexTest(BitcoinTestFramework):
         self.sync_all()
         self.stop_node(1)
         self.assert_start_raises_init_error(1, ["-addressindex"], 'You need to rebuild the database using -reindex to change -addressindex')
-        self.start_node(1, ["-addressindex", "-reindex"])
+        self.start_node(1, ["-addressindex", "-reindex", "-rest"])
         connect_nodes(self.nodes[0], 1)
         self.sync_all()
 
@@ -241,6 +246,32 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(utxos3[1]["height"], 264)
         assert_equal(utxos3[2]["height"], 265)
 
+        # Check the REST interface returns the same utxos and deltas
+        self.log.info("Testing REST...")
+        url = urllib.parse.urlparse(self.nodes[1].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest/addressutxos/' + address2 + '.json')
+        rest_utxos = json.loads(conn.getresponse().read().decode('utf-8'))
+        assert_equal(rest_utxos["chainHeight"], self.nodes[1].getblockcount())
+        assert_equal([u["txid"] for u in rest_utxos["utxos"]], [u["txid"] for u in utxos3])
+        assert_equal([u["satoshis"] for u in rest_utxos["utxos"]], [u["satoshis"] for u in utxos3])
+
+        conn.request('GET', '/rest/addressutxos/' + address2 + '.bin')
+        bin_utxos = BytesIO(conn.getresponse().read())
+        assert_equal(struct.unpack("<i", bin_utxos.read(4))[0], self.nodes[1].getblockcount())
+        assert_equal(bin_utxos.read(32)[::-1], hex_str_to_bytes(self.nodes[1].getbestblockhash()))
+        assert_equal(deser_compact_size(bin_utxos), 3)
+        assert_equal(bin_utxos.read(32)[::-1], hex_str_to_bytes(utxos3[0]["txid"]))
+
+        deltas = self.nodes[1].getaddressdeltas({"addresses": [address2], "start": 264, "end": 265})
+        conn.request('GET', '/rest/addressdeltas/' + address2 + '/264/265.json')
+        rest_deltas = json.loads(conn.getresponse().read().decode('utf-8'))
+        assert_equal([d["txid"] for d in rest_deltas], [d["txid"] for d in deltas])
+        assert_equal([d["satoshis"] for d in rest_deltas], [d["satoshis"] for d in deltas])
+
+        conn.request('GET', '/rest/addressutxos/invalidaddress.bin')
+        assert_equal(conn.getresponse().status, 400)
+
         # Check mempool indexing
         self.log.info("Testing mempool indexing...")
 
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020-2022 The Cosanta Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -coinstatsindex.
+
+Node 0 answers gettxoutsetinfo from the coin stats index, node 1 recomputes
+the statistics from its UTXO set. Check that the indexed MuHash matches the
+recomputed one at the tip and at earlier heights, also after a reorg and a
+restart.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+COMPARED_FIELDS = ['height', 'bestblock', 'txouts', 'muhash', 'total_amount']
+
+class CoinStatsIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [["-coinstatsindex"], []]
+
+    def indexed_stats(self, hash_or_height=None):
+        node = self.nodes[0]
+        if hash_or_height is None:
+            tip = node.getbestblockhash()
+            # the index catches up with the tip asynchronously
+            wait_until(lambda: node.gettxoutsetinfo('muhash')['bestblock'] == tip, timeout=30)
+            return node.gettxoutsetinfo('muhash')
+        return node.gettxoutsetinfo('muhash', hash_or_height)
+
+    def recomputed_stats(self):
+        return self.nodes[1].gettxoutsetinfo('muhash')
+
+    def assert_stats_equal(self, indexed, recomputed):
+        for field in COMPARED_FIELDS:
+            assert_equal(indexed[field], recomputed[field])
+
+    def mine_with_transactions(self, blocks):
+        """Mine blocks with spends of the wallet, remember the recomputed stats of every block"""
+        for _ in range(blocks):
+            for _ in range(3):
+                self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), Decimal('1.5'))
+            self.nodes[1].sendtoaddress(self.nodes[0].getnewaddress(), Decimal('0.5'))
+            self.sync_all()
+            self.nodes[0].generate(1)
+            self.sync_all()
+            recomputed = self.recomputed_stats()
+            self.expected[recomputed['height']] = recomputed
+            self.assert_stats_equal(self.indexed_stats(), recomputed)
+
+    def assert_history(self):
+        for height, recomputed in self.expected.items():
+            indexed = self.indexed_stats(height)
+            # the index doesn't read the UTXO set
+            assert 'transactions' not in indexed
+            self.assert_stats_equal(indexed, recomputed)
+            self.assert_stats_equal(self.indexed_stats(recomputed['bestblock']), recomputed)
+
+    def run_test(self):
+        self.expected = {}
+
+        self.log.info("Compare the indexed MuHash with a full recomputation")
+        self.nodes[0].generate(110)
+        self.sync_all()
+        self.assert_stats_equal(self.indexed_stats(), self.recomputed_stats())
+        # give node 1 confirmed coins to send back
+        self.nodes[0].sendtoaddress(self.nodes[1].getnewaddress(), 100)
+        self.nodes[0].generate(1)
+        self.sync_all()
+        self.mine_with_transactions(5)
+        self.assert_history()
+
+        # a full recomputation on the index node gives the same MuHash
+        full = self.nodes[0].gettxoutsetinfo()
+        assert 'hash_serialized_2' in full
+        assert_equal(full['txouts'], self.recomputed_stats()['txouts'])
+
+        assert_raises_rpc_error(-8, "hash_serialized_2 is only available for the current UTXO set", self.nodes[0].gettxoutsetinfo, 'hash_serialized_2', 1)
+        assert_raises_rpc_error(-1, "Querying specific blocks requires -coinstatsindex", self.nodes[1].gettxoutsetinfo, 'muhash', 1)
+
+        self.log.info("Reorganize the last blocks")
+        tip_height = self.nodes[0].getblockcount()
+        fork_hash = self.nodes[0].getblockhash(tip_height - 2)
+        for node in self.nodes:
+            node.invalidateblock(fork_hash)
+        for height in [tip_height - 2, tip_height - 1, tip_height]:
+            del self.expected[height]
+        self.assert_stats_equal(self.indexed_stats(), self.recomputed_stats())
+        assert_equal(self.nodes[0].getblockcount(), tip_height - 3)
+
+        # the disconnected transactions are mined again in different blocks
+        self.mine_with_transactions(4)
+        assert_equal(self.nodes[0].getblockcount(), tip_height + 1)
+        self.assert_history()
+
+        self.log.info("Check that the index resumes after a restart")
+        self.restart_node(0, self.extra_args[0])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.assert_history()
+        self.mine_with_transactions(2)
+        self.assert_history()
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020-2022 The Cosanta Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the socket events modes.
+
+- Check that getnetworkinfo reports the mode each node runs with
+- Relay blocks between a node using epoll and one using the default mode
+- Flood an epoll node with more data than -maxreceivebuffer, so receiving from
+  the peers is paused and resumed, and check that everything is processed
+- Disconnect peers from both ends and check that the node keeps serving others
+- Check that an unknown mode is refused at startup
+"""
+
+import sys
+
+from test_framework.mininode import *
+from test_framework.test_framework import BitcoinTestFramework, SkipTest
+from test_framework.util import *
+
+FLOOD_MSG_COUNT = 50
+FLOOD_MSG_SIZE = 20000
+
+class SocketEventsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        # 10000 bytes of receive buffer, a single flood message exceeds it
+        self.extra_args = [["-socketevents=epoll", "-maxreceivebuffer=10"], []]
+
+    def setup_network(self):
+        if not sys.platform.startswith('linux'):
+            raise SkipTest("epoll is only available on Linux")
+        super().setup_network()
+
+    def run_test(self):
+        assert_equal(self.nodes[0].getnetworkinfo()['socketevents'], 'epoll')
+        assert self.nodes[1].getnetworkinfo()['socketevents'] in ['poll', 'select']
+
+        self.log.info("Relay blocks in both directions")
+        self.nodes[0].generate(5)
+        self.sync_all()
+        self.nodes[1].generate(5)
+        self.sync_all()
+        assert_equal(self.nodes[0].getblockcount(), 10)
+
+        self.log.info("Flood the epoll node from several peers")
+        peers = [self.nodes[0].add_p2p_connection(NodeConnCB()) for _ in range(3)]
+        network_thread_start()
+        for peer in peers:
+            peer.wait_for_verack()
+
+        payload = b'\x00' * FLOOD_MSG_SIZE
+        for _ in range(FLOOD_MSG_COUNT):
+            for peer in peers[:2]:
+                peer.send_message(msg_generic(b'flood', payload))
+        # pings are answered only after everything sent before them was processed
+        for peer in peers:
+            peer.sync_with_ping(timeout=60)
+
+        peer_info = [p for p in self.nodes[0].getpeerinfo() if p['subver'] == MY_SUBVERSION.decode()]
+        assert_equal(len(peer_info), 3)
+        flooded = [p['bytesrecv_per_msg'].get('*other*', 0) for p in peer_info]
+        assert_equal(sorted(flooded), [0] + [FLOOD_MSG_COUNT * (FLOOD_MSG_SIZE + 24)] * 2)
+
+        # the node connection still relays blocks after the flood
+        self.nodes[1].generate(1)
+        self.sync_all()
+
+        self.log.info("Disconnect peers from both ends")
+        peer_ids = [p['id'] for p in peer_info]
+        self.nodes[0].disconnectnode(nodeid=peer_ids[0])
+        peers[0].wait_for_disconnect()
+        peers[1].connection.disconnect_node()
+        peers[1].wait_for_disconnect()
+        wait_until(lambda: len([p for p in self.nodes[0].getpeerinfo() if p['subver'] == MY_SUBVERSION.decode()]) == 1, timeout=10)
+        peers[2].sync_with_ping()
+
+        disconnect_nodes(self.nodes[0], 1)
+        wait_until(lambda: self.nodes[0].getconnectioncount() == 1, timeout=10)
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.nodes[0].generate(1)
+        self.sync_all()
+        assert_equal(self.nodes[1].getblockcount(), 12)
+
+        self.nodes[0].disconnect_p2ps()
+        network_thread_join()
+
+        self.log.info("Check that an unknown mode is refused")
+        self.stop_node(1)
+        self.assert_start_raises_init_error(1, ["-socketevents=unknown"], "Invalid -socketevents ('unknown') specified")
+
+if __name__ == '__main__':
+    SocketEventsTest().main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020-2022 The Cosanta Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -specialtxindex.
+
+Node 0 maintains the special tx index, node 1 reads special transactions from
+the block files. Check that getspecialtxes returns the same on both nodes, that
+protx history lists the ProTxs of a masternode and that both stay correct when
+the block containing a ProTx is reorganized away.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+class SpecialTxIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        common_args = ["-budgetparams=10:10:10", "-dip3params=135:150"]
+        self.extra_args = [common_args + ["-specialtxindex"], common_args]
+
+    def assert_specialtxes_equal(self):
+        sync_blocks(self.nodes)
+        tip = self.nodes[0].getblockcount()
+        for height in range(1, tip + 1):
+            blockhash = self.nodes[0].getblockhash(height)
+            self.assert_block_specialtxes_equal(blockhash)
+
+    def assert_block_specialtxes_equal(self, blockhash):
+        for verbosity in range(3):
+            for tx_type in [-1, 1, 3, 5]:
+                indexed = self.nodes[0].getspecialtxes(blockhash, tx_type, 100, 0, verbosity)
+                from_block = self.nodes[1].getspecialtxes(blockhash, tx_type, 100, 0, verbosity)
+                assert_equal(indexed, from_block)
+        # count and skip are applied the same way
+        assert_equal(self.nodes[0].getspecialtxes(blockhash, -1, 1, 1), self.nodes[1].getspecialtxes(blockhash, -1, 1, 1))
+
+    def assert_history(self, protx_hash, expected):
+        history = self.nodes[0].protx('history', protx_hash)
+        assert_equal([(entry['txid'], entry['type']) for entry in history], expected)
+        for entry in history:
+            assert_equal(self.nodes[0].getblockhash(entry['height']), entry['blockhash'])
+            assert entry['txid'] in self.nodes[0].getblock(entry['blockhash'])['tx']
+        detailed = self.nodes[0].protx('history', protx_hash, True)
+        assert_equal([entry['tx']['txid'] for entry in detailed], [txid for txid, _ in expected])
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Mine until DIP3 is active")
+        while node.getblockcount() < 151:
+            node.generate(10 if node.getblockcount() < 140 else 1)
+        self.sync_all()
+
+        self.log.info("Register a masternode and update it")
+        bls_key = node.bls('generate')
+        funds_address = node.getnewaddress()
+        owner_address = node.getnewaddress()
+        node.sendtoaddress(funds_address, 1000.001)
+        node.generate(1)
+        protx_hash = node.protx('register_fund', node.getnewaddress(), '127.0.0.1:%d' % p2p_port(2), owner_address, bls_key['public'], owner_address, 0, node.getnewaddress(), funds_address)
+        node.generate(1)
+
+        node.sendtoaddress(funds_address, 0.001)
+        node.generate(1)
+        update_txid = node.protx('update_registrar', protx_hash, '', '', node.getnewaddress(), funds_address)
+        update_block = node.generate(1)[0]
+        assert update_txid in node.getblock(update_block)['tx']
+
+        self.assert_specialtxes_equal()
+        self.assert_history(protx_hash, [(protx_hash, 1), (update_txid, 3)])
+        assert_raises_rpc_error(-1, "Special tx index not enabled", self.nodes[1].protx, 'history', protx_hash)
+
+        self.log.info("Reorganize the ProUpRegTx into another block")
+        node.invalidateblock(update_block)
+        assert update_txid in node.getrawmempool()
+        self.assert_history(protx_hash, [(protx_hash, 1)])
+        # a block which is not part of the active chain is read from disk
+        assert_equal(node.getspecialtxes(update_block, 3), [update_txid])
+
+        new_blocks = node.generate(2)
+        assert update_txid in node.getblock(new_blocks[0])['tx']
+        self.assert_specialtxes_equal()
+        assert_equal(self.nodes[1].getbestblockhash(), new_blocks[1])
+        self.assert_history(protx_hash, [(protx_hash, 1), (update_txid, 3)])
+        assert_equal(node.protx('history', protx_hash)[1]['blockhash'], new_blocks[0])
+        self.assert_block_specialtxes_equal(update_block)
+
+        self.log.info("Check that the index survives a restart")
+        self.restart_node(0, self.extra_args[0])
+        self.assert_history(protx_hash, [(protx_hash, 1), (update_txid, 3)])
+        connect_nodes_bi(self.nodes, 0, 1)
+        self.assert_specialtxes_equal()
+
+if __name__ == '__main__':
+    SpecialTxIndexTest().main()
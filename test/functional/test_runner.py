@@ -108,6 +108,8 @@ BASE_SCRIPTS= [
     'addressindex.py',
     'timestampindex.py',
     'spentindex.py',
+    'specialtxindex.py',
+    'coinstatsindex.py',
     'decodescript.py',
     'blockchain.py',
     'deprecated_rpc.py',
@@ -129,6 +131,7 @@ BASE_SCRIPTS= [
     'rpcnamedargs.py',
     'listsinceblock.py',
     'p2p-leaktests.py',
+    'p2p-socketevents.py',
     'p2p-compactblocks.py',
     'sporks.py',
     'rpc_getblockstats.py',
@@ -157,6 +160,7 @@ EXTENDED_SCRIPTS = [
     'maxuploadtarget.py',
     'mempool_packages.py',
     'dbcrash.py',
+    'utxosnapshot.py',
     # vv Tests less than 2m vv
     'bip68-sequence.py',
     'getblocktemplate_longpoll.py',  # FIXME: "socket.error: [Errno 54] Connection reset by peer" on my Mac, same as  https://github.com/bitcoin/bitcoin/issues/6651
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020-2022 The Cosanta Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test dumptxoutset and -loadsnapshot.
+
+Node 0 mines a chain and dumps its UTXO set. Node 1 starts from an empty data
+directory with -loadsnapshot and must only accept the snapshot known by
+-snapshotparams, with evo records which match the known hash. Check that a restart with -loadsnapshot keeps the snapshot
+chain, that an interrupted import is refused or wiped, and that node 1 accepts
+a proof-of-stake block whose stake input is below the base of the snapshot.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+# regtest nFirstPoSv2Block
+FIRST_POS_BLOCK = 10000
+BASE_HEIGHT = FIRST_POS_BLOCK - 50
+
+class UTXOSnapshotTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [[], []]
+
+    def setup_network(self):
+        # node 1 must start from an empty data directory
+        self.add_nodes(self.num_nodes, self.extra_args)
+        self.start_node(0)
+
+    def generate_to(self, height):
+        node = self.nodes[0]
+        while node.getblockcount() < height:
+            blocks = min(250, height - node.getblockcount())
+            # keep the block times close to the mocktime
+            self.bump_mocktime(blocks * 60)
+            set_node_times([n for n in self.nodes if n.running], self.mocktime)
+            node.generate(blocks)
+
+    def start_snapshot_node(self, extra_args):
+        self.start_node(1, extra_args)
+        self.nodes[1].setmocktime(self.mocktime)
+
+    def run_test(self):
+        node0 = self.nodes[0]
+        node1 = self.nodes[1]
+
+        self.log.info("Mine and dump the UTXO set at height %d" % BASE_HEIGHT)
+        self.generate_to(BASE_HEIGHT)
+        for _ in range(5):
+            node0.sendtoaddress(node0.getnewaddress(), 10)
+        node0.generate(1)
+        base_height = node0.getblockcount()
+        dump = node0.dumptxoutset('utxos.dat')
+        assert_equal(dump['base_height'], base_height)
+        assert_equal(dump['base_hash'], node0.getbestblockhash())
+        assert_equal(dump['muhash'], node0.gettxoutsetinfo('muhash')['muhash'])
+        assert dump['evohash'] != "00" * 32
+        snapshot_path = dump['path']
+        assert_raises_rpc_error(-8, "already exists", node0.dumptxoutset, 'utxos.dat')
+
+        snapshot_params = "-snapshotparams=%d:%s:%s:%s" % (base_height, dump['base_hash'], dump['muhash'], dump['evohash'])
+        load_args = [snapshot_params, "-loadsnapshot=" + snapshot_path]
+
+        self.log.info("Refuse snapshots which aren't known")
+        self.assert_start_raises_init_error(1, ["-loadsnapshot=" + snapshot_path],
+            "-loadsnapshot is not available, no UTXO snapshots are known for this network")
+        wrong_height = "-snapshotparams=%d:%s:%s:%s" % (base_height - 1, dump['base_hash'], dump['muhash'], dump['evohash'])
+        self.assert_start_raises_init_error(1, [wrong_height, "-loadsnapshot=" + snapshot_path],
+            "no snapshot at height %d is known" % base_height)
+        wrong_hash = "-snapshotparams=%d:%s:%s:%s" % (base_height, node0.getblockhash(1), dump['muhash'], dump['evohash'])
+        self.assert_start_raises_init_error(1, [wrong_hash, "-loadsnapshot=" + snapshot_path],
+            "does not match the known")
+        wrong_muhash = "-snapshotparams=%d:%s:%s:%s" % (base_height, dump['base_hash'], dump['base_hash'], dump['evohash'])
+        self.assert_start_raises_init_error(1, [wrong_muhash, "-loadsnapshot=" + snapshot_path],
+            "does not match the known")
+        wrong_evohash = "-snapshotparams=%d:%s:%s:%s" % (base_height, dump['base_hash'], dump['muhash'], dump['base_hash'])
+        self.assert_start_raises_init_error(1, [wrong_evohash, "-loadsnapshot=" + snapshot_path],
+            "the evo records hash")
+        self.assert_start_raises_init_error(1, ["-snapshotparams=%d:%s:%s" % (base_height, dump['base_hash'], dump['muhash'])],
+            "Snapshot parameters malformed")
+        # nothing was written
+        assert not os.path.exists(os.path.join(node1.datadir, "regtest", "utxosnapshot.incomplete"))
+
+        self.log.info("Load the snapshot into an empty data directory")
+        self.start_snapshot_node(load_args)
+        assert_equal(node1.getblockcount(), base_height)
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert_equal(node1.gettxoutsetinfo('muhash')['muhash'], dump['muhash'])
+        assert not os.path.exists(os.path.join(node1.datadir, "regtest", "utxosnapshot.incomplete"))
+
+        self.log.info("Keep the snapshot chain on a restart with -loadsnapshot")
+        self.stop_node(1)
+        self.start_snapshot_node(load_args)
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert_equal(node1.gettxoutsetinfo('muhash')['muhash'], dump['muhash'])
+
+        self.log.info("Reject tampered evo records and wipe the partial state of the failed import")
+        self.stop_node(1)
+        # the last bytes of the file belong to the value of the last evo record
+        tampered_path = os.path.join(node0.datadir, "regtest", "tampered.dat")
+        with open(snapshot_path, 'rb') as f:
+            data = bytearray(f.read())
+        data[-1] ^= 0xff
+        with open(tampered_path, 'wb') as f:
+            f.write(data)
+        shutil.rmtree(os.path.join(node1.datadir, "regtest"))
+        self.assert_start_raises_init_error(1, [snapshot_params, "-loadsnapshot=" + tampered_path],
+            "the evo records hash")
+        # the coins were already written, the marker is left behind
+        assert os.path.exists(os.path.join(node1.datadir, "regtest", "utxosnapshot.incomplete"))
+        self.assert_start_raises_init_error(1, [snapshot_params], "The import of a UTXO snapshot was interrupted")
+        self.start_snapshot_node(load_args)
+        assert_equal(node1.getbestblockhash(), dump['base_hash'])
+        assert_equal(node1.gettxoutsetinfo('muhash')['muhash'], dump['muhash'])
+        assert not os.path.exists(os.path.join(node1.datadir, "regtest", "utxosnapshot.incomplete"))
+
+        self.log.info("Sync the blocks above the snapshot base")
+        self.stop_node(1)
+        self.start_snapshot_node([snapshot_params])
+        connect_nodes(node0, 1)
+        self.generate_to(FIRST_POS_BLOCK - 1)
+        sync_blocks(self.nodes)
+        assert_equal(node1.gettxoutsetinfo('muhash')['muhash'], node0.gettxoutsetinfo('muhash')['muhash'])
+
+        self.log.info("Stake on top of the snapshot chain")
+        # the outputs need to be older than the minimum stake age of 24 hours
+        self.bump_mocktime(25 * 60 * 60, True)
+        force_finish_mnsync(node0)
+        staked_below_base = False
+        for _ in range(10):
+            height = node0.getblockcount()
+            wait_until(lambda: node0.getblockcount() > height, timeout=120)
+            sync_blocks(self.nodes)
+            tip = node1.getblock(node1.getbestblockhash(), 2)
+            assert node1.getblockchaininfo()['pos']
+            # the block of the stake input was never downloaded by node 1
+            stake_input = tip['tx'][1]['vin'][0]
+            stake_block = node0.gettransaction(stake_input['txid'])['blockhash']
+            if node0.getblockheader(stake_block)['height'] <= base_height:
+                assert_raises_rpc_error(-1, "Block not available", node1.getblock, stake_block)
+                staked_below_base = True
+                break
+            self.bump_mocktime(60, True)
+        assert staked_below_base
+        assert_equal(node1.gettxoutsetinfo('muhash')['muhash'], node0.gettxoutsetinfo('muhash')['muhash'])
+
+if __name__ == '__main__':
+    UTXOSnapshotTest().main()
@@ -155,5 +155,16 @@ class ZMQTest (BitcoinTestFramework):
         assert_equal(hashRPC, hashZMQ)  # txid from sendtoaddress must be equal to the hash received over zmq
         assert_equal(hashRPC, hashedZMQ)
 
+        self.log.info("Check getzmqnotifications")
+        notifications = {n["type"]: n for n in self.nodes[0].getzmqnotifications()}
+        assert_equal(sorted(notifications.keys()), ["pubhashblock", "pubhashtx", "pubrawblock", "pubrawtx"])
+        for n in notifications.values():
+            assert_equal(n["address"], "tcp://127.0.0.1:28332")
+            assert_equal(n["hwm"], 1000)
+            assert_equal(n["dropped"], 0)
+        assert_equal(notifications["pubhashblock"]["published"], blockcount + 1)
+        assert_equal(notifications["pubrawtx"]["published"], blockcount + 2)
+        assert_equal(self.nodes[1].getzmqnotifications(), [])
+
 if __name__ == '__main__':
     ZMQTest().main()